@@ -0,0 +1,203 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Benchmark\Benchmark.cpp
+//
+// summary:	Implements the benchmark case and suite classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Benchmark.h"
+#include "Kinect-Parallel.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Upper bound of iterations per case (for very fast kernels).
+static const int BENCHMARK_MAX_ITERATIONS = 100000;
+
+double BenchmarkTime()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    if(frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart/(double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9*ts.tv_nsec;
+#endif
+}
+
+BenchmarkCase::BenchmarkCase(const char* name)
+{
+    mName   = name;
+    mInput  = "synthetic";
+    mPixels = 0;
+    mBytes  = 0;
+    mFrames = 0;
+}
+
+BenchmarkSuite::BenchmarkSuite()
+{
+    mMinTime       = 0.5;
+    mMinIterations = 5;
+}
+
+BenchmarkSuite::~BenchmarkSuite()
+{
+    for(size_t i=0; i<mCases.size(); i++)
+        delete mCases[i];
+}
+
+void BenchmarkSuite::Add(BenchmarkCase* benchmark)
+{
+    mCases.push_back(benchmark);
+}
+
+int BenchmarkSuite::Run()
+{
+    mResults.clear();
+    for(size_t i=0; i<mCases.size(); i++){
+        BenchmarkCase* benchmark = mCases[i];
+        if(!mFilter.empty() && strstr(benchmark->GetName(), mFilter.c_str()) == NULL)
+            continue;
+        if(!benchmark->Setup()){
+            printf("Skipping %s (no input).\n", benchmark->GetName());
+            benchmark->Teardown();
+            continue;
+        }
+
+        // Warm up (caches, lazily allocated buffers and worker threads), then time the iterations.
+        benchmark->Run();
+        std::vector<double> times;
+        double total = 0;
+        while((total < mMinTime || (int)times.size() < mMinIterations) && (int)times.size() < BENCHMARK_MAX_ITERATIONS){
+            double start = BenchmarkTime();
+            benchmark->Run();
+            double elapsed = BenchmarkTime() - start;
+            times.push_back(elapsed);
+            total += elapsed;
+        }
+        benchmark->Teardown();
+
+        AddResult(benchmark->GetName(), benchmark->GetInput(), times, 
+                  benchmark->GetPixels(), benchmark->GetBytes(), benchmark->GetFrames());
+    }
+    return (int)mResults.size();
+}
+
+void BenchmarkSuite::AddResult(const char* name, const char* input, const std::vector<double>& times,
+                               double pixels, double bytes, double frames)
+{
+    if(times.empty() || (!mFilter.empty() && strstr(name, mFilter.c_str()) == NULL))
+        return;
+    std::vector<double> sorted(times);
+    double total = 0;
+    for(size_t i=0; i<sorted.size(); i++)
+        total += sorted[i];
+
+    BenchmarkResult result;
+    result.name       = name;
+    result.input      = input;
+    result.iterations = (int)sorted.size();
+    result.mean       = total/sorted.size();
+    result.minimum    = *std::min_element(sorted.begin(), sorted.end());
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size()/2, sorted.end());
+    result.median     = sorted[sorted.size()/2];
+    result.pixels     = pixels;
+    result.bytes      = bytes;
+    result.frames     = frames;
+    mResults.push_back(result);
+    printf("%-36s %10.3f ms\n", result.name.c_str(), 1e3*result.median);
+}
+
+void BenchmarkSuite::Print() const
+{
+    printf("\n%-36s %8s %10s %10s %10s %12s %12s\n", "case", "iter", "median ms", "min ms", "ns/pixel", "frames/s", "MB/s");
+    for(size_t i=0; i<mResults.size(); i++){
+        const BenchmarkResult& r = mResults[i];
+        printf("%-36s %8d %10.3f %10.3f", r.name.c_str(), r.iterations, 1e3*r.median, 1e3*r.minimum);
+        if(r.pixels > 0) printf(" %10.3f", 1e9*r.median/r.pixels); else printf(" %10s", "-");
+        if(r.frames > 0) printf(" %12.1f", r.frames/r.median);     else printf(" %12s", "-");
+        if(r.bytes > 0)  printf(" %12.1f", 1e-6*r.bytes/r.median); else printf(" %12s", "-");
+        printf("\n");
+    }
+}
+
+int BenchmarkSuite::Save(const char* filename) const
+{
+    CvFileStorage* fs = cvOpenFileStorage(filename, 0, CV_STORAGE_WRITE);
+    if(fs == NULL){
+        printf("ERROR: Cannot open benchmark results file!\n");
+        return -1;
+    }
+    cvWriteInt(fs, "threads", Kinect::GetParallelThreadCount());
+    cvWriteReal(fs, "min_time", mMinTime);
+    cvStartWriteStruct(fs, "results", CV_NODE_SEQ);
+    for(size_t i=0; i<mResults.size(); i++){
+        const BenchmarkResult& r = mResults[i];
+        cvStartWriteStruct(fs, NULL, CV_NODE_MAP);
+        cvWriteString(fs, "name", r.name.c_str());
+        cvWriteString(fs, "input", r.input.c_str());
+        cvWriteInt(fs, "iterations", r.iterations);
+        cvWriteReal(fs, "median_s", r.median);
+        cvWriteReal(fs, "min_s", r.minimum);
+        cvWriteReal(fs, "mean_s", r.mean);
+        cvWriteReal(fs, "ns_per_pixel", (r.pixels > 0) ? 1e9*r.median/r.pixels : 0.0);
+        cvWriteReal(fs, "frames_per_second", (r.frames > 0) ? r.frames/r.median : 0.0);
+        cvWriteReal(fs, "bytes_per_second", (r.bytes > 0) ? r.bytes/r.median : 0.0);
+        cvEndWriteStruct(fs);
+    }
+    cvEndWriteStruct(fs);
+    cvReleaseFileStorage(&fs);
+    return 0;
+}
+
+int BenchmarkSuite::Compare(const char* filename, double tolerance) const
+{
+    FILE* pFile = fopen(filename, "r");
+    if(pFile == NULL){
+        printf("ERROR: Cannot open benchmark baseline file!\n");
+        return -1;
+    }
+    fclose(pFile);
+    CvFileStorage* fs = cvOpenFileStorage(filename, 0, CV_STORAGE_READ);
+    CvFileNode* node  = (fs != NULL) ? cvGetFileNodeByName(fs, 0, "results") : NULL;
+    if(node == NULL || !CV_NODE_IS_SEQ(node->tag)){
+        printf("ERROR: Invalid benchmark baseline file!\n");
+        if(fs != NULL)
+            cvReleaseFileStorage(&fs);
+        return -1;
+    }
+
+    printf("\n%-36s %12s %12s %9s\n", "case", "baseline ms", "current ms", "change");
+    int regressions = 0;
+    CvSeq* seq = node->data.seq;
+    CvSeqReader reader;
+    cvStartReadSeq(seq, &reader, 0);
+    for(int i=0; i<seq->total; i++){
+        CvFileNode* item = (CvFileNode*)reader.ptr;
+        CV_NEXT_SEQ_ELEM(seq->elem_size, reader);
+        std::string name = cvReadStringByName(fs, item, "name", "");
+        double baseline  = cvReadRealByName(fs, item, "median_s", 0);
+        for(size_t j=0; j<mResults.size(); j++){
+            if(mResults[j].name != name || baseline <= 0)
+                continue;
+            double change = mResults[j].median/baseline - 1;
+            bool regressed = (change > tolerance);
+            printf("%-36s %12.3f %12.3f %+8.1f%%%s\n", name.c_str(), 1e3*baseline, 1e3*mResults[j].median,
+                   1e2*change, regressed ? "  REGRESSION" : "");
+            if(regressed)
+                regressions++;
+        }
+    }
+    cvReleaseFileStorage(&fs);
+    return regressions;
+}
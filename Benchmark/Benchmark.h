@@ -0,0 +1,132 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Benchmark\Benchmark.h
+//
+// summary:	Declares the benchmark case and suite classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include <string>
+#include <vector>
+
+// Get a monotonic time stamp (in seconds).
+double BenchmarkTime();
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  BenchmarkCase
+///
+/// @brief  One timed kernel.
+///
+///         Setup() prepares the inputs outside of the timed region, Run() executes one iteration
+///         of the kernel. The amount of work done by one iteration (pixels, bytes and frames) is
+///         used to derive the reported rates.
+///
+/// @ingroup Benchmark
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class BenchmarkCase
+{
+public:
+    BenchmarkCase(const char* name);
+    virtual ~BenchmarkCase() {};
+
+    // Prepare the inputs. Returns false if the case cannot run (it is skipped).
+    virtual bool Setup()            { return true; };
+
+    // Execute one iteration.
+    virtual void Run() = 0;
+
+    // Release the inputs.
+    virtual void Teardown()         {};
+
+    const char* GetName() const     { return mName.c_str(); };
+    const char* GetInput() const    { return mInput.c_str(); };
+    double GetPixels() const        { return mPixels; };
+    double GetBytes() const         { return mBytes; };
+    double GetFrames() const        { return mFrames; };
+
+protected:
+    /// <summary> Name of the case (used to match runs). </summary>
+    std::string mName;
+
+    /// <summary> Description of the input ("synthetic" or the recorded file). </summary>
+    std::string mInput;
+
+    /// <summary> Work per iteration (0 = not applicable). </summary>
+    double mPixels;
+    double mBytes;
+    double mFrames;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>   Timing of one benchmark case. </summary>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+struct BenchmarkResult
+{
+    std::string name;
+    std::string input;
+    int    iterations;
+    double median;                  // seconds per iteration
+    double minimum;                 // seconds per iteration
+    double mean;                    // seconds per iteration
+    double pixels;                  // pixels per iteration
+    double bytes;                   // bytes per iteration
+    double frames;                  // frames per iteration
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  BenchmarkSuite
+///
+/// @brief  Runs benchmark cases and reports their timings.
+///
+///         Every case is warmed up once and then run until both the minimum time and the minimum
+///         number of iterations are reached. The median time per iteration is reported as ns/pixel,
+///         frames/s and bytes/s. The results are saved with cvFileStorage (XML or YAML, by file
+///         extension), so that runs can be diffed or compared against a baseline file.
+///
+/// @ingroup Benchmark
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class BenchmarkSuite
+{
+public:
+    BenchmarkSuite();
+    ~BenchmarkSuite();
+
+    // Add a case (the suite takes ownership).
+    void Add(BenchmarkCase* benchmark);
+
+    void SetMinTime(double seconds)         { mMinTime = seconds; };
+    void SetMinIterations(int iterations)   { mMinIterations = iterations; };
+
+    // Only run the cases whose name contains filter (NULL or empty = all).
+    void SetFilter(const char* filter)      { mFilter = (filter != NULL) ? filter : ""; };
+
+    // Run the (selected) cases. Returns the number of cases that ran.
+    int  Run();
+
+    // Add the timings of a measurement made outside of the suite (e.g., one pipeline stage per run).
+    // Note: The result is dropped if its name does not match the filter.
+    void AddResult(const char* name, const char* input, const std::vector<double>& times,
+                   double pixels = 0, double bytes = 0, double frames = 0);
+
+    // Print the results to the console.
+    void Print() const;
+
+    // Save the results (XML or YAML). Returns -1 on failure.
+    int  Save(const char* filename) const;
+
+    // Compare the results against a saved baseline; cases slower than the baseline median by more
+    // than tolerance (e.g. 0.1 = 10%) are reported as regressions. Returns the number of
+    // regressions (or -1 if the baseline cannot be read).
+    int  Compare(const char* filename, double tolerance) const;
+
+    const std::vector<BenchmarkResult>& GetResults() const { return mResults; };
+
+private:
+    std::vector<BenchmarkCase*>  mCases;
+    std::vector<BenchmarkResult> mResults;
+
+    std::string mFilter;
+    double      mMinTime;
+    int         mMinIterations;
+};
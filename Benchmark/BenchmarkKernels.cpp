@@ -0,0 +1,553 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Benchmark\BenchmarkKernels.cpp
+//
+// summary:	Implements the per-frame and per-point kernel benchmarks
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "BenchmarkKernels.h"
+#include "CalibrateProCam.h"
+#include "KinectInterface.h"
+#include "Kinect-Utility.h"
+#include "UtilProCam.h"
+
+#include <vector>
+
+// Kinect frame dimensions (depth and color).
+static const int KINECT_PIXELS             = 640*480;
+static const int KINECT_PACKED_DEPTH_BYTES = 640*480*11/8;
+
+// Read a recorded frame of exactly size bytes.
+static bool readFrame(const char* filename, std::vector<unsigned char>& data, int size)
+{
+    FILE* pFile = fopen(filename, "rb");
+    if(pFile == NULL){
+        printf("ERROR: Cannot open recorded frame \"%s\"!\n", filename);
+        return false;
+    }
+    data.resize(size);
+    bool ok = ((int)fread(&data[0], 1, size, pFile) == size);
+    fclose(pFile);
+    if(!ok)
+        printf("ERROR: Recorded frame \"%s\" is smaller than %d bytes!\n", filename, size);
+    return ok;
+}
+
+// Get the size of a file (in bytes).
+static double fileSize(const char* filename)
+{
+    FILE* pFile = fopen(filename, "rb");
+    if(pFile == NULL)
+        return 0;
+    fseek(pFile, 0, SEEK_END);
+    double size = (double)ftell(pFile);
+    fclose(pFile);
+    return size;
+}
+
+// Pack raw depth values into 11-bit words, most significant bit first (the device format).
+static void packDepth(const std::vector<unsigned short>& depth, std::vector<unsigned char>& packed)
+{
+    packed.assign(KINECT_PACKED_DEPTH_BYTES + 2, 0);
+    for(int i=0; i<(int)depth.size(); i++)
+        for(int b=10; b>=0; b--)
+            if((depth[i] >> b) & 1){
+                int bit = 11*i + 10 - b;
+                packed[bit >> 3] |= (unsigned char)(0x80 >> (bit & 7));
+            }
+}
+
+// Load a packed depth frame (recorded or synthetic: a wall with a sphere in front of it and a band
+// of invalid pixels, as in the shadow of an object) and unpack it.
+static std::string loadDepth(const char* filename, std::vector<unsigned char>& packed, std::vector<unsigned short>& depth)
+{
+    depth.resize(KINECT_PIXELS);
+    if(filename != NULL){
+        if(!readFrame(filename, packed, KINECT_PACKED_DEPTH_BYTES))
+            return "";
+        packed.resize(KINECT_PACKED_DEPTH_BYTES + 2, 0);
+        Kinect::Kinect_UnpackDepth(&packed[0], &depth[0], KINECT_PIXELS);
+        return filename;
+    }
+    for(int y=0; y<480; y++){
+        for(int x=0; x<640; x++){
+            float dx = (x - 320)/160.0f, dy = (y - 240)/160.0f;
+            float r2 = dx*dx + dy*dy;
+            unsigned short d = 900;
+            if(r2 < 1)
+                d = (unsigned short)(780 - 80*sqrt(1 - r2));
+            if(x >= 500 && x < 520)
+                d = 0x7ff;
+            depth[640*y+x] = d;
+        }
+    }
+    packDepth(depth, packed);
+    return "synthetic";
+}
+
+// Fill a synthetic camera (3xN) ray map of a pinhole camera (f = 525 pixels, centered).
+static void syntheticRays(int w, int h, std::vector<float>& rays)
+{
+    rays.resize(3*w*h);
+    for(int r=0; r<h; r++){
+        for(int c=0; c<w; c++){
+            float v[3] = { (c - 0.5f*w)/525.0f, (r - 0.5f*h)/525.0f, 1.0f };
+            float norm = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+            for(int k=0; k<3; k++)
+                rays[3*(w*r+c)+k] = v[k]/norm;
+        }
+    }
+}
+
+// Kinect::ParseDepthBuffer (11-bit unpacking of the device frame).
+class KinectParseDepthCase : public BenchmarkCase
+{
+public:
+    KinectParseDepthCase(const char* filename) : BenchmarkCase("kinect_parse_depth_buffer"), mFilename(filename) {}
+
+    virtual bool Setup()
+    {
+        mInput = loadDepth(mFilename, mPacked, mDepth);
+        mPixels = KINECT_PIXELS;
+        mBytes  = KINECT_PACKED_DEPTH_BYTES;
+        mFrames = 1;
+        return !mInput.empty();
+    }
+
+    virtual void Run()
+    {
+        Kinect::Kinect_UnpackDepth(&mPacked[0], &mDepth[0], KINECT_PIXELS);
+    }
+
+private:
+    const char* mFilename;
+    std::vector<unsigned char>  mPacked;
+    std::vector<unsigned short> mDepth;
+};
+
+// Kinect::ParseColorBuffer (Bayer interpolation of the device frame).
+class KinectParseColorCase : public BenchmarkCase
+{
+public:
+    KinectParseColorCase(const char* filename) : BenchmarkCase("kinect_parse_color_buffer"), mFilename(filename) {}
+
+    virtual bool Setup()
+    {
+        if(mFilename != NULL){
+            if(!readFrame(mFilename, mBayer, KINECT_PIXELS))
+                return false;
+            mInput = mFilename;
+        }
+        else{
+            mBayer.resize(KINECT_PIXELS);
+            for(int y=0; y<480; y++)
+                for(int x=0; x<640; x++)
+                    mBayer[640*y+x] = (unsigned char)(3*x + 5*y + (((x/32 + y/32) & 1) ? 60 : 0));
+        }
+        mRGB.assign(3*KINECT_PIXELS, 0);
+        mPixels = KINECT_PIXELS;
+        mBytes  = KINECT_PIXELS;
+        mFrames = 1;
+        return true;
+    }
+
+    virtual void Run()
+    {
+        Kinect::Kinect_DemosaicColor(&mBayer[0], &mRGB[0]);
+    }
+
+private:
+    const char* mFilename;
+    std::vector<unsigned char> mBayer;
+    std::vector<unsigned char> mRGB;
+};
+
+// KinectInterface::parseDepth (metric and colored depth buffers).
+class KinectInterfaceParseDepthCase : public BenchmarkCase
+{
+public:
+    KinectInterfaceParseDepthCase(const char* filename) : BenchmarkCase("kinect_interface_parse_depth"), mFilename(filename)
+    {
+        mInterface = NULL;
+    }
+
+    virtual bool Setup()
+    {
+        mInput = loadDepth(mFilename, mPacked, mDepth);
+        mInterface = new KinectInterface((Kinect::Kinect*)NULL);
+        mPixels = KINECT_PIXELS;
+        mBytes  = 2*KINECT_PIXELS;
+        mFrames = 1;
+        return !mInput.empty();
+    }
+
+    virtual void Run()
+    {
+        mInterface->parseDepth(&mDepth[0]);
+    }
+
+    virtual void Teardown()
+    {
+        delete mInterface;
+        mInterface = NULL;
+    }
+
+private:
+    const char* mFilename;
+    KinectInterface* mInterface;
+    std::vector<unsigned char>  mPacked;
+    std::vector<unsigned short> mDepth;
+};
+
+// KinectDepthToWorld and KinectWorldToRGBSpace over all valid depth pixels.
+class KinectProjectionCase : public BenchmarkCase
+{
+public:
+    KinectProjectionCase(const char* filename, bool to_rgb)
+        : BenchmarkCase(to_rgb ? "kinect_world_to_rgb_space" : "kinect_depth_to_world"), mFilename(filename)
+    {
+        mToRGB = to_rgb;
+    }
+
+    virtual bool Setup()
+    {
+        std::vector<unsigned char>  packed;
+        std::vector<unsigned short> depth;
+        mInput = loadDepth(mFilename, packed, depth);
+        mPixel.clear();
+        mZ.clear();
+        for(int i=0; i<KINECT_PIXELS; i++){
+            if(Kinect::Kinect_IsDepthValid(depth[i])){
+                mPixel.push_back(i);
+                mZ.push_back(Kinect::Kinect_DepthValueToZ(depth[i]));
+            }
+        }
+        mOutput.resize(3*mZ.size() + 3);
+        mWorld.resize(3*mZ.size() + 3);
+        for(size_t i=0; i<mZ.size(); i++){
+            float x = (float)(mPixel[i]%640), y = (float)(mPixel[i]/640), z = mZ[i];
+            Kinect::KinectDepthToWorld(x, y, z);
+            mWorld[3*i] = x; mWorld[3*i+1] = y; mWorld[3*i+2] = z;
+        }
+        mPixels = (double)mZ.size();
+        mFrames = 1;
+        return !mInput.empty() && !mZ.empty();
+    }
+
+    virtual void Run()
+    {
+        int n = (int)mZ.size();
+        if(mToRGB){
+            for(int i=0; i<n; i++){
+                float x = mWorld[3*i], y = mWorld[3*i+1];
+                Kinect::KinectWorldToRGBSpace(x, y, mWorld[3*i+2]);
+                mOutput[2*i]   = x;
+                mOutput[2*i+1] = y;
+            }
+        }
+        else{
+            for(int i=0; i<n; i++){
+                float x = (float)(mPixel[i]%640), y = (float)(mPixel[i]/640), z = mZ[i];
+                Kinect::KinectDepthToWorld(x, y, z);
+                mOutput[3*i]   = x;
+                mOutput[3*i+1] = y;
+                mOutput[3*i+2] = z;
+            }
+        }
+    }
+
+private:
+    const char* mFilename;
+    bool mToRGB;
+    std::vector<int>   mPixel;
+    std::vector<float> mZ;
+    std::vector<float> mWorld;
+    std::vector<float> mOutput;
+};
+
+// FitPlane over a full camera frame of noisy points on a plane.
+class FitPlaneCase : public BenchmarkCase
+{
+public:
+    FitPlaneCase(int w, int h) : BenchmarkCase("fit_plane")
+    {
+        mW = w;
+        mH = h;
+        mPoints = NULL;
+    }
+
+    virtual bool Setup()
+    {
+        int n = mW*mH;
+        mPoints = cvCreateMat(n, 3, CV_32FC1);
+        CvRNG rng = cvRNG(1);
+        for(int i=0; i<n; i++){
+            float x = (float)(i%mW) - 0.5f*mW, y = (float)(i/mW) - 0.5f*mH;
+            mPoints->data.fl[3*i]   = x;
+            mPoints->data.fl[3*i+1] = y;
+            mPoints->data.fl[3*i+2] = 500 - 0.1f*x - 0.05f*y + (float)(cvRandReal(&rng) - 0.5);
+        }
+        mPixels = n;
+        mBytes  = 3*sizeof(float)*n;
+        return true;
+    }
+
+    virtual void Run()
+    {
+        FitPlane(mPoints, mPlane);
+    }
+
+    virtual void Teardown()
+    {
+        cvReleaseMat(&mPoints);
+    }
+
+private:
+    int    mW, mH;
+    CvMat* mPoints;
+    float  mPlane[4];
+};
+
+// intersectLineWithPlane3D (ray-plane) or intersectLineWithLine3D (ray-ray) for every camera pixel.
+class IntersectLineCase : public BenchmarkCase
+{
+public:
+    IntersectLineCase(int w, int h, bool with_line)
+        : BenchmarkCase(with_line ? "intersect_line_with_line_3d" : "intersect_line_with_plane_3d")
+    {
+        mN = w*h;
+        mWithLine = with_line;
+        syntheticRays(w, h, mRays);
+    }
+
+    virtual bool Setup()
+    {
+        // Plane in front of the camera and rays from a projector 100 mm to the side through it.
+        float plane[4] = { 0.1f, 0.05f, 1.0f, 500.0f };
+        float origin[3] = { 0, 0, 0 };
+        memcpy(mPlane, plane, sizeof(mPlane));
+        mProjCenter[0] = 100; mProjCenter[1] = 0; mProjCenter[2] = 0;
+        mProjRays.resize(3*mN);
+        mOutput.resize(3*mN);
+        for(int i=0; i<mN; i++){
+            float p[3], depth;
+            intersectLineWithPlane3D(origin, &mRays[3*i], mPlane, p, depth);
+            for(int k=0; k<3; k++)
+                mProjRays[3*i+k] = p[k] - mProjCenter[k] + ((k == 1) ? 0.01f : 0.0f);
+        }
+        mPixels = mN;
+        return true;
+    }
+
+    virtual void Run()
+    {
+        float origin[3] = { 0, 0, 0 };
+        if(mWithLine){
+            for(int i=0; i<mN; i++)
+                intersectLineWithLine3D(origin, &mRays[3*i], mProjCenter, &mProjRays[3*i], &mOutput[3*i]);
+        }
+        else{
+            float depth;
+            for(int i=0; i<mN; i++)
+                intersectLineWithPlane3D(origin, &mRays[3*i], mPlane, &mOutput[3*i], depth);
+        }
+    }
+
+private:
+    int  mN;
+    bool mWithLine;
+    float mPlane[4];
+    float mProjCenter[3];
+    std::vector<float> mRays;
+    std::vector<float> mProjRays;
+    std::vector<float> mOutput;
+};
+
+// CalibrateProCam::detectChessboard (corner detection with subpixel refinement).
+class DetectChessboardCase : public BenchmarkCase
+{
+public:
+    DetectChessboardCase(const char* filename, struct slParams* sl_params)
+        : BenchmarkCase("detect_chessboard"), mFilename(filename), mCalibrate(NULL)
+    {
+        mSlParams = sl_params;
+        mFrame    = NULL;
+    }
+
+    virtual bool Setup()
+    {
+        mBoardSize = cvSize(mSlParams->cam_board_w, mSlParams->cam_board_h);
+        if(mFilename != NULL){
+            mFrame = cvLoadImage(mFilename, CV_LOAD_IMAGE_COLOR);
+            if(mFrame == NULL){
+                printf("ERROR: Cannot open recorded chessboard image \"%s\"!\n", mFilename);
+                return false;
+            }
+            mInput = mFilename;
+        }
+        else
+            mFrame = renderChessboard(mSlParams->cam_w, mSlParams->cam_h);
+        mCorners.resize(mBoardSize.width*mBoardSize.height);
+        int count = 0;
+        if(!mCalibrate.detectChessboard(mFrame, mBoardSize, &mCorners[0], &count))
+            printf("WARNING: Chessboard not found in the %s image (timing the failed search).\n", mInput.c_str());
+        mPixels = mFrame->width*mFrame->height;
+        mFrames = 1;
+        return true;
+    }
+
+    virtual void Run()
+    {
+        int count = 0;
+        mCalibrate.detectChessboard(mFrame, mBoardSize, &mCorners[0], &count);
+    }
+
+    virtual void Teardown()
+    {
+        cvReleaseImage(&mFrame);
+    }
+
+private:
+    // Render the chessboard under a slight perspective distortion (and blur it like a camera).
+    IplImage* renderChessboard(int w, int h)
+    {
+        int squares_w = mBoardSize.width + 1, squares_h = mBoardSize.height + 1;
+        int square = MIN((int)(0.7*w/squares_w), (int)(0.7*h/squares_h));
+        IplImage* board = cvCreateImage(cvSize(w, h), IPL_DEPTH_8U, 3);
+        cvSet(board, cvScalarAll(255));
+        int x0 = (w - square*squares_w)/2, y0 = (h - square*squares_h)/2;
+        for(int r=0; r<squares_h; r++)
+            for(int c=0; c<squares_w; c++)
+                if((r + c) & 1)
+                    cvRectangle(board, cvPoint(x0 + c*square, y0 + r*square),
+                                cvPoint(x0 + (c+1)*square - 1, y0 + (r+1)*square - 1), cvScalarAll(0), CV_FILLED);
+
+        CvPoint2D32f src[4] = { cvPoint2D32f(0, 0), cvPoint2D32f(w, 0), cvPoint2D32f(w, h), cvPoint2D32f(0, h) };
+        CvPoint2D32f dst[4] = { cvPoint2D32f(0.04f*w, 0.02f*h), cvPoint2D32f(0.97f*w, 0.06f*h),
+                                cvPoint2D32f(0.93f*w, 0.97f*h), cvPoint2D32f(0.02f*w, 0.92f*h) };
+        CvMat* H = cvCreateMat(3, 3, CV_32FC1);
+        cvGetPerspectiveTransform(src, dst, H);
+        IplImage* frame = cvCreateImage(cvSize(w, h), IPL_DEPTH_8U, 3);
+        cvWarpPerspective(board, frame, H, CV_INTER_LINEAR + CV_WARP_FILL_OUTLIERS, cvScalarAll(128));
+        cvSmooth(frame, frame, CV_GAUSSIAN, 5, 5);
+        cvReleaseMat(&H);
+        cvReleaseImage(&board);
+        return frame;
+    }
+
+    const char*      mFilename;
+    struct slParams* mSlParams;
+    CalibrateProCam  mCalibrate;
+    CvSize           mBoardSize;
+    IplImage*        mFrame;
+    std::vector<CvPoint2D32f> mCorners;
+};
+
+// savePointsPLY, savePointsOBJ, savePointsVRML and savePointsTxt for a full camera frame.
+class SavePointsCase : public BenchmarkCase
+{
+public:
+    enum { PLY, OBJ, VRML, TXT };
+
+    SavePointsCase(int format, const char* outdir, struct slParams* sl_params)
+        : BenchmarkCase(format == PLY ? "save_points_ply" : format == OBJ ? "save_points_obj" :
+                        format == VRML ? "save_points_vrml" : "save_points_txt")
+    {
+        static const char* extensions[] = { "ply", "obj", "wrl", "txt" };
+        sprintf(mFilename, "%s/benchmark_points.%s", outdir, extensions[format]);
+        mFormat   = format;
+        mSlParams = sl_params;
+        mPoints = mNormals = mColors = mMask = NULL;
+        mCols = mRows = NULL;
+    }
+
+    virtual bool Setup()
+    {
+        // Sphere in front of a wall, with a band of missing points.
+        int w = mSlParams->cam_w, h = mSlParams->cam_h, n = w*h;
+        std::vector<float> rays;
+        syntheticRays(w, h, rays);
+        mPoints  = cvCreateMat(3, n, CV_32FC1);
+        mNormals = cvCreateMat(3, n, CV_32FC1);
+        mColors  = cvCreateMat(3, n, CV_32FC1);
+        mMask    = cvCreateMat(1, n, CV_32FC1);
+        mCols    = cvCreateImage(cvSize(w, h), IPL_DEPTH_32F, 1);
+        mRows    = cvCreateImage(cvSize(w, h), IPL_DEPTH_32F, 1);
+        for(int i=0; i<n; i++){
+            int r = i/w, c = i - r*w;
+            float dx = (c - 0.5f*w)/(0.25f*h), dy = (r - 0.5f*h)/(0.25f*h);
+            float r2 = dx*dx + dy*dy;
+            float z  = (r2 < 1) ? 700 - 100*sqrt(1 - r2) : 800;
+            for(int k=0; k<3; k++){
+                mPoints->data.fl[i+n*k]  = z*rays[3*i+k]/rays[3*i+2];
+                mNormals->data.fl[i+n*k] = -rays[3*i+k];
+                mColors->data.fl[i+n*k]  = (float)((c + 2*r + 64*k) & 255)/255.0f;
+            }
+            mMask->data.fl[i] = (c >= 4*w/5 && c < 4*w/5 + w/32) ? 0.0f : 1.0f;
+            ((float*)(mCols->imageData + r*mCols->widthStep))[c] = 1.6f*c;
+            ((float*)(mRows->imageData + r*mRows->widthStep))[c] = 1.6f*r;
+        }
+
+        // Write once to determine the output size.
+        if(save() != 0)
+            return false;
+        mPixels = n;
+        mBytes  = fileSize(mFilename);
+        mFrames = 1;
+        return true;
+    }
+
+    virtual void Run()
+    {
+        save();
+    }
+
+    virtual void Teardown()
+    {
+        cvReleaseMat(&mPoints);
+        cvReleaseMat(&mNormals);
+        cvReleaseMat(&mColors);
+        cvReleaseMat(&mMask);
+        cvReleaseImage(&mCols);
+        cvReleaseImage(&mRows);
+        remove(mFilename);
+    }
+
+private:
+    int save()
+    {
+        switch(mFormat){
+            case PLY:  return savePointsPLY(mFilename, mPoints, mNormals, mColors, mMask);
+            case OBJ:  return savePointsOBJ(mFilename, mPoints, NULL, mNormals, NULL, mColors, mMask);
+            case VRML: return savePointsVRML(mFilename, mPoints, mNormals, mColors, mMask);
+            default:   return savePointsTxt(mFilename, mPoints, mCols, mRows, mMask, mSlParams);
+        }
+    }
+
+    char             mFilename[1024];
+    int              mFormat;
+    struct slParams* mSlParams;
+    CvMat*           mPoints;
+    CvMat*           mNormals;
+    CvMat*           mColors;
+    CvMat*           mMask;
+    IplImage*        mCols;
+    IplImage*        mRows;
+};
+
+void AddKernelBenchmarks(BenchmarkSuite& suite, const BenchmarkFrames& frames, struct slParams* sl_params)
+{
+    suite.Add(new KinectParseDepthCase(frames.depth_raw));
+    suite.Add(new KinectParseColorCase(frames.bayer_raw));
+    suite.Add(new KinectInterfaceParseDepthCase(frames.depth_raw));
+    suite.Add(new KinectProjectionCase(frames.depth_raw, false));
+    suite.Add(new KinectProjectionCase(frames.depth_raw, true));
+    suite.Add(new FitPlaneCase(sl_params->cam_w, sl_params->cam_h));
+    suite.Add(new IntersectLineCase(sl_params->cam_w, sl_params->cam_h, false));
+    suite.Add(new IntersectLineCase(sl_params->cam_w, sl_params->cam_h, true));
+    suite.Add(new DetectChessboardCase(frames.chessboard, sl_params));
+    suite.Add(new SavePointsCase(SavePointsCase::PLY,  frames.outdir, sl_params));
+    suite.Add(new SavePointsCase(SavePointsCase::OBJ,  frames.outdir, sl_params));
+    suite.Add(new SavePointsCase(SavePointsCase::VRML, frames.outdir, sl_params));
+    suite.Add(new SavePointsCase(SavePointsCase::TXT,  frames.outdir, sl_params));
+}
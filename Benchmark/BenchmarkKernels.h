@@ -0,0 +1,25 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Benchmark\BenchmarkKernels.h
+//
+// summary:	Declares the per-frame and per-point kernel benchmarks
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "Benchmark.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// <summary>   Recorded inputs of the kernel benchmarks (NULL = synthetic input). </summary>
+////////////////////////////////////////////////////////////////////////////////////////////////////
+struct BenchmarkFrames
+{
+    const char* depth_raw;          // packed 11-bit Kinect depth frame (422400 bytes)
+    const char* bayer_raw;          // raw Kinect Bayer color frame (307200 bytes)
+    const char* chessboard;         // camera image of the calibration chessboard
+    const char* outdir;             // directory for the files written by the savePoints* cases
+};
+
+// Add the Kinect frame parsing, geometry, chessboard detection and point cloud writer benchmarks.
+void AddKernelBenchmarks(BenchmarkSuite& suite, const BenchmarkFrames& frames, struct slParams* sl_params);
@@ -0,0 +1,139 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file   Benchmark\BenchmarkMain.cpp
+///
+/// @brief  Implements the benchmark executable.
+///
+/// @defgroup Benchmark Benchmark
+///       Timing of the per-frame and per-point kernels on synthetic or recorded frames, and of the
+///       end-to-end calibration and scanning pipeline on a simulated projector-camera system (no
+///       camera, projector or Kinect required).
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "CalibrationExceptions.h"
+#include "Configuration.h"
+#include "Benchmark.h"
+#include "BenchmarkKernels.h"
+#include "BenchmarkPipeline.h"
+#include "Kinect-Parallel.h"
+#include "Kinect-Trace.h"
+
+static void printUsage()
+{
+    printf("Usage: Benchmark [config.xml] [options]\n");
+    printf("  --filter <text>       only run the cases whose name contains text (the pipeline only\n");
+    printf("                        runs without a filter or with a filter starting with \"pipeline\")\n");
+    printf("  --output <file>       results file (.xml or .yml, default benchmark.xml)\n");
+    printf("  --baseline <file>     compare against a previous results file\n");
+    printf("  --tolerance <ratio>   slowdown reported as a regression (default 0.1)\n");
+    printf("  --min-time <seconds>  minimum timed duration per case (default 0.5)\n");
+    printf("  --threads <count>     number of worker threads\n");
+    printf("  --depth-raw <file>    recorded packed Kinect depth frame\n");
+    printf("  --bayer-raw <file>    recorded raw Kinect color frame\n");
+    printf("  --chessboard <image>  recorded camera image of the chessboard\n");
+    printf("  --outdir <dir>        directory for the written point clouds (default .)\n");
+    printf("  --pipeline-runs <n>   end-to-end calibration and scan runs (default 3, 0 = disabled)\n");
+    printf("  --pipeline-boards <n> chessboard poses per calibration (default 8)\n");
+    printf("  --trace <file>        write a Chrome trace (JSON) of the benchmark run\n");
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @fn int main(int argc, char* argv[])
+///
+/// @brief  Main entry-point for the benchmark. Returns 1 if a case regressed against the baseline.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    printf("[Benchmark]\n");
+    const char* configFile = "../../config.xml";
+    const char* output     = "benchmark.xml";
+    const char* baseline   = NULL;
+    const char* filter     = NULL;
+    const char* trace      = NULL;
+    double tolerance = 0.1, min_time = 0.5;
+    int    threads   = 0;
+    int    pipeline_runs = 3, pipeline_boards = 8;
+    BenchmarkFrames frames = { NULL, NULL, NULL, "." };
+
+    for(int i=1; i<argc; i++){
+        bool has_value = (i + 1 < argc);
+        if(strcmp(argv[i], "--filter") == 0 && has_value)            filter          = argv[++i];
+        else if(strcmp(argv[i], "--output") == 0 && has_value)       output          = argv[++i];
+        else if(strcmp(argv[i], "--baseline") == 0 && has_value)     baseline        = argv[++i];
+        else if(strcmp(argv[i], "--tolerance") == 0 && has_value)    tolerance       = atof(argv[++i]);
+        else if(strcmp(argv[i], "--min-time") == 0 && has_value)     min_time        = atof(argv[++i]);
+        else if(strcmp(argv[i], "--threads") == 0 && has_value)      threads         = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--depth-raw") == 0 && has_value)    frames.depth_raw  = argv[++i];
+        else if(strcmp(argv[i], "--bayer-raw") == 0 && has_value)    frames.bayer_raw  = argv[++i];
+        else if(strcmp(argv[i], "--chessboard") == 0 && has_value)   frames.chessboard = argv[++i];
+        else if(strcmp(argv[i], "--outdir") == 0 && has_value)       frames.outdir     = argv[++i];
+        else if(strcmp(argv[i], "--pipeline-runs") == 0 && has_value)   pipeline_runs   = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--pipeline-boards") == 0 && has_value) pipeline_boards = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--trace") == 0 && has_value)        trace           = argv[++i];
+        else if(argv[i][0] != '-')                                   configFile      = argv[i];
+        else{
+            printUsage();
+            return -1;
+        }
+    }
+
+    // Read parameters from configuration file (for the camera dimensions and chessboard).
+    struct slParams sl_params;
+    Configuration config(std::string(configFile), &sl_params);
+    try{
+        config.Load();
+    }
+    catch(FileNotFound* e)
+    {
+        printf("%s\n", e->what());
+        delete e;
+        return -1;
+    }
+    if(threads > 0)
+        Kinect::SetParallelThreadCount(threads);
+    printf("Using %d threads.\n", Kinect::GetParallelThreadCount());
+    if(trace != NULL){
+        Kinect::TraceSetThreadName("main");
+        Kinect::TraceStart(sl_params.trace_events);
+    }
+
+    BenchmarkSuite suite;
+    suite.SetFilter(filter);
+    suite.SetMinTime(min_time);
+    AddKernelBenchmarks(suite, frames, &sl_params);
+    suite.Run();
+
+    // End-to-end pipeline on the simulated projector-camera system (its stages are named "pipeline.*").
+    if(pipeline_runs > 0 && (filter == NULL || strncmp(filter, "pipeline", 8) == 0)){
+        PipelineBenchmark pipeline(&sl_params, frames.outdir);
+        pipeline.SetBoards(pipeline_boards);
+        if(pipeline.Run(suite, pipeline_runs) != 0)
+            return -1;
+    }
+    if(trace != NULL){
+        Kinect::TraceStop();
+        if(Kinect::TraceExport(trace))
+            printf("Saved trace to \"%s\".\n", trace);
+        else
+            printf("ERROR: Cannot write trace file \"%s\"!\n", trace);
+    }
+    if(suite.GetResults().empty()){
+        printf("ERROR: No benchmark matches the filter!\n");
+        return -1;
+    }
+    suite.Print();
+    if(suite.Save(output) == 0)
+        printf("\nSaved results to \"%s\".\n", output);
+
+    if(baseline != NULL){
+        int regressions = suite.Compare(baseline, tolerance);
+        if(regressions < 0)
+            return -1;
+        if(regressions > 0){
+            printf("%d case(s) regressed against \"%s\".\n", regressions, baseline);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,811 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Benchmark\BenchmarkPipeline.cpp
+//
+// summary:	Implements the end-to-end calibration and scanning benchmark
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "BenchmarkPipeline.h"
+#include "SimulatedCameraManager.h"
+#include "CalibrateProCam.h"
+#include "CalibrationBundle.h"
+#include "IncrementalCalibration.h"
+#include "PatternCache.h"
+#include "ProCamGeometry.h"
+#include "UndistortMap.h"
+#include "UtilProCam.h"
+#include "GrayCodeDecoder.h"
+#include "RayPlaneTriangulator.h"
+#include "RayRayTriangulator.h"
+#include "OutlierFilter.h"
+#include "NormalEstimator.h"
+#include "ProjectorOutput.h"
+
+// Time after a capture within which a present still counts as during it (in milliseconds).
+static const double SCAN_GUARD_MS = 5.0;
+
+// Times the scan sequence is played before patterns that were never captured count as failed.
+static const int SCAN_MAX_PLAYS = 4;
+
+// Color the points (3xN, camera coordinates) from an undistorted camera frame (8-bit BGR): every
+// point is projected with the pinhole camera model (RGB in [0,1], black outside the frame).
+static void sampleColors(const CvMat* points, const CvMat* mask, const IplImage* texture, const CvMat* intrinsic, CvMat* colors)
+{
+    float fx = CV_MAT_ELEM(*intrinsic, float, 0, 0), cx = CV_MAT_ELEM(*intrinsic, float, 0, 2);
+    float fy = CV_MAT_ELEM(*intrinsic, float, 1, 1), cy = CV_MAT_ELEM(*intrinsic, float, 1, 2);
+    int n = points->cols;
+    cvZero(colors);
+    for(int i=0; i<n; i++){
+        float Z = points->data.fl[2*n+i];
+        if(mask->data.fl[i] == 0 || Z <= 0)
+            continue;
+        int u = cvFloor(fx*points->data.fl[i]/Z   + cx + 0.5f);
+        int v = cvFloor(fy*points->data.fl[n+i]/Z + cy + 0.5f);
+        if(u < 0 || v < 0 || u >= texture->width || v >= texture->height)
+            continue;
+        const uchar* bgr = (const uchar*)texture->imageData + v*texture->widthStep + 3*u;
+        for(int k=0; k<3; k++)
+            colors->data.fl[k*n+i] = bgr[2-k]/255.0f;
+    }
+}
+
+// Allocate the calibration matrices (as the calibration application does).
+static void allocateCalibration(struct slParams* sl_params, struct slCalib* sl_calib)
+{
+    memset(sl_calib, 0, sizeof(*sl_calib));
+    sl_calib->cam_intrinsic      = cvCreateMat(3, 3, CV_32FC1);
+    sl_calib->cam_distortion     = cvCreateMat(5, 1, CV_32FC1);
+    sl_calib->cam_extrinsic      = cvCreateMat(2, 3, CV_32FC1);
+    sl_calib->cam_rot_vec        = cvCreateMat(3, 1, CV_32FC1);
+    sl_calib->cam_rot_mat        = cvCreateMat(3, 3, CV_32FC1);
+    sl_calib->cam_trans          = cvCreateMat(3, 1, CV_32FC1);
+    sl_calib->proj_intrinsic     = cvCreateMat(3, 3, CV_32FC1);
+    sl_calib->proj_distortion    = cvCreateMat(5, 1, CV_32FC1);
+    sl_calib->proj_extrinsic     = cvCreateMat(2, 3, CV_32FC1);
+    sl_calib->proj_rot_vec       = cvCreateMat(3, 1, CV_32FC1);
+    sl_calib->proj_rot_mat       = cvCreateMat(3, 3, CV_32FC1);
+    sl_calib->proj_trans         = cvCreateMat(3, 1, CV_32FC1);
+    sl_calib->cam_center         = cvCreateMat(3, 1, CV_32FC1);
+    sl_calib->proj_center        = cvCreateMat(3, 1, CV_32FC1);
+    sl_calib->cam_rays           = cvCreateMat(3, sl_params->cam_w*sl_params->cam_h, CV_32FC1);
+    sl_calib->proj_rays          = cvCreateMat(3, sl_params->proj_w*sl_params->proj_h, CV_32FC1);
+    sl_calib->proj_column_planes = cvCreateMat(sl_params->proj_w, 4, CV_32FC1);
+    sl_calib->proj_row_planes    = cvCreateMat(sl_params->proj_h, 4, CV_32FC1);
+    cvZero(sl_calib->cam_distortion);
+    cvZero(sl_calib->proj_distortion);
+}
+
+static void releaseCalibration(struct slCalib* sl_calib)
+{
+    cvReleaseMat(&sl_calib->cam_intrinsic);
+    cvReleaseMat(&sl_calib->cam_distortion);
+    cvReleaseMat(&sl_calib->cam_extrinsic);
+    cvReleaseMat(&sl_calib->cam_rot_vec);
+    cvReleaseMat(&sl_calib->cam_rot_mat);
+    cvReleaseMat(&sl_calib->cam_trans);
+    cvReleaseMat(&sl_calib->proj_intrinsic);
+    cvReleaseMat(&sl_calib->proj_distortion);
+    cvReleaseMat(&sl_calib->proj_extrinsic);
+    cvReleaseMat(&sl_calib->proj_rot_vec);
+    cvReleaseMat(&sl_calib->proj_rot_mat);
+    cvReleaseMat(&sl_calib->proj_trans);
+    cvReleaseMat(&sl_calib->cam_center);
+    cvReleaseMat(&sl_calib->proj_center);
+    cvReleaseMat(&sl_calib->cam_rays);
+    cvReleaseMat(&sl_calib->proj_rays);
+    cvReleaseMat(&sl_calib->proj_column_planes);
+    cvReleaseMat(&sl_calib->proj_row_planes);
+    releaseUndistortMaps(sl_calib);
+}
+
+// Fit the homography between detected corners and the projector chessboard points (N x 2).
+// Note: Maps corners to points if corners_to_points is set, and points to corners otherwise.
+static void fitHomography(const CvPoint2D32f* corners, const CvMat* points, int n, bool corners_to_points, CvMat* homography)
+{
+    CvMat* src = cvCreateMat(n, 3, CV_32FC1);
+    CvMat* dst = cvCreateMat(n, 3, CV_32FC1);
+    for(int j=0; j<n; j++){
+        CvMat* c = corners_to_points ? src : dst;
+        CvMat* p = corners_to_points ? dst : src;
+        CV_MAT_ELEM(*c, float, j, 0) = corners[j].x;
+        CV_MAT_ELEM(*c, float, j, 1) = corners[j].y;
+        CV_MAT_ELEM(*c, float, j, 2) = 1.0f;
+        CV_MAT_ELEM(*p, float, j, 0) = CV_MAT_ELEM(*points, float, j, 0);
+        CV_MAT_ELEM(*p, float, j, 1) = CV_MAT_ELEM(*points, float, j, 1);
+        CV_MAT_ELEM(*p, float, j, 2) = 1.0f;
+    }
+    cvFindHomography(src, dst, homography);
+    cvReleaseMat(&src);
+    cvReleaseMat(&dst);
+}
+
+PipelineBenchmark::PipelineBenchmark(struct slParams* sl_params, const char* outdir)
+{
+    mSlParams   = sl_params;
+    mOutdir     = outdir;
+    mBoards     = 8;
+    mRun        = 0;
+    mManager    = new SimulatedCameraManager(sl_params);
+    mManager->Init(NULL);
+    mCalibrator = new CalibrateProCam(mManager->GetCamera());
+}
+
+PipelineBenchmark::~PipelineBenchmark()
+{
+    delete mCalibrator;
+    delete mManager;
+}
+
+void PipelineBenchmark::addTime(const char* stage, double seconds, int frames)
+{
+    size_t index = 0;
+    while(index < mStages.size() && mStages[index] != stage)
+        index++;
+    if(index == mStages.size()){
+        mStages.push_back(stage);
+        mTimes.push_back(std::vector<double>());
+        mFrames.push_back(0);
+    }
+    if((int)mTimes[index].size() <= mRun)
+        mTimes[index].resize(mRun + 1, 0.0);
+    mTimes[index][mRun] += seconds;
+    if(mRun == 0)
+        mFrames[index] += frames;
+}
+
+int PipelineBenchmark::Run(BenchmarkSuite& suite, int runs)
+{
+    mStages.clear();
+    mTimes.clear();
+    mFrames.clear();
+    for(mRun=0; mRun<runs; mRun++){
+        printf("Pipeline run %d of %d...\n", mRun+1, runs);
+        struct slCalib sl_calib;
+        allocateCalibration(mSlParams, &sl_calib);
+
+        double start = BenchmarkTime();
+        int result = runCalibration(&sl_calib);
+        addTime("pipeline.calibration.total", BenchmarkTime() - start);
+        if(result == 0){
+            if(mRun == 0)
+                reportCalibration(&sl_calib);
+            start = BenchmarkTime();
+            result = runScan(&sl_calib);
+            addTime("pipeline.scan.total", BenchmarkTime() - start);
+        }
+        releaseCalibration(&sl_calib);
+        if(result != 0){
+            printf("ERROR: Pipeline benchmark failed!\n");
+            return -1;
+        }
+    }
+
+    // Stages that are skipped in some runs (e.g., after early convergence) count as zero.
+    for(size_t i=0; i<mStages.size(); i++){
+        mTimes[i].resize(runs, 0.0);
+        suite.AddResult(mStages[i].c_str(), "simulated", mTimes[i], 0, 0, mFrames[i]);
+    }
+    return 0;
+}
+
+int PipelineBenchmark::runCalibration(struct slCalib* sl_calib)
+{
+    struct slParams*    sl_params = mSlParams;
+    SimulatedCamera*    camera    = mManager->GetCamera();
+    SimulatedProjector* projector = mManager->GetProjector();
+    SimulatedScene*     scene     = mManager->GetScene();
+    camera->SetSupersampling(2);
+
+    // Allocate storage (as runProjectorCalibration does).
+    int n_boards                = mBoards;
+    int cam_board_n             = sl_params->cam_board_w*sl_params->cam_board_h;
+    CvSize cam_board_size       = cvSize(sl_params->cam_board_w, sl_params->cam_board_h);
+    int proj_board_n            = sl_params->proj_board_w*sl_params->proj_board_h;
+    CvSize proj_board_size      = cvSize(sl_params->proj_board_w, sl_params->proj_board_h);
+    CvMat* cam_image_points     = cvCreateMat(n_boards*cam_board_n, 2, CV_32FC1);
+    CvMat* cam_object_points    = cvCreateMat(n_boards*cam_board_n, 3, CV_32FC1);
+    CvMat* proj_image_points    = cvCreateMat(n_boards*proj_board_n, 2, CV_32FC1);
+    CvMat* proj_image_points2   = cvCreateMat(n_boards*proj_board_n, 2, CV_32FC1);
+    CvMat* proj_points          = cvCreateMat(proj_board_n, 2, CV_32FC1);
+    CvMat* camToProjHomography  = cvCreateMat(3, 3, CV_32FC1);
+    CvMat* projToCamHomography  = cvCreateMat(3, 3, CV_32FC1);
+    CvMat* projToProjHomography = cvCreateMat(3, 3, CV_32FC1);
+    CvPoint2D32f* cam_corners   = new CvPoint2D32f[MAX(cam_board_n, proj_board_n)];
+    CvPoint2D32f* proj_corners  = new CvPoint2D32f[proj_board_n];
+    IplImage* proj_chessboard   = cvCreateImage(cvSize(sl_params->proj_w, sl_params->proj_h), IPL_DEPTH_8U, 1);
+    PatternCache pattern_cache(cvSize(sl_params->proj_w, sl_params->proj_h));
+    ProCamIncrementalCalibration incremental_calib(sl_params, sl_calib, n_boards, true);
+    const int CHESSBOARD_PATTERN = 0;
+    int result = -1;
+
+    do{
+        // Generate the projector chessboard and its display frames.
+        double start = BenchmarkTime();
+        int proj_border_cols, proj_border_rows;
+        if(mCalibrator->generateChessboard(sl_params, proj_chessboard, proj_border_cols, proj_border_rows) == -1)
+            break;
+        for(int j=0; j<proj_board_n; ++j){
+            int k = sl_params->proj_invert ? (proj_board_n-j-1) : j;
+            CV_MAT_ELEM(*proj_points, float, j, 0) =
+                sl_params->proj_board_w_pixels*float(k%sl_params->proj_board_w) + (float)proj_border_cols + (float)sl_params->proj_board_w_pixels - 0.5f;
+            CV_MAT_ELEM(*proj_points, float, j, 1) =
+                sl_params->proj_board_h_pixels*float(k/sl_params->proj_board_w) + (float)proj_border_rows + (float)sl_params->proj_board_h_pixels - 0.5f;
+        }
+        pattern_cache.GetSolid(cvScalar(0.0, 0.0, 255.0), sl_params->proj_gain);
+        pattern_cache.GetSolid(cvScalar(255.0, 255.0, 255.0), 50);
+        pattern_cache.GetPattern(CHESSBOARD_PATTERN, proj_chessboard, sl_params->proj_gain);
+        addTime("pipeline.calibration.patterns", BenchmarkTime() - start);
+
+        // Projector-camera homography (projected chessboard on the wall).
+        scene->SetWall(1000.0f);
+        projector->Show(pattern_cache.GetPattern(CHESSBOARD_PATTERN, proj_chessboard, sl_params->proj_gain));
+        start = BenchmarkTime();
+        IplImage* cam_frame = camera->QueryFrame();
+        addTime("pipeline.calibration.capture", BenchmarkTime() - start, 1);
+        start = BenchmarkTime();
+        cvScale(cam_frame, cam_frame, 2.*(sl_params->cam_gain/100.), 0);
+        int corner_count = 0;
+        mCalibrator->detectChessboard(cam_frame, proj_board_size, cam_corners, &corner_count);
+        cvReleaseImage(&cam_frame);
+        if(corner_count == proj_board_n)
+            fitHomography(cam_corners, proj_points, proj_board_n, true, camToProjHomography);
+        addTime("pipeline.calibration.homography", BenchmarkTime() - start);
+        if(corner_count != proj_board_n){
+            printf("ERROR: Projected chessboard was not found on the wall!\n");
+            break;
+        }
+
+        // Capture boards until enough were accepted or the calibration has converged.
+        int successes = 0;
+        bool converged = false;
+        for(int pose=0; pose<2*n_boards && successes<n_boards && !converged; pose++){
+            scene->SetBoardPose(pose);
+
+            // Printed chessboard (under red light).
+            projector->Show(pattern_cache.GetSolid(cvScalar(0.0, 0.0, 255.0), sl_params->proj_gain));
+            start = BenchmarkTime();
+            cam_frame = camera->QueryFrameR();
+            addTime("pipeline.calibration.capture", BenchmarkTime() - start, 1);
+            start = BenchmarkTime();
+            cvScale(cam_frame, cam_frame, 2.*(sl_params->cam_gain/100.), 0);
+            int cam_corner_count = 0;
+            mCalibrator->detectChessboard(cam_frame, cam_board_size, cam_corners, &cam_corner_count);
+            cvReleaseImage(&cam_frame);
+            addTime("pipeline.calibration.detect_camera", BenchmarkTime() - start);
+            if(cam_corner_count != cam_board_n){
+                printf("Pose %d: camera chessboard was not found.\n", pose);
+                continue;
+            }
+
+            // White frame (background).
+            projector->Show(pattern_cache.GetSolid(cvScalar(255.0, 255.0, 255.0), 50));
+            start = BenchmarkTime();
+            IplImage* cam_frame_1_gray = camera->QueryFrameGray();
+            addTime("pipeline.calibration.capture", BenchmarkTime() - start, 1);
+
+            // Projector chessboard, warped onto the printed chessboard.
+            start = BenchmarkTime();
+            fitHomography(cam_corners, proj_points, proj_board_n, false, projToCamHomography);
+            cvMatMul(camToProjHomography, projToCamHomography, projToProjHomography);
+            IplImage* proj_warp = pattern_cache.GetPattern(CHESSBOARD_PATTERN, proj_chessboard, sl_params->proj_gain, projToProjHomography, 255.0);
+            addTime("pipeline.calibration.warp", BenchmarkTime() - start);
+            projector->Show(proj_warp);
+            start = BenchmarkTime();
+            IplImage* cam_frame_2_gray = camera->QueryFrameGray();
+            addTime("pipeline.calibration.capture", BenchmarkTime() - start, 1);
+
+            // Background subtraction, inversion and projector chessboard detection.
+            start = BenchmarkTime();
+            cvSub(cam_frame_1_gray, cam_frame_2_gray, cam_frame_2_gray);
+            double min_val, max_val;
+            cvMinMaxLoc(cam_frame_2_gray, &min_val, &max_val);
+            if(max_val > min_val)
+                cvConvertScale(cam_frame_2_gray, cam_frame_2_gray,
+                    -255.0/(max_val-min_val), 255.0+((255.0*min_val)/(max_val-min_val)));
+            int proj_corner_count = 0;
+            mCalibrator->detectChessboard(cam_frame_2_gray, proj_board_size, proj_corners, &proj_corner_count);
+            cvReleaseImage(&cam_frame_1_gray);
+            cvReleaseImage(&cam_frame_2_gray);
+            addTime("pipeline.calibration.detect_projector", BenchmarkTime() - start);
+            if(proj_corner_count != proj_board_n){
+                printf("Pose %d: projector chessboard was not found.\n", pose);
+                continue;
+            }
+
+            // Accept the board (the user confirmation is skipped).
+            start = BenchmarkTime();
+            for(int i=successes*cam_board_n, j=0; j<cam_board_n; ++i,++j){
+                CV_MAT_ELEM(*cam_image_points,  float, i, 0) = cam_corners[j].x;
+                CV_MAT_ELEM(*cam_image_points,  float, i, 1) = cam_corners[j].y;
+                CV_MAT_ELEM(*cam_object_points, float, i, 0) = sl_params->cam_board_w_mm*float(j/sl_params->cam_board_w);
+                CV_MAT_ELEM(*cam_object_points, float, i, 1) = sl_params->cam_board_h_mm*float(j%sl_params->cam_board_w);
+                CV_MAT_ELEM(*cam_object_points, float, i, 2) = 0.0f;
+            }
+            for(int i=successes*proj_board_n, j=0; j<proj_board_n; ++i,++j){
+                double x = CV_MAT_ELEM(*proj_points, float, j, 0);
+                double y = CV_MAT_ELEM(*proj_points, float, j, 1);
+                double w = cvmGet(projToProjHomography, 2, 0)*x + cvmGet(projToProjHomography, 2, 1)*y + cvmGet(projToProjHomography, 2, 2);
+                CV_MAT_ELEM(*proj_image_points2, float, i, 0) = (float)((cvmGet(projToProjHomography, 0, 0)*x +
+                    cvmGet(projToProjHomography, 0, 1)*y + cvmGet(projToProjHomography, 0, 2))/w);
+                CV_MAT_ELEM(*proj_image_points2, float, i, 1) = (float)((cvmGet(projToProjHomography, 1, 0)*x +
+                    cvmGet(projToProjHomography, 1, 1)*y + cvmGet(projToProjHomography, 1, 2))/w);
+                CV_MAT_ELEM(*proj_image_points,  float, i, 0) = proj_corners[j].x;
+                CV_MAT_ELEM(*proj_image_points,  float, i, 1) = proj_corners[j].y;
+            }
+            successes++;
+            CvMat cam_image_view, cam_object_view, proj_cam_view, proj_image_view;
+            incremental_calib.AddBoard(
+                cvGetRows(cam_image_points,   &cam_image_view,  (successes-1)*cam_board_n,  successes*cam_board_n),
+                cvGetRows(cam_object_points,  &cam_object_view, (successes-1)*cam_board_n,  successes*cam_board_n),
+                cvGetRows(proj_image_points,  &proj_cam_view,   (successes-1)*proj_board_n, successes*proj_board_n),
+                cvGetRows(proj_image_points2, &proj_image_view, (successes-1)*proj_board_n, successes*proj_board_n));
+            converged = incremental_calib.IsConverged();
+            addTime("pipeline.calibration.incremental", BenchmarkTime() - start);
+        }
+        if(successes < 2){
+            printf("ERROR: At least two detected chessboards are required!\n");
+            break;
+        }
+
+        // Camera solve (warm-started from the running estimates).
+        CvMat* cam_object_points2       = cvCreateMat(successes*cam_board_n, 3, CV_32FC1);
+        CvMat* cam_image_points2        = cvCreateMat(successes*cam_board_n, 2, CV_32FC1);
+        CvMat* cam_point_counts2        = cvCreateMat(successes, 1, CV_32SC1);
+        CvMat* cam_rotation_vectors     = cvCreateMat(successes, 3, CV_32FC1);
+        CvMat* cam_translation_vectors  = cvCreateMat(successes, 3, CV_32FC1);
+        CvMat* proj_object_points2      = cvCreateMat(successes*proj_board_n, 3, CV_32FC1);
+        CvMat* proj_image_points3       = cvCreateMat(successes*proj_board_n, 2, CV_32FC1);
+        CvMat* proj_point_counts2       = cvCreateMat(successes, 1, CV_32SC1);
+        CvMat* proj_rotation_vectors    = cvCreateMat(successes, 3, CV_32FC1);
+        CvMat* proj_translation_vectors = cvCreateMat(successes, 3, CV_32FC1);
+        CvMat captured_rows;
+        cvCopy(cvGetRows(cam_image_points,   &captured_rows, 0, successes*cam_board_n),  cam_image_points2);
+        cvCopy(cvGetRows(cam_object_points,  &captured_rows, 0, successes*cam_board_n),  cam_object_points2);
+        cvCopy(cvGetRows(proj_image_points2, &captured_rows, 0, successes*proj_board_n), proj_image_points3);
+        cvSet(cam_point_counts2,  cvScalar(cam_board_n));
+        cvSet(proj_point_counts2, cvScalar(proj_board_n));
+
+        bool warm_start = incremental_calib.GetEstimates(sl_calib);
+        start = BenchmarkTime();
+        int calib_flags = warm_start ? CV_CALIB_USE_INTRINSIC_GUESS : 0;
+        if(!sl_params->cam_dist_model[0])
+            calib_flags |= CV_CALIB_ZERO_TANGENT_DIST;
+        if(!sl_params->cam_dist_model[1]){
+            cvmSet(sl_calib->cam_distortion, 4, 0, 0);
+            calib_flags |= CV_CALIB_FIX_K3;
+        }
+        double cam_error = cvCalibrateCamera2(cam_object_points2, cam_image_points2, cam_point_counts2,
+            cvSize(sl_params->cam_w, sl_params->cam_h), sl_calib->cam_intrinsic, sl_calib->cam_distortion,
+            cam_rotation_vectors, cam_translation_vectors, calib_flags);
+        for(int i=0; i<3; i++){
+            CV_MAT_ELEM(*sl_calib->cam_extrinsic, float, 0, i) = (float)cvmGet(cam_rotation_vectors, 0, i);
+            CV_MAT_ELEM(*sl_calib->cam_extrinsic, float, 1, i) = (float)cvmGet(cam_translation_vectors, 0, i);
+        }
+        sl_calib->cam_intrinsic_calib = true;
+        addTime("pipeline.calibration.solve_camera", BenchmarkTime() - start);
+
+        // Map the projector corners onto the board plane.
+        start = BenchmarkTime();
+        mapProjectorCornersToBoards(cam_image_points, cam_object_points, proj_image_points,
+            sl_calib->cam_intrinsic, sl_calib->cam_distortion, proj_object_points2, cam_board_n, proj_board_n, successes);
+        addTime("pipeline.calibration.map_corners", BenchmarkTime() - start);
+
+        // Projector solve.
+        start = BenchmarkTime();
+        calib_flags = warm_start ? CV_CALIB_USE_INTRINSIC_GUESS : 0;
+        if(!sl_params->proj_dist_model[0])
+            calib_flags |= CV_CALIB_ZERO_TANGENT_DIST;
+        if(!sl_params->proj_dist_model[1]){
+            cvmSet(sl_calib->proj_distortion, 4, 0, 0);
+            calib_flags |= CV_CALIB_FIX_K3;
+        }
+        double proj_error = cvCalibrateCamera2(proj_object_points2, proj_image_points3, proj_point_counts2,
+            cvSize(sl_params->proj_w, sl_params->proj_h), sl_calib->proj_intrinsic, sl_calib->proj_distortion,
+            proj_rotation_vectors, proj_translation_vectors, calib_flags);
+        for(int i=0; i<3; i++){
+            CV_MAT_ELEM(*sl_calib->proj_extrinsic, float, 0, i) = (float)cvmGet(proj_rotation_vectors, 0, i);
+            CV_MAT_ELEM(*sl_calib->proj_extrinsic, float, 1, i) = (float)cvmGet(proj_translation_vectors, 0, i);
+        }
+        sl_calib->proj_intrinsic_calib   = true;
+        sl_calib->procam_extrinsic_calib = true;
+        addTime("pipeline.calibration.solve_projector", BenchmarkTime() - start);
+
+        cvReleaseMat(&cam_object_points2);
+        cvReleaseMat(&cam_image_points2);
+        cvReleaseMat(&cam_point_counts2);
+        cvReleaseMat(&cam_rotation_vectors);
+        cvReleaseMat(&cam_translation_vectors);
+        cvReleaseMat(&proj_object_points2);
+        cvReleaseMat(&proj_image_points3);
+        cvReleaseMat(&proj_point_counts2);
+        cvReleaseMat(&proj_rotation_vectors);
+        cvReleaseMat(&proj_translation_vectors);
+
+        // Projector-camera geometry, undistortion maps and calibration bundle.
+        start = BenchmarkTime();
+        mCalibrator->evaluateProCamGeometry(sl_params, sl_calib);
+        addTime("pipeline.calibration.geometry", BenchmarkTime() - start);
+
+        start = BenchmarkTime();
+        releaseUndistortMaps(sl_calib);
+        getCameraUndistortMap(sl_params, sl_calib);
+        getProjectorUndistortMap(sl_params, sl_calib);
+        addTime("pipeline.calibration.undistort_maps", BenchmarkTime() - start);
+
+        start = BenchmarkTime();
+        std::string filename = mOutdir + "/pipeline_calibration.bin";
+        CalibrationBundle::Save(filename.c_str(), sl_params, sl_calib, sl_calib->procam_geometry_calib);
+        addTime("pipeline.calibration.save_bundle", BenchmarkTime() - start);
+
+        printf("Calibrated with %d boards (camera error %.3f, projector error %.3f pixels).\n", successes, cam_error, proj_error);
+        result = 0;
+    } while(false);
+
+    cvReleaseMat(&cam_image_points);
+    cvReleaseMat(&cam_object_points);
+    cvReleaseMat(&proj_image_points);
+    cvReleaseMat(&proj_image_points2);
+    cvReleaseMat(&proj_points);
+    cvReleaseMat(&camToProjHomography);
+    cvReleaseMat(&projToCamHomography);
+    cvReleaseMat(&projToProjHomography);
+    cvReleaseImage(&proj_chessboard);
+    delete[] cam_corners;
+    delete[] proj_corners;
+    return result;
+}
+
+int PipelineBenchmark::captureScan(const std::vector<IplImage*>& patterns, std::vector<IplImage*>& frames)
+{
+    SimulatedCamera*    camera    = mManager->GetCamera();
+    SimulatedProjector* projector = mManager->GetProjector();
+    int n_frames = (int)patterns.size();
+
+    // Every pattern is on screen for 2.5 frame renders (plus the guards), so one capture fits in.
+    double start = BenchmarkTime();
+    IplImage* frame = camera->QueryFrameGray();
+    double render_ms = 1000.0*(BenchmarkTime() - start);
+    cvReleaseImage(&frame);
+    double refresh_ms = 1000.0/60.0;
+    double period_ms  = 2.5*render_ms + 4*SCAN_GUARD_MS + refresh_ms;
+
+    VirtualProjectorOutput output(projector->GetWidth(), projector->GetHeight(), refresh_ms, projector);
+    if(!output.Open(period_ms))
+        return -1;
+
+    // The sequence ends with a black pattern, so the last Gray code pattern is on screen a full period.
+    std::vector<IplImage*> sequence(patterns);
+    sequence.push_back(cvCreateImage(cvGetSize(patterns[0]), IPL_DEPTH_8U, 1));
+    cvZero(sequence.back());
+    output.Load(&sequence[0], (int)sequence.size());
+    cvReleaseImage(&sequence.back());
+
+    // A frame shows a pattern if no other pattern was presented while it was captured.
+    int captured = 0, dropped = 0, result = 0;
+    for(int play=0; play<SCAN_MAX_PLAYS && captured<n_frames && result==0; play++){
+        output.Play();
+        while(output.IsPlaying()){
+            double t0 = ProjectorOutput::Now();
+            start = BenchmarkTime();
+            frame = camera->QueryFrameGray();
+            addTime("pipeline.scan.capture", BenchmarkTime() - start, 1);
+            double t1 = ProjectorOutput::Now();
+            while(ProjectorOutput::Now() < t1 + 2*SCAN_GUARD_MS)
+                SwitchToThread();
+            int pattern = output.FindPattern(t0);
+            if(pattern >= 0 && pattern < n_frames && frames[pattern] == NULL &&
+               pattern == output.FindPattern(t1 + SCAN_GUARD_MS)){
+                frames[pattern] = frame;
+                captured++;
+            }
+            else{
+                cvReleaseImage(&frame);
+                dropped++;
+            }
+        }
+
+        // Check the present times of the first play.
+        if(play > 0)
+            continue;
+        std::vector<ProjectorOutput::Present> presents = output.GetPresents();
+        double max_deviation = 0;
+        if(presents.size() != sequence.size() || output.FindPattern(presents[0].time - 1.0) != -1)
+            result = -1;
+        for(size_t i=0; i<presents.size() && result==0; i++){
+            if(presents[i].pattern != (int)i || output.FindPattern(presents[i].time) != presents[i].pattern)
+                result = -1;
+            if(i > 0){
+                double deviation = fabs(presents[i].time - presents[i-1].time - period_ms);
+                max_deviation = MAX(max_deviation, deviation);
+                if(deviation > 0.5*period_ms)
+                    result = -1;
+            }
+        }
+        if(mRun == 0 || result != 0)
+            printf("Presented %d of %d patterns every %.1f ms (maximum deviation %.1f ms)%s.\n",
+                (int)presents.size(), (int)sequence.size(), period_ms, max_deviation,
+                (result == 0) ? "" : ", the present times are wrong");
+    }
+    output.Close();
+
+    if(result == 0 && captured < n_frames){
+        printf("ERROR: %d of %d scan patterns were not captured!\n", n_frames-captured, n_frames);
+        result = -1;
+    }
+    if(mRun == 0 && result == 0)
+        printf("Captured %d scan patterns (%d frames dropped during pattern changes).\n", n_frames, dropped);
+    return result;
+}
+
+int PipelineBenchmark::runScan(struct slCalib* sl_calib)
+{
+    struct slParams*    sl_params = mSlParams;
+    SimulatedCamera*    camera    = mManager->GetCamera();
+    SimulatedProjector* projector = mManager->GetProjector();
+    SimulatedScene*     scene     = mManager->GetScene();
+
+    // Point sampling resolves every projector column (supersampling would blur the finest bit planes).
+    camera->SetSupersampling(1);
+    scene->SetObject();
+
+    GrayCodeDecoder decoder(sl_params);
+    int n_frames = decoder.GetFrameCount();
+    if(n_frames == 0){
+        printf("ERROR: Neither columns nor rows are scanned!\n");
+        return -1;
+    }
+    CvSize cam_size   = cvSize(sl_params->cam_w, sl_params->cam_h);
+    int    cam_nelems = sl_params->cam_w*sl_params->cam_h;
+
+    // Render and capture the Gray code sequence.
+    double start = BenchmarkTime();
+    std::vector<IplImage*> patterns(n_frames), frames(n_frames);
+    for(int i=0; i<n_frames; i++){
+        patterns[i] = cvCreateImage(cvSize(sl_params->proj_w, sl_params->proj_h), IPL_DEPTH_8U, 1);
+        decoder.RenderFrame(i, patterns[i]);
+    }
+    addTime("pipeline.scan.patterns", BenchmarkTime() - start);
+    if(captureScan(patterns, frames) != 0){
+        for(int i=0; i<n_frames; i++){
+            cvReleaseImage(&patterns[i]);
+            if(frames[i] != NULL)
+                cvReleaseImage(&frames[i]);
+        }
+        return -1;
+    }
+
+    // Decode.
+    IplImage* decoded_cols = (decoder.GetColumnBits() > 0) ? cvCreateImage(cam_size, IPL_DEPTH_16U, 1) : NULL;
+    IplImage* decoded_rows = (decoder.GetRowBits() > 0)    ? cvCreateImage(cam_size, IPL_DEPTH_16U, 1) : NULL;
+    IplImage* mask         = cvCreateImage(cam_size, IPL_DEPTH_8U, 1);
+    start = BenchmarkTime();
+    decoder.Decode(&frames[0], decoded_cols, decoded_rows, mask);
+    addTime("pipeline.scan.decode", BenchmarkTime() - start);
+
+    // Triangulate (pixel indices and a 1xN point mask for both reconstruction modes).
+    CvMat* points     = cvCreateMat(3, cam_nelems, CV_32FC1);
+    CvMat* indices    = cvCreateMat(1, cam_nelems, CV_32SC1);
+    CvMat* point_mask = cvCreateMat(1, cam_nelems, CV_32FC1);
+    int count = 0, result = 0;
+    cvZero(point_mask);
+    if(sl_params->mode == 2){
+        RayRayTriangulator triangulator;
+        start = BenchmarkTime();
+        bool built = triangulator.Build(sl_params, sl_calib);
+        addTime("pipeline.scan.build", BenchmarkTime() - start);
+        if(built){
+            start = BenchmarkTime();
+            IplImage* cols = NULL;
+            IplImage* rows = NULL;
+            if(decoded_cols != NULL){
+                cols = cvCreateImage(cam_size, IPL_DEPTH_32F, 1);
+                cvConvert(decoded_cols, cols);
+            }
+            if(decoded_rows != NULL){
+                rows = cvCreateImage(cam_size, IPL_DEPTH_32F, 1);
+                cvConvert(decoded_rows, rows);
+            }
+            count = triangulator.Triangulate(cols, rows, mask, points);
+            for(int i=0; i<cam_nelems; i++){
+                indices->data.i[i]     = i;
+                point_mask->data.fl[i] = (mask->imageData[(i/cam_size.width)*mask->widthStep + i%cam_size.width] != 0) ? 1.0f : 0.0f;
+            }
+            addTime("pipeline.scan.triangulate", BenchmarkTime() - start);
+            if(cols != NULL)
+                cvReleaseImage(&cols);
+            if(rows != NULL)
+                cvReleaseImage(&rows);
+        }
+        else
+            result = -1;
+    }
+    else{
+        RayPlaneTriangulator triangulator;
+        start = BenchmarkTime();
+        bool built = triangulator.Build(sl_params, sl_calib);
+        addTime("pipeline.scan.build", BenchmarkTime() - start);
+        if(built){
+            start = BenchmarkTime();
+            count = triangulator.Triangulate(decoded_cols, decoded_rows, mask, points, indices);
+            for(int i=0; i<count; i++)
+                point_mask->data.fl[i] = 1.0f;
+            addTime("pipeline.scan.triangulate", BenchmarkTime() - start);
+        }
+        else
+            result = -1;
+    }
+
+    if(result == 0){
+        // Outlier removal and export.
+        start = BenchmarkTime();
+        OutlierFilter filter(sl_params);
+        int removed = filter.Apply(points, point_mask);
+        addTime("pipeline.scan.filter", BenchmarkTime() - start);
+
+        // Texture: a frame under white light, undistorted with the camera map and sampled at the
+        // pinhole projection of every point.
+        IplImage* white = cvCreateImage(cvSize(sl_params->proj_w, sl_params->proj_h), IPL_DEPTH_8U, 1);
+        cvSet(white, cvScalar(255));
+        projector->Show(white);
+        start = BenchmarkTime();
+        IplImage* texture = camera->QueryFrame();
+        addTime("pipeline.scan.capture", BenchmarkTime() - start, 1);
+        IplImage* undistorted = cvCreateImage(cam_size, IPL_DEPTH_8U, 3);
+        start = BenchmarkTime();
+        getCameraUndistortMap(sl_params, sl_calib)->Remap(texture, undistorted);
+        addTime("pipeline.scan.undistort", BenchmarkTime() - start, 1);
+        CvMat* colors = cvCreateMat(3, cam_nelems, CV_32FC1);
+        start = BenchmarkTime();
+        sampleColors(points, point_mask, undistorted, sl_calib->cam_intrinsic, colors);
+        addTime("pipeline.scan.texture", BenchmarkTime() - start);
+
+        // Normals (if enabled) on the camera grid; the points are scattered back to their pixels
+        // first (ray-plane triangulation compacts them).
+        CvMat* normals = NULL;
+        int normal_count = 0;
+        if(sl_params->generate_normals){
+            CvMat* grid_points  = cvCreateMat(3, cam_nelems, CV_32FC1);
+            CvMat* grid_mask    = cvCreateMat(1, cam_nelems, CV_32FC1);
+            CvMat* grid_normals = cvCreateMat(3, cam_nelems, CV_32FC1);
+            cvZero(grid_points);
+            cvZero(grid_mask);
+            for(int i=0; i<cam_nelems; i++){
+                if(point_mask->data.fl[i] == 0)
+                    continue;
+                int pixel = indices->data.i[i];
+                for(int k=0; k<3; k++)
+                    grid_points->data.fl[k*cam_nelems+pixel] = points->data.fl[k*cam_nelems+i];
+                grid_mask->data.fl[pixel] = 1.0f;
+            }
+            start = BenchmarkTime();
+            NormalEstimator estimator(sl_params);
+            normal_count = estimator.Compute(grid_points, grid_mask, grid_normals);
+            addTime("pipeline.scan.normals", BenchmarkTime() - start);
+            normals = cvCreateMat(3, cam_nelems, CV_32FC1);
+            cvZero(normals);
+            for(int i=0; i<cam_nelems; i++){
+                if(point_mask->data.fl[i] == 0)
+                    continue;
+                int pixel = indices->data.i[i];
+                for(int k=0; k<3; k++)
+                    normals->data.fl[k*cam_nelems+i] = grid_normals->data.fl[k*cam_nelems+pixel];
+            }
+            cvReleaseMat(&grid_points);
+            cvReleaseMat(&grid_mask);
+            cvReleaseMat(&grid_normals);
+        }
+
+        start = BenchmarkTime();
+        std::string filename = mOutdir + "/pipeline_scan.ply";
+        savePointsPLY((char*)filename.c_str(), points, normals, colors, point_mask);
+        addTime("pipeline.scan.export", BenchmarkTime() - start);
+
+        // Compare the depth of the points with the rendered depth.
+        if(mRun == 0){
+            CvMat* depth = cvCreateMat(sl_params->cam_h, sl_params->cam_w, CV_32FC1);
+            camera->RenderDepth(depth);
+            double error = 0;
+            int n = 0;
+            for(int i=0; i<cam_nelems; i++){
+                if(point_mask->data.fl[i] == 0)
+                    continue;
+                float true_depth = depth->data.fl[indices->data.i[i]];
+                if(true_depth <= 0)
+                    continue;
+                error += fabs(CV_MAT_ELEM(*points, float, 2, i) - true_depth);
+                n++;
+            }
+            printf("Scanned %d points (%d outliers removed), mean depth error %.3f mm.\n", count, removed, (n > 0) ? error/n : 0.0);
+            cvReleaseMat(&depth);
+
+            // The undistorted texture must give every point the color of its own camera pixel.
+            double difference = 0;
+            n = 0;
+            for(int i=0; i<cam_nelems; i++){
+                if(point_mask->data.fl[i] == 0)
+                    continue;
+                int pixel = indices->data.i[i];
+                const uchar* bgr = (const uchar*)texture->imageData + (pixel/cam_size.width)*texture->widthStep + 3*(pixel%cam_size.width);
+                for(int k=0; k<3; k++)
+                    difference += fabs(255.0*colors->data.fl[k*cam_nelems+i] - bgr[2-k]);
+                n += 3;
+            }
+            printf("Mean texture difference %.2f gray levels (undistorted texture against the camera frame).\n", (n > 0) ? difference/n : 0.0);
+
+            // Normals of the sphere and the wall must face the camera.
+            if(normals != NULL){
+                int facing = 0;
+                for(int i=0; i<cam_nelems; i++){
+                    double dot = 0;
+                    for(int k=0; k<3; k++)
+                        dot += normals->data.fl[k*cam_nelems+i]*points->data.fl[k*cam_nelems+i];
+                    if(point_mask->data.fl[i] != 0 && dot < 0)
+                        facing++;
+                }
+                printf("Estimated %d normals, %.1f%% of them facing the camera.\n", normal_count,
+                    (normal_count > 0) ? 100.0*facing/normal_count : 0.0);
+            }
+        }
+        cvReleaseImage(&white);
+        cvReleaseImage(&texture);
+        cvReleaseImage(&undistorted);
+        cvReleaseMat(&colors);
+        if(normals != NULL)
+            cvReleaseMat(&normals);
+    }
+    else
+        printf("ERROR: Triangulation requires a calibrated projector-camera system!\n");
+
+    for(int i=0; i<n_frames; i++){
+        cvReleaseImage(&patterns[i]);
+        cvReleaseImage(&frames[i]);
+    }
+    if(decoded_cols != NULL)
+        cvReleaseImage(&decoded_cols);
+    if(decoded_rows != NULL)
+        cvReleaseImage(&decoded_rows);
+    cvReleaseImage(&mask);
+    cvReleaseMat(&points);
+    cvReleaseMat(&indices);
+    cvReleaseMat(&point_mask);
+    return result;
+}
+
+void PipelineBenchmark::reportCalibration(struct slCalib* sl_calib)
+{
+    CvMat* intrinsic = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* R_true    = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* T_true    = cvCreateMat(3, 1, CV_64FC1);
+    CvMat* R         = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* T         = cvCreateMat(3, 1, CV_64FC1);
+
+    mManager->GetCamera()->GetIntrinsic(intrinsic);
+    double cam_focal_error = cvmGet(sl_calib->cam_intrinsic, 0, 0) - cvmGet(intrinsic, 0, 0);
+    mManager->GetProjector()->GetIntrinsic(intrinsic);
+    double proj_focal_error = cvmGet(sl_calib->proj_intrinsic, 0, 0) - cvmGet(intrinsic, 0, 0);
+
+    // Projector center and rotation (angle of R*R_true^T).
+    double center[3];
+    float  true_center[3];
+    getProjectorCenter(sl_calib, center);
+    mManager->GetProjector()->GetCenter(true_center);
+    double center_error = sqrt((center[0]-true_center[0])*(center[0]-true_center[0]) +
+        (center[1]-true_center[1])*(center[1]-true_center[1]) + (center[2]-true_center[2])*(center[2]-true_center[2]));
+    getProjectorPose(sl_calib, R, T);
+    mManager->GetProjector()->GetPose(R_true, T_true);
+    double trace = 0;
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            trace += cvmGet(R, i, j)*cvmGet(R_true, i, j);
+    double angle = acos(MIN(MAX(0.5*(trace - 1), -1.0), 1.0))*180.0/CV_PI;
+
+    printf("Calibration error: camera focal %+.2f px, projector focal %+.2f px, projector center %.2f mm, projector rotation %.3f deg.\n",
+        cam_focal_error, proj_focal_error, center_error, angle);
+
+    cvReleaseMat(&intrinsic);
+    cvReleaseMat(&R_true);
+    cvReleaseMat(&T_true);
+    cvReleaseMat(&R);
+    cvReleaseMat(&T);
+}
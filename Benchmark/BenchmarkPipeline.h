@@ -0,0 +1,80 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Benchmark\BenchmarkPipeline.h
+//
+// summary:	Declares the end-to-end calibration and scanning benchmark
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "Benchmark.h"
+#include <string>
+#include <vector>
+
+class SimulatedCameraManager;
+class CalibrateProCam;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  PipelineBenchmark
+///
+/// @brief  Times every stage of projector-camera calibration and structured light scanning on a
+///         simulated projector-camera system (see SimulatedCameraManager).
+///
+///         The calibration follows runProjectorCalibration with the same library calls, but
+///         without windows or key presses: patterns, projector-camera homography (wall), then per
+///         scripted board pose the capture, camera and projector chessboard detection, pattern
+///         warp and incremental update, followed by the camera solve, corner mapping, projector
+///         solve, geometry, undistortion maps and calibration bundle. The scan renders the Gray
+///         code sequence onto a sphere (presented by a VirtualProjectorOutput and captured without
+///         waiting for the patterns, see captureScan()), decodes it, triangulates with the estimated calibration
+///         (ray-plane, or ray-ray for mode 2), removes outliers, colors the points from a camera
+///         frame undistorted with the camera map (UndistortMap::Remap), estimates normals (if
+///         generate_normals is set, see NormalEstimator) and saves a PLY file.
+///
+///         Each stage is recorded as "pipeline.<calibration|scan>.<stage>" with one time per run
+///         (stages repeated per board are summed), so the stages can be compared against a
+///         baseline like the kernels. The estimated calibration and the reconstruction are
+///         checked against the ground truth.
+///
+/// @ingroup Benchmark
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PipelineBenchmark
+{
+public:
+    PipelineBenchmark(struct slParams* sl_params, const char* outdir);
+    ~PipelineBenchmark();
+
+    // Number of scripted board poses shown during calibration (default 8).
+    void SetBoards(int boards)      { mBoards = MAX(boards, 2); };
+
+    // Run the calibration and the scan runs times and add the stage timings to the suite.
+    // Returns -1 if a stage fails (e.g., too few chessboards were detected).
+    int Run(BenchmarkSuite& suite, int runs);
+
+private:
+    int  runCalibration(struct slCalib* sl_calib);
+    int  runScan(struct slCalib* sl_calib);
+
+    // Play the patterns on a virtual projector output and capture one frame per pattern (frames
+    // are matched to the patterns by the present times); returns -1 if the presents are wrong.
+    int  captureScan(const std::vector<IplImage*>& patterns, std::vector<IplImage*>& frames);
+
+    // Print the error of the estimated calibration with respect to the ground truth.
+    void reportCalibration(struct slCalib* sl_calib);
+
+    // Add time (and frames) to a stage of the current run.
+    void addTime(const char* stage, double seconds, int frames = 0);
+
+    struct slParams*        mSlParams;
+    std::string             mOutdir;
+    int                     mBoards;
+    SimulatedCameraManager* mManager;
+    CalibrateProCam*        mCalibrator;
+
+    /// <summary> Stage names (in order of first use), their times per run and frames per run. </summary>
+    std::vector<std::string>          mStages;
+    std::vector<std::vector<double> > mTimes;
+    std::vector<double>               mFrames;
+    int                               mRun;
+};
@@ -0,0 +1,184 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\ArtifactWriter.cpp
+//
+// summary:	Implements the asynchronous image artifact writer class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "ArtifactWriter.h"
+#include "Kinect-Trace.h"
+
+ArtifactWriter::ArtifactWriter(Format format, int png_compression, int capacity, Overflow overflow, int workers)
+{
+    init(format, png_compression, capacity, overflow, workers);
+}
+
+ArtifactWriter::ArtifactWriter(struct slParams* sl_params)
+{
+    init((Format)sl_params->artifact_format, sl_params->artifact_png_compression,
+         sl_params->artifact_queue, (Overflow)sl_params->artifact_overflow, 2);
+}
+
+void ArtifactWriter::init(Format format, int png_compression, int capacity, Overflow overflow, int workers)
+{
+    mFormat         = format;
+    mPngCompression = MIN(png_compression, 9);
+    mCapacity       = MAX(capacity, 1);
+    mOverflow       = overflow;
+    mPending        = 0;
+    mStopping       = false;
+    mSynchronous    = false;
+    mInlineWorkers  = 0;
+    mWritten        = 0;
+    mDropped        = 0;
+    mFailed         = 0;
+
+    InitializeCriticalSection(&mLock);
+    mOwnerThread = GetCurrentThreadId();
+    mWork  = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+    mSpace = CreateEvent(NULL, FALSE, FALSE, NULL);
+    mIdle  = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+    // No workers are needed if nothing is written.
+    if(mFormat == FORMAT_NONE)
+        workers = 0;
+    for(int i=0; i<workers; i++){
+        Worker* worker = new Worker(this);
+        mWorkers.push_back(worker);
+        worker->Start();
+    }
+
+    // Encode on the calling thread if no worker thread could be started.
+    if(mInlineWorkers == (LONG)mWorkers.size())
+        mSynchronous = true;
+}
+
+ArtifactWriter::~ArtifactWriter()
+{
+    Flush();
+
+    EnterCriticalSection(&mLock);
+    mStopping = true;
+    LeaveCriticalSection(&mLock);
+    if(!mWorkers.empty())
+        ReleaseSemaphore(mWork, (LONG)mWorkers.size(), NULL);
+    for(unsigned int i=0; i<mWorkers.size(); i++){
+        mWorkers[i]->Wait();
+        delete mWorkers[i];
+    }
+
+    CloseHandle(mWork);
+    CloseHandle(mSpace);
+    CloseHandle(mIdle);
+    DeleteCriticalSection(&mLock);
+}
+
+bool ArtifactWriter::Write(const char* name, const IplImage* image)
+{
+    if(mFormat == FORMAT_NONE || image == NULL)
+        return false;
+
+    Job job;
+    job.name = name;
+    if(mSynchronous){
+        job.image = (IplImage*)image;
+        writeJob(job);
+        return true;
+    }
+
+    // Make room in the queue according to the overflow policy.
+    EnterCriticalSection(&mLock);
+    while((int)mQueue.size() >= mCapacity){
+        if(mOverflow == OVERFLOW_DROP_NEWEST){
+            LeaveCriticalSection(&mLock);
+            InterlockedIncrement(&mDropped);
+            return false;
+        }
+        if(mOverflow == OVERFLOW_DROP_OLDEST){
+            cvReleaseImage(&mQueue.front().image);
+            mQueue.pop_front();
+            mPending--;
+            InterlockedIncrement(&mDropped);
+            break;
+        }
+        LeaveCriticalSection(&mLock);
+        WaitForSingleObject(mSpace, INFINITE);
+        EnterCriticalSection(&mLock);
+    }
+
+    // Note: The image is copied, so the caller may reuse it as soon as Write() returns.
+    job.image = cvCloneImage(image);
+    mQueue.push_back(job);
+    mPending++;
+    ResetEvent(mIdle);
+    LeaveCriticalSection(&mLock);
+    ReleaseSemaphore(mWork, 1, NULL);
+    return true;
+}
+
+void ArtifactWriter::Flush()
+{
+    if(!mSynchronous)
+        WaitForSingleObject(mIdle, INFINITE);
+}
+
+int ArtifactWriter::GetQueueLength()
+{
+    EnterCriticalSection(&mLock);
+    int length = (int)mQueue.size();
+    LeaveCriticalSection(&mLock);
+    return length;
+}
+
+void ArtifactWriter::runWorker()
+{
+    // AsyncTask runs the task inline if its thread cannot be created; leave the writing to Write().
+    if(GetCurrentThreadId() == mOwnerThread){
+        InterlockedIncrement(&mInlineWorkers);
+        return;
+    }
+
+    for(;;){
+        WaitForSingleObject(mWork, INFINITE);
+
+        // Images dropped from the queue leave a surplus count on the semaphore, so the queue may be empty.
+        EnterCriticalSection(&mLock);
+        if(mQueue.empty()){
+            bool stop = mStopping;
+            LeaveCriticalSection(&mLock);
+            if(stop)
+                return;
+            continue;
+        }
+        Job job = mQueue.front();
+        mQueue.pop_front();
+        LeaveCriticalSection(&mLock);
+        SetEvent(mSpace);
+
+        writeJob(job);
+        cvReleaseImage(&job.image);
+        finishJob();
+    }
+}
+
+void ArtifactWriter::writeJob(const Job& job)
+{
+    KINECT_TRACE_SCOPE("export.artifact");
+    std::string filename = job.name + ((mFormat == FORMAT_PNG) ? ".png" : ".bmp");
+    int png_params[3] = {CV_IMWRITE_PNG_COMPRESSION, mPngCompression, 0};
+    const int* params = (mFormat == FORMAT_PNG && mPngCompression >= 0) ? png_params : NULL;
+    if(cvSaveImage(filename.c_str(), job.image, params))
+        InterlockedIncrement(&mWritten);
+    else{
+        InterlockedIncrement(&mFailed);
+        printf("ERROR: Cannot write image \"%s\"!\n", filename.c_str());
+    }
+}
+
+void ArtifactWriter::finishJob()
+{
+    EnterCriticalSection(&mLock);
+    if(--mPending == 0)
+        SetEvent(mIdle);
+    LeaveCriticalSection(&mLock);
+}
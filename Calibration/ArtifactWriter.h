@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\ArtifactWriter.h
+//
+// summary:	Declares the asynchronous image artifact writer class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "Kinect-Parallel.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  ArtifactWriter
+///
+/// @brief  Writes images (debug frames, calibration images) on background threads.
+///
+///         Write() copies the image into a bounded queue and returns; worker threads encode and
+///         write the queued images, so a capture loop never waits for an encoder. When the queue
+///         is full, the overflow policy either blocks the caller until a worker catches up, or
+///         drops the new image or the oldest queued one. Flush() is a barrier that waits until
+///         every image queued before it is written (the destructor flushes as well).
+///
+///         Names are given without extension; the format selects the encoder and the extension:
+///         PNG (".png", with a selectable compression level), raw (uncompressed ".bmp") or none
+///         (nothing is written).
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class ArtifactWriter
+{
+public:
+    enum Format
+    {
+        FORMAT_NONE = 0,            // discard all images
+        FORMAT_RAW  = 1,            // uncompressed BMP
+        FORMAT_PNG  = 2             // PNG
+    };
+
+    enum Overflow
+    {
+        OVERFLOW_BLOCK       = 0,   // wait until a worker has taken an image from the queue
+        OVERFLOW_DROP_NEWEST = 1,   // drop the image being written
+        OVERFLOW_DROP_OLDEST = 2    // drop the oldest queued image
+    };
+
+    // Start the worker threads. A png_compression of -1 uses the encoder default (0-9 otherwise).
+    ArtifactWriter(Format format = FORMAT_PNG, int png_compression = -1, int capacity = 16,
+                   Overflow overflow = OVERFLOW_BLOCK, int workers = 2);
+
+    // Configure the writer from the debug image options.
+    ArtifactWriter(struct slParams* sl_params);
+
+    // Flush the queue and stop the worker threads.
+    ~ArtifactWriter();
+
+    // Queue a copy of image to be written to name (plus the extension of the format).
+    // Returns false if the image is not written (dropped, or the format is none).
+    bool Write(const char* name, const IplImage* image);
+
+    // Wait until every image queued so far has been written.
+    void Flush();
+
+    // Backpressure: the images queued (not yet taken by a worker) and the queue capacity.
+    int GetQueueLength();
+    int GetCapacity()                   { return mCapacity; };
+
+    int GetWrittenCount()               { return mWritten; };
+    int GetDroppedCount()               { return mDropped; };
+    int GetFailedCount()                { return mFailed; };
+
+    Format GetFormat()                  { return mFormat; };
+
+private:
+    struct Job
+    {
+        std::string name;
+        IplImage*   image;
+    };
+
+    // A worker thread; runs until the writer is stopped.
+    class Worker : public Kinect::AsyncTask
+    {
+    public:
+        Worker(ArtifactWriter* owner)   { mOwner = owner; };
+        virtual void Run()              { mOwner->runWorker(); };
+
+    private:
+        ArtifactWriter* mOwner;
+    };
+
+    void init(Format format, int png_compression, int capacity, Overflow overflow, int workers);
+    void runWorker();
+    void writeJob(const Job& job);
+    void finishJob();
+
+    Format   mFormat;
+    int      mPngCompression;
+    int      mCapacity;
+    Overflow mOverflow;
+
+    CRITICAL_SECTION     mLock;
+    std::deque<Job>      mQueue;
+    std::vector<Worker*> mWorkers;
+    DWORD    mOwnerThread;
+    HANDLE   mWork;                     // semaphore: queued images (and stop requests)
+    HANDLE   mSpace;                    // auto-reset event: an image was taken from the queue
+    HANDLE   mIdle;                     // manual-reset event: nothing queued or being written
+    int      mPending;                  // images queued or being written
+    bool     mStopping;
+    bool     mSynchronous;              // no worker thread could be started; Write() encodes inline
+
+    volatile LONG mInlineWorkers;
+    volatile LONG mWritten;
+    volatile LONG mDropped;
+    volatile LONG mFailed;
+};
@@ -9,6 +9,9 @@
 #include "Common.h"
 #include "Calibration.h"
 #include "Camera.h"
+#include "PatternCache.h"
+
+class ProjectorOutput;
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @class  CalibrateProCam
@@ -25,6 +28,15 @@ class CalibrateProCam
 private:
     Camera* camera;
 
+    /// <summary> Projector frames in display format (kept across calibration sessions). </summary>
+    PatternCache* patternCache;
+
+    /// <summary> Chessboard dimensions (squares and pixels) the cached frames were rendered for. </summary>
+    int patternBoard[4];
+
+    /// <summary> Scheduled projector output (NULL = the HighGUI window "projWindow"). </summary>
+    ProjectorOutput* projectorOutput;
+
 public:
     CalibrateProCam(Camera *camera_);
 
@@ -45,7 +57,18 @@ public:
     // Note: Returns 1 if chessboard is found, 0 otherwise.
     int detectChessboard(IplImage* frame, CvSize board_size, CvPoint2D32f* corners, int* corner_count CV_DEFAULT(NULL));
 
+    // Evaluate the projector-camera geometry (centers, optical rays and projector planes).
+    // Note: Returns -1 if the projector-camera system has not been calibrated.
+    int evaluateProCamGeometry(struct slParams* sl_params, struct slCalib* sl_calib);
+
+    // Get the projector frame cache for the projector and chessboard of sl_params (kept across sessions).
+    PatternCache* getPatternCache(struct slParams* sl_params);
+
+    // Show calibration patterns on output instead of the HighGUI window (not owned).
+    void setProjectorOutput(ProjectorOutput* output) { projectorOutput = output; };
+
     // Run projector-camera calibration (including intrinsic and extrinsic parameters).
+    // Note: Drives a CalibrationSession from the console (see CalibrationSession for embedding).
     int runProjectorCalibration(struct slParams* sl_params, struct slCalib* sl_calib, bool calibrate_both);
 
 private:
@@ -9,12 +9,33 @@
 
 #include "Common.h"
 #include "Calibration.h"
+#include "CalibrationBundle.h"
 #include "CalibrationExceptions.h"
 #include "CalibrateProCam.h"
 #include "CameraConfigParams.h"
 #include "Configuration.h"
 #include "KinectCameraManager.h"
+#include "FrameBusCameraManager.h"
+#include "ProjectorOutput.h"
+#include "UndistortMap.h"
 #include "UtilProCam.h"
+#include "Kinect-Trace.h"
+#include "Kinect-Log.h"
+#include "Kinect-Parallel.h"
+
+// Load a calibration matrix from an XML file into pre-allocated storage.
+// Note: Returns false if the file is missing or the dimensions do not match.
+static bool loadCalibrationMatrix(const char* filename, CvMat* dst)
+{
+	CvMat* m = (CvMat*)cvLoad(filename);
+	if(m == NULL)
+		return false;
+	bool loaded = (m->rows == dst->rows && m->cols == dst->cols);
+	if(loaded)
+		cvConvert(m, dst);
+	cvReleaseMat(&m);
+	return loaded;
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @fn int main(int argc, char* argv[])
@@ -55,6 +76,29 @@ int main(int argc, char* argv[])
         return -1;
     }
 
+	// Size the thread pool shared by decoding, calibration, reconstruction, export and the driver
+	// (the Kinect DLL holds one pool for the whole process).
+	if(sl_params.threads > 0)
+		Kinect::SetParallelThreadCount(sl_params.threads);
+	if(sl_params.numa_node >= 0){
+		DWORD_PTR processors = Kinect::GetNumaNodeProcessors(sl_params.numa_node);
+		if(processors != 0)
+			Kinect::SetParallelAffinity(processors);
+		else
+			printf("ERROR: NUMA node %d not found!\n", sl_params.numa_node);
+	}
+
+	// Set the level of the driver messages.
+	if(sl_params.log_level >= Kinect::LOG_DEBUG && sl_params.log_level <= Kinect::LOG_NONE)
+		Kinect::SetLogLevel((Kinect::LogLevel)sl_params.log_level);
+
+	// Start tracing (if enabled); every calibration round is written to its own trace, which also
+	// holds the events of the driver threads.
+	if(sl_params.trace){
+		Kinect::TraceSetThreadName("main");
+		Kinect::TraceStart(sl_params.trace_events);
+	}
+
     // ***************************************************
     // Intialize the hardware
     // ***************************************************
@@ -63,16 +107,21 @@ int main(int argc, char* argv[])
     // Create blank camera parameters
     CameraConfigParams cameraConfigParams;
     
+    // Read from a capture daemon's frame bus if one is configured (the Kinect is shared then).
     KinectCameraManager kinectCameraManager;
+    FrameBusCameraManager frameBusCameraManager(sl_params.frame_bus);
+    CameraManager* cameraManager = &kinectCameraManager;
+    if(sl_params.frame_bus[0] != '\0')
+        cameraManager = &frameBusCameraManager;
     std::vector<Camera*> cameras;
     Camera* camera;
     
     // Initialize cameras
     try
     {
-        kinectCameraManager.Init(&cameraConfigParams);
+        cameraManager->Init(&cameraConfigParams);
 
-        std::vector<Camera*> cameras = kinectCameraManager.GetCameras();
+        std::vector<Camera*> cameras = cameraManager->GetCameras();
         if(cameras.size() < 1)
         {
             printf("Camera not found\n");
@@ -95,11 +144,27 @@ int main(int argc, char* argv[])
     CalibrateProCam cvCalibrateProCam(camera);
 
 	// Create fullscreen window (for controlling projector display).
-	cvNamedWindow("projWindow", CV_WINDOW_AUTOSIZE);
+	// Note: The scheduled output presents from its own thread and records when patterns are on screen.
 	IplImage* proj_frame = cvCreateImage(cvSize(sl_params.proj_w, sl_params.proj_h), IPL_DEPTH_8U, 3);
 	cvSet(proj_frame, cvScalar(0, 0, 255));
-	cvShowImage("projWindow", proj_frame);
-	cvMoveWindow("projWindow", -sl_params.proj_w+sl_params.window_offset_x, sl_params.window_offset_y);
+	ProjectorOutput* proj_output = NULL;
+	if(sl_params.proj_scheduled){
+		proj_output = new WindowProjectorOutput(-sl_params.proj_w+sl_params.window_offset_x, sl_params.window_offset_y,
+		                                        sl_params.proj_w, sl_params.proj_h);
+		if(!proj_output->Open(sl_params.proj_period)){
+			printf("The HighGUI projector window is used instead.\n");
+			delete proj_output;
+			proj_output = NULL;
+		}
+	}
+	cvCalibrateProCam.setProjectorOutput(proj_output);
+	if(proj_output != NULL)
+		proj_output->Show(proj_frame);
+	else{
+		cvNamedWindow("projWindow", CV_WINDOW_AUTOSIZE);
+		cvShowImage("projWindow", proj_frame);
+		cvMoveWindow("projWindow", -sl_params.proj_w+sl_params.window_offset_x, sl_params.window_offset_y);
+	}
 	cvWaitKey(1);
 	
 	// Create output directory (clear previous scan first).
@@ -125,6 +190,9 @@ int main(int argc, char* argv[])
     sl_calib.cam_intrinsic_calib    = false;
 	sl_calib.proj_intrinsic_calib   = false;
 	sl_calib.procam_extrinsic_calib = false;
+	sl_calib.procam_geometry_calib  = false;
+	sl_calib.cam_pose_calib         = false;
+	sl_calib.proj_pose_calib        = false;
 	sl_calib.cam_intrinsic          = cvCreateMat(3,3,CV_32FC1);
 	sl_calib.cam_distortion         = cvCreateMat(5,1,CV_32FC1);
 	sl_calib.cam_extrinsic          = cvCreateMat(2, 3, CV_32FC1);
@@ -140,58 +208,70 @@ int main(int argc, char* argv[])
 	sl_calib.cam_center             = cvCreateMat(3, 1, CV_32FC1);
 	sl_calib.proj_center            = cvCreateMat(3, 1, CV_32FC1);
 	sl_calib.cam_rays               = cvCreateMat(3, cam_nelems, CV_32FC1);
-	sl_calib.proj_rays              = cvCreateMat(3, cam_nelems, CV_32FC1);
-	//sl_calib.proj_rays              = cvCreateMat(3, proj_nelems, CV_32FC1);
+	sl_calib.proj_rays              = cvCreateMat(3, proj_nelems, CV_32FC1);
 	sl_calib.proj_column_planes     = cvCreateMat(sl_params.proj_w, 4, CV_32FC1);
 	sl_calib.proj_row_planes        = cvCreateMat(sl_params.proj_h, 4, CV_32FC1);
+	sl_calib.cam_undistort_map      = NULL;
+	sl_calib.proj_undistort_map     = NULL;
+	sl_calib.proj_latency           = 0;
+	sl_calib.proj_latency_time      = 0;
 	//sl_calib.fundMatrx				= new FundamentalMatrix();
 
 	
-	// Load intrinsic camera calibration parameters (if found).
+	// Load the calibration bundle (if found), otherwise fall back to the XML files.
 	char str1[1024], str2[1024];
-	sprintf(str1, "%s\\calib\\cam\\cam_intrinsic.xml",  sl_params.outdir);
-	sprintf(str2, "%s\\calib\\cam\\cam_distortion.xml", sl_params.outdir);
-	if( ((CvMat*)cvLoad(str1) != 0) && ((CvMat*)cvLoad(str2) != 0) ){
-		sl_calib.cam_intrinsic  = (CvMat*)cvLoad(str1);
-		sl_calib.cam_distortion = (CvMat*)cvLoad(str2);
-		sl_calib.cam_intrinsic_calib = true;
-		printf("Loaded previous intrinsic camera calibration.\n");
+	CalibrationBundle calib_bundle;
+	sprintf(str1, "%s\\calib\\calibration.bin", sl_params.outdir);
+	if(calib_bundle.Open(str1) && calib_bundle.LoadInto(&sl_params, &sl_calib) == 0){
+		printf("Loaded previous calibration bundle.\n");
+		if(!sl_calib.cam_intrinsic_calib)
+			printf("Camera has not been intrinsically calibrated!\n");
+		if(!sl_calib.proj_intrinsic_calib)
+			printf("Projector has not been intrinsically calibrated!\n");
+		if(!sl_calib.procam_extrinsic_calib)
+			printf("Projector-camera system has not been extrinsically calibrated!\n");
 	}
-	else
-		printf("Camera has not been intrinsically calibrated!\n");
-
-	//sprintf(str1, "%s\\calib\\proj\\fundamental_matrix.xml",  sl_params.outdir);
-	//if( (CvMat*)cvLoad(str1) != 0 )
-	//{
-	//	//sl_calib.fundMatrx->SetMatrix((CvMat*)cvLoad(str1));
-	//	printf("Loaded previous fundamental matrix.\n");
-	//}
-
-	// Load intrinsic projector calibration parameters (if found);
-	sprintf(str1, "%s\\calib\\proj\\proj_intrinsic.xml",  sl_params.outdir);
-	sprintf(str2, "%s\\calib\\proj\\proj_distortion.xml", sl_params.outdir);
-	if( ((CvMat*)cvLoad(str1) != 0) && ((CvMat*)cvLoad(str2) != 0) ){
-		sl_calib.proj_intrinsic  = (CvMat*)cvLoad(str1);
-		sl_calib.proj_distortion = (CvMat*)cvLoad(str2);
-		sl_calib.proj_intrinsic_calib = true;
-		printf("Loaded previous intrinsic projector calibration.\n");
+	else{
+
+		// Load intrinsic camera calibration parameters (if found).
+		sprintf(str1, "%s\\calib\\cam\\cam_intrinsic.xml",  sl_params.outdir);
+		sprintf(str2, "%s\\calib\\cam\\cam_distortion.xml", sl_params.outdir);
+		if( loadCalibrationMatrix(str1, sl_calib.cam_intrinsic) && loadCalibrationMatrix(str2, sl_calib.cam_distortion) ){
+			sl_calib.cam_intrinsic_calib = true;
+			printf("Loaded previous intrinsic camera calibration.\n");
+		}
+		else
+			printf("Camera has not been intrinsically calibrated!\n");
+
+		// Load intrinsic projector calibration parameters (if found);
+		sprintf(str1, "%s\\calib\\proj\\proj_intrinsic.xml",  sl_params.outdir);
+		sprintf(str2, "%s\\calib\\proj\\proj_distortion.xml", sl_params.outdir);
+		if( loadCalibrationMatrix(str1, sl_calib.proj_intrinsic) && loadCalibrationMatrix(str2, sl_calib.proj_distortion) ){
+			sl_calib.proj_intrinsic_calib = true;
+			printf("Loaded previous intrinsic projector calibration.\n");
+		}
+		else
+			printf("Projector has not been intrinsically calibrated!\n");
+
+		// Load extrinsic projector-camera parameters (if found).
+		sprintf(str1, "%s\\calib\\proj\\cam_extrinsic.xml",  sl_params.outdir);
+		sprintf(str2, "%s\\calib\\proj\\proj_extrinsic.xml", sl_params.outdir);
+		if( (sl_calib.cam_intrinsic_calib && sl_calib.proj_intrinsic_calib) &&
+			( loadCalibrationMatrix(str1, sl_calib.cam_extrinsic) && loadCalibrationMatrix(str2, sl_calib.proj_extrinsic) ) ){
+			sl_calib.procam_extrinsic_calib = true;
+			printf("Loaded previous extrinsic projector-camera calibration.\n");
+		}
+		else
+			printf("Projector-camera system has not been extrinsically calibrated!\n");
 	}
-	else
-		printf("Projector has not been intrinsically calibrated!\n");
-
-	// Load extrinsic projector-camera parameters (if found).
-	sprintf(str1, "%s\\calib\\proj\\cam_extrinsic.xml",  sl_params.outdir);
-	sprintf(str2, "%s\\calib\\proj\\proj_extrinsic.xml", sl_params.outdir);
-	if( (sl_calib.cam_intrinsic_calib && sl_calib.proj_intrinsic_calib) &&
-		( ((CvMat*)cvLoad(str1) != 0) && ((CvMat*)cvLoad(str2) != 0) ) ){
-		sl_calib.cam_extrinsic  = (CvMat*)cvLoad(str1);
-		sl_calib.proj_extrinsic = (CvMat*)cvLoad(str2);
-		sl_calib.procam_extrinsic_calib = true;
-		//cvCalibrateProCam.evaluateProCamGeometry(&sl_params, &sl_calib);
-		printf("Loaded previous extrinsic projector-camera calibration.\n");
+	calib_bundle.Close();
+
+	// Evaluate the projector-camera geometry (unless it was cached in the bundle), and cache it.
+	if(sl_calib.procam_extrinsic_calib && !sl_calib.procam_geometry_calib &&
+	   cvCalibrateProCam.evaluateProCamGeometry(&sl_params, &sl_calib) == 0){
+		sprintf(str1, "%s\\calib\\calibration.bin", sl_params.outdir);
+		CalibrationBundle::Save(str1, &sl_params, &sl_calib, true);
 	}
-	else
-		printf("Projector-camera system has not been extrinsically calibrated!\n");
 
 	// Initialize background model.
 	sl_calib.background_depth_map = cvCreateMat(sl_params.cam_h, sl_params.cam_w, CV_32FC1);
@@ -210,7 +290,10 @@ int main(int argc, char* argv[])
 
 		// Display a black projector image by default.
 		cvSet(proj_frame, cvScalar(0, 0, 255));
-		cvShowImage("projWindow", proj_frame);
+		if(proj_output != NULL)
+			proj_output->Show(proj_frame);
+		else
+			cvShowImage("projWindow", proj_frame);
 		cvWaitKey(1);
 
 		// Parse keystroke.
@@ -224,6 +307,14 @@ int main(int argc, char* argv[])
 			printf("\n> Calibrating camera and projector simultaneously...\n");
 			cvCalibrateProCam.runProjectorCalibration(&sl_params, &sl_calib, true);
 			config.Save();
+			if(sl_params.trace){
+				sprintf(str, "%s\\calib\\trace.json", sl_params.outdir);
+				if(Kinect::TraceExport(str))
+					printf("Saved trace to \"%s\" (open with chrome://tracing or ui.perfetto.dev).\n", str);
+				else
+					printf("ERROR: Cannot write trace file \"%s\"!\n", str);
+				Kinect::TraceStart(sl_params.trace_events);
+			}
 
             cvKey = NULL;
 		}
@@ -240,12 +331,9 @@ int main(int argc, char* argv[])
 		cvKey = _getch();
 	}
 
-    // Destory camera
+    // Destory camera (the manager deletes its cameras)
     camera->EndCapture();
-    if(camera)
-	{
-        delete camera;
-	}
+    cameraManager->CleanUp();
 
 	delete sl_calib.fundMatrx;
 
@@ -268,13 +356,17 @@ int main(int argc, char* argv[])
 	cvReleaseMat(&sl_calib.proj_rays);
 	cvReleaseMat(&sl_calib.proj_column_planes);
 	cvReleaseMat(&sl_calib.proj_row_planes);
+	releaseUndistortMaps(&sl_calib);
 	cvReleaseImage(&proj_frame);
 	cvReleaseMat(&sl_calib.background_depth_map);
 	cvReleaseImage(&sl_calib.background_image);
 	cvReleaseImage(&sl_calib.background_mask);
 
 	// Exit without errors.
-	cvDestroyWindow("projWindow");
+	if(proj_output != NULL)
+		delete proj_output;
+	else
+		cvDestroyWindow("projWindow");
 
     return 0;
 }
\ No newline at end of file
@@ -23,16 +23,23 @@ struct slParams{
 	char outdir[1024];	            // base output directory
 	char object[1024];              // object name
 	bool save;                      // enable/disable saving of image sequence
+	int  artifact_format;           // format of the debug images (0 = none, 1 = raw (uncompressed BMP), 2 = PNG)
+	int  artifact_png_compression;  // PNG compression level of the debug images (0-9, -1 = encoder default)
+	int  artifact_queue;            // number of debug images queued for the writer threads
+	int  artifact_overflow;         // action when the debug image queue is full (0 = wait, 1 = drop newest, 2 = drop oldest)
 
 	// Camera options.
 	int  cam_w;                     // camera columns
 	int  cam_h;                     // camera rows
 	bool Logitech_9000;             // enable/disable Logitech QuickCam 9000 raw-mode (should be disabled for all other cameras)
+	char frame_bus[256];            // name of the capture daemon's frame bus to read frames from (empty = open the Kinect directly)
 
 	// Projector options.
 	int  proj_w;                    // projector columns
 	int  proj_h;                    // projector rows
 	bool proj_invert;               // enable/disable inverted projector mode (i.e., camera and projector are flipped with respect to each other)
+	bool proj_scheduled;            // enable/disable the scheduled projector output (see ProjectorOutput) instead of the HighGUI window
+	float proj_period;              // period of pattern sequences on the scheduled output (in ms, 0 = every vertical refresh)
 
 	// Projector-camera gain parameters.
 	int cam_gain;                   // scale factor for camera images
@@ -56,6 +63,10 @@ struct slParams{
 	int proj_board_w_pixels;        // physical length of chessboard square (width in pixels)
 	int proj_board_h_pixels;        // physical length of chessboard square (height in pixels)
 
+	// Incremental calibration options.
+	float calib_stop_uncertainty;   // stop capturing boards once the focal length/principal point std. dev. is below this (in pixels, 0 = disabled)
+	int   calib_min_boards;         // minimum number of boards before the stop rule is evaluated
+
 	// General options.
 	int   mode;                     // structured light reconstruction mode (1 = "ray-plane", 2 = "ray-ray")
 	bool  scan_cols;                // enable/disable column scanning
@@ -66,6 +77,25 @@ struct slParams{
 	float dist_reject;              // rejection distance (for outlier removal) if row and column scanning are both enabled (in mm)
 	float background_depth_thresh;  // threshold distance for background removal (in mm)	
     bool  generate_normals;         // generate smoothed surface normals
+	int   normal_radius;            // maximum normal estimation window radius (in pixels)
+	float normal_max_depth_change;  // maximum depth change between neighbouring pixels of a surface (in mm)
+	int   outlier_neighbors;        // number of neighbours for statistical outlier removal (0 = disabled)
+	float outlier_std_ratio;        // statistical outlier threshold (standard deviations above the mean neighbour distance)
+	float outlier_radius;           // neighbourhood radius for radius outlier removal (in mm, 0 = disabled)
+	int   outlier_min_neighbors;    // minimum number of neighbours within the radius
+
+	// Latency measurement options.
+	bool  latency_probe;            // measure the projector-to-camera latency and use it instead of the frame delay
+	int   latency_changes;          // number of pattern changes measured
+	float latency_percentile;       // percentile of the measured latencies used as the capture delay
+	int   latency_margin;           // margin added to the percentile (in ms)
+	int   latency_recheck;          // measure again once the stored latency is older than this (in minutes, 0 = every calibration)
+
+	// Point export options.
+	int   export_subsample_mode;    // correspondence subsampling (1 = stratified image-space, 2 = voxel grid)
+	int   export_point_budget;      // maximum number of exported correspondences
+	float export_voxel_size;        // initial voxel size for voxel grid subsampling (in mm)
+	int   export_seed;              // random seed for subsampling (identical seeds give identical exports)
 
 	// Visualization options.
 	bool display;                   // enable/disable display of intermediate results (e.g., image sequence, calibration data, etc.)
@@ -73,11 +103,23 @@ struct slParams{
 	int window_h;                   // camera display window width (derived parameter)
     int window_offset_x;
     int window_offset_y;
+
+	// Threading options.
+	int  threads;                   // number of threads shared by all parallel work (0 = one per processor)
+	int  numa_node;                 // NUMA node whose processors run the worker threads (-1 = any processor)
+
+	// Diagnostics options.
+	bool trace;                     // enable/disable tracing of capture and calibration (written to "<outdir>\calib\trace.json" after each calibration)
+	int  trace_events;              // number of trace events kept per thread
+	int  log_level;                 // minimum level of the Kinect driver messages (0 = debug, 1 = info, 2 = warning, 3 = error, 4 = none)
 };
 
 // forward define of fundamental matrix
 class FundamentalMatrix;
 
+// forward define of the undistortion map
+class UndistortMap;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /// @struct slCalib{
 ///
@@ -120,10 +162,21 @@ struct slCalib{
 	CvMat* proj_column_planes;      // plane equations describing every projector column
 	CvMat* proj_row_planes;         // plane equations describing every projector row
 
+	// Dense undistortion tables (built on first use, see getCameraUndistortMap/getProjectorUndistortMap).
+	UndistortMap* cam_undistort_map;  // remap table for undistorting camera frames
+	UndistortMap* proj_undistort_map; // remap table for predistorting projector patterns
+
+	// Measured projector-to-camera latency (see LatencyProbe).
+	int    proj_latency;            // capture delay after a pattern change (in ms, 0 = not measured)
+	double proj_latency_time;       // time of the measurement (in seconds since 1970)
+
 	// Flags to indicate calibration status.
 	bool cam_intrinsic_calib;       // flag to indicate state of intrinsic camera calibration
     bool proj_intrinsic_calib;		// flag to indicate state of intrinsic projector calibration
 	bool procam_extrinsic_calib;    // flag to indicate state of extrinsic projector-camera calibration
+	bool procam_geometry_calib;     // flag to indicate that the projector-camera geometry has been evaluated
+	bool cam_pose_calib;            // flag to indicate that cam_rot_vec/cam_rot_mat/cam_trans hold the last camera board pose
+	bool proj_pose_calib;           // flag to indicate that proj_rot_vec/proj_rot_mat/proj_trans hold the last projector board pose
 
 	// Background model (used to segment foreground objects of interest from static background).
 	CvMat*    background_depth_map; // background depth map
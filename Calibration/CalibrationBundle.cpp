@@ -0,0 +1,374 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\CalibrationBundle.cpp
+//
+// summary:	Implements the binary calibration bundle class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "CalibrationBundle.h"
+#include "UndistortMap.h"
+#include "Kinect-Trace.h"
+
+static const char BUNDLE_MAGIC[8] = { 'O', 'L', 'C', 'A', 'L', 'I', 'B', '\0' };
+
+// CRC32 (IEEE 802.3 polynomial) lookup table.
+// Note: Built during static initialization, before any thread can save or load a bundle.
+static unsigned int crc32Table[256];
+
+static bool crc32BuildTable()
+{
+    for(unsigned int i=0; i<256; i++){
+        unsigned int c = i;
+        for(int k=0; k<8; k++)
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        crc32Table[i] = c;
+    }
+    return true;
+}
+
+static const bool crc32TableReady = crc32BuildTable();
+
+// Update a CRC32 with a block of data.
+static unsigned int crc32Update(unsigned int crc, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    for(size_t i=0; i<size; i++)
+        crc = crc32Table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Round an offset up to the section alignment.
+static unsigned int alignOffset(unsigned int offset)
+{
+    return (offset + CalibrationBundle::SECTION_ALIGNMENT - 1) & ~(unsigned int)(CalibrationBundle::SECTION_ALIGNMENT - 1);
+}
+
+CalibrationBundle::CalibrationBundle()
+{
+    mFile     = NULL;
+    mMapping  = NULL;
+    mData     = NULL;
+    mSize     = 0;
+    mHeader   = NULL;
+    mSections = NULL;
+}
+
+CalibrationBundle::~CalibrationBundle()
+{
+    Close();
+}
+
+int CalibrationBundle::Save(const char* filename, struct slParams* sl_params, struct slCalib* sl_calib, bool save_geometry)
+{
+    KINECT_TRACE_SCOPE("export.calibration_bundle");
+
+    // Collect the sections to write.
+    // Note: The board poses are only written once a calibration has filled them in (they are
+    //       not stored in the XML files the calibration may have been loaded from).
+    std::vector<int>    ids;
+    std::vector<CvMat*> mats;
+    CvMat* calib_mats[] = {
+        sl_calib->cam_intrinsic,  sl_calib->cam_distortion,  sl_calib->cam_extrinsic,
+        sl_calib->cam_rot_vec,    sl_calib->cam_rot_mat,     sl_calib->cam_trans,
+        sl_calib->proj_intrinsic, sl_calib->proj_distortion, sl_calib->proj_extrinsic,
+        sl_calib->proj_rot_vec,   sl_calib->proj_rot_mat,    sl_calib->proj_trans };
+    for(int i=0; i<12; i++){
+        bool pose = (i%6 >= 3);
+        if(pose && !(i < 6 ? sl_calib->cam_pose_calib : sl_calib->proj_pose_calib))
+            continue;
+        ids.push_back(CAM_INTRINSIC+i);
+        mats.push_back(calib_mats[i]);
+    }
+    if(save_geometry){
+        CvMat* geometry_mats[] = {
+            sl_calib->cam_center, sl_calib->proj_center, sl_calib->cam_rays,
+            sl_calib->proj_rays,  sl_calib->proj_column_planes, sl_calib->proj_row_planes };
+        for(int i=0; i<6; i++){
+            ids.push_back(CAM_CENTER+i);
+            mats.push_back(geometry_mats[i]);
+        }
+    }
+    UndistortMap* maps[] = { sl_calib->cam_undistort_map, sl_calib->proj_undistort_map };
+    for(int i=0; i<2; i++){
+        if(maps[i] != NULL && maps[i]->IsBuilt()){
+            ids.push_back(CAM_UNDISTORT_XY+2*i);
+            mats.push_back(maps[i]->GetCoordinates());
+            ids.push_back(CAM_UNDISTORT_FRAC+2*i);
+            mats.push_back(maps[i]->GetFractions());
+        }
+    }
+
+    double latency[2] = { (double)sl_calib->proj_latency, sl_calib->proj_latency_time };
+    CvMat latency_mat = cvMat(1, 2, CV_64FC1, latency);
+    if(sl_calib->proj_latency > 0){
+        ids.push_back(PROJ_LATENCY);
+        mats.push_back(&latency_mat);
+    }
+
+    // Drop the matrices that were never allocated, so the table has one entry per payload.
+    unsigned int count = 0;
+    for(unsigned int i=0; i<ids.size(); i++){
+        if(mats[i] == NULL)
+            continue;
+        ids[count]  = ids[i];
+        mats[count] = mats[i];
+        count++;
+    }
+    ids.resize(count);
+    mats.resize(count);
+
+    // Lay out the payloads after the header and the section table.
+    std::vector<Section> sections;
+    unsigned int offset = alignOffset(sizeof(Header) + (unsigned int)ids.size()*sizeof(Section));
+    for(unsigned int i=0; i<ids.size(); i++){
+        CvMat* m = mats[i];
+        Section s;
+        memset(&s, 0, sizeof(s));
+        s.id     = ids[i];
+        s.type   = CV_MAT_TYPE(m->type);
+        s.rows   = m->rows;
+        s.cols   = m->cols;
+        s.size   = m->rows*m->cols*CV_ELEM_SIZE(m->type);
+        s.offset = offset;
+        s.crc    = 0;
+        for(int r=0; r<m->rows; r++)
+            s.crc = crc32Update(s.crc, m->data.ptr + r*m->step, m->cols*CV_ELEM_SIZE(m->type));
+        sections.push_back(s);
+        offset = alignOffset(offset + s.size);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BUNDLE_MAGIC, sizeof(header.magic));
+    header.version       = BUNDLE_VERSION;
+    header.section_count = (unsigned int)sections.size();
+    header.status        = (sl_calib->cam_intrinsic_calib    ? STATUS_CAM_INTRINSIC    : 0) |
+                           (sl_calib->proj_intrinsic_calib   ? STATUS_PROJ_INTRINSIC   : 0) |
+                           (sl_calib->procam_extrinsic_calib ? STATUS_PROCAM_EXTRINSIC : 0);
+    header.cam_w         = sl_params->cam_w;
+    header.cam_h         = sl_params->cam_h;
+    header.proj_w        = sl_params->proj_w;
+    header.proj_h        = sl_params->proj_h;
+    header.table_crc     = crc32Update(0, &header, sizeof(header));
+    if(!sections.empty())
+        header.table_crc = crc32Update(header.table_crc, &sections[0], sections.size()*sizeof(Section));
+
+    // Write the header, the section table and the (aligned) payloads.
+    FILE* pFile = fopen(filename, "wb");
+    if(pFile == NULL){
+        printf("ERROR: Cannot open calibration bundle \"%s\" for writing!\n", filename);
+        return -1;
+    }
+    bool ok = (fwrite(&header, sizeof(header), 1, pFile) == 1);
+    if(ok && !sections.empty())
+        ok = (fwrite(&sections[0], sizeof(Section), sections.size(), pFile) == sections.size());
+    unsigned int position = sizeof(Header) + (unsigned int)sections.size()*sizeof(Section);
+    static const char padding[SECTION_ALIGNMENT] = { 0 };
+    for(unsigned int i=0; ok && i<sections.size(); i++){
+        CvMat* m = mats[i];
+        ok = (fwrite(padding, 1, sections[i].offset-position, pFile) == sections[i].offset-position);
+        for(int r=0; ok && r<m->rows; r++)
+            ok = (fwrite(m->data.ptr + r*m->step, m->cols*CV_ELEM_SIZE(m->type), 1, pFile) == 1);
+        position = sections[i].offset + sections[i].size;
+    }
+    if(fclose(pFile) != 0)
+        ok = false;
+    if(!ok){
+        printf("ERROR: Cannot write calibration bundle \"%s\"!\n", filename);
+        return -1;
+    }
+    return 0;
+}
+
+bool CalibrationBundle::Open(const char* filename)
+{
+    Close();
+
+    // Map the whole file (read-only).
+    mFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(mFile == INVALID_HANDLE_VALUE){
+        mFile = NULL;
+        return false;
+    }
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(mFile, &size) || size.QuadPart < (LONGLONG)sizeof(Header) || size.QuadPart > 0x7FFFFFFF){
+        printf("ERROR: Calibration bundle \"%s\" is truncated!\n", filename);
+        Close();
+        return false;
+    }
+    mSize    = (unsigned int)size.QuadPart;
+    mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mMapping != NULL)
+        mData = (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    if(mData == NULL){
+        printf("ERROR: Cannot map calibration bundle \"%s\"!\n", filename);
+        Close();
+        return false;
+    }
+
+    // Validate the header and the section table.
+    mHeader   = (const Header*)mData;
+    mSections = (const Section*)(mData + sizeof(Header));
+    bool valid = (memcmp(mHeader->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) == 0) &&
+                 (mHeader->version == BUNDLE_VERSION) &&
+                 (mHeader->section_count <= (mSize - sizeof(Header))/sizeof(Section));
+    if(valid){
+        Header header = *mHeader;
+        header.table_crc = 0;
+        unsigned int crc = crc32Update(0, &header, sizeof(header));
+        crc = crc32Update(crc, mSections, mHeader->section_count*sizeof(Section));
+        valid = (crc == mHeader->table_crc);
+    }
+
+    // Validate the payloads.
+    // Note: The payload size is computed in 64 bits from at most as many elements as the file has
+    //       bytes, so rows and columns of a corrupt table cannot overflow it into the stored size.
+    for(unsigned int i=0; valid && i<mHeader->section_count; i++){
+        const Section& s = mSections[i];
+        LONGLONG elements = (LONGLONG)s.rows*s.cols;
+        valid = (s.rows > 0) && (s.cols > 0) && (s.type == CV_MAT_TYPE(s.type)) &&
+                (elements <= (LONGLONG)mSize) && (elements*CV_ELEM_SIZE(s.type) == (LONGLONG)s.size) &&
+                (s.offset % SECTION_ALIGNMENT == 0) &&
+                (s.offset <= mSize) && (s.size <= mSize - s.offset) &&
+                (crc32Update(0, mData + s.offset, s.size) == s.crc);
+    }
+    if(!valid){
+        printf("ERROR: Calibration bundle \"%s\" is corrupt or has an unsupported version!\n", filename);
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void CalibrationBundle::Close()
+{
+    if(mData != NULL)
+        UnmapViewOfFile(mData);
+    if(mMapping != NULL)
+        CloseHandle(mMapping);
+    if(mFile != NULL)
+        CloseHandle(mFile);
+    mFile     = NULL;
+    mMapping  = NULL;
+    mData     = NULL;
+    mSize     = 0;
+    mHeader   = NULL;
+    mSections = NULL;
+}
+
+const CalibrationBundle::Section* CalibrationBundle::findSection(int id)
+{
+    if(mData == NULL)
+        return NULL;
+    for(unsigned int i=0; i<mHeader->section_count; i++)
+        if(mSections[i].id == (unsigned int)id)
+            return &mSections[i];
+    return NULL;
+}
+
+bool CalibrationBundle::HasSection(int id)
+{
+    return findSection(id) != NULL;
+}
+
+bool CalibrationBundle::HasGeometry()
+{
+    for(int id=CAM_CENTER; id<=PROJ_ROW_PLANES; id++)
+        if(!HasSection(id))
+            return false;
+    return true;
+}
+
+CvMat* CalibrationBundle::GetSection(int id, CvMat* header)
+{
+    const Section* s = findSection(id);
+    if(s == NULL)
+        return NULL;
+    return cvInitMatHeader(header, s->rows, s->cols, s->type, (void*)(mData + s->offset));
+}
+
+bool CalibrationBundle::loadSection(int id, CvMat* dst)
+{
+    CvMat header;
+    if(dst == NULL || GetSection(id, &header) == NULL)
+        return false;
+    if(header.rows != dst->rows || header.cols != dst->cols)
+        return false;
+    cvConvert(&header, dst);
+    return true;
+}
+
+int CalibrationBundle::LoadInto(struct slParams* sl_params, struct slCalib* sl_calib)
+{
+    if(mData == NULL)
+        return -1;
+    if(mHeader->cam_w  != sl_params->cam_w  || mHeader->cam_h  != sl_params->cam_h ||
+       mHeader->proj_w != sl_params->proj_w || mHeader->proj_h != sl_params->proj_h){
+        printf("ERROR: Calibration bundle resolution (%dx%d, %dx%d) does not match the configuration!\n",
+            mHeader->cam_w, mHeader->cam_h, mHeader->proj_w, mHeader->proj_h);
+        return -1;
+    }
+
+    // Load the calibration parameters.
+    CvMat* calib_mats[] = {
+        sl_calib->cam_intrinsic,  sl_calib->cam_distortion,  sl_calib->cam_extrinsic,
+        sl_calib->cam_rot_vec,    sl_calib->cam_rot_mat,     sl_calib->cam_trans,
+        sl_calib->proj_intrinsic, sl_calib->proj_distortion, sl_calib->proj_extrinsic,
+        sl_calib->proj_rot_vec,   sl_calib->proj_rot_mat,    sl_calib->proj_trans };
+    for(int i=0; i<12; i++){
+        if(i%6 >= 3)
+            continue;
+        if(!loadSection(CAM_INTRINSIC+i, calib_mats[i])){
+            printf("ERROR: Calibration bundle is missing calibration parameters!\n");
+            return -1;
+        }
+    }
+
+    // Load the board poses (if they were filled in by a calibration).
+    sl_calib->cam_pose_calib  = loadSection(CAM_ROT_VEC,  sl_calib->cam_rot_vec)  &&
+                                loadSection(CAM_ROT_MAT,  sl_calib->cam_rot_mat)  &&
+                                loadSection(CAM_TRANS,    sl_calib->cam_trans);
+    sl_calib->proj_pose_calib = loadSection(PROJ_ROT_VEC, sl_calib->proj_rot_vec) &&
+                                loadSection(PROJ_ROT_MAT, sl_calib->proj_rot_mat) &&
+                                loadSection(PROJ_TRANS,   sl_calib->proj_trans);
+    sl_calib->cam_intrinsic_calib    = (mHeader->status & STATUS_CAM_INTRINSIC)    != 0;
+    sl_calib->proj_intrinsic_calib   = (mHeader->status & STATUS_PROJ_INTRINSIC)   != 0;
+    sl_calib->procam_extrinsic_calib = (mHeader->status & STATUS_PROCAM_EXTRINSIC) != 0;
+
+    // Load the derived geometry (if available).
+    sl_calib->procam_geometry_calib = false;
+    if(HasGeometry() && sl_calib->procam_extrinsic_calib){
+        sl_calib->procam_geometry_calib =
+            loadSection(CAM_CENTER,         sl_calib->cam_center)         &&
+            loadSection(PROJ_CENTER,        sl_calib->proj_center)        &&
+            loadSection(CAM_RAYS,           sl_calib->cam_rays)           &&
+            loadSection(PROJ_RAYS,          sl_calib->proj_rays)          &&
+            loadSection(PROJ_COLUMN_PLANES, sl_calib->proj_column_planes) &&
+            loadSection(PROJ_ROW_PLANES,    sl_calib->proj_row_planes);
+    }
+
+    // Load the undistortion maps (if available and matching the configured resolutions).
+    CvMat coordinates, fractions;
+    if(GetSection(CAM_UNDISTORT_XY, &coordinates) && GetSection(CAM_UNDISTORT_FRAC, &fractions) &&
+       coordinates.cols == sl_params->cam_w && coordinates.rows == sl_params->cam_h){
+        if(sl_calib->cam_undistort_map == NULL)
+            sl_calib->cam_undistort_map = new UndistortMap();
+        sl_calib->cam_undistort_map->Load(&coordinates, &fractions);
+    }
+    if(GetSection(PROJ_UNDISTORT_XY, &coordinates) && GetSection(PROJ_UNDISTORT_FRAC, &fractions) &&
+       coordinates.cols == sl_params->proj_w && coordinates.rows == sl_params->proj_h){
+        if(sl_calib->proj_undistort_map == NULL)
+            sl_calib->proj_undistort_map = new UndistortMap();
+        sl_calib->proj_undistort_map->Load(&coordinates, &fractions);
+    }
+
+    // Load the measured latency (if available).
+    CvMat latency;
+    if(GetSection(PROJ_LATENCY, &latency) && latency.cols == 2){
+        sl_calib->proj_latency      = (int)cvmGet(&latency, 0, 0);
+        sl_calib->proj_latency_time = cvmGet(&latency, 0, 1);
+    }
+    return 0;
+}
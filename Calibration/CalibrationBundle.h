@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\CalibrationBundle.h
+//
+// summary:	Declares the binary calibration bundle class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  CalibrationBundle
+///
+/// @brief  Versioned, checksummed binary file holding a complete projector-camera calibration.
+///
+///         The file starts with a fixed header and a section table, followed by the matrix
+///         payloads (each 16-byte aligned). A bundle is opened by memory-mapping the file, so
+///         sections can be used in place or copied into the pre-allocated slCalib matrices
+///         without any XML parsing. Derived geometry (camera rays, projector planes) is stored
+///         and the undistortion maps are stored as optional sections, so they do not have
+///         to be recomputed at startup.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class CalibrationBundle
+{
+public:
+    /// <summary> Section identifiers (stored in the file, never renumber). </summary>
+    enum SectionId
+    {
+        CAM_INTRINSIC       = 1,
+        CAM_DISTORTION      = 2,
+        CAM_EXTRINSIC       = 3,
+        CAM_ROT_VEC         = 4,
+        CAM_ROT_MAT         = 5,
+        CAM_TRANS           = 6,
+        PROJ_INTRINSIC      = 7,
+        PROJ_DISTORTION     = 8,
+        PROJ_EXTRINSIC      = 9,
+        PROJ_ROT_VEC        = 10,
+        PROJ_ROT_MAT        = 11,
+        PROJ_TRANS          = 12,
+        CAM_CENTER          = 13,
+        PROJ_CENTER         = 14,
+        CAM_RAYS            = 15,
+        PROJ_RAYS           = 16,
+        PROJ_COLUMN_PLANES  = 17,
+        PROJ_ROW_PLANES     = 18,
+        CAM_UNDISTORT_XY    = 19,
+        CAM_UNDISTORT_FRAC  = 20,
+        PROJ_UNDISTORT_XY   = 21,
+        PROJ_UNDISTORT_FRAC = 22,
+        PROJ_LATENCY        = 23        // 1x2 (CV_64FC1): capture delay (ms), time measured (seconds since 1970)
+    };
+
+    enum { BUNDLE_VERSION = 1, SECTION_ALIGNMENT = 16 };
+
+    CalibrationBundle();
+    ~CalibrationBundle();
+
+    // Write the calibration to a bundle (derived geometry is only written if requested,
+    // undistortion maps whenever they have been built).
+    // Note: Returns 0 on success, -1 otherwise.
+    static int Save(const char* filename, struct slParams* sl_params, struct slCalib* sl_calib, bool save_geometry);
+
+    // Memory-map a bundle and validate its header and checksums.
+    // Note: Returns false if the file is missing, truncated, corrupt or of another version.
+    bool Open(const char* filename);
+    void Close();
+
+    bool IsOpen()                   { return mData != NULL; };
+
+    // Returns true if the bundle contains the given section.
+    bool HasSection(int id);
+
+    // Returns true if the derived projector-camera geometry is available.
+    bool HasGeometry();
+
+    // Initialize a read-only matrix header over a mapped section (no data is copied).
+    // Note: Returns NULL if the section is missing. The header is only valid while the bundle is open.
+    CvMat* GetSection(int id, CvMat* header);
+
+    // Copy the bundle into the pre-allocated calibration and set the calibration status flags.
+    // Note: Returns 0 on success, -1 if the bundle does not match the configured resolutions.
+    int LoadInto(struct slParams* sl_params, struct slCalib* sl_calib);
+
+private:
+    /// <summary> File header (followed by section_count section entries). </summary>
+    struct Header
+    {
+        char         magic[8];
+        unsigned int version;
+        unsigned int section_count;
+        unsigned int status;        // calibration status bits (see STATUS_*)
+        int          cam_w;
+        int          cam_h;
+        int          proj_w;
+        int          proj_h;
+        unsigned int table_crc;     // CRC32 of the header (with table_crc = 0) and the section table
+        unsigned int reserved[2];
+    };
+
+    /// <summary> Section table entry. </summary>
+    struct Section
+    {
+        unsigned int id;
+        int          type;          // OpenCV matrix type (e.g., CV_32FC1)
+        int          rows;
+        int          cols;
+        unsigned int offset;        // offset of the payload from the start of the file
+        unsigned int size;          // payload size in bytes (rows*cols*element size)
+        unsigned int crc;           // CRC32 of the payload
+        unsigned int reserved;
+    };
+
+    enum
+    {
+        STATUS_CAM_INTRINSIC    = 0x1,
+        STATUS_PROJ_INTRINSIC   = 0x2,
+        STATUS_PROCAM_EXTRINSIC = 0x4
+    };
+
+    const Section* findSection(int id);
+
+    // Copy a section into a pre-allocated matrix (sizes must match).
+    bool loadSection(int id, CvMat* dst);
+
+    HANDLE               mFile;
+    HANDLE               mMapping;
+    const unsigned char* mData;
+    unsigned int         mSize;
+    const Header*        mHeader;
+    const Section*       mSections;
+};
@@ -0,0 +1,1142 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\CalibrationSession.cpp
+//
+// summary:	Implements the non-blocking projector-camera calibration session class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "CalibrationSession.h"
+#include "UtilProCam.h"
+#include "CalibrationBundle.h"
+#include "IncrementalCalibration.h"
+#include "UndistortMap.h"
+#include "ArtifactWriter.h"
+#include "LatencyProbe.h"
+#include "Kinect-Trace.h"
+
+#include <time.h>
+
+using namespace std;
+using namespace cv;
+
+// Pattern id of the projector chessboard in the pattern cache.
+static const int CHESSBOARD_PATTERN = 0;
+
+// A board whose camera corners moved less than this (mean, in pixels) since the pending or the last
+// accepted board is captured again (the operator has not moved it yet).
+static const double BOARD_MOTION_PIXELS = 10.0;
+
+// Solve for the intrinsics of a camera (or projector) on the thread pool.
+class CalibrateCameraTask : public Kinect::Task
+{
+public:
+    CalibrateCameraTask(const CvMat* object_points, const CvMat* image_points, const CvMat* point_counts,
+                        CvSize image_size, CvMat* intrinsic, CvMat* distortion,
+                        CvMat* rotation_vectors, CvMat* translation_vectors, int flags)
+    {
+        mObjectPoints       = object_points;
+        mImagePoints        = image_points;
+        mPointCounts        = point_counts;
+        mImageSize          = image_size;
+        mIntrinsic          = intrinsic;
+        mDistortion         = distortion;
+        mRotationVectors    = rotation_vectors;
+        mTranslationVectors = translation_vectors;
+        mFlags              = flags;
+        mError              = -1;
+    }
+
+    virtual void Run()
+    {
+        KINECT_TRACE_SCOPE("calibration.solve");
+        mError = cvCalibrateCamera2(mObjectPoints, mImagePoints, mPointCounts, mImageSize,
+            mIntrinsic, mDistortion, mRotationVectors, mTranslationVectors, mFlags);
+    }
+
+    double GetError() { return mError; }
+
+private:
+    const CvMat* mObjectPoints;
+    const CvMat* mImagePoints;
+    const CvMat* mPointCounts;
+    CvSize mImageSize;
+    CvMat* mIntrinsic;
+    CvMat* mDistortion;
+    CvMat* mRotationVectors;
+    CvMat* mTranslationVectors;
+    int    mFlags;
+    double mError;
+};
+
+CalibrationSession::CalibrationSession(CalibrateProCam* procam, Camera* camera, struct slParams* sl_params,
+                                       struct slCalib* sl_calib, bool calibrate_both, int max_boards)
+{
+    mProCam              = procam;
+    mCamera              = camera;
+    mListener            = NULL;
+    mSlParams            = sl_params;
+    mSlCalib             = sl_calib;
+    mCalibrateBoth       = calibrate_both;
+    mMaxBoards           = max_boards;
+
+    mState               = SESSION_IDLE;
+    mStep                = STEP_HOMOGRAPHY;
+    mResult              = -1;
+    mSuccesses           = 0;
+    mRounds              = 0;
+    mConverged           = false;
+    mPattern             = NULL;
+    mPatternTime         = 0;
+    mCapture             = NULL;
+    mPending             = NULL;
+    mHomographyFrame     = NULL;
+    mDetecting           = false;
+    mSolveTask           = NULL;
+    mProbe               = NULL;
+    mDelay               = sl_params->delay;
+
+    mPatternCache        = NULL;
+    mProjChessboard      = NULL;
+    mProjPoints          = NULL;
+    mCamToProjHomography = NULL;
+    mCamBoardN           = sl_params->cam_board_w*sl_params->cam_board_h;
+    mProjBoardN          = sl_params->proj_board_w*sl_params->proj_board_h;
+    mCamBoardSize        = cvSize(sl_params->cam_board_w, sl_params->cam_board_h);
+    mProjBoardSize       = cvSize(sl_params->proj_board_w, sl_params->proj_board_h);
+    mCamImagePoints      = NULL;
+    mCamObjectPoints     = NULL;
+    mCamPointCounts      = NULL;
+    mProjImagePoints     = NULL;
+    mProjImagePoints2    = NULL;
+    mProjPointCounts     = NULL;
+    mIncrementalCalib    = NULL;
+    mDebugWriter         = NULL;
+}
+
+CalibrationSession::~CalibrationSession()
+{
+    // Neither the detection nor the solve may outlive the storage they use.
+    if(mDetecting)
+        mDetect.Wait();
+    if(mSolveTask != NULL){
+        mSolveTask->Wait();
+        delete mSolveTask;
+    }
+    delete mProbe;
+
+    releaseRound(mCapture);
+    releaseRound(mPending);
+    cvReleaseImage(&mHomographyFrame);
+    for(unsigned int i=0; i<mCamCalibImages.size(); i++)
+        cvReleaseImage(&mCamCalibImages[i]);
+    for(unsigned int i=0; i<mProjCalibImages.size(); i++)
+        cvReleaseImage(&mProjCalibImages[i]);
+    delete mIncrementalCalib;
+    delete mDebugWriter;
+    cvReleaseImage(&mProjChessboard);
+    cvReleaseMat(&mProjPoints);
+    cvReleaseMat(&mCamToProjHomography);
+    cvReleaseMat(&mCamImagePoints);
+    cvReleaseMat(&mCamObjectPoints);
+    cvReleaseMat(&mCamPointCounts);
+    cvReleaseMat(&mProjImagePoints);
+    cvReleaseMat(&mProjImagePoints2);
+    cvReleaseMat(&mProjPointCounts);
+}
+
+int CalibrationSession::Start()
+{
+    struct slParams* sl_params = mSlParams;
+    struct slCalib*  sl_calib  = mSlCalib;
+
+    // Reset projector (and camera) calibration status (will be set again, if successful.
+    sl_calib->proj_intrinsic_calib   = false;
+    sl_calib->procam_extrinsic_calib = false;
+    sl_calib->procam_geometry_calib  = false;
+    sl_calib->proj_pose_calib        = false;
+    if(mCalibrateBoth){
+        sl_calib->cam_intrinsic_calib = false;
+        sl_calib->cam_pose_calib      = false;
+    }
+
+    // Discard the undistortion maps of the previous calibration.
+    releaseUndistortMaps(sl_calib);
+
+    // Create camera calibration directory (clear previous calibration first).
+    char str[1024], calibDir[1024];
+    if(mCalibrateBoth){
+        printf("Creating camera calibration directory (overwrites existing data)...\n");
+        sprintf(calibDir, "%s\\calib\\cam", sl_params->outdir);
+        sprintf(str, "%s\\calib", sl_params->outdir);
+        _mkdir(str);
+        _mkdir(calibDir);
+        sprintf(str, "rd /s /q \"%s\"", calibDir);
+        system(str);
+        if(_mkdir(calibDir) != 0){
+            printf("ERROR: Cannot open output directory!\n");
+            fail();
+            return -1;
+        }
+    }
+    else{
+        if(!sl_calib->cam_intrinsic_calib){
+            printf("ERROR: Camera must be calibrated first or simultaneously!\n");
+            fail();
+            return -1;
+        }
+    }
+
+    // Create projector calibration directory (clear previous calibration first).
+    printf("Creating projector calibration directory (overwrites existing data)...\n");
+    sprintf(calibDir, "%s\\calib\\proj", sl_params->outdir);
+    sprintf(str, "%s\\calib", sl_params->outdir);
+    _mkdir(str);
+    _mkdir(calibDir);
+    sprintf(str, "rd /s /q \"%s\"", calibDir);
+    system(str);
+    if(_mkdir(calibDir) != 0){
+        printf("ERROR: Cannot open output directory!\n");
+        fail();
+        return -1;
+    }
+    if(mMaxBoards < 2){
+        printf("ERROR: At least two images are required!\n");
+        fail();
+        return -1;
+    }
+
+    // Generate projector calibration chessboard pattern.
+    mProjChessboard = cvCreateImage(cvSize(sl_params->proj_w, sl_params->proj_h), IPL_DEPTH_8U, 1);
+    int proj_border_cols, proj_border_rows;
+    if(mProCam->generateChessboard(sl_params, mProjChessboard, proj_border_cols, proj_border_rows) == -1){
+        fail();
+        return -1;
+    }
+
+    // Allocate storage for the accepted boards.
+    mCamImagePoints   = cvCreateMat(mMaxBoards*mCamBoardN, 2, CV_32FC1);
+    mCamObjectPoints  = cvCreateMat(mMaxBoards*mCamBoardN, 3, CV_32FC1);
+    mCamPointCounts   = cvCreateMat(mMaxBoards, 1, CV_32SC1);
+    mProjImagePoints  = cvCreateMat(mMaxBoards*mProjBoardN, 2, CV_32FC1);
+    mProjImagePoints2 = cvCreateMat(mMaxBoards*mProjBoardN, 2, CV_32FC1);
+    mProjPointCounts  = cvCreateMat(mMaxBoards, 1, CV_32SC1);
+
+    // Define image points corresponding to projector chessboard (i.e., considering projector as an inverse camera).
+    mProjPoints = cvCreateMat(mProjBoardN, 2, CV_32FC1);
+    for(int j=0; j<mProjBoardN; ++j){
+        int k = sl_params->proj_invert ? mProjBoardN-j-1 : j;
+        CV_MAT_ELEM(*mProjPoints, float, j, 0) =
+            sl_params->proj_board_w_pixels*float(k%sl_params->proj_board_w) + (float)proj_border_cols + (float)sl_params->proj_board_w_pixels - (float)0.5;
+        CV_MAT_ELEM(*mProjPoints, float, j, 1) =
+            sl_params->proj_board_h_pixels*float(k/sl_params->proj_board_w) + (float)proj_border_rows + (float)sl_params->proj_board_h_pixels - (float)0.5;
+    }
+    mCamToProjHomography = cvCreateMat(3, 3, CV_32FC1);
+    cvSetIdentity(mCamToProjHomography);
+
+    // Allocate the incremental calibration (re-estimated after every accepted board).
+    mIncrementalCalib = new ProCamIncrementalCalibration(sl_params, sl_calib, mMaxBoards, mCalibrateBoth);
+
+    // Write the debug images on background threads, so encoding never stalls the capture.
+    mDebugWriter = new ArtifactWriter(sl_params);
+
+    mPatternCache = mProCam->getPatternCache(sl_params);
+    mCapture = createRound();
+
+    // Measure the projector-to-camera latency, unless the stored measurement is recent enough.
+    mDelay = sl_params->delay;
+    if(sl_params->latency_probe){
+        double age = difftime(time(NULL), (time_t)sl_calib->proj_latency_time)/60.0;
+        if(sl_calib->proj_latency > 0 && age < sl_params->latency_recheck){
+            mDelay = sl_calib->proj_latency;
+            printf("Using the measured capture delay of %d ms (measured %.0f minutes ago).\n", mDelay, age);
+        }
+        else{
+            mProbe = new LatencyProbe(mCamera, mPatternCache, sl_params);
+            mProbe->SetListener(mListener);
+            setState(SESSION_MEASURE_LATENCY);
+            mProbe->Start();
+            return 0;
+        }
+    }
+    startCapture();
+    return 0;
+}
+
+void CalibrationSession::startCapture()
+{
+    // Determine the projector-camera homography from the projected chessboard first.
+    showPattern(STEP_HOMOGRAPHY, mPatternCache->GetPattern(CHESSBOARD_PATTERN, mProjChessboard, mSlParams->proj_gain));
+}
+
+bool CalibrationSession::Step()
+{
+    switch(mState){
+    case SESSION_MEASURE_LATENCY:
+        {
+            if(mProbe->Step())
+                break;
+
+            // The delay is stored with the calibration (the configured frame delay is used if the probe failed).
+            char str[1024];
+            mDelay = mProbe->GetDelay();
+            if(mProbe->Succeeded()){
+                mSlCalib->proj_latency      = mDelay;
+                mSlCalib->proj_latency_time = (double)time(NULL);
+            }
+            sprintf(str, "%s\\calib\\proj\\latency.txt", mSlParams->outdir);
+            mProbe->SaveLog(str);
+            delete mProbe;
+            mProbe = NULL;
+            startCapture();
+        }
+        break;
+
+    case SESSION_SHOW_PATTERN:
+        if(mListener != NULL)
+            mListener->ShowPattern(mPattern);
+        mPatternTime = GetTickCount();
+        setState(SESSION_AWAIT_FRAME);
+        break;
+
+    case SESSION_AWAIT_FRAME:
+        // Wait until the camera sees the pattern.
+        if(GetTickCount() - mPatternTime < (DWORD)mDelay)
+            break;
+        capture();
+        break;
+
+    case SESSION_DETECT:
+        // Without worker threads, the detection runs in Wait().
+        if(!mDetect.IsDone() && Kinect::GetParallelThreadCount() > 1)
+            break;
+        mDetect.Wait();
+        mDetecting = false;
+        detected();
+        break;
+
+    case SESSION_SOLVE:
+        if(mSolveTask == NULL || !mSolveTask->IsDone())
+            break;
+        mSolveTask->Wait();
+        mResult = mSolveTask->GetResult();
+        delete mSolveTask;
+        mSolveTask = NULL;
+        setState(mResult == 0 ? SESSION_DONE : SESSION_FAILED);
+        if(mListener != NULL)
+            mListener->Finished(mResult);
+        break;
+
+    default:
+        break;
+    }
+    return !IsFinished();
+}
+
+void CalibrationSession::Accept()
+{
+    if(mPending == NULL)
+        return;
+    addBoard(mPending);
+    releaseRound(mPending);
+
+    // Stop once the maximum number of boards is reached or the running estimate has converged.
+    if(mConverged || mSuccesses >= mMaxBoards){
+        startSolve();
+        return;
+    }
+
+    // A board detected meanwhile was captured before the operator saw this one; capture it again.
+    if(mState == SESSION_ACCEPT)
+        showRed();
+}
+
+void CalibrationSession::Reject()
+{
+    if(mPending == NULL)
+        return;
+    releaseRound(mPending);
+    if(mState == SESSION_ACCEPT)
+        showRed();
+}
+
+void CalibrationSession::Finish()
+{
+    if(mState == SESSION_IDLE || mState == SESSION_SOLVE || IsFinished())
+        return;
+
+    // No board is captured before the latency is known; stop the measurement and give up.
+    if(mState == SESSION_MEASURE_LATENCY){
+        printf("The latency measurement was stopped.\n");
+        delete mProbe;
+        mProbe = NULL;
+        fail();
+        return;
+    }
+    startSolve();
+}
+
+void CalibrationSession::setState(CalibrationSessionState state)
+{
+    mState = state;
+    if(mListener != NULL)
+        mListener->StateChanged(state);
+}
+
+void CalibrationSession::fail()
+{
+    if(mCalibrateBoth)
+        printf("Projector-camera calibration was not successful and must be repeated.\n");
+    else
+        printf("Projector calibration was not successful and must be repeated.\n");
+    mResult = -1;
+    setState(SESSION_FAILED);
+    if(mListener != NULL)
+        mListener->Finished(mResult);
+}
+
+void CalibrationSession::showPattern(RoundStep step, IplImage* pattern)
+{
+    mStep    = step;
+    mPattern = pattern;
+    setState(SESSION_SHOW_PATTERN);
+}
+
+void CalibrationSession::showRed()
+{
+    // Rendered again every round, so gain changes are applied.
+    showPattern(STEP_CAMERA_BOARD, mPatternCache->GetSolid(cvScalar(0.0, 0.0, 255.0), mSlParams->proj_gain));
+}
+
+void CalibrationSession::startDetect(IplImage* frame, CvSize board_size, CvPoint2D32f* corners)
+{
+    mDetectTask.mProCam      = mProCam;
+    mDetectTask.mFrame       = frame;
+    mDetectTask.mSize        = board_size;
+    mDetectTask.mCorners     = corners;
+    mDetectTask.mCornerCount = 0;
+    mDetectTask.mFound       = 0;
+    mDetecting = true;
+    setState(SESSION_DETECT);
+    mDetect.Run(&mDetectTask);
+}
+
+void CalibrationSession::capture()
+{
+    struct slParams* sl_params = mSlParams;
+    Round* round = mCapture;
+    ostringstream os;
+
+    switch(mStep){
+    case STEP_HOMOGRAPHY:
+        cvReleaseImage(&mHomographyFrame);
+        mHomographyFrame = mCamera->QueryFrame();
+        cvScale(mHomographyFrame, mHomographyFrame, 2.*(sl_params->cam_gain/100.), 0);
+        startDetect(mHomographyFrame, mProjBoardSize, round->camCorners);
+        break;
+
+    case STEP_CAMERA_BOARD:
+        cvReleaseImage(&round->camFrame);
+        round->camFrame = mCamera->QueryFrameR();
+        cvScale(round->camFrame, round->camFrame, 2.*(sl_params->cam_gain/100.), 0);
+        startDetect(round->camFrame, mCamBoardSize, round->camCorners);
+        break;
+
+    case STEP_WHITE:
+        cvReleaseImage(&round->whiteFrame);
+        round->whiteFrame = mCamera->QueryFrameGray();
+        os << "CameraImage" << 5*mRounds+1;
+        mDebugWriter->Write(os.str().c_str(), round->whiteFrame);
+        if(mListener != NULL)
+            mListener->ShowPreview(VIEW_PROJECTOR, round->whiteFrame);
+
+        // Display projector chessboard, warped based on the camera checkerboard and the precomputed proCam homography.
+        mDebugWriter->Write("projFrame", mProjChessboard);
+        mDebugWriter->Write("cam_frame", round->camFrame);
+        mDebugWriter->Write("projWarp", mPatternCache->GetPattern(CHESSBOARD_PATTERN, mProjChessboard, 50, round->projToProj, 255.0));
+        showPattern(STEP_PROJECTOR_BOARD,
+            mPatternCache->GetPattern(CHESSBOARD_PATTERN, mProjChessboard, sl_params->proj_gain, round->projToProj, 255.0));
+        break;
+
+    case STEP_PROJECTOR_BOARD:
+        {
+            cvReleaseImage(&round->boardFrame);
+            round->boardFrame = mCamera->QueryFrameGray();
+            if(mListener != NULL)
+                mListener->ShowPreview(VIEW_PROJECTOR, round->boardFrame);
+            os << "CameraImage" << 5*mRounds+2;
+            mDebugWriter->Write(os.str().c_str(), round->boardFrame);
+
+            // Apply background subtraction.
+            cvSub(round->whiteFrame, round->boardFrame, round->boardFrame);
+            os.str("");
+            os << "CameraImage" << 5*mRounds+3;
+            mDebugWriter->Write(os.str().c_str(), round->boardFrame);
+
+            // Invert chessboard image.
+            double min_val, max_val;
+            cvMinMaxLoc(round->boardFrame, &min_val, &max_val);
+            cvConvertScale(round->boardFrame, round->boardFrame,
+                -255.0/(max_val-min_val), 255.0+((255.0*min_val)/(max_val-min_val)));
+            startDetect(round->boardFrame, mProjBoardSize, round->projCorners);
+        }
+        break;
+    }
+}
+
+void CalibrationSession::detected()
+{
+    Round* round = mCapture;
+    int corner_count = mDetectTask.mCornerCount;
+    int found = mDetectTask.mFound;
+    ostringstream os;
+
+    switch(mStep){
+    case STEP_HOMOGRAPHY:
+        {
+            cvDrawChessboardCorners(mHomographyFrame, mProjBoardSize, round->camCorners, corner_count, found);
+            if(mListener != NULL)
+                mListener->ShowPreview(VIEW_CAMERA, mHomographyFrame);
+
+            // If we see the projected checkerboard pattern, map the camera onto the projector.
+            bool capturedH = false;
+            if(corner_count == mProjBoardN){
+                CvMat* cam_src = cvCreateMat(mProjBoardN, 3, CV_32FC1);
+                CvMat* cam_dst = cvCreateMat(mProjBoardN, 3, CV_32FC1);
+                for(int j=0; j<mProjBoardN; ++j){
+                    CV_MAT_ELEM(*cam_src, float, j, 0) = round->camCorners[j].x;
+                    CV_MAT_ELEM(*cam_src, float, j, 1) = round->camCorners[j].y;
+                    CV_MAT_ELEM(*cam_src, float, j, 2) = 1.0;
+                    CV_MAT_ELEM(*cam_dst, float, j, 0) = CV_MAT_ELEM(*mProjPoints, float, j, 0);
+                    CV_MAT_ELEM(*cam_dst, float, j, 1) = CV_MAT_ELEM(*mProjPoints, float, j, 1);
+                    CV_MAT_ELEM(*cam_dst, float, j, 2) = 1.0;
+                }
+                {
+                    KINECT_TRACE_SCOPE("calibration.homography");
+                    cvFindHomography(cam_src, cam_dst, mCamToProjHomography);
+                }
+                cvReleaseMat(&cam_src);
+                cvReleaseMat(&cam_dst);
+                capturedH = true;
+            }
+
+            IplImage* cam_warp = cvCreateImage(cvGetSize(mHomographyFrame), IPL_DEPTH_8U, mHomographyFrame->nChannels);
+            mDebugWriter->Write("cam_frame_homography", mHomographyFrame);
+            cvWarpPerspective(mHomographyFrame, cam_warp, mCamToProjHomography);
+            mDebugWriter->Write("cam_warp", cam_warp);
+            cvReleaseImage(&cam_warp);
+            cvReleaseImage(&mHomographyFrame);
+
+            // Capture again until the homography is found.
+            if(capturedH)
+                showRed();
+            else
+                setState(SESSION_AWAIT_FRAME);
+        }
+        break;
+
+    case STEP_CAMERA_BOARD:
+        {
+            IplImage* cam_frame_BGR = Gray2BGR(round->camFrame);
+            cvDrawChessboardCorners(cam_frame_BGR, mCamBoardSize, round->camCorners, corner_count, found);
+            if(mListener != NULL)
+                mListener->ShowPreview(VIEW_CAMERA, cam_frame_BGR);
+            cvReleaseImage(&cam_frame_BGR);
+            if(corner_count != mCamBoardN || !boardMoved(round)){
+                showRed();
+                break;
+            }
+
+            // Calculate projector points.
+            // Note: The corners of the printed chessboard define the homography (it must have at least
+            //       as many corners as the projector chessboard).
+            CvMat* projToCamHomography = cvCreateMat(3, 3, CV_32FC1);
+            CvMat* cam_src = cvCreateMat(mProjBoardN, 3, CV_32FC1);
+            CvMat* cam_dst = cvCreateMat(mProjBoardN, 3, CV_32FC1);
+            for(int j=0; j<mProjBoardN; ++j){
+                CV_MAT_ELEM(*cam_src, float, j, 0) = round->camCorners[j].x;
+                CV_MAT_ELEM(*cam_src, float, j, 1) = round->camCorners[j].y;
+                CV_MAT_ELEM(*cam_src, float, j, 2) = 1.0;
+                CV_MAT_ELEM(*cam_dst, float, j, 0) = CV_MAT_ELEM(*mProjPoints, float, j, 0);
+                CV_MAT_ELEM(*cam_dst, float, j, 1) = CV_MAT_ELEM(*mProjPoints, float, j, 1);
+                CV_MAT_ELEM(*cam_dst, float, j, 2) = 1.0;
+            }
+            {
+                KINECT_TRACE_SCOPE("calibration.homography");
+                cvFindHomography(cam_dst, cam_src, projToCamHomography);
+            }
+            cvReleaseMat(&cam_src);
+            cvReleaseMat(&cam_dst);
+            cvMatMul(mCamToProjHomography, projToCamHomography, round->projToProj);
+            cvReleaseMat(&projToCamHomography);
+
+            // Red light checkerboard detection successful.
+            os << "CameraImage" << 5*mRounds;
+            mDebugWriter->Write(os.str().c_str(), round->camFrame);
+
+            // Get a white checkboard image.
+            // Note: The white frame is shown without projector gain (a gain of 50 is the identity).
+            showPattern(STEP_WHITE, mPatternCache->GetSolid(cvScalar(255.0, 255.0, 255.0), 50));
+        }
+        break;
+
+    case STEP_WHITE:
+        break;
+
+    case STEP_PROJECTOR_BOARD:
+        {
+            // Display current projector tracking results.
+            IplImage* cam_frame_BGR = Gray2BGR(round->boardFrame);
+            cvDrawChessboardCorners(cam_frame_BGR, mProjBoardSize, round->projCorners, corner_count, found);
+            if(mListener != NULL)
+                mListener->ShowPreview(VIEW_PROJECTOR, cam_frame_BGR);
+            cvReleaseImage(&cam_frame_BGR);
+            os << "CameraImage" << 5*mRounds+4;
+            mDebugWriter->Write(os.str().c_str(), round->boardFrame);
+
+            round->projCornerCount = corner_count;
+            if(corner_count != mProjBoardN)
+                showRed();
+            else if(mPending == NULL)
+                promote();
+            else
+                setState(SESSION_ACCEPT);
+        }
+        break;
+    }
+}
+
+void CalibrationSession::promote()
+{
+    mPending = mCapture;
+    mCapture = createRound();
+    mRounds++;
+    if(mListener != NULL)
+        mListener->BoardDetected(mSuccesses+1);
+    showRed();
+}
+
+bool CalibrationSession::boardMoved(const Round* round)
+{
+    double pending = 0, accepted = 0;
+    for(int j=0; j<mCamBoardN; ++j){
+        if(mPending != NULL){
+            double dx = round->camCorners[j].x - mPending->camCorners[j].x;
+            double dy = round->camCorners[j].y - mPending->camCorners[j].y;
+            pending += sqrt(dx*dx + dy*dy);
+        }
+        if(mSuccesses > 0){
+            int i = (mSuccesses-1)*mCamBoardN + j;
+            double dx = round->camCorners[j].x - CV_MAT_ELEM(*mCamImagePoints, float, i, 0);
+            double dy = round->camCorners[j].y - CV_MAT_ELEM(*mCamImagePoints, float, i, 1);
+            accepted += sqrt(dx*dx + dy*dy);
+        }
+    }
+    if((mPending != NULL && pending < BOARD_MOTION_PIXELS*mCamBoardN) ||
+       (mSuccesses > 0 && accepted < BOARD_MOTION_PIXELS*mCamBoardN))
+        return false;
+    return true;
+}
+
+void CalibrationSession::addBoard(Round* round)
+{
+    struct slParams* sl_params = mSlParams;
+    int successes = mSuccesses;
+
+    // Add camera calibration data.
+    for(int i=successes*mCamBoardN, j=0; j<mCamBoardN; ++i,++j){
+        CV_MAT_ELEM(*mCamImagePoints,  float, i, 0) = round->camCorners[j].x;
+        CV_MAT_ELEM(*mCamImagePoints,  float, i, 1) = round->camCorners[j].y;
+        CV_MAT_ELEM(*mCamObjectPoints, float, i, 0) = sl_params->cam_board_w_mm*float(j/sl_params->cam_board_w);
+        CV_MAT_ELEM(*mCamObjectPoints, float, i, 1) = sl_params->cam_board_h_mm*float(j%sl_params->cam_board_w);
+        CV_MAT_ELEM(*mCamObjectPoints, float, i, 2) = 0.0f;
+    }
+    CV_MAT_ELEM(*mCamPointCounts, int, successes, 0) = mCamBoardN;
+    mCamCalibImages.push_back(cvCloneImage(round->camFrame));
+
+    // Define projector points (the projector chessboard corners at their warped position).
+    const CvMat* H = round->projToProj;
+    for(int j=0; j<mProjBoardN; ++j){
+        double x = CV_MAT_ELEM(*mProjPoints, float, j, 0);
+        double y = CV_MAT_ELEM(*mProjPoints, float, j, 1);
+        double w = cvmGet(H, 2, 0)*x + cvmGet(H, 2, 1)*y + cvmGet(H, 2, 2);
+        CV_MAT_ELEM(*mProjImagePoints2, float, mProjBoardN*successes+j, 0) = (float)((cvmGet(H, 0, 0)*x + cvmGet(H, 0, 1)*y + cvmGet(H, 0, 2))/w);
+        CV_MAT_ELEM(*mProjImagePoints2, float, mProjBoardN*successes+j, 1) = (float)((cvmGet(H, 1, 0)*x + cvmGet(H, 1, 1)*y + cvmGet(H, 1, 2))/w);
+    }
+
+    // Add projector calibration data.
+    for(int i=successes*mProjBoardN, j=0; j<mProjBoardN; ++i,++j){
+        CV_MAT_ELEM(*mProjImagePoints, float, i, 0) = round->projCorners[j].x;
+        CV_MAT_ELEM(*mProjImagePoints, float, i, 1) = round->projCorners[j].y;
+    }
+    CV_MAT_ELEM(*mProjPointCounts, int, successes, 0) = mProjBoardN;
+    mProjCalibImages.push_back(cvCloneImage(round->boardFrame));
+
+    // Update display.
+    successes = ++mSuccesses;
+    printf("*%d Captured frame %d of %d.\n", successes, successes, mMaxBoards);
+
+    // Update the running calibration and stop once the intrinsics are sufficiently constrained.
+    CvMat cam_image_view, cam_object_view, proj_cam_view, proj_image_view;
+    mIncrementalCalib->AddBoard(
+        cvGetRows(mCamImagePoints,   &cam_image_view,  (successes-1)*mCamBoardN,  successes*mCamBoardN),
+        cvGetRows(mCamObjectPoints,  &cam_object_view, (successes-1)*mCamBoardN,  successes*mCamBoardN),
+        cvGetRows(mProjImagePoints,  &proj_cam_view,   (successes-1)*mProjBoardN, successes*mProjBoardN),
+        cvGetRows(mProjImagePoints2, &proj_image_view, (successes-1)*mProjBoardN, successes*mProjBoardN));
+    mIncrementalCalib->DisplayProgress();
+    if(mIncrementalCalib->IsConverged()){
+        printf("Calibration converged after %d boards (uncertainty below %.2f pixels).\n",
+            successes, sl_params->calib_stop_uncertainty);
+        mConverged = true;
+    }
+    if(mListener != NULL)
+        mListener->BoardAccepted(mSuccesses, mMaxBoards, mConverged);
+}
+
+void CalibrationSession::startSolve()
+{
+    // The round being captured is not needed anymore.
+    if(mDetecting){
+        mDetect.Wait();
+        mDetecting = false;
+    }
+    releaseRound(mPending);
+    setState(SESSION_SOLVE);
+    mSolveTask = new SolveTask(this);
+    mSolveTask->Start();
+}
+
+CalibrationSession::Round* CalibrationSession::createRound()
+{
+    Round* round = new Round;
+    round->camFrame        = NULL;
+    round->whiteFrame      = NULL;
+    round->boardFrame      = NULL;
+    round->camCorners      = new CvPoint2D32f[MAX(mCamBoardN, mProjBoardN)];
+    round->camCornerCount  = 0;
+    round->projCorners     = new CvPoint2D32f[mProjBoardN];
+    round->projCornerCount = 0;
+    round->projToProj      = cvCreateMat(3, 3, CV_32FC1);
+    return round;
+}
+
+void CalibrationSession::releaseRound(Round*& round)
+{
+    if(round == NULL)
+        return;
+    cvReleaseImage(&round->camFrame);
+    cvReleaseImage(&round->whiteFrame);
+    cvReleaseImage(&round->boardFrame);
+    delete[] round->camCorners;
+    delete[] round->projCorners;
+    cvReleaseMat(&round->projToProj);
+    delete round;
+    round = NULL;
+}
+
+// Solve and save the calibration from the accepted boards.
+int CalibrationSession::solve()
+{
+    KINECT_TRACE_SCOPE("calibration.round");
+    struct slParams* sl_params = mSlParams;
+    struct slCalib*  sl_calib  = mSlCalib;
+    bool calibrate_both        = mCalibrateBoth;
+    int successes              = mSuccesses;
+    int cam_board_n            = mCamBoardN;
+    int proj_board_n           = mProjBoardN;
+    CvMat* cam_image_points    = mCamImagePoints;
+    CvMat* cam_object_points   = mCamObjectPoints;
+    CvMat* cam_point_counts    = mCamPointCounts;
+    CvMat* proj_image_points   = mProjImagePoints;
+    CvMat* proj_image_points2  = mProjImagePoints2;
+    CvMat* proj_point_counts   = mProjPointCounts;
+    char str[1024], calibDir[1024];
+    sprintf(calibDir, "%s\\calib\\proj", sl_params->outdir);
+
+    // Calibrate projector, if minimum number of frames are available.
+    if(successes >= 2){
+
+        // Allocate calibration matrices.
+        CvMat* cam_object_points2       = cvCreateMat(successes*cam_board_n, 3, CV_32FC1);
+        CvMat* cam_image_points2        = cvCreateMat(successes*cam_board_n, 2, CV_32FC1);
+        CvMat* cam_point_counts2        = cvCreateMat(successes, 1, CV_32SC1);
+        CvMat* cam_rotation_vectors     = cvCreateMat(successes, 3, CV_32FC1);
+        CvMat* cam_translation_vectors  = cvCreateMat(successes, 3, CV_32FC1);
+        CvMat* proj_object_points2      = cvCreateMat(successes*proj_board_n, 3, CV_32FC1);
+        //CvMat* proj_image_points2       = cvCreateMat(successes*proj_board_n, 2, CV_32FC1);
+        CvMat* proj_point_counts2       = cvCreateMat(successes, 1, CV_32SC1);
+        CvMat* proj_rotation_vectors    = cvCreateMat(successes, 3, CV_32FC1);
+        CvMat* proj_translation_vectors = cvCreateMat(successes, 3, CV_32FC1);
+
+        // Transfer camera calibration data from captured values.
+        CvMat captured_rows;
+        cvCopy(cvGetRows(cam_image_points,  &captured_rows, 0, successes*cam_board_n), cam_image_points2);
+        cvCopy(cvGetRows(cam_object_points, &captured_rows, 0, successes*cam_board_n), cam_object_points2);
+        cvCopy(cvGetRows(cam_point_counts,  &captured_rows, 0, successes),             cam_point_counts2);
+        cvCopy(cvGetRows(proj_point_counts, &captured_rows, 0, successes),             proj_point_counts2);
+
+        // Warm-start the final solutions from the running estimates.
+        bool warm_start = mIncrementalCalib->GetEstimates(sl_calib);
+
+        // Start the camera solve on the thread pool (if camera calibration is enabled).
+        CalibrateCameraTask* cam_task = NULL;
+        Kinect::TaskGroup cam_solve;
+        if(calibrate_both){
+            printf("Calibrating camera...\n");
+            int calib_flags = warm_start ? CV_CALIB_USE_INTRINSIC_GUESS : 0;
+            if(!sl_params->cam_dist_model[0])
+                calib_flags |= CV_CALIB_ZERO_TANGENT_DIST;
+            if(!sl_params->cam_dist_model[1]){
+                cvmSet(sl_calib->cam_distortion, 4, 0, 0);
+                calib_flags |= CV_CALIB_FIX_K3;
+            }
+            cam_task = new CalibrateCameraTask(cam_object_points2, cam_image_points2, cam_point_counts2,
+                cvSize(sl_params->cam_w, sl_params->cam_h),
+                sl_calib->cam_intrinsic, sl_calib->cam_distortion,
+                cam_rotation_vectors, cam_translation_vectors, calib_flags);
+            cam_solve.Run(cam_task);
+        }
+
+        // Save the calibration images while the camera and the projector are solved.
+        // Note: The queue holds every image, so none is dropped; the writer is flushed after the solves.
+        printf("Saving calibration images...\n");
+        ArtifactWriter calib_writer(ArtifactWriter::FORMAT_PNG, -1, 3*successes,
+            ArtifactWriter::OVERFLOW_BLOCK, Kinect::GetParallelThreadCount());
+        char camCalibDir[1024], projCalibDir[1024];
+        sprintf(camCalibDir,  "%s\\calib\\cam",  sl_params->outdir);
+        sprintf(projCalibDir, "%s\\calib\\proj", sl_params->outdir);
+        {
+            KINECT_TRACE_SCOPE("export.calibration_images");
+            for(int i=0; i<successes; ++i){
+                if(calibrate_both){
+                    sprintf(str,"%s\\%0.2d", camCalibDir, i);
+                    calib_writer.Write(str, mCamCalibImages[i]);
+                }
+                sprintf(str,"%s\\%0.2d", projCalibDir, i);
+                calib_writer.Write(str, mProjCalibImages[i]);
+                sprintf(str,"%s\\%0.2db", projCalibDir, i);
+                calib_writer.Write(str, mCamCalibImages[i]);
+            }
+        }
+
+        // Save the camera calibration parameters.
+        if(calibrate_both){
+            cam_solve.Wait();
+            double camCalibrationError = cam_task->GetError();
+            delete cam_task;
+            printf("***Camera Calibration succeeded with error: %f\n", camCalibrationError);
+
+            CvMat* camCalibrationErrorMat = cvCreateMat(1, 1, CV_32FC1);
+            camCalibrationErrorMat->data.fl[0] = camCalibrationError;
+            sprintf(str, "%s\\calibrationError.xml", calibDir);
+            cvSave(str, camCalibrationErrorMat);
+            cvReleaseMat(&camCalibrationErrorMat);
+
+            printf("Saving calibration parameters...\n");
+            sprintf(calibDir, "%s", camCalibDir);
+            cvGetRow(cam_rotation_vectors, sl_calib->cam_rot_vec, successes-1);
+            cvGetRow(cam_translation_vectors, sl_calib->cam_trans, successes-1);
+            cvRodrigues2(sl_calib->cam_rot_vec, sl_calib->cam_rot_mat, NULL);
+            sl_calib->cam_pose_calib = true;
+
+            sprintf(str,"%s\\cam_object_points2.xml", calibDir);
+            cvSave(str, cam_object_points2);
+            sprintf(str,"%s\\cam_image_points2.xml", calibDir);
+            cvSave(str, cam_image_points2);
+            sprintf(str,"%s\\cam_intrinsic.xml", calibDir);
+            cvSave(str, sl_calib->cam_intrinsic);
+            sprintf(str,"%s\\cam_distortion.xml", calibDir);
+            cvSave(str, sl_calib->cam_distortion);
+            sprintf(str,"%s\\cam_rotation_vectors.xml", calibDir);
+            cvSave(str, sl_calib->cam_rot_vec);
+            sprintf(str,"%s\\cam_translation_vectors.xml", calibDir);
+            cvSave(str, sl_calib->cam_trans);
+            sl_calib->cam_intrinsic_calib = true;
+        }
+
+        // Transfer projector calibration data from captured values.
+        // Note: Views are independent, so they are mapped onto the chessboard plane in parallel.
+        mapProjectorCornersToBoards(cam_image_points, cam_object_points, proj_image_points,
+            sl_calib->cam_intrinsic, sl_calib->cam_distortion, proj_object_points2, cam_board_n, proj_board_n, successes);
+
+        // Start the projector solve on the thread pool.
+        printf("Calibrating projector...\n");
+        int calib_flags = warm_start ? CV_CALIB_USE_INTRINSIC_GUESS : 0;
+        if(!sl_params->proj_dist_model[0])
+            calib_flags |= CV_CALIB_ZERO_TANGENT_DIST;
+        if(!sl_params->proj_dist_model[1]){
+            cvmSet(sl_calib->proj_distortion, 4, 0, 0);
+            calib_flags |= CV_CALIB_FIX_K3;
+        }
+        CalibrateCameraTask proj_task(
+            proj_object_points2, proj_image_points2, proj_point_counts2,
+            cvSize(sl_params->proj_w, sl_params->proj_h),
+            sl_calib->proj_intrinsic, sl_calib->proj_distortion,
+            proj_rotation_vectors, proj_translation_vectors, calib_flags);
+        Kinect::TaskGroup proj_solve;
+        proj_solve.Run(&proj_task);
+
+        // Save the camera calibration parameters (in case camera is recalibrated) while the projector is solved.
+        sprintf(str,"%s\\cam_intrinsic.xml", projCalibDir);
+        cvSave(str, sl_calib->cam_intrinsic);
+        sprintf(str,"%s\\cam_distortion.xml", projCalibDir);
+        cvSave(str, sl_calib->cam_distortion);
+        sprintf(str,"%s\\cam_rotation_vectors.xml", projCalibDir);
+        cvSave(str, cam_rotation_vectors);
+        sprintf(str,"%s\\cam_translation_vectors.xml", projCalibDir);
+        cvSave(str, cam_translation_vectors);
+        CvMat* cam_dim = cvCreateMat(2, 1, CV_32FC1);
+        cvmSet(cam_dim, 0, 0, sl_params->cam_w);
+        cvmSet(cam_dim, 1, 0, sl_params->cam_h);
+        sprintf(str,"%s\\cam_dimensions.xml", projCalibDir);
+        cvSave(str, cam_dim);
+        cvReleaseMat(&cam_dim);
+
+        proj_solve.Wait();
+        double projCalibrationError = proj_task.GetError();
+
+        // Create projector extrinsics with the camera as the origin
+        //  instead of the final calibration target as the origin
+        //CvMat* proj_extrinsic_cam_ref = cvCreateMat(
+
+
+        printf("***Projector Calibration succeeded with error: %f\n", projCalibrationError);
+        sprintf(str, "%s\\projCalibrationError.xml", calibDir);
+        CvMat* projCalibrationErrorMat = cvCreateMat(1, 1, CV_32FC1);
+        projCalibrationErrorMat->data.fl[0] = projCalibrationError;
+        cvSave(str, projCalibrationErrorMat);
+        cvReleaseMat(&projCalibrationErrorMat);
+
+        printf("Saving calibration parameters...\n");
+        sprintf(calibDir, "%s", projCalibDir);
+        CvMat* r = cvCreateMat(1, 3, CV_32FC1);
+        cvGetRow(proj_rotation_vectors, sl_calib->proj_rot_vec, successes-1);
+        cvGetRow(proj_translation_vectors, sl_calib->proj_trans, successes-1);
+        cvRodrigues2(sl_calib->proj_rot_vec, sl_calib->proj_rot_mat, NULL);
+        sl_calib->proj_pose_calib = true;
+
+        sprintf(str,"%s\\proj_intrinsic.xml", calibDir);
+        cvSave(str, sl_calib->proj_intrinsic);
+        sprintf(str,"%s\\proj_distortion.xml", calibDir);
+        cvSave(str, sl_calib->proj_distortion);
+        sprintf(str,"%s\\proj_rotation_vectors.xml", calibDir);
+        cvSave(str, proj_rotation_vectors);
+        sprintf(str,"%s\\proj_translation_vectors.xml", calibDir);
+        cvSave(str, proj_translation_vectors);
+
+        //// Calculate the fundamental matrix between the two elements.
+        //sl_calib->fundMatrx->ComputeFundamentalMatrix();
+        //CvMat* fundMat = sl_calib->fundMatrx->GetMatrix();
+        //printf("Fund Mat: ");
+        //for(int row = 0; row < 3; row++)
+        //{
+        //  for(int col = 0; col < 3; col++)
+        //  {
+        //      printf("%f ", cvmGet(fundMat, row, col));
+        //  }
+        //}
+        //printf("\n");
+
+        // Save extrinsic calibration of projector-camera system.
+        // Note: First calibration image is used to define extrinsic calibration.
+        CvMat* cam_object_points_00      = cvCreateMat(cam_board_n, 3, CV_32FC1);
+        CvMat* cam_image_points_00       = cvCreateMat(cam_board_n, 2, CV_32FC1);
+        CvMat* cam_rotation_vector_00    = cvCreateMat(1, 3, CV_32FC1);
+        CvMat* cam_translation_vector_00 = cvCreateMat(1, 3, CV_32FC1);
+        if(!calibrate_both){
+            for(int i=0; i<cam_board_n; ++i){
+                CV_MAT_ELEM(*cam_image_points_00,  float, i, 0) = CV_MAT_ELEM(*cam_image_points2,  float, i, 0);
+                CV_MAT_ELEM(*cam_image_points_00,  float, i, 1) = CV_MAT_ELEM(*cam_image_points2,  float, i, 1);
+                CV_MAT_ELEM(*cam_object_points_00, float, i, 0) = CV_MAT_ELEM(*cam_object_points2, float, i, 0);
+                CV_MAT_ELEM(*cam_object_points_00, float, i, 1) = CV_MAT_ELEM(*cam_object_points2, float, i, 1);
+                CV_MAT_ELEM(*cam_object_points_00, float, i, 2) = CV_MAT_ELEM(*cam_object_points2, float, i, 2);
+            }
+            cvFindExtrinsicCameraParams2(
+                cam_object_points_00, cam_image_points_00,
+                sl_calib->cam_intrinsic, sl_calib->cam_distortion,
+                cam_rotation_vector_00, cam_translation_vector_00);
+            for(int i=0; i<3; i++)
+                CV_MAT_ELEM(*sl_calib->cam_extrinsic, float, 0, i) = (float)cvmGet(cam_rotation_vector_00, 0, i);
+            for(int i=0; i<3; i++)
+                CV_MAT_ELEM(*sl_calib->cam_extrinsic, float, 1, i) = (float)cvmGet(cam_translation_vector_00, 0, i);
+        }
+        else{
+            for(int i=0; i<3; i++)
+                CV_MAT_ELEM(*sl_calib->cam_extrinsic, float, 0, i) = (float)cvmGet(cam_rotation_vectors, 0, i);
+            for(int i=0; i<3; i++)
+                CV_MAT_ELEM(*sl_calib->cam_extrinsic, float, 1, i) = (float)cvmGet(cam_translation_vectors, 0, i);
+        }
+        sprintf(str, "%s\\cam_extrinsic.xml", calibDir);
+        cvSave(str, sl_calib->cam_extrinsic);
+        //sprintf(str, "%s\\fundamental_matrix.xml", calibDir);
+        //cvSave(str, sl_calib->fundMatrx->GetMatrix());
+
+        for(int i=0; i<3; i++)
+            CV_MAT_ELEM(*sl_calib->proj_extrinsic, float, 0, i) = (float)cvmGet(proj_rotation_vectors, 0, i);
+        for(int i=0; i<3; i++)
+            CV_MAT_ELEM(*sl_calib->proj_extrinsic, float, 1, i) = (float)cvmGet(proj_translation_vectors, 0, i);
+        sprintf(str, "%s\\proj_extrinsic.xml", calibDir);
+        cvSave(str, sl_calib->proj_extrinsic);
+
+        // get the projector in the coordinate system of the camera
+
+        // Camera extrinsic matrix
+
+        // convert to the new matrix representation
+        Mat cam_rot_mat2(sl_calib->cam_rot_mat);
+        PrintMatrix("cam_rot_mat2", cam_rot_mat2);
+        Mat cam_trans2(sl_calib->cam_trans);
+        PrintMatrix("cam_trans2", cam_trans2);
+
+        // Mat cam_ext_mat
+        // r11 r12 r13  t1
+        // r21 r22 r23  t2
+        // r31 r32 r33  t3
+        //   0   0   0   1
+        Mat cam_ext_mat = Mat::zeros(4, 4, CV_32F);
+        cam_ext_mat.at<float>(0,0) = cam_rot_mat2.at<float>(0,0);
+        cam_ext_mat.at<float>(0,1) = cam_rot_mat2.at<float>(0,1);
+        cam_ext_mat.at<float>(0,2) = cam_rot_mat2.at<float>(0,2);
+        cam_ext_mat.at<float>(1,0) = cam_rot_mat2.at<float>(1,0);
+        cam_ext_mat.at<float>(1,1) = cam_rot_mat2.at<float>(1,1);
+        cam_ext_mat.at<float>(1,2) = cam_rot_mat2.at<float>(1,2);
+        cam_ext_mat.at<float>(2,0) = cam_rot_mat2.at<float>(2,0);
+        cam_ext_mat.at<float>(2,1) = cam_rot_mat2.at<float>(2,1);
+        cam_ext_mat.at<float>(2,2) = cam_rot_mat2.at<float>(2,2);
+
+        cam_ext_mat.at<float>(0,3) = cam_trans2.at<float>(0,0);
+        cam_ext_mat.at<float>(1,3) = cam_trans2.at<float>(1,0);
+        cam_ext_mat.at<float>(2,3) = cam_trans2.at<float>(2,0);
+
+        cam_ext_mat.at<float>(3,0) = 0;
+        cam_ext_mat.at<float>(3,1) = 0;
+        cam_ext_mat.at<float>(3,2) = 0;
+        cam_ext_mat.at<float>(3,3) = 1;
+        PrintMatrix("cam_ext_mat", cam_ext_mat);
+
+        Mat cam_ext_mat_inv(4, 4, CV_32F);
+        invert(cam_ext_mat, cam_ext_mat_inv);
+        PrintMatrix("cam_ext_mat_inv", cam_ext_mat_inv);
+
+        // projector extrinsic matrix
+
+        // convert to the new matrix representation
+        Mat proj_rot_mat2(sl_calib->proj_rot_mat);
+        Mat proj_trans2(sl_calib->proj_trans);
+
+        // Mat proj_ext_mat
+        // r11 r12 r13  t1
+        // r21 r22 r23  t2
+        // r31 r32 r33  t3
+        //   0   0   0   1
+        Mat proj_ext_mat = Mat::zeros(4, 4, CV_32F);
+        proj_ext_mat.at<float>(0,0) = proj_rot_mat2.at<float>(0,0);
+        proj_ext_mat.at<float>(0,1) = proj_rot_mat2.at<float>(0,1);
+        proj_ext_mat.at<float>(0,2) = proj_rot_mat2.at<float>(0,2);
+        proj_ext_mat.at<float>(1,0) = proj_rot_mat2.at<float>(1,0);
+        proj_ext_mat.at<float>(1,1) = proj_rot_mat2.at<float>(1,1);
+        proj_ext_mat.at<float>(1,2) = proj_rot_mat2.at<float>(1,2);
+        proj_ext_mat.at<float>(2,0) = proj_rot_mat2.at<float>(2,0);
+        proj_ext_mat.at<float>(2,1) = proj_rot_mat2.at<float>(2,1);
+        proj_ext_mat.at<float>(2,2) = proj_rot_mat2.at<float>(2,2);
+
+        proj_ext_mat.at<float>(0,3) = proj_trans2.at<float>(0,0);
+        proj_ext_mat.at<float>(1,3) = proj_trans2.at<float>(1,0);
+        proj_ext_mat.at<float>(2,3) = proj_trans2.at<float>(2,0);
+
+        proj_ext_mat.at<float>(3,0) = 0;
+        proj_ext_mat.at<float>(3,1) = 0;
+        proj_ext_mat.at<float>(3,2) = 0;
+        proj_ext_mat.at<float>(3,3) = 1;
+        PrintMatrix("cam_ext_mat", proj_ext_mat);
+        //proj_ext_mat( Range(0,2), Range(0,2) ) = proj_rot_mat2( Range::all(), Range::all() );
+        //proj_ext_mat( Range(0,0), Range(0,2) ) = proj_trans2( Range::all(), Range(0,0) );
+        //proj_ext_mat.at<float>(3,3) = 1;
+
+        Mat proj_ext_mat_new(4, 4, CV_32F);
+        multiply(proj_ext_mat, cam_ext_mat_inv, proj_ext_mat_new);
+        PrintMatrix("proj_ext_mat_new", proj_ext_mat_new);
+
+        sprintf(str, "%s\\proj_extrinsic_4x4.xml", calibDir);
+        CvMat proj_ext_mat_new_cv(proj_ext_mat_new);
+        cvSave(str, &proj_ext_mat_new_cv);
+
+        // create the new rot mat
+        Mat proj_rot_mat_new(3, 3, CV_32F);
+        proj_rot_mat_new = proj_ext_mat_new( Range(0,3), Range(0,3) );
+
+        // create the rotation vectors
+        Mat proj_rot_vec_new(1, 3, CV_32F);
+        Rodrigues(proj_rot_mat_new, proj_rot_vec_new);
+
+        // create the new translation vectors
+        Mat proj_trans_new(3, 1, CV_32F);
+        proj_trans_new = proj_ext_mat_new( Range(0,3), Range(3,4) );
+
+        Mat proj_ext_mat_orig_format(2, 3, CV_32F);
+        proj_ext_mat_orig_format.at<float>(0,0) = proj_rot_vec_new.at<float>(0,0);
+        proj_ext_mat_orig_format.at<float>(0,1) = proj_rot_vec_new.at<float>(0,1);
+        proj_ext_mat_orig_format.at<float>(0,2) = proj_rot_vec_new.at<float>(0,2);
+        proj_ext_mat_orig_format.at<float>(1,0) = proj_trans_new.at<float>(0,0);
+        proj_ext_mat_orig_format.at<float>(1,1) = proj_trans_new.at<float>(0,1);
+        proj_ext_mat_orig_format.at<float>(1,2) = proj_trans_new.at<float>(0,2);
+        //proj_ext_mat_orig_format( Range(0,0), Range(0,2) ) = proj_rot_vec_new;
+        //proj_ext_mat_orig_format( Range(1,1), Range(0,2) ) = proj_trans_new;
+
+        sprintf(str, "%s\\proj_extrinsic_new.xml", calibDir);
+        CvMat proj_ext_mat_orig_format_cv(proj_ext_mat_orig_format);
+        cvSave(str, &proj_ext_mat_orig_format_cv);
+
+        // Free allocated resources.
+        cvReleaseMat(&cam_object_points2);
+        cvReleaseMat(&cam_image_points2);
+        cvReleaseMat(&cam_point_counts2);
+        cvReleaseMat(&cam_rotation_vectors);
+        cvReleaseMat(&cam_translation_vectors);
+        cvReleaseMat(&proj_object_points2);
+        cvReleaseMat(&proj_point_counts2);
+        cvReleaseMat(&proj_rotation_vectors);
+        cvReleaseMat(&proj_translation_vectors);
+        //cvReleaseMat(&R);
+        cvReleaseMat(&r);
+        cvReleaseMat(&cam_object_points_00);
+        cvReleaseMat(&cam_image_points_00);
+        cvReleaseMat(&cam_rotation_vector_00);
+        cvReleaseMat(&cam_translation_vector_00);
+
+        // Wait for the calibration images.
+        calib_writer.Flush();
+    }
+    else{
+        printf("ERROR: At least two detected chessboards are required!\n");
+        if(calibrate_both)
+            printf("Projector-camera calibration was not successful and must be repeated.\n");
+        else
+            printf("Projector calibration was not successful and must be repeated.\n");
+        return -1;
+    }
+
+    // Update calibration status.
+    sl_calib->proj_intrinsic_calib   = true;
+    sl_calib->procam_extrinsic_calib = true;
+
+    // Evaluate projector-camera geometry.
+    mProCam->evaluateProCamGeometry(sl_params, sl_calib);
+
+    // Save the calibration bundle (loaded at startup instead of the XML files).
+    // Note: The undistortion maps and the geometry are computed here, so they are cached in the bundle as well.
+    getCameraUndistortMap(sl_params, sl_calib);
+    getProjectorUndistortMap(sl_params, sl_calib);
+    sprintf(str, "%s\\calib\\calibration.bin", sl_params->outdir);
+    CalibrationBundle::Save(str, sl_params, sl_calib, sl_calib->procam_geometry_calib);
+
+    // Return without errors.
+    if(calibrate_both){
+        printf("Projector-camera calibration was successful.\n");
+        mProCam->displayCamCalib(sl_calib);
+    }
+    else
+        printf("Projector calibration was successful.\n");
+    mProCam->displayProjCalib(sl_calib);
+    return 0;
+}
\ No newline at end of file
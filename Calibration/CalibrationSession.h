@@ -0,0 +1,268 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\CalibrationSession.h
+//
+// summary:	Declares the non-blocking projector-camera calibration session class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "Camera.h"
+#include "CalibrateProCam.h"
+#include "PatternCache.h"
+#include "Kinect-Parallel.h"
+
+#include <vector>
+
+class ArtifactWriter;
+class LatencyProbe;
+class ProCamIncrementalCalibration;
+
+/// <summary> States of a calibration session. </summary>
+enum CalibrationSessionState
+{
+    SESSION_IDLE = 0,           // not started
+    SESSION_MEASURE_LATENCY,    // the projector-to-camera latency is measured (see LatencyProbe)
+    SESSION_SHOW_PATTERN,       // the next pattern goes to the projector
+    SESSION_AWAIT_FRAME,        // waiting for the projector latency to pass, then capturing
+    SESSION_DETECT,             // chessboard detection runs on the thread pool
+    SESSION_ACCEPT,             // capture is stalled until the detected board is accepted or rejected
+    SESSION_SOLVE,              // the final calibration is solved and saved
+    SESSION_DONE,               // finished (see GetResult())
+    SESSION_FAILED              // could not be started or solved
+};
+
+/// <summary> Preview images of a calibration session. </summary>
+enum CalibrationView
+{
+    VIEW_CAMERA = 0,            // camera frames with the printed chessboard
+    VIEW_PROJECTOR              // difference frames with the projected chessboard
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  CalibrationSessionListener
+///
+/// @brief  Receives the patterns, previews and progress of a calibration session.
+///
+///         All callbacks are made from Step(), Accept(), Reject() or Finish(), i.e. on the thread
+///         driving the session.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class CalibrationSessionListener
+{
+public:
+    virtual ~CalibrationSessionListener() {};
+
+    // Put pattern on the projector (owned by the session, valid until the next call).
+    virtual void ShowPattern(IplImage* pattern) {};
+
+    // A preview of the current round (owned by the session, valid during the call).
+    virtual void ShowPreview(CalibrationView view, IplImage* image) {};
+
+    virtual void StateChanged(CalibrationSessionState state) {};
+
+    // A board was detected and waits for Accept() or Reject() (the next round is captured meanwhile).
+    virtual void BoardDetected(int board) {};
+
+    // A board was accepted (boards of max_boards so far); converged once the estimate is good enough.
+    virtual void BoardAccepted(int boards, int max_boards, bool converged) {};
+
+    // The session has finished; result is 0 if the calibration was solved, -1 otherwise.
+    virtual void Finished(int result) {};
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  CalibrationSession
+///
+/// @brief  Projector-camera calibration as a state machine, driven by an event loop.
+///
+///         Each round shows a red frame to find the printed chessboard, a white frame and the
+///         projector chessboard warped onto the printed one, and detects the projected corners in
+///         the difference image. Step() does the work of one state and returns without waiting for
+///         the projector latency or the detection (which runs on the thread pool), so it can be
+///         called from a window's message loop or a coroutine.
+///
+///         A detected board waits for Accept() or Reject() while the next round is shown, captured
+///         and detected; only once the next board is detected as well does capture stall (state
+///         SESSION_ACCEPT). That board is never promoted: it was captured before the operator could
+///         react, so the round is captured again after Accept() or Reject(). Rounds whose printed
+///         board has not moved since the pending or the last accepted board are captured again as
+///         well, so duplicate poses do not reach the calibration. Once enough boards are accepted
+///         (or the running estimate has converged, or Finish() is called), the calibration is
+///         solved and saved on its own thread.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class CalibrationSession
+{
+public:
+    CalibrationSession(CalibrateProCam* procam, Camera* camera, struct slParams* sl_params,
+                       struct slCalib* sl_calib, bool calibrate_both, int max_boards);
+    ~CalibrationSession();
+
+    void SetListener(CalibrationSessionListener* listener)     { mListener = listener; };
+
+    // Clear the calibration directories, allocate storage and show the first pattern.
+    // Note: The latency is measured first if enabled and the stored measurement is too old.
+    // Note: Returns -1 (and fails the session) if the calibration cannot be started.
+    int Start();
+
+    // Do the work of the current state without blocking; returns false once the session has finished.
+    bool Step();
+
+    // Accept or reject the detected board (ignored if no board is waiting).
+    void Accept();
+    void Reject();
+
+    // Stop capturing and solve with the boards accepted so far (a waiting board is dropped). While
+    // the latency is measured, the measurement is stopped and the session fails.
+    void Finish();
+
+    CalibrationSessionState GetState()      { return mState; };
+    bool IsAwaitingAcceptance()             { return mPending != NULL; };
+    bool IsFinished()                       { return mState == SESSION_DONE || mState == SESSION_FAILED; };
+    int GetBoardCount()                     { return mSuccesses; };
+    int GetMaxBoards()                      { return mMaxBoards; };
+
+    // Delay between showing a pattern and capturing its frame (in ms).
+    int GetDelay()                          { return mDelay; };
+
+    // 0 if the calibration was solved and saved, -1 otherwise.
+    int GetResult()                         { return mResult; };
+
+private:
+    /// <summary> Patterns shown during a round. </summary>
+    enum RoundStep
+    {
+        STEP_HOMOGRAPHY = 0,    // projector chessboard (once, for the camera-to-projector homography)
+        STEP_CAMERA_BOARD,      // red frame
+        STEP_WHITE,             // white frame
+        STEP_PROJECTOR_BOARD    // warped projector chessboard
+    };
+
+    /// <summary> Frames and corners of one board. </summary>
+    struct Round
+    {
+        IplImage*     camFrame;         // printed chessboard under red light
+        IplImage*     whiteFrame;       // white frame
+        IplImage*     boardFrame;       // inverted difference of the white and the projector chessboard frame
+        CvPoint2D32f* camCorners;
+        int           camCornerCount;
+        CvPoint2D32f* projCorners;
+        int           projCornerCount;
+        CvMat*        projToProj;       // projector chessboard to its warped position
+    };
+
+    // Detect a chessboard on the thread pool.
+    class DetectTask : public Kinect::Task
+    {
+    public:
+        DetectTask()                    { mProCam = NULL; mFrame = NULL; mCorners = NULL; mCornerCount = 0; mFound = 0; };
+        virtual void Run()              { mFound = mProCam->detectChessboard(mFrame, mSize, mCorners, &mCornerCount); };
+
+        CalibrateProCam* mProCam;
+        IplImage*        mFrame;
+        CvSize           mSize;
+        CvPoint2D32f*    mCorners;
+        int              mCornerCount;
+        int              mFound;
+    };
+
+    // Solve and save the calibration on its own thread.
+    class SolveTask : public Kinect::AsyncTask
+    {
+    public:
+        SolveTask(CalibrationSession* owner)    { mOwner = owner; mDone = 0; mResult = -1; };
+        virtual void Run()              { mResult = mOwner->solve(); InterlockedExchange(&mDone, 1); };
+        bool IsDone()                   { return mDone != 0; };
+        int GetResult()                 { return mResult; };
+
+    private:
+        CalibrationSession* mOwner;
+        volatile LONG       mDone;
+        int                 mResult;
+    };
+
+    void setState(CalibrationSessionState state);
+    void fail();
+
+    // Show a pattern and capture the frame of step once the projector latency has passed.
+    void showPattern(RoundStep step, IplImage* pattern);
+    void showRed();
+
+    // Start the rounds with the homography pattern.
+    void startCapture();
+
+    void capture();
+    void detected();
+    void startDetect(IplImage* frame, CvSize board_size, CvPoint2D32f* corners);
+
+    // The captured round becomes the board waiting for acceptance; capture continues.
+    void promote();
+
+    // Whether the camera corners of round moved since the pending and the last accepted board.
+    bool boardMoved(const Round* round);
+    void addBoard(Round* round);
+    void startSolve();
+
+    Round* createRound();
+    void releaseRound(Round*& round);
+
+    // Solve and save the calibration from the accepted boards (runs on the solve thread).
+    int solve();
+
+    CalibrateProCam*             mProCam;
+    Camera*                      mCamera;
+    CalibrationSessionListener*  mListener;
+    struct slParams*             mSlParams;
+    struct slCalib*              mSlCalib;
+    bool                         mCalibrateBoth;
+    int                          mMaxBoards;
+
+    CalibrationSessionState      mState;
+    RoundStep                    mStep;
+    int                          mResult;
+    int                          mSuccesses;
+    int                          mRounds;
+    bool                         mConverged;
+
+    /// <summary> Pattern on the projector and when it was shown (GetTickCount()). </summary>
+    IplImage*                    mPattern;
+    DWORD                        mPatternTime;
+
+    /// <summary> Round being captured, and the detected board waiting for acceptance. </summary>
+    Round*                       mCapture;
+    Round*                       mPending;
+    IplImage*                    mHomographyFrame;
+
+    DetectTask                   mDetectTask;
+    Kinect::TaskGroup            mDetect;
+    bool                         mDetecting;
+    SolveTask*                   mSolveTask;
+    LatencyProbe*                mProbe;
+    int                          mDelay;
+
+    PatternCache*                mPatternCache;
+    IplImage*                    mProjChessboard;
+    CvMat*                       mProjPoints;
+    CvMat*                       mCamToProjHomography;
+    int                          mCamBoardN;
+    int                          mProjBoardN;
+    CvSize                       mCamBoardSize;
+    CvSize                       mProjBoardSize;
+
+    /// <summary> Accepted boards, one block of rows per board. </summary>
+    CvMat*                       mCamImagePoints;
+    CvMat*                       mCamObjectPoints;
+    CvMat*                       mCamPointCounts;
+    CvMat*                       mProjImagePoints;
+    CvMat*                       mProjImagePoints2;
+    CvMat*                       mProjPointCounts;
+    std::vector<IplImage*>       mCamCalibImages;
+    std::vector<IplImage*>       mProjCalibImages;
+
+    ProCamIncrementalCalibration* mIncrementalCalib;
+    ArtifactWriter*              mDebugWriter;
+};
@@ -49,17 +49,26 @@ void Configuration::Load()
 	strcpy(sl_params->object, cvReadStringByName(fs, m, "object_name", "./output"));
 	sl_params->save = (cvReadIntByName(fs, m, "save_intermediate_results", 0) != 0);
 
+	// Read debug image options.
+	sl_params->artifact_format          = cvReadIntByName(fs, m, "debug_image_format",          2);
+	sl_params->artifact_png_compression = cvReadIntByName(fs, m, "debug_image_png_compression", 1);
+	sl_params->artifact_queue           = cvReadIntByName(fs, m, "debug_image_queue_length",   16);
+	sl_params->artifact_overflow        = cvReadIntByName(fs, m, "debug_image_overflow",        2);
+
 	// Read camera parameters.
 	m = cvGetFileNodeByName(fs, 0, "camera");
 	sl_params->cam_w         =  cvReadIntByName(fs, m, "width",                          960);
 	sl_params->cam_h         =  cvReadIntByName(fs, m, "height",                         720);
 	sl_params->Logitech_9000 = (cvReadIntByName(fs, m, "Logitech_Quickcam_9000_raw_mode",  0) != 0);
+	strcpy(sl_params->frame_bus, cvReadStringByName(fs, m, "frame_bus", ""));
 
 	// Read projector parameters.
 	m = cvGetFileNodeByName(fs, 0, "projector");
 	sl_params->proj_w      =  cvReadIntByName(fs, m, "width",            1024);
 	sl_params->proj_h      =  cvReadIntByName(fs, m, "height",            768);
 	sl_params->proj_invert = (cvReadIntByName(fs, m, "invert_projector",    0) != 0);
+	sl_params->proj_scheduled = (cvReadIntByName(fs, m, "scheduled_output",  0) != 0);
+	sl_params->proj_period    = (float)cvReadRealByName(fs, m, "sequence_period_ms", 0.0);
 
 	// Read camera and projector gain parameters.
 	m = cvGetFileNodeByName(fs, 0, "gain");
@@ -86,6 +95,11 @@ void Configuration::Load()
 	sl_params->proj_board_h        = cvReadIntByName(fs,  m, "interior_vertical_corners",    6);
 	sl_params->proj_board_w_pixels = cvReadIntByName(fs, m, "square_width_pixels",          75);
 	sl_params->proj_board_h_pixels = cvReadIntByName(fs, m, "square_height_pixels",         75);
+
+	// Read incremental calibration parameters.
+	m = cvGetFileNodeByName(fs, 0, "calibration");
+	sl_params->calib_stop_uncertainty = (float)cvReadRealByName(fs, m, "stop_uncertainty_pixels", 0.0);
+	sl_params->calib_min_boards       =        cvReadIntByName(fs,  m, "minimum_boards",          4);
 	
 	// Read scanning and reconstruction parameters.
 	m = cvGetFileNodeByName(fs, 0, "scanning_and_reconstruction");
@@ -99,6 +113,27 @@ void Configuration::Load()
 	sl_params->dist_reject             = (float) cvReadRealByName(fs, m, "maximum_distance_variation_mm",   10.0);
 	sl_params->background_depth_thresh = (float) cvReadRealByName(fs, m, "minimum_background_distance_mm",  20.0);
     sl_params->generate_normals        =        (cvReadIntByName(fs,  m, "generate_normals",                   1) != 0);
+	sl_params->normal_radius           =         cvReadIntByName(fs,  m, "normal_window_radius_pixels",        5);
+	sl_params->normal_max_depth_change = (float) cvReadRealByName(fs, m, "normal_maximum_depth_change_mm",   20.0);
+	sl_params->outlier_neighbors       =         cvReadIntByName(fs,  m, "outlier_neighbors",                  8);
+	sl_params->outlier_std_ratio       = (float) cvReadRealByName(fs, m, "outlier_std_ratio",                 2.0);
+	sl_params->outlier_radius          = (float) cvReadRealByName(fs, m, "outlier_radius_mm",                 0.0);
+	sl_params->outlier_min_neighbors   =         cvReadIntByName(fs,  m, "outlier_minimum_neighbors",          4);
+
+	// Read latency measurement parameters.
+	m = cvGetFileNodeByName(fs, 0, "latency");
+	sl_params->latency_probe      =       (cvReadIntByName(fs,  m, "measure_latency",    1) != 0);
+	sl_params->latency_changes    =        cvReadIntByName(fs,  m, "pattern_changes",   20);
+	sl_params->latency_percentile = (float)cvReadRealByName(fs, m, "percentile",       95.0);
+	sl_params->latency_margin     =        cvReadIntByName(fs,  m, "margin_ms",         10);
+	sl_params->latency_recheck    =        cvReadIntByName(fs,  m, "recheck_minutes", 1440);
+
+	// Read point export options.
+	m = cvGetFileNodeByName(fs, 0, "export");
+	sl_params->export_subsample_mode = cvReadIntByName(fs, m, "subsample_mode",             1);
+	sl_params->export_point_budget   = cvReadIntByName(fs, m, "point_budget",            3000);
+	sl_params->export_voxel_size     = (float)cvReadRealByName(fs, m, "voxel_size_mm",   10.0);
+	sl_params->export_seed           = cvReadIntByName(fs, m, "random_seed",                1);
 
 	// Read visualization options.
 	m = cvGetFileNodeByName(fs, 0, "visualization");
@@ -107,6 +142,17 @@ void Configuration::Load()
     sl_params->window_offset_x =  cvReadIntByName(fs, m, "window_offset_x",  -13);
     sl_params->window_offset_y =  cvReadIntByName(fs, m, "window_offset_y",  -23);
 
+	// Read threading options.
+	m = cvGetFileNodeByName(fs, 0, "threading");
+	sl_params->threads   = cvReadIntByName(fs, m, "worker_threads",  0);
+	sl_params->numa_node = cvReadIntByName(fs, m, "numa_node",      -1);
+
+	// Read diagnostics options.
+	m = cvGetFileNodeByName(fs, 0, "diagnostics");
+	sl_params->trace        = (cvReadIntByName(fs, m, "enable_tracing",              0) != 0);
+	sl_params->trace_events =  cvReadIntByName(fs, m, "trace_events_per_thread", 65536);
+	sl_params->log_level    =  cvReadIntByName(fs, m, "log_level",                   1);
+
 	// Enable both row and column scanning, if "ray-ray" reconstruction mode is enabled.
 	if(sl_params->mode == 2){
 		sl_params->scan_cols = true;
@@ -139,9 +185,13 @@ void Configuration::Save()
 	
 	// Write output directory and object (or sequence) name.
 	cvStartWriteStruct(fs, "output", CV_NODE_MAP);
-	cvWriteString(fs, "output_directory",          sl_params->outdir, 1);
-	cvWriteString(fs, "object_name",               sl_params->object, 1);
-	cvWriteInt(fs,    "save_intermediate_results", sl_params->save);
+	cvWriteString(fs, "output_directory",            sl_params->outdir, 1);
+	cvWriteString(fs, "object_name",                 sl_params->object, 1);
+	cvWriteInt(fs,    "save_intermediate_results",   sl_params->save);
+	cvWriteInt(fs,    "debug_image_format",          sl_params->artifact_format);
+	cvWriteInt(fs,    "debug_image_png_compression", sl_params->artifact_png_compression);
+	cvWriteInt(fs,    "debug_image_queue_length",    sl_params->artifact_queue);
+	cvWriteInt(fs,    "debug_image_overflow",        sl_params->artifact_overflow);
 	cvEndWriteStruct(fs);
 	
 	// Write camera parameters.
@@ -149,6 +199,7 @@ void Configuration::Save()
 	cvWriteInt(fs, "width",                           sl_params->cam_w);
 	cvWriteInt(fs, "height",                          sl_params->cam_h);
 	cvWriteInt(fs, "Logitech_Quickcam_9000_raw_mode", sl_params->Logitech_9000);
+	cvWriteString(fs, "frame_bus",                    sl_params->frame_bus, 1);
 	cvEndWriteStruct(fs);
 
 	// Write projector parameters.
@@ -156,6 +207,8 @@ void Configuration::Save()
 	cvWriteInt(fs, "width",            sl_params->proj_w);
 	cvWriteInt(fs, "height",           sl_params->proj_h);
 	cvWriteInt(fs, "invert_projector", sl_params->proj_invert);
+	cvWriteInt(fs, "scheduled_output", sl_params->proj_scheduled);
+	cvWriteReal(fs, "sequence_period_ms", sl_params->proj_period);
 	cvEndWriteStruct(fs);
 
 	// Write camera and projector gain parameters.
@@ -188,6 +241,12 @@ void Configuration::Save()
 	cvWriteInt(fs, "square_height_pixels",         sl_params->proj_board_h_pixels);
 	cvEndWriteStruct(fs);
 
+	// Write incremental calibration parameters.
+	cvStartWriteStruct(fs, "calibration", CV_NODE_MAP);
+	cvWriteReal(fs, "stop_uncertainty_pixels", sl_params->calib_stop_uncertainty);
+	cvWriteInt(fs,  "minimum_boards",          sl_params->calib_min_boards);
+	cvEndWriteStruct(fs);
+
 	// Write scanning and reconstruction parameters.
 	cvStartWriteStruct(fs, "scanning_and_reconstruction", CV_NODE_MAP);
 	cvWriteInt(fs,  "mode",                           sl_params->mode);
@@ -200,6 +259,29 @@ void Configuration::Save()
 	cvWriteReal(fs, "maximum_distance_variation_mm",  sl_params->dist_reject);
 	cvWriteReal(fs, "minimum_background_distance_mm", sl_params->background_depth_thresh);
     cvWriteInt(fs,  "generate_normals",               sl_params->generate_normals);
+	cvWriteInt(fs,  "normal_window_radius_pixels",    sl_params->normal_radius);
+	cvWriteReal(fs, "normal_maximum_depth_change_mm", sl_params->normal_max_depth_change);
+	cvWriteInt(fs,  "outlier_neighbors",              sl_params->outlier_neighbors);
+	cvWriteReal(fs, "outlier_std_ratio",              sl_params->outlier_std_ratio);
+	cvWriteReal(fs, "outlier_radius_mm",              sl_params->outlier_radius);
+	cvWriteInt(fs,  "outlier_minimum_neighbors",      sl_params->outlier_min_neighbors);
+	cvEndWriteStruct(fs);
+
+	// Write latency measurement parameters.
+	cvStartWriteStruct(fs, "latency", CV_NODE_MAP);
+	cvWriteInt(fs,  "measure_latency", sl_params->latency_probe);
+	cvWriteInt(fs,  "pattern_changes", sl_params->latency_changes);
+	cvWriteReal(fs, "percentile",      sl_params->latency_percentile);
+	cvWriteInt(fs,  "margin_ms",       sl_params->latency_margin);
+	cvWriteInt(fs,  "recheck_minutes", sl_params->latency_recheck);
+	cvEndWriteStruct(fs);
+
+	// Write point export options.
+	cvStartWriteStruct(fs, "export", CV_NODE_MAP);
+	cvWriteInt(fs,  "subsample_mode", sl_params->export_subsample_mode);
+	cvWriteInt(fs,  "point_budget",   sl_params->export_point_budget);
+	cvWriteReal(fs, "voxel_size_mm",  sl_params->export_voxel_size);
+	cvWriteInt(fs,  "random_seed",    sl_params->export_seed);
 	cvEndWriteStruct(fs);
 
 	// Write visualization options.
@@ -210,6 +292,19 @@ void Configuration::Save()
     cvWriteInt(fs, "window_offset_y",  sl_params->window_offset_y);
 	cvEndWriteStruct(fs);
 
+	// Write threading options.
+	cvStartWriteStruct(fs, "threading", CV_NODE_MAP);
+	cvWriteInt(fs, "worker_threads", sl_params->threads);
+	cvWriteInt(fs, "numa_node",      sl_params->numa_node);
+	cvEndWriteStruct(fs);
+
+	// Write diagnostics options.
+	cvStartWriteStruct(fs, "diagnostics", CV_NODE_MAP);
+	cvWriteInt(fs, "enable_tracing",          sl_params->trace);
+	cvWriteInt(fs, "trace_events_per_thread", sl_params->trace_events);
+	cvWriteInt(fs, "log_level",               sl_params->log_level);
+	cvEndWriteStruct(fs);
+
 	// Close file storage for XML-formatted configuration file.
 	cvReleaseFileStorage(&fs);
 }
@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\FrameBusCamera.cpp
+//
+// summary:	Implements the frame bus camera class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "FrameBusCamera.h"
+#include "Kinect-Trace.h"
+
+// Time to wait for a frame before reporting that the daemon does not publish (in milliseconds).
+static const DWORD FRAMEBUS_CAMERA_TIMEOUT = 2000;
+
+// Time Init() waits for the first frame, and the pause between reconnect attempts (in milliseconds).
+static const DWORD FRAMEBUS_CAMERA_INIT_TIMEOUT = 10000;
+static const DWORD FRAMEBUS_CAMERA_RECONNECT_DELAY = 100;
+
+FrameBusCamera::FrameBusCamera(const char* bus_name)
+{
+    mBusName   = bus_name;
+    mWidth     = 0;
+    mHeight    = 0;
+    mCurFrame  = NULL;
+    mCamParams = NULL;
+    mEnabled   = false;
+    memset(&mFrame, 0, sizeof(mFrame));
+    memset(&mView, 0, sizeof(mView));
+}
+
+FrameBusCamera::~FrameBusCamera()
+{
+    mReader.Close();
+}
+
+void FrameBusCamera::Init(CameraConfigParams* camParams)
+{
+    mCamParams = camParams;
+    if(!mReader.Open(mBusName.c_str())){
+        printf("ERROR: No capture daemon publishes the frame bus \"%s\"!\n", mBusName.c_str());
+        throw new HardwareNotFound("Frame bus");
+    }
+
+    // The frame size is given by the daemon.
+    if(!acquire(FRAMEBUS_CAMERA_INIT_TIMEOUT)){
+        printf("ERROR: The capture daemon publishes no frames on the frame bus \"%s\"!\n", mBusName.c_str());
+        mReader.Close();
+        throw new HardwareNotFound("Frame bus");
+    }
+    mWidth   = mFrame.mWidth;
+    mHeight  = mFrame.mHeight;
+    mEnabled = true;
+}
+
+bool FrameBusCamera::acquire(DWORD max_wait_ms)
+{
+    bool waiting = false;
+    DWORD start = GetTickCount();
+    for(;;){
+        DWORD timeout = FRAMEBUS_CAMERA_TIMEOUT;
+        if(max_wait_ms != INFINITE){
+            DWORD elapsed = GetTickCount() - start;
+            if(elapsed >= max_wait_ms)
+                return false;
+            if(max_wait_ms - elapsed < timeout)
+                timeout = max_wait_ms - elapsed;
+        }
+        if(mReader.IsOpen() && mReader.Acquire(Kinect::FRAMEBUS_COLOR, &mFrame, timeout)){
+            int channels = (mFrame.mFormat == Kinect::FRAMEBUS_GRAY8) ? 1 : 3;
+            bool usable = (mFrame.mFormat == Kinect::FRAMEBUS_RGB8 || mFrame.mFormat == Kinect::FRAMEBUS_GRAY8) &&
+                          mFrame.mBytes >= mFrame.mWidth*mFrame.mHeight*channels;
+            if(usable){
+                if(waiting)
+                    printf("Frame bus \"%s\" is publishing again.\n", mBusName.c_str());
+                return true;
+            }
+            continue;
+        }
+
+        // Timeout or closed bus: reconnect (a restarted daemon takes the bus of the same name over).
+        if(!waiting)
+            printf("Waiting for frames on the frame bus \"%s\"...\n", mBusName.c_str());
+        waiting = true;
+        mReader.Close();
+        Sleep(FRAMEBUS_CAMERA_RECONNECT_DELAY);
+        mReader.Open(mBusName.c_str());
+    }
+}
+
+IplImage* FrameBusCamera::QueryFrame()
+{
+    KINECT_TRACE_SCOPE("camera.query_frame");
+    for(;;){
+        acquire(INFINITE);
+        int channels  = (mFrame.mFormat == Kinect::FRAMEBUS_GRAY8) ? 1 : 3;
+        int row_bytes = mFrame.mWidth*channels;
+        IplImage* frame = cvCreateImage(cvSize(mFrame.mWidth, mFrame.mHeight), IPL_DEPTH_8U, channels);
+        const char* src = (const char*)mFrame.mData;
+        for(int y=0; y<mFrame.mHeight; y++)
+            memcpy(frame->imageData + y*frame->widthStep, src + y*row_bytes, row_bytes);
+
+        // A frame overwritten while it was copied is torn; take the next one.
+        if(mReader.IsValid(mFrame))
+            return frame;
+        cvReleaseImage(&frame);
+    }
+}
+
+const IplImage* FrameBusCamera::QueryFrameView()
+{
+    acquire(INFINITE);
+    int channels = (mFrame.mFormat == Kinect::FRAMEBUS_GRAY8) ? 1 : 3;
+    cvInitImageHeader(&mView, cvSize(mFrame.mWidth, mFrame.mHeight), IPL_DEPTH_8U, channels);
+
+    // Rows are packed in the ring (no row alignment).
+    mView.widthStep = mFrame.mWidth*channels;
+    mView.imageSize = mView.widthStep*mFrame.mHeight;
+    mView.imageData = (char*)mFrame.mData;
+    mView.imageDataOrigin = mView.imageData;
+    return &mView;
+}
@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\FrameBusCamera.h
+//
+// summary:	Declares the frame bus camera class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "Camera.h"
+#include "Kinect-FrameBus.h"
+
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  FrameBusCamera
+///
+/// @brief  Camera reading the color frames a capture daemon publishes on a shared-memory frame
+///         bus, so several processes can use one Kinect at the same time.
+///
+///         QueryFrame() follows the Camera contract (a new image, released by the caller), so it
+///         copies the newest frame out of the shared ring once. QueryFrameView() returns the frame
+///         in place instead (no copy): the view is read-only and stays valid until the daemon has
+///         overwritten its slot, which IsFrameViewValid() tells after the view was used.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class FrameBusCamera : public Camera
+{
+public:
+    FrameBusCamera(const char* bus_name);
+    virtual ~FrameBusCamera();
+
+    // Open the bus and wait for the first frame (throws HardwareNotFound if no daemon publishes
+    // one within a few seconds).
+    virtual void Init(CameraConfigParams* camParams);
+
+    virtual void StartCapture()
+        { return; };
+
+    virtual void EndCapture()
+        { return; };
+
+    // Copy the next color frame (a new 8-bit image, 3 channels as KinectCamera's or gray, released by the caller).
+    virtual IplImage* QueryFrame();
+
+    // The next color frame in place (owned by the camera, valid until the next call).
+    const IplImage* QueryFrameView();
+
+    // True if the frame of the last QueryFrameView() has not been overwritten meanwhile.
+    bool IsFrameViewValid()                 { return mReader.IsValid(mFrame); };
+
+    // Frames published while this camera was not reading (skipped to stay at the newest frame).
+    long GetMissedCount()                   { return mReader.GetMissedCount(); };
+
+private:
+    // Wait up to max_wait_ms (or INFINITE) for the next color frame; reconnects if the daemon was
+    // restarted. Returns false on timeout.
+    bool acquire(DWORD max_wait_ms);
+
+    std::string            mBusName;
+    Kinect::FrameBusReader mReader;
+    Kinect::FrameBusFrame  mFrame;
+    IplImage               mView;           // header of the frame in the ring
+};
@@ -0,0 +1,47 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\FrameBusCameraManager.cpp
+//
+// summary:	Implements the frame bus camera manager class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "FrameBusCameraManager.h"
+
+FrameBusCameraManager::FrameBusCameraManager(const char* bus_name)
+{
+    mBusName   = bus_name;
+    mIsLoaded  = false;
+    mCamParams = NULL;
+}
+
+FrameBusCameraManager::~FrameBusCameraManager()
+{
+    CleanUp();
+}
+
+void FrameBusCameraManager::Init(CameraConfigParams* camParams)
+{
+    CleanUp();
+    mCamParams = camParams;
+    FrameBusCamera* camera = new FrameBusCamera(mBusName.c_str());
+    try
+    {
+        camera->Init(camParams);
+    }
+    catch(...)
+    {
+        delete camera;
+        throw;
+    }
+    mCameras.push_back(camera);
+    mIsLoaded = true;
+}
+
+void FrameBusCameraManager::CleanUp()
+{
+    for(unsigned int i=0; i<mCameras.size(); i++)
+        delete (FrameBusCamera*)mCameras[i];
+    mCameras.clear();
+    mIsLoaded = false;
+}
@@ -0,0 +1,38 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\FrameBusCameraManager.h
+//
+// summary:	Declares the frame bus camera manager class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "CameraManager.h"
+#include "FrameBusCamera.h"
+
+#include <string>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  FrameBusCameraManager
+///
+/// @brief  Camera manager reading from the frame bus of a running capture daemon, instead of
+///         opening the Kinect (which only one process can do).
+///
+///         Init() creates one FrameBusCamera; it throws HardwareNotFound if no daemon publishes the
+///         bus.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class FrameBusCameraManager : public CameraManager
+{
+public:
+    FrameBusCameraManager(const char* bus_name);
+    ~FrameBusCameraManager();
+
+    void Init(CameraConfigParams* camParams);
+    void CleanUp();
+
+private:
+    std::string mBusName;
+};
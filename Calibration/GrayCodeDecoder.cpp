@@ -0,0 +1,199 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\GrayCodeDecoder.cpp
+//
+// summary:	Implements the Gray code structured light decoder class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "GrayCodeDecoder.h"
+#include "Kinect-Parallel.h"
+#include "Kinect-Trace.h"
+#include <emmintrin.h>
+#include <vector>
+
+// Decode one projector axis for a band of rows (the mask rows are combined with AND).
+class GrayCodeDecodeBody : public Kinect::ParallelLoopBody
+{
+public:
+    GrayCodeDecodeBody(IplImage** frames, int bits, int shift, int size, int thresh, IplImage* decoded, IplImage* mask)
+    {
+        mFrames  = frames;
+        mBits    = bits;
+        mShift   = shift;
+        mSize    = size;
+        mThresh  = thresh;
+        mDecoded = decoded;
+        mMask    = mask;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        std::vector<const uchar*> planes(2*mBits);
+        for(int y=begin; y<end; y++){
+            for(int k=0; k<2*mBits; k++)
+                planes[k] = (const uchar*)mFrames[k]->imageData + y*mFrames[k]->widthStep;
+            ushort* decoded = (ushort*)(mDecoded->imageData + y*mDecoded->widthStep);
+            uchar*  mask    = (uchar*)mMask->imageData + y*mMask->widthStep;
+            decodeRow(&planes[0], decoded, mask);
+        }
+    }
+
+private:
+    void decodeRow(const uchar** planes, ushort* decoded, uchar* mask)
+    {
+        const int     width  = mMask->width;
+        const __m128i zero   = _mm_setzero_si128();
+        const __m128i ones   = _mm_set1_epi8(-1);
+        const __m128i thresh = _mm_set1_epi8((char)mThresh);
+        const __m128i shift  = _mm_set1_epi16((short)mShift);
+        const __m128i lower  = _mm_set1_epi16((short)(mShift - 1));
+        const __m128i upper  = _mm_set1_epi16((short)(mShift + mSize));
+
+        int x = 0;
+        for(; x+16 <= width; x+=16){
+            __m128i valid   = ones;
+            __m128i binary  = zero;
+            __m128i code_lo = zero;
+            __m128i code_hi = zero;
+            for(int k=0; k<mBits; k++){
+                __m128i p = _mm_loadu_si128((const __m128i*)(planes[2*k]   + x));
+                __m128i n = _mm_loadu_si128((const __m128i*)(planes[2*k+1] + x));
+
+                // Contrast test: |p - n| >= thresh.
+                __m128i p_n  = _mm_subs_epu8(p, n);
+                __m128i diff = _mm_or_si128(p_n, _mm_subs_epu8(n, p));
+                valid = _mm_and_si128(valid, _mm_cmpeq_epi8(_mm_max_epu8(diff, thresh), diff));
+
+                // Gray bit (p > n), converted to binary by XOR with the previous binary bit.
+                binary = _mm_xor_si128(binary, _mm_xor_si128(_mm_cmpeq_epi8(p_n, zero), ones));
+
+                // Append the bit to the 16-bit codes.
+                code_lo = _mm_or_si128(_mm_slli_epi16(code_lo, 1), _mm_srli_epi16(_mm_unpacklo_epi8(binary, binary), 15));
+                code_hi = _mm_or_si128(_mm_slli_epi16(code_hi, 1), _mm_srli_epi16(_mm_unpackhi_epi8(binary, binary), 15));
+            }
+
+            // Reject codes outside of the projector.
+            __m128i range_lo = _mm_and_si128(_mm_cmpgt_epi16(code_lo, lower), _mm_cmplt_epi16(code_lo, upper));
+            __m128i range_hi = _mm_and_si128(_mm_cmpgt_epi16(code_hi, lower), _mm_cmplt_epi16(code_hi, upper));
+            valid = _mm_and_si128(valid, _mm_packs_epi16(range_lo, range_hi));
+
+            _mm_storeu_si128((__m128i*)(decoded + x),     _mm_sub_epi16(code_lo, shift));
+            _mm_storeu_si128((__m128i*)(decoded + x + 8), _mm_sub_epi16(code_hi, shift));
+            _mm_storeu_si128((__m128i*)(mask + x), _mm_and_si128(_mm_loadu_si128((const __m128i*)(mask + x)), valid));
+        }
+
+        // Remaining pixels.
+        for(; x<width; x++){
+            bool valid  = true;
+            int  binary = 0;
+            int  code   = 0;
+            for(int k=0; k<mBits; k++){
+                int p = planes[2*k][x];
+                int n = planes[2*k+1][x];
+                valid  &= (abs(p - n) >= mThresh);
+                binary ^= (p > n) ? 1 : 0;
+                code    = (code << 1) | binary;
+            }
+            code -= mShift;
+            valid &= (code >= 0) && (code < mSize);
+            decoded[x] = (ushort)code;
+            if(!valid)
+                mask[x] = 0;
+        }
+    }
+
+    IplImage** mFrames;
+    int        mBits;
+    int        mShift;
+    int        mSize;
+    int        mThresh;
+    IplImage*  mDecoded;
+    IplImage*  mMask;
+};
+
+GrayCodeDecoder::GrayCodeDecoder(struct slParams* sl_params)
+{
+    mProjW    = sl_params->proj_w;
+    mProjH    = sl_params->proj_h;
+    mScanCols = sl_params->scan_cols;
+    mScanRows = sl_params->scan_rows;
+    mThresh   = MIN(MAX(sl_params->thresh, 0), 255);
+
+    mColBits  = GetBitCount(mProjW);
+    mRowBits  = GetBitCount(mProjH);
+    mColShift = ((1 << mColBits) - mProjW)/2;
+    mRowShift = ((1 << mRowBits) - mProjH)/2;
+}
+
+int GrayCodeDecoder::GetBitCount(int size)
+{
+    int bits = 0;
+    while(bits < MAX_BITS && (1 << bits) < size)
+        bits++;
+    return bits;
+}
+
+void GrayCodeDecoder::RenderFrame(int index, IplImage* pattern)
+{
+    bool columns = index < 2*GetColumnBits();
+    int  plane   = columns ? index : index - 2*GetColumnBits();
+    int  bits    = columns ? mColBits  : mRowBits;
+    int  shift   = columns ? mColShift : mRowShift;
+    int  bit     = bits - 1 - plane/2;
+    uchar on     = (plane % 2 == 0) ? 255 : 0;
+
+    // Projector pixel i shows bit of the Gray code of (i + shift).
+    if(columns){
+        std::vector<uchar> row(pattern->width);
+        for(int c=0; c<pattern->width; c++){
+            int code = c + shift;
+            row[c] = (((code ^ (code >> 1)) >> bit) & 1) ? on : (uchar)(255 - on);
+        }
+        for(int r=0; r<pattern->height; r++)
+            memcpy(pattern->imageData + r*pattern->widthStep, &row[0], pattern->width);
+    }
+    else{
+        for(int r=0; r<pattern->height; r++){
+            int code = r + shift;
+            uchar value = (((code ^ (code >> 1)) >> bit) & 1) ? on : (uchar)(255 - on);
+            memset(pattern->imageData + r*pattern->widthStep, value, pattern->width);
+        }
+    }
+}
+
+bool GrayCodeDecoder::Decode(IplImage** frames, IplImage* decoded_cols, IplImage* decoded_rows, IplImage* mask)
+{
+    KINECT_TRACE_SCOPE("decode.gray_code");
+
+    // Check the sequence and output formats.
+    for(int k=0; k<GetFrameCount(); k++){
+        if(frames[k]->depth != IPL_DEPTH_8U || frames[k]->nChannels != 1 ||
+           frames[k]->width != mask->width || frames[k]->height != mask->height){
+            printf("ERROR: Structured light frames must be 8-bit grayscale images of the mask size!\n");
+            return false;
+        }
+    }
+    IplImage* decoded[2] = {decoded_cols, decoded_rows};
+    for(int i=0; i<2; i++){
+        if((i == 0 ? GetColumnBits() : GetRowBits()) == 0)
+            continue;
+        if(decoded[i] == NULL || decoded[i]->depth != IPL_DEPTH_16U || decoded[i]->nChannels != 1 ||
+           decoded[i]->width != mask->width || decoded[i]->height != mask->height){
+            printf("ERROR: Decoded images must be 16-bit single channel images of the mask size!\n");
+            return false;
+        }
+    }
+
+    // Decode each scanned axis into the mask.
+    cvSet(mask, cvScalar(255));
+    if(GetColumnBits() > 0){
+        GrayCodeDecodeBody body(frames, mColBits, mColShift, mProjW, mThresh, decoded_cols, mask);
+        Kinect::ParallelFor(0, mask->height, body, 16);
+    }
+    if(GetRowBits() > 0){
+        GrayCodeDecodeBody body(frames + 2*GetColumnBits(), mRowBits, mRowShift, mProjH, mThresh, decoded_rows, mask);
+        Kinect::ParallelFor(0, mask->height, body, 16);
+    }
+    return true;
+}
@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\GrayCodeDecoder.h
+//
+// summary:	Declares the Gray code structured light decoder class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  GrayCodeDecoder
+///
+/// @brief  Decoder for Gray code structured light sequences (with inverse patterns).
+///
+///         Each projector axis uses ceil(log2(size)) bit planes, most significant bit first, and
+///         the codes are centred on the projector (shifted by (2^bits - size)/2). The captured
+///         sequence is ordered as column bit planes followed by row bit planes, each one
+///         immediately followed by its inverse:
+///
+///             col[n-1], ~col[n-1], ..., col[0], ~col[0], row[m-1], ~row[m-1], ..., row[0], ~row[0]
+///
+///         A bit is set where the pattern is brighter than its inverse, and a pixel is valid if
+///         every bit has a contrast of at least thresh and the decoded column/row lies on the
+///         projector. Decoding compares 16 pixels at a time (SSE2), converts Gray to binary while
+///         the bits are packed, and splits the image into row bands that are decoded in parallel.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class GrayCodeDecoder
+{
+public:
+    /// <summary> Maximum number of bit planes per axis (decoded values are 16-bit). </summary>
+    enum { MAX_BITS = 15 };
+
+    // Configure the decoder from the projector resolution, scanning options and contrast threshold.
+    GrayCodeDecoder(struct slParams* sl_params);
+
+    // Number of bit planes needed to encode size columns (or rows).
+    static int GetBitCount(int size);
+
+    int  GetColumnBits()            { return mScanCols ? mColBits : 0; };
+    int  GetRowBits()               { return mScanRows ? mRowBits : 0; };
+    int  GetColumnShift()           { return mColShift; };
+    int  GetRowShift()              { return mRowShift; };
+
+    // Total number of frames in the sequence (two per bit plane).
+    int  GetFrameCount()            { return 2*(GetColumnBits() + GetRowBits()); };
+
+    // Render frame index of the sequence into an 8-bit, single channel projector image.
+    void RenderFrame(int index, IplImage* pattern);
+
+    // Decode a captured sequence (GetFrameCount() 8-bit, single channel camera frames).
+    // Note: decoded_cols/decoded_rows are 16-bit (IPL_DEPTH_16U) and may be NULL if the axis is
+    //       not scanned; mask is set to 255 for valid pixels and 0 otherwise.
+    //       Returns false if the images do not match the sequence.
+    bool Decode(IplImage** frames, IplImage* decoded_cols, IplImage* decoded_rows, IplImage* mask);
+
+private:
+    int  mProjW;
+    int  mProjH;
+    bool mScanCols;
+    bool mScanRows;
+    int  mThresh;
+
+    int  mColBits;
+    int  mRowBits;
+    int  mColShift;
+    int  mRowShift;
+};
@@ -0,0 +1,140 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\GridMesher.cpp
+//
+// summary:	Implements the organized grid mesher class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "GridMesher.h"
+#include "Kinect-Parallel.h"
+
+// Test whether the depths of three vertices differ by less than max_jump.
+static bool isContinuous(float z0, float z1, float z2, float max_jump)
+{
+    float z_min = MIN(z0, MIN(z1, z2));
+    float z_max = MAX(z0, MAX(z1, z2));
+    return z_max - z_min < max_jump;
+}
+
+// Triangulate the quad with top-left pixel i. Returns the number of triangles (0 to 2).
+// Note: The winding (a, d, b) of the pixels a = (r,c), b = (r,c+1), d = (r+1,c) faces the camera.
+static int triangulateQuad(const int* V, const float* Z, int i, int width, float max_jump, int* faces)
+{
+    int a = i, b = i + 1, d = i + width, e = i + width + 1;
+    int n = 0;
+    if(V[a] >= 0 && V[e] >= 0 && (V[b] < 0 || V[d] < 0 || fabs(Z[a] - Z[e]) < fabs(Z[b] - Z[d]))){
+        // Split along the a-e diagonal.
+        if(V[d] >= 0 && isContinuous(Z[a], Z[d], Z[e], max_jump)){
+            faces[3*n+0] = V[a]; faces[3*n+1] = V[d]; faces[3*n+2] = V[e];
+            n++;
+        }
+        if(V[b] >= 0 && isContinuous(Z[a], Z[e], Z[b], max_jump)){
+            faces[3*n+0] = V[a]; faces[3*n+1] = V[e]; faces[3*n+2] = V[b];
+            n++;
+        }
+    }
+    else if(V[b] >= 0 && V[d] >= 0){
+        // Split along the b-d diagonal.
+        if(V[a] >= 0 && isContinuous(Z[a], Z[d], Z[b], max_jump)){
+            faces[3*n+0] = V[a]; faces[3*n+1] = V[d]; faces[3*n+2] = V[b];
+            n++;
+        }
+        if(V[e] >= 0 && isContinuous(Z[b], Z[d], Z[e], max_jump)){
+            faces[3*n+0] = V[b]; faces[3*n+1] = V[d]; faces[3*n+2] = V[e];
+            n++;
+        }
+    }
+    return n;
+}
+
+// Count the faces of a range of quad rows.
+class MeshCountBody : public Kinect::ParallelLoopBody
+{
+public:
+    MeshCountBody(const int* vertices, const float* Z, int width, float max_jump, int* counts)
+    {
+        mVertices = vertices;
+        mZ        = Z;
+        mWidth    = width;
+        mMaxJump  = max_jump;
+        mCounts   = counts;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        int faces[6];
+        for(int r=begin; r<end; r++){
+            int count = 0;
+            for(int c=0; c+1<mWidth; c++)
+                count += triangulateQuad(mVertices, mZ, r*mWidth + c, mWidth, mMaxJump, faces);
+            mCounts[r] = count;
+        }
+    }
+
+private:
+    const int*   mVertices;
+    const float* mZ;
+    int          mWidth;
+    float        mMaxJump;
+    int*         mCounts;
+};
+
+// Configure the grid size and the maximum depth jump (dist_reject) from the scanning options.
+GridMesher::GridMesher(struct slParams* sl_params)
+{
+    mWidth        = sl_params->cam_w;
+    mHeight       = sl_params->cam_h;
+    mMaxDepthJump = sl_params->dist_reject;
+    mPoints       = NULL;
+    mMask         = NULL;
+    mVertexCount  = 0;
+    mFaceCount    = 0;
+    mNextQuad     = 0;
+}
+
+// Number the valid vertices and count the faces.
+int GridMesher::Build(const CvMat* points, const CvMat* mask)
+{
+    int n = mWidth*mHeight;
+    mPoints      = NULL;
+    mVertexCount = 0;
+    mFaceCount   = 0;
+    mNextQuad    = 0;
+    if(points == NULL || points->cols != n || points->rows < 3 || (mask != NULL && mask->cols*mask->rows < n)){
+        printf("ERROR: Invalid point cloud for meshing!\n");
+        return 0;
+    }
+    mPoints = points;
+    mMask   = mask;
+
+    mVertices.resize(n);
+    for(int i=0; i<n; i++)
+        mVertices[i] = (mask == NULL || mask->data.fl[i] != 0) ? mVertexCount++ : -1;
+
+    if(mHeight > 1){
+        std::vector<int> counts(mHeight - 1);
+        const float* Z = (const float*)(points->data.ptr + 2*points->step);
+        MeshCountBody body(&mVertices[0], Z, mWidth, mMaxDepthJump, &counts[0]);
+        Kinect::ParallelFor(0, mHeight - 1, body, 16);
+        for(int r=0; r<mHeight-1; r++)
+            mFaceCount += counts[r];
+    }
+    return mFaceCount;
+}
+
+// Write up to max_faces triangles into faces.
+int GridMesher::NextFaces(int* faces, int max_faces)
+{
+    if(mPoints == NULL || max_faces < 2)
+        return 0;
+    const float* Z    = (const float*)(mPoints->data.ptr + 2*mPoints->step);
+    int          last = (mHeight - 1)*mWidth;
+    int          n    = 0;
+    while(mNextQuad < last && n + 2 <= max_faces){
+        // Skip the last column (it has no quads).
+        if(mNextQuad % mWidth != mWidth - 1)
+            n += triangulateQuad(&mVertices[0], Z, mNextQuad, mWidth, mMaxDepthJump, faces + 3*n);
+        mNextQuad++;
+    }
+    return n;
+}
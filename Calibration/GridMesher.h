@@ -0,0 +1,70 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\GridMesher.h
+//
+// summary:	Declares the organized grid mesher class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  GridMesher
+///
+/// @brief  Triangulates organized point clouds (one point per camera pixel) along the camera grid.
+///
+///         Every valid pixel becomes a vertex, numbered in row-major order of the mask (the same
+///         order in which PointCloudExport compacts the points). Each 2x2 quad of pixels is split
+///         along the diagonal with the smaller depth difference, and each of its two triangles is
+///         emitted if its three vertices are valid and their depths differ by less than the
+///         maximum depth jump (dist_reject by default). Quads with three valid pixels thus still
+///         yield one triangle. Triangles face the camera.
+///
+///         Build() numbers the vertices and counts the faces in parallel row bands. The faces
+///         are then streamed in blocks with NextFaces(), so they never have to be stored.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class GridMesher
+{
+public:
+    // Configure the grid size and the maximum depth jump (dist_reject) from the scanning options.
+    GridMesher(struct slParams* sl_params);
+
+    // Set the maximum depth difference between the vertices of a triangle (in mm).
+    void SetMaxDepthJump(float max_depth_jump) { mMaxDepthJump = max_depth_jump; };
+
+    // Number the valid vertices and count the faces of the points (3 x width*height, CV_32FC1)
+    // for which mask (1 x width*height, CV_32FC1) is non-zero. Returns the number of faces.
+    // Note: The points and mask must remain unchanged while the faces are streamed.
+    int  Build(const CvMat* points, const CvMat* mask);
+
+    int  GetVertexCount()           { return mVertexCount; };
+    int  GetFaceCount()             { return mFaceCount; };
+
+    // Restart streaming with the first face.
+    void Rewind()                   { mNextQuad = 0; };
+
+    // Write up to max_faces (at least 2) triangles, three zero-based vertex indices each, into
+    // faces. Returns the number of triangles written (0 once all faces have been streamed).
+    int  NextFaces(int* faces, int max_faces);
+
+private:
+    int   mWidth;
+    int   mHeight;
+    float mMaxDepthJump;
+
+    const CvMat* mPoints;
+    const CvMat* mMask;
+
+    int   mVertexCount;
+    int   mFaceCount;
+
+    /// <summary> Vertex index of every pixel (-1 for invalid pixels). </summary>
+    std::vector<int> mVertices;
+
+    /// <summary> Streaming position (top-left pixel index of the next quad). </summary>
+    int   mNextQuad;
+};
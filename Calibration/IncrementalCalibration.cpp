@@ -0,0 +1,399 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\IncrementalCalibration.cpp
+//
+// summary:	Implements the incremental (warm-started) calibration classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "IncrementalCalibration.h"
+#include "UtilProCam.h"
+#include "Kinect-Trace.h"
+
+// Relative change of the camera intrinsics that invalidates the cached projector views.
+static const double CAMERA_ESTIMATE_TOLERANCE = 1e-3;
+
+// Number of camera parameters cached per projector view (fx, fy, cx, cy, k1, k2, p1, p2, k3).
+static const int NUM_CACHED_CAM_PARAMS = 9;
+
+IncrementalCalibration::IncrementalCalibration(CvSize image_size, int points_per_view, int max_views, int calib_flags)
+{
+    mImageSize     = image_size;
+    mPointsPerView = points_per_view;
+    mMaxViews      = max_views;
+    mNumViews      = 0;
+    mFlags         = calib_flags;
+    mSolved        = false;
+    mRMSError      = -1;
+    for(int i=0; i<NUM_INTRINSIC_PARAMS; i++)
+        mSigma[i] = DBL_MAX;
+
+    mObjectPoints       = cvCreateMat(max_views*points_per_view, 3, CV_32FC1);
+    mImagePoints        = cvCreateMat(max_views*points_per_view, 2, CV_32FC1);
+    mPointCounts        = cvCreateMat(max_views, 1, CV_32SC1);
+    mIntrinsic          = cvCreateMat(3, 3, CV_64FC1);
+    mDistortion         = cvCreateMat(5, 1, CV_64FC1);
+    mRotationVectors    = cvCreateMat(max_views, 3, CV_64FC1);
+    mTranslationVectors = cvCreateMat(max_views, 3, CV_64FC1);
+    cvSet(mPointCounts, cvScalar(points_per_view));
+    cvZero(mIntrinsic);
+    cvZero(mDistortion);
+}
+
+IncrementalCalibration::~IncrementalCalibration()
+{
+    cvReleaseMat(&mObjectPoints);
+    cvReleaseMat(&mImagePoints);
+    cvReleaseMat(&mPointCounts);
+    cvReleaseMat(&mIntrinsic);
+    cvReleaseMat(&mDistortion);
+    cvReleaseMat(&mRotationVectors);
+    cvReleaseMat(&mTranslationVectors);
+}
+
+int IncrementalCalibration::AddView(const CvMat* object_points, const CvMat* image_points)
+{
+    if(mNumViews >= mMaxViews)
+        return -1;
+
+    int view = mNumViews++;
+    CvMat image_header;
+    cvConvert(image_points, GetViewImagePoints(view, &image_header));
+    SetViewObjectPoints(view, object_points);
+    return view;
+}
+
+void IncrementalCalibration::SetViewObjectPoints(int view, const CvMat* object_points)
+{
+    CvMat object_header;
+    cvConvert(object_points, GetViewObjectPoints(view, &object_header));
+}
+
+CvMat* IncrementalCalibration::GetViewObjectPoints(int view, CvMat* header)
+{
+    return cvGetRows(mObjectPoints, header, view*mPointsPerView, (view+1)*mPointsPerView);
+}
+
+CvMat* IncrementalCalibration::GetViewImagePoints(int view, CvMat* header)
+{
+    return cvGetRows(mImagePoints, header, view*mPointsPerView, (view+1)*mPointsPerView);
+}
+
+double IncrementalCalibration::Solve()
+{
+    KINECT_TRACE_SCOPE("calibration.incremental_solve");
+
+    // A planar target needs at least two views to constrain the intrinsics.
+    if(mNumViews < 2)
+        return -1;
+
+    CvMat object_points, image_points, point_counts, rotation_vectors, translation_vectors;
+    cvGetRows(mObjectPoints,       &object_points,       0, mNumViews*mPointsPerView);
+    cvGetRows(mImagePoints,        &image_points,        0, mNumViews*mPointsPerView);
+    cvGetRows(mPointCounts,        &point_counts,        0, mNumViews);
+    cvGetRows(mRotationVectors,    &rotation_vectors,    0, mNumViews);
+    cvGetRows(mTranslationVectors, &translation_vectors, 0, mNumViews);
+
+    // Warm-start from the previous estimate.
+    int flags = mFlags;
+    if(mSolved)
+        flags |= CV_CALIB_USE_INTRINSIC_GUESS;
+    if(flags & CV_CALIB_FIX_K3)
+        cvmSet(mDistortion, 4, 0, 0);
+
+    mRMSError = cvCalibrateCamera2(&object_points, &image_points, &point_counts, mImageSize,
+        mIntrinsic, mDistortion, &rotation_vectors, &translation_vectors, flags);
+    mSolved = true;
+
+    evaluateUncertainty();
+    return mRMSError;
+}
+
+void IncrementalCalibration::GetEstimate(CvMat* intrinsic, CvMat* distortion)
+{
+    if(intrinsic != NULL)
+        cvConvert(mIntrinsic, intrinsic);
+    if(distortion != NULL)
+        cvConvert(mDistortion, distortion);
+}
+
+double IncrementalCalibration::GetMaxPixelUncertainty()
+{
+    double sigma = 0;
+    for(int i=0; i<4; i++)
+        sigma = __max(sigma, mSigma[i]);
+    return sigma;
+}
+
+bool IncrementalCalibration::IsConverged(double threshold, int min_views)
+{
+    if(!mSolved || threshold <= 0 || mNumViews < __max(min_views, 2))
+        return false;
+    return GetMaxPixelUncertainty() < threshold;
+}
+
+// Evaluate the marginal standard deviation of the intrinsic parameters.
+// Note: For view i the Jacobian of the reprojection error is split into the intrinsic block A_i
+//       and the extrinsic block B_i. The extrinsics are eliminated by the Schur complement
+//       S = sum(A_i'A_i) - sum(A_i'B_i inv(B_i'B_i) B_i'A_i), and the covariance of the
+//       intrinsics is sigma^2*inv(S), with sigma^2 estimated from the residuals.
+void IncrementalCalibration::evaluateUncertainty()
+{
+    // Select the intrinsic parameters that are actually estimated.
+    bool active[NUM_INTRINSIC_PARAMS];
+    for(int i=0; i<NUM_INTRINSIC_PARAMS; i++)
+        active[i] = true;
+    if(mFlags & CV_CALIB_ZERO_TANGENT_DIST)
+        active[6] = active[7] = false;
+    if(mFlags & CV_CALIB_FIX_K3)
+        active[8] = false;
+    int num_active = 0;
+    for(int i=0; i<NUM_INTRINSIC_PARAMS; i++)
+        if(active[i])
+            num_active++;
+
+    int n2 = 2*mPointsPerView;
+    CvMat* image_points = cvCreateMat(mPointsPerView, 2, CV_64FC1);
+    CvMat* dpdrot  = cvCreateMat(n2, 3, CV_64FC1);
+    CvMat* dpdt    = cvCreateMat(n2, 3, CV_64FC1);
+    CvMat* dpdf    = cvCreateMat(n2, 2, CV_64FC1);
+    CvMat* dpdc    = cvCreateMat(n2, 2, CV_64FC1);
+    CvMat* dpddist = cvCreateMat(n2, 5, CV_64FC1);
+    CvMat* A       = cvCreateMat(n2, num_active, CV_64FC1);
+    CvMat* B       = cvCreateMat(n2, 6, CV_64FC1);
+    CvMat* S       = cvCreateMat(num_active, num_active, CV_64FC1);
+    CvMat* W       = cvCreateMat(num_active, 6, CV_64FC1);
+    CvMat* WVinv   = cvCreateMat(num_active, 6, CV_64FC1);
+    CvMat* V       = cvCreateMat(6, 6, CV_64FC1);
+    CvMat* Vinv    = cvCreateMat(6, 6, CV_64FC1);
+    CvMat* Sinv    = cvCreateMat(num_active, num_active, CV_64FC1);
+    cvZero(S);
+
+    double sum_sq = 0;
+    for(int v=0; v<mNumViews; v++){
+
+        // Evaluate reprojection and its Jacobians for this view.
+        CvMat object_points, measured, rotation_vector, translation_vector;
+        GetViewObjectPoints(v, &object_points);
+        GetViewImagePoints(v, &measured);
+        cvGetRow(mRotationVectors,    &rotation_vector,    v);
+        cvGetRow(mTranslationVectors, &translation_vector, v);
+        cvProjectPoints2(&object_points, &rotation_vector, &translation_vector, mIntrinsic, mDistortion,
+            image_points, dpdrot, dpdt, dpdf, dpdc, dpddist);
+        for(int j=0; j<mPointsPerView; j++){
+            double dx = CV_MAT_ELEM(*image_points, double, j, 0) - CV_MAT_ELEM(measured, float, j, 0);
+            double dy = CV_MAT_ELEM(*image_points, double, j, 1) - CV_MAT_ELEM(measured, float, j, 1);
+            sum_sq += dx*dx + dy*dy;
+        }
+
+        // Assemble the intrinsic and extrinsic blocks.
+        for(int r=0; r<n2; r++){
+            double full[NUM_INTRINSIC_PARAMS];
+            full[0] = CV_MAT_ELEM(*dpdf, double, r, 0);
+            full[1] = CV_MAT_ELEM(*dpdf, double, r, 1);
+            full[2] = CV_MAT_ELEM(*dpdc, double, r, 0);
+            full[3] = CV_MAT_ELEM(*dpdc, double, r, 1);
+            full[4] = CV_MAT_ELEM(*dpddist, double, r, 0);
+            full[5] = CV_MAT_ELEM(*dpddist, double, r, 1);
+            full[6] = CV_MAT_ELEM(*dpddist, double, r, 2);
+            full[7] = CV_MAT_ELEM(*dpddist, double, r, 3);
+            full[8] = CV_MAT_ELEM(*dpddist, double, r, 4);
+            for(int i=0, k=0; i<NUM_INTRINSIC_PARAMS; i++)
+                if(active[i])
+                    CV_MAT_ELEM(*A, double, r, k++) = full[i];
+            for(int i=0; i<3; i++){
+                CV_MAT_ELEM(*B, double, r, i)   = CV_MAT_ELEM(*dpdrot, double, r, i);
+                CV_MAT_ELEM(*B, double, r, i+3) = CV_MAT_ELEM(*dpdt,   double, r, i);
+            }
+        }
+
+        // Accumulate the reduced normal matrix.
+        cvGEMM(A, A, 1, S, 1, S, CV_GEMM_A_T);
+        cvGEMM(A, B, 1, NULL, 0, W, CV_GEMM_A_T);
+        cvGEMM(B, B, 1, NULL, 0, V, CV_GEMM_A_T);
+        cvInvert(V, Vinv, CV_SVD);
+        cvMatMul(W, Vinv, WVinv);
+        cvGEMM(WVinv, W, -1, S, 1, S, CV_GEMM_B_T);
+    }
+
+    // Scale the inverse reduced normal matrix by the residual variance.
+    int dof = 2*mPointsPerView*mNumViews - num_active - 6*mNumViews;
+    for(int i=0; i<NUM_INTRINSIC_PARAMS; i++)
+        mSigma[i] = active[i] ? DBL_MAX : 0;
+    if(dof > 0 && cvInvert(S, Sinv, CV_SVD) != 0){
+        double variance = sum_sq/dof;
+        for(int i=0, k=0; i<NUM_INTRINSIC_PARAMS; i++){
+            if(!active[i])
+                continue;
+            double var = variance*cvmGet(Sinv, k, k);
+            mSigma[i] = (var >= 0) ? sqrt(var) : DBL_MAX;
+            k++;
+        }
+    }
+
+    // Release allocated resources.
+    cvReleaseMat(&image_points);
+    cvReleaseMat(&dpdrot);
+    cvReleaseMat(&dpdt);
+    cvReleaseMat(&dpdf);
+    cvReleaseMat(&dpdc);
+    cvReleaseMat(&dpddist);
+    cvReleaseMat(&A);
+    cvReleaseMat(&B);
+    cvReleaseMat(&S);
+    cvReleaseMat(&W);
+    cvReleaseMat(&WVinv);
+    cvReleaseMat(&V);
+    cvReleaseMat(&Vinv);
+    cvReleaseMat(&Sinv);
+}
+
+// Build the cvCalibrateCamera2 flags for a distortion model ([tangential, 6th-order radial]).
+static int distortionModelFlags(const bool* dist_model)
+{
+    int calib_flags = 0;
+    if(!dist_model[0])
+        calib_flags |= CV_CALIB_ZERO_TANGENT_DIST;
+    if(!dist_model[1])
+        calib_flags |= CV_CALIB_FIX_K3;
+    return calib_flags;
+}
+
+// Read the camera parameters that determine the undistorted projector corners.
+static void getCameraParams(const CvMat* intrinsic, const CvMat* distortion, double* params)
+{
+    params[0] = cvmGet(intrinsic, 0, 0);
+    params[1] = cvmGet(intrinsic, 1, 1);
+    params[2] = cvmGet(intrinsic, 0, 2);
+    params[3] = cvmGet(intrinsic, 1, 2);
+    for(int i=0; i<5; i++)
+        params[4+i] = cvmGet(distortion, i, 0);
+}
+
+ProCamIncrementalCalibration::ProCamIncrementalCalibration(struct slParams* sl_params, struct slCalib* sl_calib,
+                                                           int max_views, bool calibrate_camera)
+{
+    mSlParams        = sl_params;
+    mCalibrateCamera = calibrate_camera;
+    mCamBoardN       = sl_params->cam_board_w*sl_params->cam_board_h;
+    mProjBoardN      = sl_params->proj_board_w*sl_params->proj_board_h;
+
+    mCamCalib  = new IncrementalCalibration(cvSize(sl_params->cam_w, sl_params->cam_h),
+        mCamBoardN, max_views, distortionModelFlags(sl_params->cam_dist_model));
+    mProjCalib = new IncrementalCalibration(cvSize(sl_params->proj_w, sl_params->proj_h),
+        mProjBoardN, max_views, distortionModelFlags(sl_params->proj_dist_model));
+
+    // Without camera calibration the projector views use the existing camera intrinsics.
+    mCamIntrinsic  = cvCreateMat(3, 3, CV_32FC1);
+    mCamDistortion = cvCreateMat(5, 1, CV_32FC1);
+    cvConvert(sl_calib->cam_intrinsic,  mCamIntrinsic);
+    cvConvert(sl_calib->cam_distortion, mCamDistortion);
+
+    mProjCamPoints = cvCreateMat(max_views*mProjBoardN, 2, CV_32FC1);
+    mViewCamParams.resize(max_views*NUM_CACHED_CAM_PARAMS, 0.0);
+}
+
+ProCamIncrementalCalibration::~ProCamIncrementalCalibration()
+{
+    delete mCamCalib;
+    delete mProjCalib;
+    cvReleaseMat(&mCamIntrinsic);
+    cvReleaseMat(&mCamDistortion);
+    cvReleaseMat(&mProjCamPoints);
+}
+
+void ProCamIncrementalCalibration::AddBoard(const CvMat* cam_image_points, const CvMat* cam_object_points,
+                                            const CvMat* proj_cam_points,  const CvMat* proj_image_points)
+{
+    // Store the camera view and the projected corners (board-plane points are evaluated below).
+    int view = mCamCalib->AddView(cam_object_points, cam_image_points);
+    if(view < 0)
+        return;
+    CvMat header;
+    cvConvert(proj_cam_points, cvGetRows(mProjCamPoints, &header, view*mProjBoardN, (view+1)*mProjBoardN));
+    CvMat* proj_object_points = cvCreateMat(mProjBoardN, 3, CV_32FC1);
+    cvZero(proj_object_points);
+    mProjCalib->AddView(proj_object_points, proj_image_points);
+    cvReleaseMat(&proj_object_points);
+
+    // Mark the new view as stale, then re-estimate the camera and the projector.
+    for(int i=0; i<NUM_CACHED_CAM_PARAMS; i++)
+        mViewCamParams[view*NUM_CACHED_CAM_PARAMS+i] = 0;
+    if(mCalibrateCamera && mCamCalib->Solve() >= 0)
+        mCamCalib->GetEstimate(mCamIntrinsic, mCamDistortion);
+    if(!mCalibrateCamera || mCamCalib->IsSolved()){
+        refreshProjectorViews();
+        mProjCalib->Solve();
+    }
+}
+
+void ProCamIncrementalCalibration::refreshProjectorViews()
+{
+    double cam_params[NUM_CACHED_CAM_PARAMS];
+    getCameraParams(mCamIntrinsic, mCamDistortion, cam_params);
+
+    CvMat* proj_object_points = cvCreateMat(mProjBoardN, 3, CV_32FC1);
+    for(int v=0; v<mCamCalib->GetViewCount(); v++){
+
+        // Reuse the cached correspondences while the camera estimate is (nearly) unchanged.
+        double* cached = &mViewCamParams[v*NUM_CACHED_CAM_PARAMS];
+        bool stale = false;
+        for(int i=0; i<NUM_CACHED_CAM_PARAMS; i++){
+            double scale = (i < 4) ? fabs(cam_params[i]) : 1.0;
+            if(fabs(cam_params[i]-cached[i]) > CAMERA_ESTIMATE_TOLERANCE*__max(scale, 1e-6))
+                stale = true;
+        }
+        if(!stale)
+            continue;
+
+        CvMat cam_image_points, cam_object_points, proj_cam_points;
+        mCamCalib->GetViewImagePoints(v, &cam_image_points);
+        mCamCalib->GetViewObjectPoints(v, &cam_object_points);
+        cvGetRows(mProjCamPoints, &proj_cam_points, v*mProjBoardN, (v+1)*mProjBoardN);
+        mapProjectorCornersToBoard(&cam_image_points, &cam_object_points, &proj_cam_points,
+            mCamIntrinsic, mCamDistortion, proj_object_points);
+        mProjCalib->SetViewObjectPoints(v, proj_object_points);
+        for(int i=0; i<NUM_CACHED_CAM_PARAMS; i++)
+            cached[i] = cam_params[i];
+    }
+    cvReleaseMat(&proj_object_points);
+}
+
+void ProCamIncrementalCalibration::DisplayProgress()
+{
+    if(mCalibrateCamera){
+        if(mCamCalib->IsSolved()){
+            const double* s = mCamCalib->GetUncertainty();
+            printf("+ Camera:    RMS error = %6.3f px, std. dev. (fx, fy, cx, cy) = (%.3f, %.3f, %.3f, %.3f)\n",
+                mCamCalib->GetRMSError(), s[0], s[1], s[2], s[3]);
+        }
+        else
+            printf("+ Camera:    waiting for more boards...\n");
+    }
+    if(mProjCalib->IsSolved()){
+        const double* s = mProjCalib->GetUncertainty();
+        printf("+ Projector: RMS error = %6.3f px, std. dev. (fx, fy, cx, cy) = (%.3f, %.3f, %.3f, %.3f)\n",
+            mProjCalib->GetRMSError(), s[0], s[1], s[2], s[3]);
+    }
+    else
+        printf("+ Projector: waiting for more boards...\n");
+}
+
+bool ProCamIncrementalCalibration::IsConverged()
+{
+    double threshold = mSlParams->calib_stop_uncertainty;
+    int    min_views = mSlParams->calib_min_boards;
+    if(mCalibrateCamera && !mCamCalib->IsConverged(threshold, min_views))
+        return false;
+    return mProjCalib->IsConverged(threshold, min_views);
+}
+
+bool ProCamIncrementalCalibration::GetEstimates(struct slCalib* sl_calib)
+{
+    if(!mProjCalib->IsSolved() || (mCalibrateCamera && !mCamCalib->IsSolved()))
+        return false;
+    if(mCalibrateCamera)
+        mCamCalib->GetEstimate(sl_calib->cam_intrinsic, sl_calib->cam_distortion);
+    mProjCalib->GetEstimate(sl_calib->proj_intrinsic, sl_calib->proj_distortion);
+    return true;
+}
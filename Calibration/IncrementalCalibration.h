@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\IncrementalCalibration.h
+//
+// summary:	Declares the incremental (warm-started) calibration classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  IncrementalCalibration
+///
+/// @brief  Re-estimates the intrinsics of a single camera (or projector) every time a new view
+///         is accepted.
+///
+///         All views are stored in pre-allocated contiguous matrices, so a solve only creates
+///         row headers over the first n views. After the first solve the previous estimate is
+///         used as the intrinsic guess for the next one. The marginal standard deviation of the
+///         intrinsic parameters is evaluated from the Jacobian of the reprojection error, with
+///         the per-view extrinsics eliminated by a Schur complement.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class IncrementalCalibration
+{
+public:
+    /// <summary> Number of intrinsic parameters (fx, fy, cx, cy, k1, k2, p1, p2, k3). </summary>
+    enum { NUM_INTRINSIC_PARAMS = 9 };
+
+    IncrementalCalibration(CvSize image_size, int points_per_view, int max_views, int calib_flags);
+    ~IncrementalCalibration();
+
+    // Append a view (object points are Nx3, image points are Nx2).
+    // Note: Returns the index of the view, or -1 if the capacity is exhausted.
+    int AddView(const CvMat* object_points, const CvMat* image_points);
+
+    // Replace the object points of a previously added view.
+    void SetViewObjectPoints(int view, const CvMat* object_points);
+
+    // Access the stored points of a view (returns a header, no data is copied).
+    CvMat* GetViewObjectPoints(int view, CvMat* header);
+    CvMat* GetViewImagePoints(int view, CvMat* header);
+
+    // Re-estimate the intrinsics from all views, warm-started from the previous estimate.
+    // Note: Returns the RMS reprojection error in pixels, or -1 if there are too few views.
+    double Solve();
+
+    // Copy the current estimate to the (32-bit or 64-bit) calibration matrices.
+    void GetEstimate(CvMat* intrinsic, CvMat* distortion);
+
+    // Standard deviation of each intrinsic parameter (in the order fx, fy, cx, cy, k1, k2, p1, p2, k3).
+    // Note: Fixed parameters report zero, undetermined ones DBL_MAX.
+    const double* GetUncertainty()  { return mSigma; };
+
+    // Largest standard deviation of the focal lengths and principal point (in pixels).
+    double GetMaxPixelUncertainty();
+
+    // Returns true once at least min_views are solved and the pixel uncertainty is below threshold.
+    bool IsConverged(double threshold, int min_views);
+
+    int    GetViewCount()           { return mNumViews; };
+    bool   IsSolved()               { return mSolved; };
+    double GetRMSError()            { return mRMSError; };
+
+private:
+    // Evaluate the marginal standard deviation of the intrinsics for the current solution.
+    void evaluateUncertainty();
+
+    CvSize mImageSize;
+    int    mPointsPerView;
+    int    mMaxViews;
+    int    mNumViews;
+    int    mFlags;
+    bool   mSolved;
+    double mRMSError;
+    double mSigma[NUM_INTRINSIC_PARAMS];
+
+    /// <summary> Stored correspondences (contiguous, one block of rows per view). </summary>
+    CvMat* mObjectPoints;
+    CvMat* mImagePoints;
+    CvMat* mPointCounts;
+
+    /// <summary> Current estimate (64-bit, reused as the intrinsic guess). </summary>
+    CvMat* mIntrinsic;
+    CvMat* mDistortion;
+    CvMat* mRotationVectors;
+    CvMat* mTranslationVectors;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  ProCamIncrementalCalibration
+///
+/// @brief  Incremental projector-camera calibration driven by the accepted boards.
+///
+///         The projector views depend on the camera intrinsics (the projected corners are
+///         undistorted and mapped onto the board plane), so each view caches its board-plane
+///         correspondences together with the camera estimate they were derived from. They are
+///         only re-evaluated once the camera estimate moves by more than a small tolerance.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class ProCamIncrementalCalibration
+{
+public:
+    ProCamIncrementalCalibration(struct slParams* sl_params, struct slCalib* sl_calib, int max_views, bool calibrate_camera);
+    ~ProCamIncrementalCalibration();
+
+    // Add an accepted board and re-estimate the camera (if enabled) and projector intrinsics.
+    // Note: cam_image_points/cam_object_points belong to the printed chessboard, proj_cam_points
+    //       are the projected corners seen by the camera, proj_image_points are projector pixels.
+    void AddBoard(const CvMat* cam_image_points, const CvMat* cam_object_points,
+                  const CvMat* proj_cam_points,  const CvMat* proj_image_points);
+
+    // Display running RMS error and parameter uncertainty on the console.
+    void DisplayProgress();
+
+    // Returns true once both devices are constrained below the configured uncertainty.
+    bool IsConverged();
+
+    // Copy the running estimates to the calibration (used to warm-start the final solve).
+    // Note: Returns true if estimates were available.
+    bool GetEstimates(struct slCalib* sl_calib);
+
+private:
+    // Re-evaluate the board-plane projector corners of every view derived from a stale camera estimate.
+    void refreshProjectorViews();
+
+    struct slParams* mSlParams;
+    bool   mCalibrateCamera;
+    int    mCamBoardN;
+    int    mProjBoardN;
+
+    IncrementalCalibration* mCamCalib;
+    IncrementalCalibration* mProjCalib;
+
+    /// <summary> Camera intrinsics used for the projector views (fixed unless the camera is calibrated too). </summary>
+    CvMat* mCamIntrinsic;
+    CvMat* mCamDistortion;
+
+    /// <summary> Projected corners in camera pixels, one block of rows per view. </summary>
+    CvMat* mProjCamPoints;
+
+    /// <summary> Camera intrinsics each cached projector view was evaluated with (fx, fy, cx, cy, k1..k3). </summary>
+    std::vector<double> mViewCamParams;
+};
@@ -0,0 +1,228 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\LatencyProbe.cpp
+//
+// summary:	Implements the projector-to-camera latency probe class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "LatencyProbe.h"
+#include "CalibrationSession.h"
+#include "Kinect-Trace.h"
+
+#include <algorithm>
+
+// Time to show the black and the white frame before their levels are taken (in milliseconds).
+static const double LATENCY_SETTLE_MS  = 1000.0;
+
+// Time a change may take before it counts as missed (in milliseconds).
+static const double LATENCY_TIMEOUT_MS = 2000.0;
+
+// Hold after a change was seen, plus a random part spreading the changes over the camera frame period.
+static const double LATENCY_HOLD_MS    = 100.0;
+static const int    LATENCY_JITTER_MS  = 50;
+
+// A frame shows the new pattern once its level is within this fraction of the contrast from the new level.
+static const double LATENCY_SETTLED_FRACTION = 0.1;
+
+// Minimum difference of the white and the black level (mean brightness, 0-255).
+static const double LATENCY_MIN_CONTRAST = 16.0;
+
+LatencyProbe::LatencyProbe(Camera* camera, PatternCache* pattern_cache, struct slParams* sl_params)
+{
+    mCamera       = camera;
+    mPatternCache = pattern_cache;
+    mListener     = NULL;
+    mSlParams     = sl_params;
+    mPhase        = PROBE_IDLE;
+    mWhite        = false;
+    mShownTime    = 0;
+    mMidpointTime = 0;
+    mHoldUntil    = 0;
+    mBlackLevel   = 0;
+    mWhiteLevel   = 0;
+    mChanges      = 0;
+    mMisses       = 0;
+    mDelay        = sl_params->delay;
+    QueryPerformanceFrequency(&mFrequency);
+    mStart.QuadPart = 0;
+}
+
+void LatencyProbe::Start()
+{
+    mSamples.clear();
+    mLatencies.clear();
+    mMidpointLatencies.clear();
+    mChanges = 0;
+    mMisses  = 0;
+    QueryPerformanceCounter(&mStart);
+    printf("Measuring the projector-to-camera latency (%d pattern changes)...\n", mSlParams->latency_changes);
+    mPhase = PROBE_SETTLE_BLACK;
+    show(false);
+}
+
+bool LatencyProbe::Step()
+{
+    KINECT_TRACE_SCOPE("calibration.latency_probe");
+    switch(mPhase){
+    case PROBE_SETTLE_BLACK:
+    case PROBE_SETTLE_WHITE:
+        {
+            double level = capture();
+            if(now() - mShownTime < LATENCY_SETTLE_MS)
+                break;
+            if(mPhase == PROBE_SETTLE_BLACK){
+                mBlackLevel = level;
+                mPhase = PROBE_SETTLE_WHITE;
+                show(true);
+                break;
+            }
+            mWhiteLevel = level;
+            if(mWhiteLevel - mBlackLevel < LATENCY_MIN_CONTRAST){
+                fail("the camera does not see the projector");
+                break;
+            }
+
+            // Flash between the levels, starting from white.
+            mPhase = PROBE_CHANGE;
+            show(false);
+        }
+        break;
+
+    case PROBE_CHANGE:
+        {
+            // The first frame within a fraction of the new level shows the new pattern (a frame past
+            // the midpoint may still blend both).
+            double level   = capture();
+            double mid     = 0.5*(mBlackLevel + mWhiteLevel);
+            double settled = LATENCY_SETTLED_FRACTION*(mWhiteLevel - mBlackLevel);
+            double time    = mSamples.back().time;
+            if(mMidpointTime == 0 && (mWhite ? level > mid : level < mid))
+                mMidpointTime = time;
+            if(mWhite ? level >= mWhiteLevel - settled : level <= mBlackLevel + settled){
+                mLatencies.push_back(time - mShownTime);
+                mMidpointLatencies.push_back(mMidpointTime - mShownTime);
+                mChanges++;
+                mHoldUntil = time + LATENCY_HOLD_MS + rand()%LATENCY_JITTER_MS;
+                mPhase = PROBE_HOLD;
+            }
+            else if(time - mShownTime > LATENCY_TIMEOUT_MS){
+                mChanges++;
+                if(++mMisses > mSlParams->latency_changes/4){
+                    fail("pattern changes were missed");
+                    break;
+                }
+                show(!mWhite);
+            }
+        }
+        break;
+
+    case PROBE_HOLD:
+        capture();
+        if(now() < mHoldUntil)
+            break;
+        if(mChanges < mSlParams->latency_changes){
+            mPhase = PROBE_CHANGE;
+            show(!mWhite);
+            break;
+        }
+        mDelay = (int)ceil(GetLatency(mSlParams->latency_percentile) + mSlParams->latency_margin);
+        mPhase = PROBE_DONE;
+        DisplayResults();
+        break;
+
+    default:
+        break;
+    }
+    return !IsFinished();
+}
+
+double LatencyProbe::GetLatency(double percentile)
+{
+    if(mLatencies.empty())
+        return 0;
+
+    // Nearest rank.
+    std::vector<double> sorted(mLatencies);
+    std::sort(sorted.begin(), sorted.end());
+    int rank = (int)ceil(percentile/100.0*sorted.size()) - 1;
+    rank = MAX(0, MIN((int)sorted.size()-1, rank));
+    return sorted[rank];
+}
+
+void LatencyProbe::DisplayResults()
+{
+    printf("Projector-to-camera latency over %d changes (%d missed):\n", (int)mLatencies.size(), mMisses);
+    printf("  minimum %.1f ms, median %.1f ms, %.0fth percentile %.1f ms, maximum %.1f ms\n",
+        GetLatency(0), GetLatency(50), mSlParams->latency_percentile,
+        GetLatency(mSlParams->latency_percentile), GetLatency(100));
+    if(!mMidpointLatencies.empty()){
+        std::vector<double> sorted(mMidpointLatencies);
+        std::sort(sorted.begin(), sorted.end());
+        printf("  (midpoint crossed after a median of %.1f ms)\n", sorted[(sorted.size()-1)/2]);
+    }
+    printf("Capture delay is %d ms (configured frame delay is %d ms).\n", mDelay, mSlParams->delay);
+}
+
+int LatencyProbe::SaveLog(const char* filename)
+{
+    FILE* pFile = fopen(filename, "w");
+    if(pFile == NULL){
+        printf("ERROR: Cannot write latency log \"%s\"!\n", filename);
+        return -1;
+    }
+    fprintf(pFile, "# black level %.1f, white level %.1f, delay %d ms\n", mBlackLevel, mWhiteLevel, mDelay);
+    fprintf(pFile, "# sequence time_ms level change\n");
+    for(unsigned int i=0; i<mSamples.size(); i++)
+        fprintf(pFile, "%d %.3f %.2f %d\n", mSamples[i].sequence, mSamples[i].time, mSamples[i].level, mSamples[i].change);
+    fprintf(pFile, "# latency_ms midpoint_ms\n");
+    for(unsigned int i=0; i<mLatencies.size(); i++)
+        fprintf(pFile, "%.3f %.3f\n", mLatencies[i], mMidpointLatencies[i]);
+    fclose(pFile);
+    return 0;
+}
+
+void LatencyProbe::show(bool white)
+{
+    // Projector gain is not applied (a gain of 50 is the identity).
+    double value = white ? 255.0 : 0.0;
+    mWhite = white;
+    if(mListener != NULL)
+        mListener->ShowPattern(mPatternCache->GetSolid(cvScalar(value, value, value), 50));
+    mShownTime    = now();
+    mMidpointTime = 0;
+}
+
+void LatencyProbe::fail(const char* reason)
+{
+    printf("ERROR: Latency measurement failed (%s)!\n", reason);
+    printf("The configured frame delay of %d ms is used.\n", mSlParams->delay);
+    mDelay = mSlParams->delay;
+    mPhase = PROBE_FAILED;
+}
+
+double LatencyProbe::capture()
+{
+    IplImage* frame = mCamera->QueryFrame();
+    CvScalar mean = cvAvg(frame);
+    double level = 0;
+    for(int c=0; c<frame->nChannels; c++)
+        level += mean.val[c];
+    level /= frame->nChannels;
+    cvReleaseImage(&frame);
+
+    Sample sample;
+    sample.sequence = (int)mSamples.size();
+    sample.time     = now();
+    sample.level    = level;
+    sample.change   = (mPhase == PROBE_CHANGE || mPhase == PROBE_HOLD) ? mChanges : -1;
+    mSamples.push_back(sample);
+    return level;
+}
+
+double LatencyProbe::now()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return 1000.0*(counter.QuadPart - mStart.QuadPart)/mFrequency.QuadPart;
+}
@@ -0,0 +1,123 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\LatencyProbe.h
+//
+// summary:	Declares the projector-to-camera latency probe class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "Camera.h"
+#include "PatternCache.h"
+
+#include <vector>
+
+class CalibrationSessionListener;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  LatencyProbe
+///
+/// @brief  Measures the latency from a pattern change on the projector to the first camera frame
+///         showing it, to replace the fixed frame delay.
+///
+///         The probe first settles on a black and a white frame to learn the two brightness levels,
+///         then flashes between them. Every captured frame is logged with a sequence number, its
+///         timestamp and mean brightness; the latency of a change is the time until the first frame
+///         within 10% of the new level (a frame past the midpoint may still blend both patterns).
+///         The time the midpoint was crossed is logged as well, for diagnostics. The changes are
+///         spread over the camera frame period by a random hold, so the latencies sample the whole
+///         distribution. The delay is a percentile of the latencies plus a margin.
+///
+///         Like CalibrationSession, Step() never waits, so the probe can run from an event loop;
+///         the patterns go to the listener's ShowPattern().
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class LatencyProbe
+{
+public:
+    /// <summary> A captured frame. </summary>
+    struct Sample
+    {
+        int    sequence;                // frame number (from 0)
+        double time;                    // capture time (in ms since the probe started)
+        double level;                   // mean brightness
+        int    change;                  // pattern change the frame belongs to (-1 while settling)
+    };
+
+    LatencyProbe(Camera* camera, PatternCache* pattern_cache, struct slParams* sl_params);
+
+    void SetListener(CalibrationSessionListener* listener)     { mListener = listener; };
+
+    void Start();
+
+    // Do the work of the current phase without blocking; returns false once the probe has finished.
+    bool Step();
+
+    bool IsFinished()                       { return mPhase == PROBE_DONE || mPhase == PROBE_FAILED; };
+    bool Succeeded()                        { return mPhase == PROBE_DONE; };
+
+    // The capture delay: the configured percentile of the latencies plus the margin (in ms).
+    int GetDelay()                          { return mDelay; };
+
+    // Latency at percentile (0-100) of the measured changes (in ms).
+    double GetLatency(double percentile);
+
+    const std::vector<Sample>& GetSamples() { return mSamples; };
+    const std::vector<double>& GetLatencies() { return mLatencies; };
+
+    // Time until the first frame past the midpoint of the levels, for each latency (in ms).
+    const std::vector<double>& GetMidpointLatencies() { return mMidpointLatencies; };
+
+    // Print the latency distribution to the console.
+    void DisplayResults();
+
+    // Write the frame log (one line per frame) and the latencies.
+    // Note: Returns -1 if the file cannot be written.
+    int SaveLog(const char* filename);
+
+private:
+    enum Phase
+    {
+        PROBE_IDLE = 0,
+        PROBE_SETTLE_BLACK,             // learn the black level
+        PROBE_SETTLE_WHITE,             // learn the white level
+        PROBE_CHANGE,                   // waiting for the first frame after a change
+        PROBE_HOLD,                     // holding the pattern before the next change
+        PROBE_DONE,
+        PROBE_FAILED
+    };
+
+    void show(bool white);
+    void fail(const char* reason);
+
+    // Capture a frame and log it; returns its mean brightness.
+    double capture();
+
+    // Milliseconds since Start().
+    double now();
+
+    Camera*                     mCamera;
+    PatternCache*               mPatternCache;
+    CalibrationSessionListener* mListener;
+    struct slParams*            mSlParams;
+
+    Phase                       mPhase;
+    bool                        mWhite;         // pattern on the projector
+    double                      mShownTime;     // when it was shown
+    double                      mMidpointTime;  // when the midpoint was crossed since (0 = not yet)
+    double                      mHoldUntil;
+    double                      mBlackLevel;
+    double                      mWhiteLevel;
+    int                         mChanges;
+    int                         mMisses;
+    int                         mDelay;
+
+    LARGE_INTEGER               mFrequency;
+    LARGE_INTEGER               mStart;
+
+    std::vector<Sample>         mSamples;
+    std::vector<double>         mLatencies;
+    std::vector<double>         mMidpointLatencies;
+};
@@ -0,0 +1,279 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\NormalEstimator.cpp
+//
+// summary:	Implements the integral image normal estimation class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "NormalEstimator.h"
+#include "Kinect-Parallel.h"
+
+// Channels of an integral image entry: horizontal difference sum (x, y, z) and count, then the
+// vertical difference sum (x, y, z) and count.
+static const int NORMAL_CHANNELS = 8;
+
+// Accumulate the differences of each row (row prefix sums) and mark the depth discontinuities.
+class DifferenceRowBody : public Kinect::ParallelLoopBody
+{
+public:
+    DifferenceRowBody(const CvMat* points, const CvMat* mask, int width, int height, float max_depth_change,
+                      double* integral, int* distance)
+    {
+        mPoints         = points;
+        mMask           = mask;
+        mWidth          = width;
+        mHeight         = height;
+        mMaxDepthChange = max_depth_change;
+        mIntegral       = integral;
+        mDistance       = distance;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        const float* X = mPoints->data.fl;
+        const float* Y = X + mPoints->step/sizeof(float);
+        const float* Z = Y + mPoints->step/sizeof(float);
+        int no_edge = mWidth + mHeight;
+        for(int r=begin; r<end; r++){
+            double* I = mIntegral + ((r + 1)*(mWidth + 1) + 1)*NORMAL_CHANNELS;
+            double  acc[NORMAL_CHANNELS] = {0, 0, 0, 0, 0, 0, 0, 0};
+            for(int c=0; c<mWidth; c++){
+                int  i    = r*mWidth + c;
+                bool edge = false;
+                if(isValid(i)){
+                    // Difference to the right neighbour.
+                    if(c + 1 < mWidth && isValid(i + 1)){
+                        if(fabs(Z[i+1] - Z[i]) < mMaxDepthChange){
+                            acc[0] += X[i+1] - X[i];
+                            acc[1] += Y[i+1] - Y[i];
+                            acc[2] += Z[i+1] - Z[i];
+                            acc[3] += 1;
+                        }
+                        else
+                            edge = true;
+                    }
+                    // Difference to the neighbour below.
+                    if(r + 1 < mHeight && isValid(i + mWidth)){
+                        if(fabs(Z[i+mWidth] - Z[i]) < mMaxDepthChange){
+                            acc[4] += X[i+mWidth] - X[i];
+                            acc[5] += Y[i+mWidth] - Y[i];
+                            acc[6] += Z[i+mWidth] - Z[i];
+                            acc[7] += 1;
+                        }
+                        else
+                            edge = true;
+                    }
+                    // Discontinuities to the left and above (marked on both sides).
+                    if(c > 0 && isValid(i - 1) && !(fabs(Z[i-1] - Z[i]) < mMaxDepthChange))
+                        edge = true;
+                    if(r > 0 && isValid(i - mWidth) && !(fabs(Z[i-mWidth] - Z[i]) < mMaxDepthChange))
+                        edge = true;
+                }
+                for(int k=0; k<NORMAL_CHANNELS; k++)
+                    I[c*NORMAL_CHANNELS+k] = acc[k];
+                mDistance[i] = edge ? 0 : no_edge;
+            }
+        }
+    }
+
+private:
+    bool isValid(int i) const
+    {
+        return mMask == NULL || mMask->data.fl[i] != 0;
+    }
+
+    const CvMat* mPoints;
+    const CvMat* mMask;
+    int          mWidth;
+    int          mHeight;
+    float        mMaxDepthChange;
+    double*      mIntegral;
+    int*         mDistance;
+};
+
+// Accumulate the row prefix sums down a range of columns (completing the integral images).
+class IntegralColumnBody : public Kinect::ParallelLoopBody
+{
+public:
+    IntegralColumnBody(int width, int height, double* integral)
+    {
+        mWidth    = width;
+        mHeight   = height;
+        mIntegral = integral;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        int step = (mWidth + 1)*NORMAL_CHANNELS;
+        for(int r=2; r<=mHeight; r++){
+            double*       I     = mIntegral + r*step;
+            const double* above = I - step;
+            for(int j=(begin+1)*NORMAL_CHANNELS; j<(end+1)*NORMAL_CHANNELS; j++)
+                I[j] += above[j];
+        }
+    }
+
+private:
+    int     mWidth;
+    int     mHeight;
+    double* mIntegral;
+};
+
+// Evaluate the normals of a range of rows from the integral images.
+class NormalRowBody : public Kinect::ParallelLoopBody
+{
+public:
+    NormalRowBody(const CvMat* points, const CvMat* mask, int width, int height, int radius,
+                  const double* integral, const int* distance, CvMat* normals, int* counts)
+    {
+        mPoints   = points;
+        mMask     = mask;
+        mWidth    = width;
+        mHeight   = height;
+        mRadius   = radius;
+        mIntegral = integral;
+        mDistance = distance;
+        mNormals  = normals;
+        mCounts   = counts;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        const float* X  = mPoints->data.fl;
+        const float* Y  = X + mPoints->step/sizeof(float);
+        const float* Z  = Y + mPoints->step/sizeof(float);
+        float*       NX = mNormals->data.fl;
+        float*       NY = NX + mNormals->step/sizeof(float);
+        float*       NZ = NY + mNormals->step/sizeof(float);
+        for(int r=begin; r<end; r++){
+            int count = 0;
+            for(int c=0; c<mWidth; c++){
+                int i = r*mWidth + c;
+                NX[i] = NY[i] = NZ[i] = 0;
+                if(mMask != NULL && mMask->data.fl[i] == 0)
+                    continue;
+
+                // Shrink the window to the nearest discontinuity.
+                int radius = MAX(1, MIN(mRadius, mDistance[i]));
+                int r0 = MAX(r - radius, 0), r1 = MIN(r + radius, mHeight - 1);
+                int c0 = MAX(c - radius, 0), c1 = MIN(c + radius, mWidth - 1);
+
+                // Horizontal differences start in columns c0..c1-1, vertical ones in rows r0..r1-1.
+                double h[4], v[4];
+                boxSum(r0, r1,     c0, c1 - 1, 0, h);
+                boxSum(r0, r1 - 1, c0, c1,     4, v);
+                if(h[3] < 1 || v[3] < 1)
+                    continue;
+
+                double n[3] = { h[1]*v[2] - h[2]*v[1],
+                                h[2]*v[0] - h[0]*v[2],
+                                h[0]*v[1] - h[1]*v[0] };
+                double len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                if(!(len > 0))
+                    continue;
+                // Orient towards the camera center (the origin).
+                if(n[0]*X[i] + n[1]*Y[i] + n[2]*Z[i] > 0)
+                    len = -len;
+                NX[i] = (float)(n[0]/len);
+                NY[i] = (float)(n[1]/len);
+                NZ[i] = (float)(n[2]/len);
+                count++;
+            }
+            mCounts[r] = count;
+        }
+    }
+
+private:
+    // Sum the 4 channels starting at channel over pixel rows r0..r1 and columns c0..c1.
+    void boxSum(int r0, int r1, int c0, int c1, int channel, double* sum) const
+    {
+        if(r1 < r0 || c1 < c0){
+            sum[0] = sum[1] = sum[2] = sum[3] = 0;
+            return;
+        }
+        int step = (mWidth + 1)*NORMAL_CHANNELS;
+        const double* a = mIntegral + r0*step       + c0*NORMAL_CHANNELS       + channel;
+        const double* b = mIntegral + r0*step       + (c1 + 1)*NORMAL_CHANNELS + channel;
+        const double* d = mIntegral + (r1 + 1)*step + c0*NORMAL_CHANNELS       + channel;
+        const double* e = mIntegral + (r1 + 1)*step + (c1 + 1)*NORMAL_CHANNELS + channel;
+        for(int k=0; k<4; k++)
+            sum[k] = e[k] - b[k] - d[k] + a[k];
+    }
+
+    const CvMat*  mPoints;
+    const CvMat*  mMask;
+    int           mWidth;
+    int           mHeight;
+    int           mRadius;
+    const double* mIntegral;
+    const int*    mDistance;
+    CvMat*        mNormals;
+    int*          mCounts;
+};
+
+// Configure the window radius and depth discontinuity threshold from the scanning options.
+NormalEstimator::NormalEstimator(struct slParams* sl_params)
+{
+    mWidth          = sl_params->cam_w;
+    mHeight         = sl_params->cam_h;
+    mRadius         = MAX(1, sl_params->normal_radius);
+    mMaxDepthChange = sl_params->normal_max_depth_change;
+}
+
+// Estimate the normals of the points for which mask is non-zero.
+int NormalEstimator::Compute(const CvMat* points, const CvMat* mask, CvMat* normals)
+{
+    int n = mWidth*mHeight;
+    if(points == NULL || normals == NULL || points->cols != n || points->rows < 3 ||
+       normals->cols != n || normals->rows < 3 || (mask != NULL && mask->cols*mask->rows < n)){
+        printf("ERROR: Invalid point cloud for normal estimation!\n");
+        return 0;
+    }
+
+    // Build the integral images (the first row and column stay zero).
+    mIntegral.assign((mWidth + 1)*(mHeight + 1)*NORMAL_CHANNELS, 0.0);
+    mDistance.resize(n);
+    DifferenceRowBody row_body(points, mask, mWidth, mHeight, mMaxDepthChange, &mIntegral[0], &mDistance[0]);
+    Kinect::ParallelFor(0, mHeight, row_body, 16);
+    IntegralColumnBody column_body(mWidth, mHeight, &mIntegral[0]);
+    Kinect::ParallelFor(0, mWidth, column_body, 64);
+
+    // Chessboard distance transform of the discontinuities (two sequential passes).
+    int* D = &mDistance[0];
+    for(int r=0; r<mHeight; r++){
+        for(int c=0; c<mWidth; c++){
+            int i = r*mWidth + c;
+            int d = D[i];
+            if(c > 0)                     d = MIN(d, D[i-1] + 1);
+            if(r > 0){
+                                          d = MIN(d, D[i-mWidth] + 1);
+                if(c > 0)                 d = MIN(d, D[i-mWidth-1] + 1);
+                if(c + 1 < mWidth)        d = MIN(d, D[i-mWidth+1] + 1);
+            }
+            D[i] = d;
+        }
+    }
+    for(int r=mHeight-1; r>=0; r--){
+        for(int c=mWidth-1; c>=0; c--){
+            int i = r*mWidth + c;
+            int d = D[i];
+            if(c + 1 < mWidth)            d = MIN(d, D[i+1] + 1);
+            if(r + 1 < mHeight){
+                                          d = MIN(d, D[i+mWidth] + 1);
+                if(c + 1 < mWidth)        d = MIN(d, D[i+mWidth+1] + 1);
+                if(c > 0)                 d = MIN(d, D[i+mWidth-1] + 1);
+            }
+            D[i] = d;
+        }
+    }
+
+    // Evaluate the normals.
+    std::vector<int> counts(mHeight, 0);
+    NormalRowBody normal_body(points, mask, mWidth, mHeight, mRadius, &mIntegral[0], &mDistance[0], normals, &counts[0]);
+    Kinect::ParallelFor(0, mHeight, normal_body, 16);
+
+    int count = 0;
+    for(int r=0; r<mHeight; r++)
+        count += counts[r];
+    return count;
+}
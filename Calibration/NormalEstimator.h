@@ -0,0 +1,59 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\NormalEstimator.h
+//
+// summary:	Declares the integral image normal estimation class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  NormalEstimator
+///
+/// @brief  Smoothed surface normals of organized point clouds (one point per camera pixel).
+///
+///         The normal of a pixel is the cross product of the mean horizontal and the mean
+///         vertical 3D difference vectors in a square window around it. Differences are only
+///         accumulated between neighbouring valid pixels whose depths differ by less than the
+///         maximum depth change, so the window never averages across a depth discontinuity or a
+///         hole. The window sums come from integral images of the difference vectors (and their
+///         counts), so the cost per pixel does not depend on the window size. Additionally, the
+///         window is shrunk to the (chessboard) distance to the nearest discontinuity, which
+///         keeps surfaces on either side of an edge from blending. Normals point towards the
+///         camera. Integral images and normals are computed in parallel row (or column) bands.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class NormalEstimator
+{
+public:
+    // Configure the window radius and depth discontinuity threshold from the scanning options.
+    NormalEstimator(struct slParams* sl_params);
+
+    // Set the maximum window radius (in pixels, the window is 2*radius+1 pixels wide).
+    void SetRadius(int radius)      { mRadius = MAX(1, radius); };
+
+    // Set the maximum depth change between neighbouring pixels of the same surface (in mm).
+    void SetMaxDepthChange(float max_depth_change) { mMaxDepthChange = max_depth_change; };
+
+    // Estimate the normals of the points (3 x width*height, CV_32FC1) for which mask (1 x
+    // width*height, CV_32FC1) is non-zero (or all of them without a mask).
+    // Note: normals (3 x width*height, CV_32FC1) receives unit normals in its X, Y and Z rows, and
+    //       zero vectors where no normal could be estimated. Returns the number of normals.
+    int Compute(const CvMat* points, const CvMat* mask, CvMat* normals);
+
+private:
+    int   mWidth;
+    int   mHeight;
+    int   mRadius;
+    float mMaxDepthChange;
+
+    /// <summary> Integral images of the horizontal and vertical differences (8 channels per entry). </summary>
+    std::vector<double> mIntegral;
+
+    /// <summary> Chessboard distance of every pixel to the nearest depth discontinuity. </summary>
+    std::vector<int> mDistance;
+};
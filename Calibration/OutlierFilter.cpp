@@ -0,0 +1,153 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\OutlierFilter.cpp
+//
+// summary:	Implements the point cloud outlier filter class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "OutlierFilter.h"
+#include "Kinect-Parallel.h"
+
+#include <float.h>
+
+// Number of points per parallel query block.
+static const int OUTLIER_BLOCK_SIZE = 1024;
+
+// Maximum number of neighbours of the statistical filter.
+static const int OUTLIER_MAX_NEIGHBORS = 64;
+
+// Evaluate the mean distance to the k nearest neighbours for a range of query blocks.
+class MeanDistanceBody : public Kinect::ParallelLoopBody
+{
+public:
+    MeanDistanceBody(const PointKdTree& tree, int k, float* mean_dist) : mTree(tree)
+    {
+        mK        = k;
+        mMeanDist = mean_dist;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        int   indices[OUTLIER_MAX_NEIGHBORS + 1];
+        float dist2[OUTLIER_MAX_NEIGHBORS + 1];
+        int   last = MIN(end*OUTLIER_BLOCK_SIZE, mTree.GetCount());
+        for(int i=begin*OUTLIER_BLOCK_SIZE; i<last; i++){
+            // The nearest point is the query itself.
+            int   n   = mTree.KnnSearch(mTree.GetPoint(i), mK + 1, indices, dist2);
+            float sum = 0;
+            for(int j=1; j<n; j++)
+                sum += sqrt(dist2[j]);
+            mMeanDist[i] = (n > 1) ? sum/(n - 1) : FLT_MAX;
+        }
+    }
+
+private:
+    const PointKdTree& mTree;
+    int                mK;
+    float*             mMeanDist;
+};
+
+// Flag the points of a range of query blocks with too few neighbours within the radius.
+class RadiusCountBody : public Kinect::ParallelLoopBody
+{
+public:
+    RadiusCountBody(const PointKdTree& tree, float radius, int min_neighbors, unsigned char* reject) : mTree(tree)
+    {
+        mRadius       = radius;
+        mMinNeighbors = min_neighbors;
+        mReject       = reject;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        int last = MIN(end*OUTLIER_BLOCK_SIZE, mTree.GetCount());
+        for(int i=begin*OUTLIER_BLOCK_SIZE; i<last; i++){
+            // Count the query itself as well.
+            int n = mTree.RadiusCount(mTree.GetPoint(i), mRadius, mMinNeighbors + 1);
+            mReject[i] = (n < mMinNeighbors + 1);
+        }
+    }
+
+private:
+    const PointKdTree& mTree;
+    float              mRadius;
+    int                mMinNeighbors;
+    unsigned char*     mReject;
+};
+
+// Configure the filters from the outlier removal options.
+OutlierFilter::OutlierFilter(struct slParams* sl_params)
+{
+    mNeighbors    = sl_params->outlier_neighbors;
+    mStdRatio     = sl_params->outlier_std_ratio;
+    mRadius       = sl_params->outlier_radius;
+    mMinNeighbors = sl_params->outlier_min_neighbors;
+}
+
+int OutlierFilter::Apply(const CvMat* points, CvMat* mask)
+{
+    PointKdTree tree;
+    int removed = 0;
+    if(mNeighbors > 0){
+        tree.Build(points, mask);
+        removed += FilterStatistical(tree, mask);
+    }
+    if(mRadius > 0 && mMinNeighbors > 0){
+        // Rebuild without the statistical outliers (they no longer count as neighbours).
+        if(removed > 0 || tree.GetCount() == 0)
+            tree.Build(points, mask);
+        removed += FilterRadius(tree, mask);
+    }
+    return removed;
+}
+
+int OutlierFilter::FilterStatistical(const PointKdTree& tree, CvMat* mask)
+{
+    int n = tree.GetCount();
+    int k = MIN(MAX(mNeighbors, 1), OUTLIER_MAX_NEIGHBORS);
+    if(n <= k || mask == NULL)
+        return 0;
+
+    std::vector<float> mean_dist(n);
+    MeanDistanceBody body(tree, k, &mean_dist[0]);
+    Kinect::ParallelFor(0, (n + OUTLIER_BLOCK_SIZE - 1)/OUTLIER_BLOCK_SIZE, body);
+
+    // Reject points beyond the mean plus std_ratio standard deviations.
+    double sum = 0, sum2 = 0;
+    for(int i=0; i<n; i++){
+        sum  += mean_dist[i];
+        sum2 += (double)mean_dist[i]*mean_dist[i];
+    }
+    double mean      = sum/n;
+    double deviation = sqrt(MAX(sum2/n - mean*mean, 0.0));
+    float  threshold = (float)(mean + mStdRatio*deviation);
+
+    int removed = 0;
+    for(int i=0; i<n; i++){
+        if(mean_dist[i] > threshold){
+            mask->data.fl[tree.GetIndex(i)] = 0;
+            removed++;
+        }
+    }
+    return removed;
+}
+
+int OutlierFilter::FilterRadius(const PointKdTree& tree, CvMat* mask)
+{
+    int n = tree.GetCount();
+    if(n == 0 || mask == NULL || !(mRadius > 0))
+        return 0;
+
+    std::vector<unsigned char> reject(n);
+    RadiusCountBody body(tree, mRadius, mMinNeighbors, &reject[0]);
+    Kinect::ParallelFor(0, (n + OUTLIER_BLOCK_SIZE - 1)/OUTLIER_BLOCK_SIZE, body);
+
+    int removed = 0;
+    for(int i=0; i<n; i++){
+        if(reject[i]){
+            mask->data.fl[tree.GetIndex(i)] = 0;
+            removed++;
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\OutlierFilter.h
+//
+// summary:	Declares the point cloud outlier filter class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "PointKdTree.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  OutlierFilter
+///
+/// @brief  Removes stray points from reconstructed point clouds (structured light or Kinect).
+///
+///         Both filters index the valid points with a PointKdTree and clear the mask of the points
+///         they reject. The neighbourhood queries run in parallel blocks of points in tree order,
+///         so that neighbouring queries touch the same leaves.
+///           - Statistical: the mean distance of every point to its k nearest neighbours is
+///             evaluated, and points whose mean distance exceeds the global mean by more than
+///             std_ratio standard deviations are removed.
+///           - Radius: points with fewer than min_neighbors other points within radius are
+///             removed.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class OutlierFilter
+{
+public:
+    // Configure the filters from the outlier removal options.
+    OutlierFilter(struct slParams* sl_params);
+
+    void SetStatistical(int neighbors, float std_ratio)     { mNeighbors = neighbors; mStdRatio = std_ratio; };
+    void SetRadius(float radius, int min_neighbors)         { mRadius = radius; mMinNeighbors = min_neighbors; };
+
+    // Apply the enabled filters (statistical if neighbors > 0, radius if radius > 0) to the points
+    // (3xN, CV_32FC1) and clear the rejected points in mask (1xN, CV_32FC1).
+    // Returns the number of removed points.
+    int Apply(const CvMat* points, CvMat* mask);
+
+    // Statistical outlier removal on an existing tree (built from points with mask).
+    int FilterStatistical(const PointKdTree& tree, CvMat* mask);
+
+    // Radius outlier removal on an existing tree (built from points with mask).
+    int FilterRadius(const PointKdTree& tree, CvMat* mask);
+
+private:
+    int   mNeighbors;
+    float mStdRatio;
+    float mRadius;
+    int   mMinNeighbors;
+};
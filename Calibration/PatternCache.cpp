@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PatternCache.cpp
+//
+// summary:	Implements the projector pattern cache class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "PatternCache.h"
+
+PatternCache::PatternCache(CvSize size)
+{
+    mSize    = size;
+    mLUT     = cvCreateMat(1, 256, CV_8UC1);
+    mLUTGain = -1;
+    mGray    = cvCreateImage(size, IPL_DEPTH_8U, 1);
+    mWarped  = cvCreateImage(size, IPL_DEPTH_8U, 3);
+}
+
+PatternCache::~PatternCache()
+{
+    Clear();
+    cvReleaseMat(&mLUT);
+    cvReleaseImage(&mGray);
+    cvReleaseImage(&mWarped);
+}
+
+void PatternCache::Clear()
+{
+    for(unsigned int i=0; i<mEntries.size(); i++)
+        cvReleaseImage(&mEntries[i].image);
+    mEntries.clear();
+}
+
+const CvMat* PatternCache::gainLUT(int gain)
+{
+    if(gain != mLUTGain){
+        double scale = 2.*(gain/100.);
+        for(int i=0; i<256; i++)
+            mLUT->data.ptr[i] = CV_CAST_8U(cvRound(i*scale));
+        mLUTGain = gain;
+    }
+    return mLUT;
+}
+
+PatternCache::Entry* PatternCache::find(int pattern_id, int gain, CvScalar color)
+{
+    for(unsigned int i=0; i<mEntries.size(); i++){
+        Entry& e = mEntries[i];
+        if(e.pattern_id != pattern_id || e.gain != gain)
+            continue;
+        bool match = true;
+        for(int k=0; k<4; k++)
+            match &= (e.color.val[k] == color.val[k]);
+        if(match)
+            return &e;
+    }
+    return NULL;
+}
+
+PatternCache::Entry* PatternCache::insert(int pattern_id, int gain, CvScalar color)
+{
+    // Evict the oldest frame once the cache is full (reusing its image).
+    Entry e;
+    if(mEntries.size() >= MAX_ENTRIES){
+        e.image = mEntries[0].image;
+        mEntries.erase(mEntries.begin());
+    }
+    else
+        e.image = cvCreateImage(mSize, IPL_DEPTH_8U, 3);
+    e.pattern_id = pattern_id;
+    e.gain       = gain;
+    e.color      = color;
+    mEntries.push_back(e);
+    return &mEntries.back();
+}
+
+IplImage* PatternCache::GetSolid(CvScalar color, int gain)
+{
+    Entry* e = find(SOLID_PATTERN_ID, gain, color);
+    if(e == NULL){
+        const uchar* lut = gainLUT(gain)->data.ptr;
+        e = insert(SOLID_PATTERN_ID, gain, color);
+        CvScalar scaled;
+        for(int k=0; k<4; k++)
+            scaled.val[k] = lut[CV_CAST_8U(cvRound(color.val[k]))];
+        cvSet(e->image, scaled);
+    }
+    return e->image;
+}
+
+IplImage* PatternCache::GetPattern(int pattern_id, const IplImage* pattern, int gain, const CvMat* warp, double fill)
+{
+    // Warp and gain-correct the single-channel pattern, then expand it to three channels.
+    if(warp != NULL){
+        cvWarpPerspective(pattern, mGray, warp, CV_INTER_LINEAR+CV_WARP_FILL_OUTLIERS, cvScalarAll(fill));
+        cvLUT(mGray, mGray, gainLUT(gain));
+        cvMerge(mGray, mGray, mGray, NULL, mWarped);
+        return mWarped;
+    }
+
+    // Unwarped frames do not depend on fill.
+    Entry* e = find(pattern_id, gain, cvScalarAll(0));
+    if(e == NULL){
+        cvLUT(pattern, mGray, gainLUT(gain));
+        e = insert(pattern_id, gain, cvScalarAll(0));
+        cvMerge(mGray, mGray, mGray, NULL, e->image);
+    }
+    return e->image;
+}
@@ -0,0 +1,72 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PatternCache.h
+//
+// summary:	Declares the projector pattern cache class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  PatternCache
+///
+/// @brief  Cache of projector frames rendered in display format (8-bit BGR).
+///
+///         Frames are keyed by (pattern id, gain), so each one is rendered once and then reused
+///         across display steps and calibration sessions. Warped frames depend on a homography
+///         that changes with every board pose, so they are rendered into a scratch frame instead
+///         and never evict the reusable ones. The projector gain is applied with a 256-entry
+///         lookup table (equivalent to cvScale by 2*gain/100); grayscale patterns are warped and
+///         gain-corrected before they are expanded to three channels.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PatternCache
+{
+public:
+    /// <summary> Maximum number of cached frames (the least recently rendered one is evicted). </summary>
+    enum { MAX_ENTRIES = 16 };
+
+    PatternCache(CvSize size);
+    ~PatternCache();
+
+    // Get a solid colour frame.
+    IplImage* GetSolid(CvScalar color, int gain);
+
+    // Get a frame showing a grayscale pattern (same size as the cache), optionally warped by a
+    // 3x3 homography; fill is the grayscale value used outside the warped pattern.
+    // Note: pattern_id must uniquely identify the contents of pattern. Warped frames are not cached:
+    //       the returned frame is only valid until the next warped frame is requested.
+    IplImage* GetPattern(int pattern_id, const IplImage* pattern, int gain, const CvMat* warp = NULL, double fill = 255);
+
+    // Drop all cached frames (e.g., after a pattern has been regenerated).
+    void Clear();
+
+    CvSize GetSize()                { return mSize; };
+
+private:
+    /// <summary> Pattern id reserved for solid colour frames. </summary>
+    enum { SOLID_PATTERN_ID = -1 };
+
+    struct Entry
+    {
+        int       pattern_id;
+        int       gain;
+        CvScalar  color;
+        IplImage* image;
+    };
+
+    Entry* find(int pattern_id, int gain, CvScalar color);
+    Entry* insert(int pattern_id, int gain, CvScalar color);
+
+    // Fill the lookup table for a gain value.
+    const CvMat* gainLUT(int gain);
+
+    CvSize             mSize;
+    std::vector<Entry> mEntries;
+    CvMat*             mLUT;
+    int                mLUTGain;
+    IplImage*          mGray;
+    IplImage*          mWarped;
+};
@@ -0,0 +1,455 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PointCloudExport.cpp
+//
+// summary:	Implements the point cloud export class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "PointCloudExport.h"
+#include "GridMesher.h"
+#include "Kinect-Parallel.h"
+#include "Kinect-Trace.h"
+
+// Number of records formatted by each parallel task, and size of the binary write blocks.
+static const int EXPORT_CHUNK_SIZE = 8192;
+static const int EXPORT_BLOCK_SIZE = 1 << 20;
+
+// Append a float with six decimals (equivalent to "%f").
+char* PointCloudExport::FormatFloat(char* p, float value)
+{
+    double v = value;
+    if(!(fabs(v) < 1e9)){
+        // Large or non-finite values (e.g., from near-parallel rays) take the C library path.
+        // Note: _snprintf does not terminate truncated output.
+        char text[MAX_FLOAT_LENGTH + 16];
+        int  length = _snprintf(text, MAX_FLOAT_LENGTH, "%f", v);
+        if(length < 0 || length > MAX_FLOAT_LENGTH)
+            length = MAX_FLOAT_LENGTH;
+        memcpy(p, text, length);
+        return p + length;
+    }
+    if(v < 0){
+        *p++ = '-';
+        v = -v;
+    }
+    // Round half to even (the scaled fraction of a float is exact in double precision).
+    unsigned int integer  = (unsigned int)v;
+    double       scaled   = (v - integer)*1e6;
+    unsigned int fraction = (unsigned int)scaled;
+    double       rest     = scaled - fraction;
+    if(rest > 0.5 || (rest == 0.5 && (fraction & 1)))
+        fraction++;
+    if(fraction >= 1000000){
+        integer++;
+        fraction -= 1000000;
+    }
+    char digits[10];
+    int  n = 0;
+    do{
+        digits[n++] = (char)('0' + integer % 10);
+        integer /= 10;
+    } while(integer != 0);
+    while(n > 0)
+        *p++ = digits[--n];
+    *p++ = '.';
+    for(int k=5; k>=0; k--){
+        p[k] = (char)('0' + fraction % 10);
+        fraction /= 10;
+    }
+    return p + 6;
+}
+
+// Format a range of records into a text buffer.
+class TextFormatBody : public Kinect::ParallelLoopBody
+{
+public:
+    TextFormatBody(const float* data, int dim, int count, const float* scale, const char* line_prefix,
+                   const char* value_prefix, int first_chunk, std::vector<std::vector<char> >& buffers)
+        : mBuffers(buffers)
+    {
+        mData        = data;
+        mDim         = dim;
+        mCount       = count;
+        mScale       = scale;
+        mLinePrefix  = line_prefix;
+        mValuePrefix = value_prefix;
+        mFirstChunk  = first_chunk;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        size_t line_length = strlen(mLinePrefix) + mDim*(strlen(mValuePrefix) + PointCloudExport::MAX_FLOAT_LENGTH + 1) + 1;
+        for(int chunk=begin; chunk<end; chunk++){
+            int first = (mFirstChunk + chunk)*EXPORT_CHUNK_SIZE;
+            int last  = MIN(first + EXPORT_CHUNK_SIZE, mCount);
+            std::vector<char>& buffer = mBuffers[chunk];
+            buffer.resize((last - first)*line_length);
+            char* p = buffer.empty() ? NULL : &buffer[0];
+            for(int i=first; i<last; i++){
+                for(const char* s=mLinePrefix; *s; s++)
+                    *p++ = *s;
+                for(int k=0; k<mDim; k++){
+                    for(const char* s=mValuePrefix; *s; s++)
+                        *p++ = *s;
+                    p = PointCloudExport::FormatFloat(p, mData[i*mDim+k]*mScale[k]);
+                    *p++ = ' ';
+                }
+                *p++ = '\n';
+            }
+            buffer.resize(buffer.empty() ? 0 : p - &buffer[0]);
+        }
+    }
+
+private:
+    const float* mData;
+    int          mDim;
+    int          mCount;
+    const float* mScale;
+    const char*  mLinePrefix;
+    const char*  mValuePrefix;
+    int          mFirstChunk;
+    std::vector<std::vector<char> >& mBuffers;
+};
+
+// Append a non-negative integer.
+static char* formatIndex(char* p, unsigned int value)
+{
+    char digits[10];
+    int  n = 0;
+    do{
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while(value != 0);
+    while(n > 0)
+        *p++ = digits[--n];
+    return p;
+}
+
+// Format a range of chunks of triangles as OBJ face lines (with one-based indices).
+class FaceFormatBody : public Kinect::ParallelLoopBody
+{
+public:
+    FaceFormatBody(const int* faces, int count, std::vector<std::vector<char> >& buffers)
+        : mBuffers(buffers)
+    {
+        mFaces = faces;
+        mCount = count;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int chunk=begin; chunk<end; chunk++){
+            int first = chunk*EXPORT_CHUNK_SIZE;
+            int last  = MIN(first + EXPORT_CHUNK_SIZE, mCount);
+            std::vector<char>& buffer = mBuffers[chunk];
+            buffer.resize((last - first)*40);
+            char* p = buffer.empty() ? NULL : &buffer[0];
+            for(int i=first; i<last; i++){
+                *p++ = 'f';
+                for(int k=0; k<3; k++){
+                    *p++ = ' ';
+                    p = formatIndex(p, (unsigned int)mFaces[3*i+k] + 1);
+                }
+                *p++ = '\n';
+            }
+            buffer.resize(buffer.empty() ? 0 : p - &buffer[0]);
+        }
+    }
+
+private:
+    const int* mFaces;
+    int        mCount;
+    std::vector<std::vector<char> >& mBuffers;
+};
+
+// Compact the masked columns of an attribute matrix into interleaved records.
+static void compactAttribute(const CvMat* src, const CvMat* mask, int dim, std::vector<float>& dst, int count)
+{
+    dst.resize(count*dim);
+    const float* rows[3];
+    for(int k=0; k<dim; k++)
+        rows[k] = (const float*)(src->data.ptr + k*src->step);
+    float* p = dst.empty() ? NULL : &dst[0];
+    for(int c=0; c<src->cols; c++){
+        if(mask == NULL || mask->data.fl[c] != 0){
+            for(int k=0; k<dim; k++)
+                *p++ = rows[k][c];
+        }
+    }
+}
+
+PointCloudExport::PointCloudExport(const CvMat* points, const CvMat* normals, const CvMat* colors, const CvMat* mask, const CvMat* uv_coords)
+{
+    mMask   = mask;
+    mMesher = NULL;
+    mCount = 0;
+    for(int c=0; c<points->cols; c++)
+        if(mask == NULL || mask->data.fl[c] != 0)
+            mCount++;
+
+    mHasNormals = (normals   != NULL);
+    mHasColors  = (colors    != NULL);
+    mHasUV      = (uv_coords != NULL);
+    compactAttribute(points, mask, 3, mPoints, mCount);
+    if(mHasNormals)
+        compactAttribute(normals, mask, 3, mNormals, mCount);
+    if(mHasColors)
+        compactAttribute(colors, mask, 3, mColors, mCount);
+    if(mHasUV)
+        compactAttribute(uv_coords, mask, 2, mUV, mCount);
+}
+
+bool PointCloudExport::writeText(FILE* pFile, const float* data, int dim, int count, const float* scale,
+                                 const char* line_prefix, const char* value_prefix)
+{
+    // Format a batch of chunks in parallel, then write them in order.
+    int n_chunks = (count + EXPORT_CHUNK_SIZE - 1)/EXPORT_CHUNK_SIZE;
+    int batch    = 4*Kinect::GetParallelThreadCount();
+    std::vector<std::vector<char> > buffers(batch);
+    for(int first=0; first<n_chunks; first+=batch){
+        int n = MIN(batch, n_chunks - first);
+        TextFormatBody body(data, dim, count, scale, line_prefix, value_prefix, first, buffers);
+        Kinect::ParallelFor(0, n, body);
+        for(int i=0; i<n; i++)
+            if(!buffers[i].empty() && fwrite(&buffers[i][0], 1, buffers[i].size(), pFile) != buffers[i].size())
+                return false;
+    }
+    return true;
+}
+
+bool PointCloudExport::SetMesh(GridMesher* mesher)
+{
+    if(mesher != NULL && mesher->GetVertexCount() != mCount){
+        printf("ERROR: Mesh does not match the point cloud!\n");
+        mMesher = NULL;
+        return false;
+    }
+    mMesher = mesher;
+    return true;
+}
+
+bool PointCloudExport::writeFacesPLY(FILE* pFile)
+{
+    // Pack the face records (vertex count and three indices) into large blocks.
+    const int record_size = 1 + 3*sizeof(int);
+    int per_block = MAX(EXPORT_BLOCK_SIZE/record_size, 2);
+    std::vector<int>  faces(3*per_block);
+    std::vector<char> block(per_block*record_size);
+    mMesher->Rewind();
+    int n;
+    while((n = mMesher->NextFaces(&faces[0], per_block)) > 0){
+        char* p = &block[0];
+        for(int i=0; i<n; i++){
+            *p++ = 3;
+            memcpy(p, &faces[3*i], 3*sizeof(int));
+            p += 3*sizeof(int);
+        }
+        if(fwrite(&block[0], 1, p - &block[0], pFile) != (size_t)(p - &block[0]))
+            return false;
+    }
+    return true;
+}
+
+bool PointCloudExport::writeFacesOBJ(FILE* pFile)
+{
+    // Stream a batch of chunks, format them in parallel, then write them in order.
+    int batch = 4*Kinect::GetParallelThreadCount();
+    std::vector<int> faces(3*batch*EXPORT_CHUNK_SIZE);
+    std::vector<std::vector<char> > buffers(batch);
+    mMesher->Rewind();
+    for(;;){
+        int count = 0, n;
+        while(count < batch*EXPORT_CHUNK_SIZE &&
+              (n = mMesher->NextFaces(&faces[3*count], batch*EXPORT_CHUNK_SIZE - count)) > 0)
+            count += n;
+        if(count == 0)
+            break;
+        int n_chunks = (count + EXPORT_CHUNK_SIZE - 1)/EXPORT_CHUNK_SIZE;
+        FaceFormatBody body(&faces[0], count, buffers);
+        Kinect::ParallelFor(0, n_chunks, body);
+        for(int i=0; i<n_chunks; i++)
+            if(!buffers[i].empty() && fwrite(&buffers[i][0], 1, buffers[i].size(), pFile) != buffers[i].size())
+                return false;
+    }
+    return true;
+}
+
+int PointCloudExport::SavePLY(const char* filename)
+{
+    KINECT_TRACE_SCOPE("export.ply");
+
+    // Open output file and create header.
+    FILE* pFile = fopen(filename, "wb");
+    if(pFile == NULL){
+        fprintf(stderr,"ERROR: Cannot open PLY file!\n");
+        return -1;
+    }
+    fprintf(pFile, "ply\n");
+    fprintf(pFile, "format binary_little_endian 1.0\n");
+    fprintf(pFile, "element vertex %d\n", mCount);
+    fprintf(pFile, "property float x\nproperty float y\nproperty float z\n");
+    if(mHasNormals)
+        fprintf(pFile, "property float nx\nproperty float ny\nproperty float nz\n");
+    if(mHasColors)
+        fprintf(pFile, "property uchar red\nproperty uchar green\nproperty uchar blue\n");
+    if(mMesher != NULL){
+        fprintf(pFile, "element face %d\n", mMesher->GetFaceCount());
+        fprintf(pFile, "property list uchar int vertex_indices\n");
+    }
+    fprintf(pFile, "end_header\n");
+
+    // Pack the vertex records into large blocks.
+    // Note: The records are written in native byte order, which is little-endian on x86.
+    int record_size = 3*sizeof(float) + (mHasNormals ? 3*sizeof(float) : 0) + (mHasColors ? 3 : 0);
+    int per_block   = MAX(EXPORT_BLOCK_SIZE/record_size, 1);
+    std::vector<char> block(per_block*record_size);
+    bool ok = true;
+    for(int first=0; ok && first<mCount; first+=per_block){
+        int   last = MIN(first + per_block, mCount);
+        char* p    = &block[0];
+        for(int i=first; i<last; i++){
+            memcpy(p, &mPoints[3*i], 3*sizeof(float));
+            p += 3*sizeof(float);
+            if(mHasNormals){
+                memcpy(p, &mNormals[3*i], 3*sizeof(float));
+                p += 3*sizeof(float);
+            }
+            if(mHasColors){
+                for(int k=0; k<3; k++)
+                    *p++ = (char)CV_CAST_8U(cvRound(255*mColors[3*i+k]));
+            }
+        }
+        ok = (fwrite(&block[0], 1, p - &block[0], pFile) == (size_t)(p - &block[0]));
+    }
+    if(ok && mMesher != NULL)
+        ok = writeFacesPLY(pFile);
+
+    if(fclose(pFile) != 0 || !ok){
+        printf("ERROR: Cannot write PLY file!\n");
+        return -1;
+    }
+    return 0;
+}
+
+int PointCloudExport::SaveVRML(const char* filename)
+{
+    KINECT_TRACE_SCOPE("export.vrml");
+
+    // Open output file and create header.
+    FILE* pFile = fopen(filename, "w");
+    if(pFile == NULL){
+        fprintf(stderr,"ERROR: Cannot open VRML file!\n");
+        return -1;
+    }
+    fprintf(pFile, "#VRML V2.0 utf8\n");
+    fprintf(pFile, "Shape {\n");
+    fprintf(pFile, " geometry IndexedFaceSet {\n");
+
+    // Output points (i.e., indexed face set vertices).
+    // Note: Flip y-component for compatibility with Java-based viewer.
+    static const float point_scale[3]  = { 1, -1,  1 };
+    static const float normal_scale[3] = {-1, -1, -1 };
+    static const float color_scale[3]  = { 1,  1,  1 };
+    bool ok = true;
+    fprintf(pFile, "  coord Coordinate {\n");
+    fprintf(pFile, "   point [\n");
+    ok &= writeText(pFile, mCount ? &mPoints[0] : NULL, 3, mCount, point_scale, "", "    ");
+    fprintf(pFile, "   ]\n");
+    fprintf(pFile, "  }\n");
+
+    // Output normals (if provided).
+    // Note: Flips normals, for compatibility with Java-based viewer.
+    if(mHasNormals){
+        fprintf(pFile, "  normalPerVertex TRUE\n");
+        fprintf(pFile, "  normal Normal {\n");
+        fprintf(pFile, "   vector [\n");
+        ok &= writeText(pFile, mCount ? &mNormals[0] : NULL, 3, mCount, normal_scale, "", "    ");
+        fprintf(pFile, "   ]\n");
+        fprintf(pFile, "  }\n");
+    }
+
+    // Output colors (if provided).
+    if(mHasColors){
+        fprintf(pFile, "  colorPerVertex TRUE\n");
+        fprintf(pFile, "  color Color {\n");
+        fprintf(pFile, "   color [\n");
+        ok &= writeText(pFile, mCount ? &mColors[0] : NULL, 3, mCount, color_scale, "", "    ");
+        fprintf(pFile, "   ]\n");
+        fprintf(pFile, "  }\n");
+    }
+
+    // Create footer and close file.
+    fprintf(pFile, " }\n");
+    fprintf(pFile, "}\n");
+    if(fclose(pFile) != 0 || !ok){
+        printf("ERROR: Cannot write VRML file!\n");
+        return -1;
+    }
+    return 0;
+}
+
+int PointCloudExport::SaveOBJ(const char* filename, const CvMat* faces)
+{
+    KINECT_TRACE_SCOPE("export.obj");
+
+    // Open output file and create header.
+    FILE* pFile = fopen(filename, "w");
+    if(pFile == NULL){
+        fprintf(stderr,"ERROR: Cannot open OBJ file!\n");
+        return -1;
+    }
+    fprintf(pFile, "#OBJ File\n");
+    fprintf(pFile, "\n");
+    fprintf(pFile, "#Begin Vertices\n");
+
+    // Output points (i.e., vertices).
+    // Note: Flip y-component for compatibility with Java-based viewer.
+    static const float point_scale[3]  = { 1, -1,  1 };
+    static const float normal_scale[3] = {-1, -1, -1 };
+    static const float uv_scale[2]     = { 1,  1 };
+    bool ok = writeText(pFile, mCount ? &mPoints[0] : NULL, 3, mCount, point_scale, "v ", "");
+    fprintf(pFile, "\n");
+
+    // Output faces (streamed from the mesh, or buffered; the face list is masked like the points).
+    if(mMesher != NULL){
+        ok &= writeFacesOBJ(pFile);
+        fprintf(pFile, "\n");
+    }
+    else if(faces != NULL){
+        std::vector<char> buffer;
+        char line[256];
+        for(int c=0; c<faces->cols; c++){
+            if((mMask == NULL || mMask->data.fl[c] != 0) && faces->data.i[c] > 0){
+                char* p = line + sprintf(line, "f ");
+                for(int r=0; r<faces->rows && r<16; r++)
+                    p += sprintf(p, "%i ", ((const int*)(faces->data.ptr + r*faces->step))[c]);
+                *p++ = '\n';
+                buffer.insert(buffer.end(), line, p);
+            }
+        }
+        if(!buffer.empty())
+            ok &= (fwrite(&buffer[0], 1, buffer.size(), pFile) == buffer.size());
+        fprintf(pFile, "\n");
+    }
+
+    // Output normals (if provided).
+    // Note: Flips normals, for compatibility with Java-based viewer.
+    if(mHasNormals){
+        ok &= writeText(pFile, mCount ? &mNormals[0] : NULL, 3, mCount, normal_scale, "vn ", "");
+        fprintf(pFile, "\n");
+    }
+
+    // Output texture coordinates (if provided).
+    if(mHasUV){
+        ok &= writeText(pFile, mCount ? &mUV[0] : NULL, 2, mCount, uv_scale, "vt ", "");
+        fprintf(pFile, "\n");
+    }
+
+    // Create footer and close file.
+    fprintf(pFile, "\n");
+    if(fclose(pFile) != 0 || !ok){
+        printf("ERROR: Cannot write OBJ file!\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PointCloudExport.h
+//
+// summary:	Declares the point cloud export class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include <vector>
+
+class GridMesher;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  PointCloudExport
+///
+/// @brief  Writes point clouds as binary PLY, OBJ or VRML files.
+///
+///         The constructor compacts the masked points (and their normals, colors and texture
+///         coordinates) from the 3xN (2xN) attribute matrices into contiguous interleaved buffers.
+///         PLY files are written as binary little-endian records in large blocks. For the text
+///         formats the vertices are split into chunks that are formatted in parallel with a fixed
+///         precision float formatter (same output as "%f") and then written in order. Faces of
+///         a GridMesher are streamed into both PLY and OBJ files in blocks.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PointCloudExport
+{
+public:
+    /// <summary> Maximum length of a value written by FormatFloat() ("-FLT_MAX" has 47 characters). </summary>
+    enum { MAX_FLOAT_LENGTH = 48 };
+
+    // Compact the points (3xN) and optional normals (3xN), colors (3xN, RGB in [0,1]) and texture
+    // coordinates (2xN) for which mask (1xN, CV_32FC1) is non-zero (or all of them without a mask).
+    PointCloudExport(const CvMat* points, const CvMat* normals, const CvMat* colors, const CvMat* mask, const CvMat* uv_coords = NULL);
+
+    int  GetCount()                 { return mCount; };
+
+    // Stream the faces of mesher (built from the same points and mask) into the PLY/OBJ files.
+    // Note: Returns false (and ignores the mesh) if the vertex count does not match.
+    bool SetMesh(GridMesher* mesher);
+
+    // Save a binary little-endian PLY file (vertices with optional normals and 8-bit colors).
+    int  SavePLY(const char* filename);
+
+    // Save a VRML file (indexed face set without faces).
+    // Note: The y-components of the points and the normals are flipped (for the Java-based viewer).
+    int  SaveVRML(const char* filename);
+
+    // Save an OBJ file. The faces (masked like the points, with vertex indices in each column) are
+    // written for columns with a positive first index (or the faces of the mesh, if set).
+    // Note: The y-components of the points and the normals are flipped (for the Java-based viewer).
+    int  SaveOBJ(const char* filename, const CvMat* faces = NULL);
+
+    // Append a float with six decimals to p (same output as "%f"); returns the end of the text.
+    // Note: Writes at most MAX_FLOAT_LENGTH characters (without a terminating zero).
+    static char* FormatFloat(char* p, float value);
+
+private:
+    // Format count records of dim values each into the file, in parallel chunks.
+    // Every line is line_prefix, then value_prefix + value*scale[k] + " " per value, then newline.
+    bool writeText(FILE* pFile, const float* data, int dim, int count, const float* scale,
+                   const char* line_prefix, const char* value_prefix);
+
+    // Stream the mesh faces as binary PLY records or OBJ face lines.
+    bool writeFacesPLY(FILE* pFile);
+    bool writeFacesOBJ(FILE* pFile);
+
+    const CvMat* mMask;
+    GridMesher*  mMesher;
+
+    int  mCount;
+    bool mHasNormals;
+    bool mHasColors;
+    bool mHasUV;
+
+    /// <summary> Interleaved attributes of the compacted points. </summary>
+    std::vector<float> mPoints;
+    std::vector<float> mNormals;
+    std::vector<float> mColors;
+    std::vector<float> mUV;
+};
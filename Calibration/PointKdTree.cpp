@@ -0,0 +1,265 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PointKdTree.cpp
+//
+// summary:	Implements the point k-d tree class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "PointKdTree.h"
+#include "Kinect-Parallel.h"
+
+#include <algorithm>
+#include <float.h>
+
+// Point record used while building (coordinates and column index, partitioned in place).
+struct KdRecord
+{
+    float p[3];
+    int   index;
+};
+
+// Order point records by one coordinate.
+struct KdAxisLess
+{
+    KdAxisLess(int axis) : mAxis(axis) {}
+
+    bool operator()(const KdRecord& a, const KdRecord& b) const
+    {
+        return a.p[mAxis] < b.p[mAxis];
+    }
+
+    int mAxis;
+};
+
+// Partition the ranges of one tree level at their medians (along their widest axis).
+class KdLevelBody : public Kinect::ParallelLoopBody
+{
+public:
+    KdLevelBody(KdRecord* records, const int* bounds, int first_node, unsigned char* axis, float* split)
+    {
+        mRecords   = records;
+        mBounds    = bounds;
+        mFirstNode = first_node;
+        mAxis      = axis;
+        mSplit     = split;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int j=begin; j<end; j++){
+            int first = mBounds[j], last = mBounds[j+1];
+            int node  = mFirstNode + j;
+            if(last - first < 2){
+                mAxis[node]  = 0;
+                mSplit[node] = (last > first) ? mRecords[first].p[0] : 0;
+                continue;
+            }
+
+            // Split along the axis with the largest extent.
+            float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for(int i=first; i<last; i++){
+                const float* p = mRecords[i].p;
+                for(int k=0; k<3; k++){
+                    lo[k] = MIN(lo[k], p[k]);
+                    hi[k] = MAX(hi[k], p[k]);
+                }
+            }
+            int axis = 0;
+            for(int k=1; k<3; k++)
+                if(hi[k] - lo[k] > hi[axis] - lo[axis])
+                    axis = k;
+
+            int mid = first + (last - first)/2;
+            std::nth_element(mRecords + first, mRecords + mid, mRecords + last, KdAxisLess(axis));
+            mAxis[node]  = (unsigned char)axis;
+            mSplit[node] = mRecords[mid].p[axis];
+        }
+    }
+
+private:
+    KdRecord*      mRecords;
+    const int*     mBounds;
+    int            mFirstNode;
+    unsigned char* mAxis;
+    float*         mSplit;
+};
+
+PointKdTree::PointKdTree()
+{
+    mDepth = 0;
+}
+
+int PointKdTree::Build(const CvMat* points, const CvMat* mask)
+{
+    mAxis.clear();
+    mSplit.clear();
+    mPoints.clear();
+    mIndices.clear();
+    mDepth = 0;
+    if(points == NULL || points->rows < 3 || (mask != NULL && mask->cols*mask->rows < points->cols)){
+        printf("ERROR: Invalid point cloud for k-d tree!\n");
+        return 0;
+    }
+
+    // Gather the (masked) points.
+    const float* rows[3];
+    for(int k=0; k<3; k++)
+        rows[k] = (const float*)(points->data.ptr + k*points->step);
+    std::vector<KdRecord> records;
+    for(int c=0; c<points->cols; c++){
+        if(mask != NULL && mask->data.fl[c] == 0)
+            continue;
+        KdRecord record;
+        for(int k=0; k<3; k++)
+            record.p[k] = rows[k][c];
+        record.index = c;
+        records.push_back(record);
+    }
+    int n = (int)records.size();
+    if(n == 0)
+        return 0;
+
+    // Choose the depth such that every leaf holds at most LEAF_SIZE points.
+    while(((n - 1) >> mDepth) >= LEAF_SIZE)
+        mDepth++;
+    int n_inner = (1 << mDepth) - 1;
+    mAxis.resize(MAX(n_inner, 1));
+    mSplit.resize(MAX(n_inner, 1));
+
+    // Partition the tree level by level (the ranges of a level are contiguous).
+    std::vector<int> bounds(2), next;
+    bounds[0] = 0;
+    bounds[1] = n;
+    for(int level=0; level<mDepth; level++){
+        int n_nodes = 1 << level;
+        KdLevelBody body(&records[0], &bounds[0], n_nodes - 1, &mAxis[0], &mSplit[0]);
+        Kinect::ParallelFor(0, n_nodes, body);
+        next.resize(2*n_nodes + 1);
+        for(int j=0; j<n_nodes; j++){
+            next[2*j]   = bounds[j];
+            next[2*j+1] = bounds[j] + (bounds[j+1] - bounds[j])/2;
+        }
+        next[2*n_nodes] = n;
+        bounds.swap(next);
+    }
+
+    // Store the points in tree order.
+    mPoints.resize(3*n);
+    mIndices.resize(n);
+    for(int i=0; i<n; i++){
+        for(int k=0; k<3; k++)
+            mPoints[3*i+k] = records[i].p[k];
+        mIndices[i] = records[i].index;
+    }
+    return n;
+}
+
+int PointKdTree::RadiusSearch(const float* query, float radius, std::vector<int>& indices, std::vector<float>* dist2) const
+{
+    indices.clear();
+    if(dist2 != NULL)
+        dist2->clear();
+    if(!mIndices.empty())
+        radiusSearch(0, 0, GetCount(), query, radius*radius, indices, dist2);
+    return (int)indices.size();
+}
+
+int PointKdTree::RadiusCount(const float* query, float radius, int max_count) const
+{
+    int count = 0;
+    if(!mIndices.empty() && max_count > 0)
+        radiusCount(0, 0, GetCount(), query, radius*radius, max_count, count);
+    return count;
+}
+
+int PointKdTree::KnnSearch(const float* query, int k, int* indices, float* dist2) const
+{
+    int count = 0;
+    if(!mIndices.empty() && k > 0)
+        knnSearch(0, 0, GetCount(), query, k, indices, dist2, count);
+    return count;
+}
+
+void PointKdTree::radiusSearch(int node, int begin, int end, const float* query, float radius2,
+                               std::vector<int>& indices, std::vector<float>* dist2) const
+{
+    if(node >= (int)mAxis.size() || mDepth == 0){
+        for(int i=begin; i<end; i++){
+            const float* p = &mPoints[3*i];
+            float dx = p[0] - query[0], dy = p[1] - query[1], dz = p[2] - query[2];
+            float d2 = dx*dx + dy*dy + dz*dz;
+            if(d2 <= radius2){
+                indices.push_back(mIndices[i]);
+                if(dist2 != NULL)
+                    dist2->push_back(d2);
+            }
+        }
+        return;
+    }
+    int   mid  = begin + (end - begin)/2;
+    float diff = query[mAxis[node]] - mSplit[node];
+    if(diff < 0){
+        radiusSearch(2*node + 1, begin, mid, query, radius2, indices, dist2);
+        if(diff*diff <= radius2)
+            radiusSearch(2*node + 2, mid, end, query, radius2, indices, dist2);
+    }
+    else{
+        radiusSearch(2*node + 2, mid, end, query, radius2, indices, dist2);
+        if(diff*diff <= radius2)
+            radiusSearch(2*node + 1, begin, mid, query, radius2, indices, dist2);
+    }
+}
+
+void PointKdTree::radiusCount(int node, int begin, int end, const float* query, float radius2, int max_count, int& count) const
+{
+    if(node >= (int)mAxis.size() || mDepth == 0){
+        for(int i=begin; i<end && count<max_count; i++){
+            const float* p = &mPoints[3*i];
+            float dx = p[0] - query[0], dy = p[1] - query[1], dz = p[2] - query[2];
+            if(dx*dx + dy*dy + dz*dz <= radius2)
+                count++;
+        }
+        return;
+    }
+    int   mid  = begin + (end - begin)/2;
+    float diff = query[mAxis[node]] - mSplit[node];
+    int   near_node = (diff < 0) ? 2*node + 1 : 2*node + 2;
+    int   far_node  = (diff < 0) ? 2*node + 2 : 2*node + 1;
+    radiusCount(near_node, (diff < 0) ? begin : mid, (diff < 0) ? mid : end, query, radius2, max_count, count);
+    if(count < max_count && diff*diff <= radius2)
+        radiusCount(far_node, (diff < 0) ? mid : begin, (diff < 0) ? end : mid, query, radius2, max_count, count);
+}
+
+void PointKdTree::knnSearch(int node, int begin, int end, const float* query, int k, int* indices, float* dist2, int& count) const
+{
+    if(node >= (int)mAxis.size() || mDepth == 0){
+        for(int i=begin; i<end; i++){
+            const float* p = &mPoints[3*i];
+            float dx = p[0] - query[0], dy = p[1] - query[1], dz = p[2] - query[2];
+            float d2 = dx*dx + dy*dy + dz*dz;
+            if(count == k && d2 >= dist2[k-1])
+                continue;
+            // Insert into the sorted list of the nearest points.
+            int j = (count < k) ? count++ : k - 1;
+            for(; j>0 && dist2[j-1] > d2; j--){
+                dist2[j]   = dist2[j-1];
+                indices[j] = indices[j-1];
+            }
+            dist2[j]   = d2;
+            indices[j] = mIndices[i];
+        }
+        return;
+    }
+    int   mid  = begin + (end - begin)/2;
+    float diff = query[mAxis[node]] - mSplit[node];
+    if(diff < 0){
+        knnSearch(2*node + 1, begin, mid, query, k, indices, dist2, count);
+        if(count < k || diff*diff < dist2[k-1])
+            knnSearch(2*node + 2, mid, end, query, k, indices, dist2, count);
+    }
+    else{
+        knnSearch(2*node + 2, mid, end, query, k, indices, dist2, count);
+        if(count < k || diff*diff < dist2[k-1])
+            knnSearch(2*node + 1, begin, mid, query, k, indices, dist2, count);
+    }
+}
@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PointKdTree.h
+//
+// summary:	Declares the point k-d tree class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  PointKdTree
+///
+/// @brief  Compact k-d tree over 3D point clouds for radius and k-nearest neighbour queries.
+///
+///         The tree is implicit: node i has the children 2i+1 and 2i+2, every node splits its
+///         range of points at the median (so all leaves are at the same depth and hold at most
+///         LEAF_SIZE points), and only the split axis and value are stored per node. The points
+///         are copied into tree order, so each leaf is a contiguous block of coordinates. The tree
+///         is built level by level, and the nodes of a level are partitioned in parallel.
+///
+///         Queries return the column indices of the points in the matrix the tree was built from.
+///         The tree is read-only after Build(), so queries may run concurrently.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PointKdTree
+{
+public:
+    /// <summary> Maximum number of points per leaf. </summary>
+    enum { LEAF_SIZE = 16 };
+
+    PointKdTree();
+
+    // Build the tree over the points (3xN, CV_32FC1) for which mask (1xN, CV_32FC1, optional) is
+    // non-zero. Returns the number of indexed points.
+    int  Build(const CvMat* points, const CvMat* mask = NULL);
+
+    int  GetCount() const           { return (int)mIndices.size(); };
+
+    // Get the coordinates of the i-th point in tree order (and its column index).
+    const float* GetPoint(int i) const  { return &mPoints[3*i]; };
+    int  GetIndex(int i) const          { return mIndices[i]; };
+
+    // Find the points within radius of query (xyz). Returns their number; indices receives the
+    // column indices (and dist2, if not NULL, the squared distances), in no particular order.
+    int  RadiusSearch(const float* query, float radius, std::vector<int>& indices, std::vector<float>* dist2 = NULL) const;
+
+    // Count the points within radius of query, stopping at max_count.
+    int  RadiusCount(const float* query, float radius, int max_count) const;
+
+    // Find the k nearest neighbours of query (xyz). Returns their number (at most k); indices and
+    // dist2 (k entries each) receive the column indices and squared distances, nearest first.
+    int  KnnSearch(const float* query, int k, int* indices, float* dist2) const;
+
+private:
+    void radiusSearch(int node, int begin, int end, const float* query, float radius2,
+                      std::vector<int>& indices, std::vector<float>* dist2) const;
+    void radiusCount(int node, int begin, int end, const float* query, float radius2, int max_count, int& count) const;
+    void knnSearch(int node, int begin, int end, const float* query, int k, int* indices, float* dist2, int& count) const;
+
+    /// <summary> Number of split levels (leaves are at this depth). </summary>
+    int  mDepth;
+
+    /// <summary> Split axis and value of the inner nodes. </summary>
+    std::vector<unsigned char> mAxis;
+    std::vector<float>         mSplit;
+
+    /// <summary> Points (xyz) in tree order and their column indices. </summary>
+    std::vector<float> mPoints;
+    std::vector<int>   mIndices;
+};
@@ -0,0 +1,303 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PointSubsampler.cpp
+//
+// summary:	Implements the point subsampler class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "PointSubsampler.h"
+#include "Kinect-Parallel.h"
+
+#include <algorithm>
+
+// Maximum number of voxel size increases before the remaining points are trimmed randomly.
+static const int VOXEL_MAX_PASSES = 4;
+
+// Mix two words into a well-distributed 32-bit hash (used to derive independent random streams).
+static unsigned int hashMix(unsigned int a, unsigned int b)
+{
+    unsigned int h = a*0x9E3779B1u ^ (b + 0x7F4A7C15u + (a << 6) + (a >> 2));
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// Small deterministic random generator (xorshift32), one instance per random stream.
+class SubsampleRandom
+{
+public:
+    SubsampleRandom(unsigned int seed, unsigned int stream)
+    {
+        mState = hashMix(seed, stream);
+        if(mState == 0)
+            mState = 0x6D2B79F5u;
+    }
+
+    unsigned int Next()
+    {
+        mState ^= mState << 13;
+        mState ^= mState >> 17;
+        mState ^= mState << 5;
+        return mState;
+    }
+
+    // Uniform integer in [0, n).
+    int Uniform(int n)
+    {
+        return (int)(((unsigned long long)Next()*(unsigned int)n) >> 32);
+    }
+
+private:
+    unsigned int mState;
+};
+
+// Draw one valid pixel per cell for a range of cell rows.
+class StratifiedBody : public Kinect::ParallelLoopBody
+{
+public:
+    StratifiedBody(const float* mask, int width, int height, int cell, int cells_x, unsigned int seed, int* chosen)
+    {
+        mMask   = mask;
+        mWidth  = width;
+        mHeight = height;
+        mCell   = cell;
+        mCellsX = cells_x;
+        mSeed   = seed;
+        mChosen = chosen;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int cy=begin; cy<end; cy++){
+            int r0 = cy*mCell;
+            int r1 = MIN(r0 + mCell, mHeight);
+            for(int cx=0; cx<mCellsX; cx++){
+                int c0 = cx*mCell;
+                int c1 = MIN(c0 + mCell, mWidth);
+                SubsampleRandom rng(mSeed, (unsigned int)(cy*mCellsX + cx));
+                int selected = -1;
+                int seen     = 0;
+                for(int r=r0; r<r1; r++){
+                    const float* mask = mMask + r*mWidth;
+                    for(int c=c0; c<c1; c++){
+                        if(mask[c] == 0)
+                            continue;
+                        // Reservoir sampling: keep the k-th valid pixel with probability 1/k.
+                        if(rng.Uniform(++seen) == 0)
+                            selected = r*mWidth + c;
+                    }
+                }
+                mChosen[cy*mCellsX + cx] = selected;
+            }
+        }
+    }
+
+private:
+    const float* mMask;
+    int          mWidth;
+    int          mHeight;
+    int          mCell;
+    int          mCellsX;
+    unsigned int mSeed;
+    int*         mChosen;
+};
+
+// Evaluate the voxel coordinates and the squared distance to the voxel center of a range of points.
+class VoxelKeyBody : public Kinect::ParallelLoopBody
+{
+public:
+    VoxelKeyBody(const CvMat* points, const int* indices, float voxel_size, int* keys, float* dists)
+    {
+        mPoints    = points;
+        mIndices   = indices;
+        mVoxelSize = voxel_size;
+        mKeys      = keys;
+        mDists     = dists;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        const float* rows[3];
+        for(int k=0; k<3; k++)
+            rows[k] = (const float*)(mPoints->data.ptr + k*mPoints->step);
+        double inv_size = 1.0/mVoxelSize;
+        for(int i=begin; i<end; i++){
+            int   idx  = mIndices[i];
+            float dist = 0;
+            for(int k=0; k<3; k++){
+                double v = rows[k][idx]*inv_size;
+                // Points outside of the integer voxel range (or not finite) are skipped.
+                if(!(fabs(v) < 1e9)){
+                    dist = -1;
+                    break;
+                }
+                double f = floor(v);
+                mKeys[3*i+k] = (int)f;
+                dist += (float)((v - f - 0.5)*(v - f - 0.5));
+            }
+            mDists[i] = dist;
+        }
+    }
+
+private:
+    const CvMat* mPoints;
+    const int*   mIndices;
+    float        mVoxelSize;
+    int*         mKeys;
+    float*       mDists;
+};
+
+// Hash table entry of an occupied voxel.
+struct VoxelSlot
+{
+    int   key[3];
+    int   point;
+    float dist;
+};
+
+// Configure the subsampler from the export options.
+PointSubsampler::PointSubsampler(struct slParams* sl_params)
+{
+    mMode      = sl_params->export_subsample_mode;
+    mBudget    = sl_params->export_point_budget;
+    mVoxelSize = sl_params->export_voxel_size;
+    mSeed      = (unsigned int)sl_params->export_seed;
+}
+
+// Select up to the point budget of the pixels for which mask (1 x width*height) is non-zero.
+int PointSubsampler::Select(const CvMat* points, const CvMat* mask, int width, int height, std::vector<int>& indices)
+{
+    indices.clear();
+    int n = width*height;
+    if(mask == NULL || mask->cols*mask->rows < n){
+        printf("ERROR: Invalid mask for point subsampling!\n");
+        return 0;
+    }
+
+    int valid = 0;
+    for(int i=0; i<n; i++)
+        if(mask->data.fl[i] != 0)
+            valid++;
+    if(valid == 0)
+        return 0;
+
+    // Keep all of the points if the budget is not exceeded (or not set).
+    if(mBudget <= 0 || valid <= mBudget){
+        indices.reserve(valid);
+        for(int i=0; i<n; i++)
+            if(mask->data.fl[i] != 0)
+                indices.push_back(i);
+        return (int)indices.size();
+    }
+
+    if(mMode == VOXEL_GRID && points != NULL && mVoxelSize > 0)
+        selectVoxelGrid(points, mask, width, height, valid, indices);
+    else
+        selectStratified(mask, width, height, valid, indices);
+
+    trim(indices);
+    return (int)indices.size();
+}
+
+// Stratified image-space sampling (one valid pixel per square cell).
+int PointSubsampler::selectStratified(const CvMat* mask, int width, int height, int valid, std::vector<int>& indices)
+{
+    // Choose the cell size such that about budget cells contain valid pixels.
+    int cell    = MAX(1, (int)floor(sqrt((double)valid/mBudget)));
+    int cells_x = (width  + cell - 1)/cell;
+    int cells_y = (height + cell - 1)/cell;
+
+    std::vector<int> chosen(cells_x*cells_y);
+    StratifiedBody body(mask->data.fl, width, height, cell, cells_x, mSeed, &chosen[0]);
+    Kinect::ParallelFor(0, cells_y, body, 4);
+
+    for(size_t i=0; i<chosen.size(); i++)
+        if(chosen[i] >= 0)
+            indices.push_back(chosen[i]);
+    std::sort(indices.begin(), indices.end());
+    return (int)indices.size();
+}
+
+// Voxel grid sampling (the point closest to the center of each occupied voxel).
+int PointSubsampler::selectVoxelGrid(const CvMat* points, const CvMat* mask, int width, int height, int valid, std::vector<int>& indices)
+{
+    int n = width*height;
+    std::vector<int> candidates;
+    candidates.reserve(valid);
+    for(int i=0; i<n; i++)
+        if(mask->data.fl[i] != 0)
+            candidates.push_back(i);
+
+    // Open-addressing table with at least twice as many slots as points.
+    int table_size = 1;
+    while(table_size < 2*valid)
+        table_size <<= 1;
+    std::vector<VoxelSlot> table(table_size);
+    std::vector<int>       keys(3*valid);
+    std::vector<float>     dists(valid);
+
+    float voxel_size = mVoxelSize;
+    for(int pass=0; pass<VOXEL_MAX_PASSES; pass++){
+        VoxelKeyBody body(points, &candidates[0], voxel_size, &keys[0], &dists[0]);
+        Kinect::ParallelFor(0, valid, body, 4096);
+
+        for(int s=0; s<table_size; s++)
+            table[s].point = -1;
+        indices.clear();
+
+        // Insert the points in index order, so ties are resolved identically on every run.
+        for(int i=0; i<valid; i++){
+            if(dists[i] < 0)
+                continue;
+            const int* key = &keys[3*i];
+            unsigned int h = ((unsigned int)key[0]*73856093u) ^ ((unsigned int)key[1]*19349663u) ^ ((unsigned int)key[2]*83492791u);
+            int s = (int)(hashMix(h, 0) & (unsigned int)(table_size - 1));
+            while(table[s].point >= 0 &&
+                  (table[s].key[0] != key[0] || table[s].key[1] != key[1] || table[s].key[2] != key[2]))
+                s = (s + 1) & (table_size - 1);
+            VoxelSlot& slot = table[s];
+            if(slot.point < 0){
+                slot.key[0] = key[0];
+                slot.key[1] = key[1];
+                slot.key[2] = key[2];
+                slot.point  = candidates[i];
+                slot.dist   = dists[i];
+                indices.push_back(s);
+            }
+            else if(dists[i] < slot.dist){
+                slot.point = candidates[i];
+                slot.dist  = dists[i];
+            }
+        }
+        for(size_t i=0; i<indices.size(); i++)
+            indices[i] = table[indices[i]].point;
+
+        // Enlarge the voxels while the budget is exceeded (voxel counts on a surface scale with 1/size^2).
+        if((int)indices.size() <= mBudget)
+            break;
+        voxel_size *= (float)(1.05*sqrt((double)indices.size()/mBudget));
+    }
+
+    std::sort(indices.begin(), indices.end());
+    return (int)indices.size();
+}
+
+// Keep a seeded random subset of budget indices (in row-major order).
+void PointSubsampler::trim(std::vector<int>& indices)
+{
+    int count = (int)indices.size();
+    if(count <= mBudget)
+        return;
+
+    // Partial Fisher-Yates shuffle.
+    SubsampleRandom rng(mSeed, 0xFFFFFFFFu);
+    for(int i=0; i<mBudget; i++){
+        int j = i + rng.Uniform(count - i);
+        std::swap(indices[i], indices[j]);
+    }
+    indices.resize(mBudget);
+    std::sort(indices.begin(), indices.end());
+}
@@ -0,0 +1,54 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\PointSubsampler.h
+//
+// summary:	Declares the point subsampler class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  PointSubsampler
+///
+/// @brief  Selects a bounded, evenly distributed subset of the reconstructed points.
+///
+///         Two strategies are available, both deterministic for a given seed:
+///           - Stratified image-space sampling: the camera image is divided into square cells
+///             holding about budget cells' worth of valid pixels, and one valid pixel is drawn per
+///             cell (reservoir sampling with a per-cell random stream).
+///           - Voxel grid: points are hashed into cubic voxels and the point closest to each
+///             voxel center is kept; the voxel size is enlarged while the budget is exceeded.
+///         Cells are sampled in parallel bands of cell rows, and voxel keys are evaluated in
+///         parallel blocks. If more than budget points remain, a seeded random subset of exactly
+///         budget points is kept. The selected pixel indices are returned in row-major order.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class PointSubsampler
+{
+public:
+    /// <summary> Subsampling strategies (slParams::export_subsample_mode). </summary>
+    enum { STRATIFIED = 1, VOXEL_GRID = 2 };
+
+    // Configure the subsampler from the export options.
+    PointSubsampler(struct slParams* sl_params);
+
+    // Select up to the point budget of the pixels for which mask (1 x width*height) is non-zero.
+    // Note: points (3 x width*height, CV_32FC1) are only needed for voxel grid subsampling.
+    int Select(const CvMat* points, const CvMat* mask, int width, int height, std::vector<int>& indices);
+
+private:
+    int selectStratified(const CvMat* mask, int width, int height, int valid, std::vector<int>& indices);
+    int selectVoxelGrid(const CvMat* points, const CvMat* mask, int width, int height, int valid, std::vector<int>& indices);
+
+    // Keep a seeded random subset of budget indices (in row-major order).
+    void trim(std::vector<int>& indices);
+
+    int          mMode;
+    int          mBudget;
+    float        mVoxelSize;
+    unsigned int mSeed;
+};
@@ -0,0 +1,216 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\ProCamGeometry.cpp
+//
+// summary:	Implements the projector-camera geometry functions
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "ProCamGeometry.h"
+
+// Get the projector pose in the camera coordinate system (X_proj = R*X_cam + T).
+void getProjectorPose(struct slCalib* sl_calib, CvMat* rotation, CvMat* translation)
+{
+    // Extract the rotation vectors and translations (with respect to the reference chessboard).
+    CvMat* cam_r  = cvCreateMat(1, 3, CV_64FC1);
+    CvMat* proj_r = cvCreateMat(1, 3, CV_64FC1);
+    CvMat* cam_R  = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* proj_R = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* cam_T  = cvCreateMat(3, 1, CV_64FC1);
+    CvMat* proj_T = cvCreateMat(3, 1, CV_64FC1);
+    for(int i=0; i<3; i++){
+        cvmSet(cam_r,  0, i, cvmGet(sl_calib->cam_extrinsic,  0, i));
+        cvmSet(proj_r, 0, i, cvmGet(sl_calib->proj_extrinsic, 0, i));
+        cvmSet(cam_T,  i, 0, cvmGet(sl_calib->cam_extrinsic,  1, i));
+        cvmSet(proj_T, i, 0, cvmGet(sl_calib->proj_extrinsic, 1, i));
+    }
+    cvRodrigues2(cam_r,  cam_R);
+    cvRodrigues2(proj_r, proj_R);
+
+    // R = R_proj*R_cam^T and T = T_proj - R*T_cam.
+    cvGEMM(proj_R, cam_R, 1, NULL, 0, rotation, CV_GEMM_B_T);
+    cvGEMM(rotation, cam_T, -1, proj_T, 1, translation);
+
+    cvReleaseMat(&cam_r);
+    cvReleaseMat(&proj_r);
+    cvReleaseMat(&cam_R);
+    cvReleaseMat(&proj_R);
+    cvReleaseMat(&cam_T);
+    cvReleaseMat(&proj_T);
+}
+
+// Get the camera pose with respect to the first calibration chessboard.
+void getCameraPose(struct slCalib* sl_calib, CvMat* rotation, CvMat* translation)
+{
+    CvMat* cam_r = cvCreateMat(1, 3, CV_64FC1);
+    for(int i=0; i<3; i++){
+        cvmSet(cam_r,       0, i, cvmGet(sl_calib->cam_extrinsic, 0, i));
+        cvmSet(translation, i, 0, cvmGet(sl_calib->cam_extrinsic, 1, i));
+    }
+    cvRodrigues2(cam_r, rotation);
+    cvReleaseMat(&cam_r);
+}
+
+// Get the projector center of projection in camera coordinates.
+void getProjectorCenter(struct slCalib* sl_calib, double* center)
+{
+    CvMat* rotation    = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* translation = cvCreateMat(3, 1, CV_64FC1);
+    getProjectorPose(sl_calib, rotation, translation);
+    for(int i=0; i<3; i++){
+        center[i] = 0;
+        for(int j=0; j<3; j++)
+            center[i] -= cvmGet(rotation, j, i)*cvmGet(translation, j, 0);
+    }
+    cvReleaseMat(&rotation);
+    cvReleaseMat(&translation);
+}
+
+// Get the 3x4 projection matrix K*[R|T] of the projector, in camera coordinates.
+void getProjectorProjection(struct slCalib* sl_calib, CvMat* projection)
+{
+    CvMat* rotation    = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* translation = cvCreateMat(3, 1, CV_64FC1);
+    CvMat* pose        = cvCreateMat(3, 4, CV_64FC1);
+    CvMat* intrinsic   = cvCreateMat(3, 3, CV_64FC1);
+    getProjectorPose(sl_calib, rotation, translation);
+    for(int i=0; i<3; i++){
+        for(int j=0; j<3; j++){
+            cvmSet(pose, i, j, cvmGet(rotation, i, j));
+            cvmSet(intrinsic, i, j, cvmGet(sl_calib->proj_intrinsic, i, j));
+        }
+        cvmSet(pose, i, 3, cvmGet(translation, i, 0));
+    }
+    cvMatMul(intrinsic, pose, projection);
+
+    cvReleaseMat(&rotation);
+    cvReleaseMat(&translation);
+    cvReleaseMat(&pose);
+    cvReleaseMat(&intrinsic);
+}
+
+// Compute the unit optical ray of every camera pixel.
+void computeCameraRays(struct slParams* sl_params, struct slCalib* sl_calib, CvMat* rays)
+{
+    // Undistort all pixels at once (normalized image coordinates).
+    int n = sl_params->cam_w*sl_params->cam_h;
+    CvMat* pixels = cvCreateMat(n, 1, CV_32FC2);
+    float* p = pixels->data.fl;
+    for(int y=0; y<sl_params->cam_h; y++){
+        for(int x=0; x<sl_params->cam_w; x++){
+            *p++ = (float)x;
+            *p++ = (float)y;
+        }
+    }
+    cvUndistortPoints(pixels, pixels, sl_calib->cam_intrinsic, sl_calib->cam_distortion);
+
+    // Normalize the rays (x, y, 1).
+    float* rx = (float*)(rays->data.ptr);
+    float* ry = (float*)(rays->data.ptr + rays->step);
+    float* rz = (float*)(rays->data.ptr + 2*rays->step);
+    p = pixels->data.fl;
+    for(int i=0; i<n; i++, p+=2){
+        float norm = 1.0f/sqrt(p[0]*p[0] + p[1]*p[1] + 1.0f);
+        rx[i] = p[0]*norm;
+        ry[i] = p[1]*norm;
+        rz[i] = norm;
+    }
+    cvReleaseMat(&pixels);
+}
+
+// Compute the optical ray of every projector pixel in camera coordinates.
+void computeProjectorRays(struct slParams* sl_params, struct slCalib* sl_calib, CvMat* rays)
+{
+    // Undistort all pixels at once (normalized image coordinates).
+    int n = sl_params->proj_w*sl_params->proj_h;
+    CvMat* pixels = cvCreateMat(n, 1, CV_32FC2);
+    float* p = pixels->data.fl;
+    for(int y=0; y<sl_params->proj_h; y++){
+        for(int x=0; x<sl_params->proj_w; x++){
+            *p++ = (float)x;
+            *p++ = (float)y;
+        }
+    }
+    cvUndistortPoints(pixels, pixels, sl_calib->proj_intrinsic, sl_calib->proj_distortion);
+
+    // Rotate the rays (x, y, 1) into the camera coordinate system (by R^T).
+    CvMat* rotation    = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* translation = cvCreateMat(3, 1, CV_64FC1);
+    getProjectorPose(sl_calib, rotation, translation);
+    double R[3][3];
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            R[i][j] = cvmGet(rotation, i, j);
+    float* r[3];
+    for(int k=0; k<3; k++)
+        r[k] = (float*)(rays->data.ptr + k*rays->step);
+    p = pixels->data.fl;
+    for(int i=0; i<n; i++, p+=2){
+        for(int k=0; k<3; k++)
+            r[k][i] = (float)(R[0][k]*p[0] + R[1][k]*p[1] + R[2][k]);
+    }
+    cvReleaseMat(&rotation);
+    cvReleaseMat(&translation);
+    cvReleaseMat(&pixels);
+}
+
+// Compute the plane of every projector column and row in camera coordinates.
+void computeProjectorPlanes(struct slParams* sl_params, struct slCalib* sl_calib, CvMat* column_planes, CvMat* row_planes)
+{
+    // End points of every column (top, bottom) and row (left, right).
+    int w = sl_params->proj_w, h = sl_params->proj_h;
+    int n = 2*(w + h);
+    CvMat* pixels = cvCreateMat(n, 1, CV_32FC2);
+    float* p = pixels->data.fl;
+    for(int c=0; c<w; c++){
+        *p++ = (float)c; *p++ = 0;
+        *p++ = (float)c; *p++ = (float)(h-1);
+    }
+    for(int r=0; r<h; r++){
+        *p++ = 0;        *p++ = (float)r;
+        *p++ = (float)(w-1); *p++ = (float)r;
+    }
+    cvUndistortPoints(pixels, pixels, sl_calib->proj_intrinsic, sl_calib->proj_distortion);
+
+    // Projector orientation and center of projection.
+    CvMat* rotation    = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* translation = cvCreateMat(3, 1, CV_64FC1);
+    getProjectorPose(sl_calib, rotation, translation);
+    double R[3][3], center[3];
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            R[i][j] = cvmGet(rotation, i, j);
+    getProjectorCenter(sl_calib, center);
+    cvReleaseMat(&rotation);
+    cvReleaseMat(&translation);
+
+    // The plane normal is the cross product of the two end point rays (rotated by R^T).
+    p = pixels->data.fl;
+    for(int i=0; i<w+h; i++, p+=4){
+        double d1[3], d2[3], normal[3];
+        for(int k=0; k<3; k++){
+            d1[k] = R[0][k]*p[0] + R[1][k]*p[1] + R[2][k];
+            d2[k] = R[0][k]*p[2] + R[1][k]*p[3] + R[2][k];
+        }
+        normal[0] = d1[1]*d2[2] - d1[2]*d2[1];
+        normal[1] = d1[2]*d2[0] - d1[0]*d2[2];
+        normal[2] = d1[0]*d2[1] - d1[1]*d2[0];
+        double norm = sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+        float* plane = (i < w) ? (float*)(column_planes->data.ptr + i*column_planes->step)
+                               : (float*)(row_planes->data.ptr + (i-w)*row_planes->step);
+        plane[3] = 0;
+        for(int k=0; k<3; k++){
+            plane[k]  = (float)(normal[k]/norm);
+            plane[3] += (float)(normal[k]/norm*center[k]);
+        }
+    }
+    cvReleaseMat(&pixels);
+}
+
+// Undistort a set of pixel coordinates in place.
+void undistortPixels(CvMat* pixels, const CvMat* intrinsic, const CvMat* distortion)
+{
+    CvMat pixels2;
+    cvReshape(pixels, &pixels2, 2, pixels->rows);
+    cvUndistortPoints(&pixels2, &pixels2, intrinsic, distortion, NULL, intrinsic);
+}
@@ -0,0 +1,46 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file   Calibration\ProCamGeometry.h
+///
+/// @brief  Declares the projector-camera geometry functions.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+// Get the projector pose in the camera coordinate system (X_proj = R*X_cam + T).
+// Note: rotation is 3x3 and translation is 3x1 (both CV_64FC1); the pose is derived from the
+//       extrinsics of both devices with respect to the first calibration chessboard.
+void getProjectorPose(struct slCalib* sl_calib, CvMat* rotation, CvMat* translation);
+
+// Get the camera pose with respect to the first calibration chessboard (X_cam = R*X_board + T).
+// Note: rotation is 3x3 and translation is 3x1 (both CV_64FC1); this is the world-to-camera pose
+//       of a view for volumetric fusion in chessboard coordinates.
+void getCameraPose(struct slCalib* sl_calib, CvMat* rotation, CvMat* translation);
+
+// Get the projector center of projection -R^T*T in camera coordinates.
+void getProjectorCenter(struct slCalib* sl_calib, double* center);
+
+// Get the 3x4 projection matrix K*[R|T] of the projector (CV_64FC1), in camera coordinates.
+void getProjectorProjection(struct slCalib* sl_calib, CvMat* projection);
+
+// Compute the unit optical ray of every camera pixel (3 x cam_w*cam_h, CV_32FC1, row-major pixels).
+void computeCameraRays(struct slParams* sl_params, struct slCalib* sl_calib, CvMat* rays);
+
+// Compute the optical ray of every projector pixel in camera coordinates (3 x proj_w*proj_h, CV_32FC1).
+// Note: The rays are not normalized (they have a unit z component in the projector coordinate
+//       system); all of them pass through the projector center -R^T*T.
+void computeProjectorRays(struct slParams* sl_params, struct slCalib* sl_calib, CvMat* rays);
+
+// Compute the plane of every projector column (proj_w x 4) and row (proj_h x 4) in camera coordinates.
+// Note: Each plane (n, d), with n.X = d, contains the projector center and the back-projected end
+//       points of the column (row). All end points are undistorted in one batch, so no per-plane
+//       fitting is needed.
+void computeProjectorPlanes(struct slParams* sl_params, struct slCalib* sl_calib, CvMat* column_planes, CvMat* row_planes);
+
+// Undistort a set of projector (or camera) pixel coordinates in place (N x 2, CV_32FC1).
+// Note: The undistorted coordinates are still pixels (i.e., with the same intrinsic matrix).
+void undistortPixels(CvMat* pixels, const CvMat* intrinsic, const CvMat* distortion);
@@ -0,0 +1,527 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\ProjectorOutput.cpp
+//
+// summary:	Implements the scheduled projector output classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "ProjectorOutput.h"
+#include "Kinect-Trace.h"
+
+// Period of sequences on a display that cannot wait for the vertical refresh (in milliseconds).
+static const double PROJECTOR_DEFAULT_REFRESH_MS = 1000.0/60.0;
+
+// Remaining wait below which the presenter spins instead of sleeping (Sleep() is only as exact as
+// the system timer).
+static const double PROJECTOR_SPIN_MS = 20.0;
+
+static const char* PROJECTOR_WINDOW_CLASS = "ProjectorOutput";
+
+ProjectorOutput::ProjectorOutput()
+{
+    mPresenter    = NULL;
+    mStopping     = 0;
+    mOpenResult   = false;
+    mPeriod       = 0;
+    mPlaying      = false;
+    mNext         = 0;
+    mNextTime     = 0;
+    mFirstTime    = 0;
+    mShowFrame    = NULL;
+    mShowTime     = -1;
+    mPresentCount = 0;
+    InitializeCriticalSection(&mLock);
+    InitializeCriticalSection(&mPresentLock);
+    mWake   = CreateEvent(NULL, FALSE, FALSE, NULL);
+    mOpened = CreateEvent(NULL, TRUE, FALSE, NULL);
+    mShown  = CreateEvent(NULL, FALSE, FALSE, NULL);
+    mIdle   = CreateEvent(NULL, TRUE, TRUE, NULL);
+    mClosed = CreateEvent(NULL, TRUE, TRUE, NULL);
+}
+
+ProjectorOutput::~ProjectorOutput()
+{
+    // The display is closed by the derived destructor (closeDisplay() is pure here).
+    releaseSequence();
+    CloseHandle(mWake);
+    CloseHandle(mOpened);
+    CloseHandle(mShown);
+    CloseHandle(mIdle);
+    CloseHandle(mClosed);
+    DeleteCriticalSection(&mPresentLock);
+    DeleteCriticalSection(&mLock);
+}
+
+bool ProjectorOutput::Open(double period_ms)
+{
+    if(mPresenter != NULL)
+        return true;
+
+    mPeriod = MAX(0.0, period_ms);
+    InterlockedExchange(&mStopping, 0);
+    ResetEvent(mOpened);
+    ResetEvent(mClosed);
+    mPresenter = new Presenter(this);
+    mPresenter->Start();
+    WaitForSingleObject(mOpened, INFINITE);
+    if(!mOpenResult){
+        mPresenter->Wait();
+        delete mPresenter;
+        mPresenter = NULL;
+        printf("ERROR: Cannot open the projector output!\n");
+        return false;
+    }
+    return true;
+}
+
+void ProjectorOutput::Close()
+{
+    if(mPresenter == NULL)
+        return;
+
+    InterlockedExchange(&mStopping, 1);
+    SetEvent(mClosed);
+    SetEvent(mWake);
+    mPresenter->Wait();
+    delete mPresenter;
+    mPresenter = NULL;
+
+    EnterCriticalSection(&mLock);
+    mPlaying = false;
+    LeaveCriticalSection(&mLock);
+    SetEvent(mIdle);
+}
+
+void ProjectorOutput::Load(IplImage** patterns, int count)
+{
+    // Convert outside the lock; the presenter keeps presenting meanwhile.
+    std::vector<IplImage*> sequence(count);
+    for(int i=0; i<count; i++)
+        sequence[i] = convert(patterns[i]);
+
+    EnterCriticalSection(&mLock);
+    mPlaying = false;
+    mSequence.swap(sequence);
+    mPresents.clear();
+    LeaveCriticalSection(&mLock);
+    SetEvent(mIdle);
+
+    // The presenter may still be presenting a pattern of the old sequence.
+    EnterCriticalSection(&mPresentLock);
+    LeaveCriticalSection(&mPresentLock);
+    for(unsigned int i=0; i<sequence.size(); i++)
+        cvReleaseImage(&sequence[i]);
+}
+
+void ProjectorOutput::Play()
+{
+    EnterCriticalSection(&mLock);
+    mPresents.clear();
+    mNext     = 0;
+    mNextTime = 0;
+    mPlaying  = !mSequence.empty() && mPresenter != NULL;
+    if(mPlaying)
+        ResetEvent(mIdle);
+    LeaveCriticalSection(&mLock);
+    SetEvent(mWake);
+}
+
+void ProjectorOutput::Stop()
+{
+    EnterCriticalSection(&mLock);
+    mPlaying = false;
+    LeaveCriticalSection(&mLock);
+    SetEvent(mIdle);
+}
+
+bool ProjectorOutput::IsPlaying()
+{
+    EnterCriticalSection(&mLock);
+    bool playing = mPlaying;
+    LeaveCriticalSection(&mLock);
+    return playing;
+}
+
+void ProjectorOutput::WaitForSequence()
+{
+    WaitForSingleObject(mIdle, INFINITE);
+}
+
+double ProjectorOutput::Show(const IplImage* frame)
+{
+    if(mPresenter == NULL)
+        return -1;
+
+    IplImage* converted = convert(frame);
+    ResetEvent(mShown);
+    EnterCriticalSection(&mLock);
+    mShowFrame = converted;
+    LeaveCriticalSection(&mLock);
+    SetEvent(mWake);
+
+    // Close() may stop the presenter before it gets to the frame.
+    HANDLE events[2] = { mShown, mClosed };
+    double time = -1;
+    if(WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0){
+        EnterCriticalSection(&mLock);
+        time = mShowTime;
+        LeaveCriticalSection(&mLock);
+    }
+    else{
+        // Withdraw the frame; the presenter may still be presenting it (under mPresentLock).
+        EnterCriticalSection(&mPresentLock);
+        EnterCriticalSection(&mLock);
+        if(mShowFrame == converted)
+            mShowFrame = NULL;
+        LeaveCriticalSection(&mLock);
+        LeaveCriticalSection(&mPresentLock);
+    }
+    cvReleaseImage(&converted);
+    return time;
+}
+
+std::vector<ProjectorOutput::Present> ProjectorOutput::GetPresents()
+{
+    EnterCriticalSection(&mLock);
+    std::vector<Present> presents(mPresents);
+    LeaveCriticalSection(&mLock);
+    return presents;
+}
+
+int ProjectorOutput::FindPattern(double time)
+{
+    // Presents are in time order; the last one at or before time is on screen.
+    int pattern = -1;
+    EnterCriticalSection(&mLock);
+    for(int i=(int)mPresents.size()-1; i>=0; i--){
+        if(mPresents[i].time <= time){
+            pattern = mPresents[i].pattern;
+            break;
+        }
+    }
+    LeaveCriticalSection(&mLock);
+    return pattern;
+}
+
+double ProjectorOutput::Now()
+{
+    static LARGE_INTEGER frequency = {0};
+    if(frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return 1000.0*counter.QuadPart/frequency.QuadPart;
+}
+
+IplImage* ProjectorOutput::convert(const IplImage* pattern)
+{
+    IplImage* frame = cvCreateImage(cvGetSize(pattern), IPL_DEPTH_8U, 3);
+    if(pattern->nChannels == 1)
+        cvCvtColor(pattern, frame, CV_GRAY2BGR);
+    else
+        cvCopy(pattern, frame);
+    return frame;
+}
+
+void ProjectorOutput::run()
+{
+    mOpenResult = openDisplay();
+    SetEvent(mOpened);
+    if(!mOpenResult)
+        return;
+
+    while(!mStopping){
+        idle();
+
+        // A frame of Show() goes first, then the next pattern of the sequence.
+        // Note: mPresentLock keeps Load() from releasing the picked pattern, but it is not held while
+        //       waiting for the pattern to be due, so Show() and Load() are not held up by the period.
+        const IplImage* frame = NULL;
+        int pattern = -1;
+        double due = 0;
+        EnterCriticalSection(&mPresentLock);
+        EnterCriticalSection(&mLock);
+        if(mShowFrame != NULL)
+            frame = mShowFrame;
+        else if(mPlaying){
+            if(mNext < (int)mSequence.size()){
+                frame   = mSequence[mNext];
+                pattern = mNext;
+                due     = mNextTime;
+            }
+            else{
+                mPlaying = false;
+                SetEvent(mIdle);
+            }
+        }
+        LeaveCriticalSection(&mLock);
+
+        if(frame == NULL){
+            LeaveCriticalSection(&mPresentLock);
+            WaitForSingleObject(mWake, 10);
+            continue;
+        }
+        if(pattern >= 0 && due > Now()){
+            LeaveCriticalSection(&mPresentLock);
+            waitUntil(due);
+            continue;
+        }
+
+        double time;
+        bool synced;
+        {
+            KINECT_TRACE_SCOPE("calibration.projector_present");
+            present(frame);
+            synced = waitForRefresh();
+            time   = Now();
+        }
+        LeaveCriticalSection(&mPresentLock);
+
+        EnterCriticalSection(&mLock);
+        Present p;
+        p.pattern  = pattern;
+        p.sequence = mPresentCount++;
+        p.time     = time;
+        if(pattern < 0){
+            mShowFrame = NULL;
+            mShowTime  = time;
+            SetEvent(mShown);
+        }
+        else if(mPlaying && mNext == pattern){
+            // The sequence may have been stopped or reloaded while the pattern was presented.
+            mPresents.push_back(p);
+            if(pattern == 0)
+                mFirstTime = time;
+            mNext++;
+            if(mPeriod > 0)
+                mNextTime = mFirstTime + mNext*mPeriod;
+            else
+                mNextTime = synced ? 0 : time + PROJECTOR_DEFAULT_REFRESH_MS;
+        }
+        LeaveCriticalSection(&mLock);
+    }
+
+    closeDisplay();
+}
+
+void ProjectorOutput::waitUntil(double time)
+{
+    for(;;){
+        double left = time - Now();
+        if(left <= 0 || mStopping)
+            break;
+
+        // A frame of Show(), or a stopped or restarted sequence, needs the presenter now.
+        EnterCriticalSection(&mLock);
+        bool wake = mShowFrame != NULL || !mPlaying || mNextTime != time;
+        LeaveCriticalSection(&mLock);
+        if(wake)
+            break;
+
+        if(left > PROJECTOR_SPIN_MS)
+            WaitForSingleObject(mWake, (DWORD)(left - PROJECTOR_SPIN_MS));
+        else
+            SwitchToThread();
+    }
+}
+
+void ProjectorOutput::releaseSequence()
+{
+    for(unsigned int i=0; i<mSequence.size(); i++)
+        cvReleaseImage(&mSequence[i]);
+    mSequence.clear();
+}
+
+WindowProjectorOutput::WindowProjectorOutput(int x, int y, int width, int height)
+{
+    mX        = x;
+    mY        = y;
+    mWidth    = width;
+    mHeight   = height;
+    mWindow   = NULL;
+    mDC       = NULL;
+    mDwmApi   = NULL;
+    mDwmFlush = NULL;
+}
+
+WindowProjectorOutput::~WindowProjectorOutput()
+{
+    Close();
+}
+
+bool WindowProjectorOutput::openDisplay()
+{
+    // The window belongs to the presenter thread, which dispatches its messages in idle().
+    HINSTANCE instance = GetModuleHandle(NULL);
+    WNDCLASSA wc;
+    memset(&wc, 0, sizeof(wc));
+    wc.lpfnWndProc   = windowProc;
+    wc.hInstance     = instance;
+    wc.hbrBackground = (HBRUSH)GetStockObject(BLACK_BRUSH);
+    wc.lpszClassName = PROJECTOR_WINDOW_CLASS;
+    RegisterClassA(&wc);
+
+    mWindow = CreateWindowExA(WS_EX_TOPMOST | WS_EX_TOOLWINDOW, PROJECTOR_WINDOW_CLASS, "Projector",
+                              WS_POPUP | WS_VISIBLE, mX, mY, mWidth, mHeight, NULL, NULL, instance, NULL);
+    if(mWindow == NULL)
+        return false;
+    mDC = GetDC(mWindow);
+
+    // DwmFlush() is only available from Windows Vista on.
+    mDwmApi = LoadLibraryA("dwmapi.dll");
+    if(mDwmApi != NULL)
+        mDwmFlush = (DwmFlushProc)GetProcAddress(mDwmApi, "DwmFlush");
+    if(mDwmFlush == NULL)
+        printf("Projector output cannot wait for the vertical refresh; frames are paced by the timer.\n");
+    return true;
+}
+
+void WindowProjectorOutput::closeDisplay()
+{
+    if(mDC != NULL)
+        ReleaseDC(mWindow, mDC);
+    if(mWindow != NULL)
+        DestroyWindow(mWindow);
+    if(mDwmApi != NULL)
+        FreeLibrary(mDwmApi);
+    mDC       = NULL;
+    mWindow   = NULL;
+    mDwmApi   = NULL;
+    mDwmFlush = NULL;
+}
+
+void WindowProjectorOutput::present(const IplImage* frame)
+{
+    // Rows of an IplImage are 4-byte aligned, as a DIB's are; a negative height is top-down.
+    BITMAPINFO bmi;
+    memset(&bmi, 0, sizeof(bmi));
+    bmi.bmiHeader.biSize        = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth       = frame->width;
+    bmi.bmiHeader.biHeight      = -frame->height;
+    bmi.bmiHeader.biPlanes      = 1;
+    bmi.bmiHeader.biBitCount    = 24;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    SetDIBitsToDevice(mDC, 0, 0, frame->width, frame->height, 0, 0, 0, frame->height,
+                      frame->imageData, &bmi, DIB_RGB_COLORS);
+    GdiFlush();
+}
+
+bool WindowProjectorOutput::waitForRefresh()
+{
+    // DwmFlush() fails if desktop composition is off.
+    return mDwmFlush != NULL && SUCCEEDED(mDwmFlush());
+}
+
+void WindowProjectorOutput::idle()
+{
+    MSG msg;
+    while(PeekMessageA(&msg, mWindow, 0, 0, PM_REMOVE)){
+        TranslateMessage(&msg);
+        DispatchMessageA(&msg);
+    }
+}
+
+LRESULT CALLBACK WindowProjectorOutput::windowProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
+{
+    switch(msg){
+    case WM_SETCURSOR:
+        // No cursor over the patterns.
+        SetCursor(NULL);
+        return TRUE;
+    case WM_ERASEBKGND:
+        return 1;
+    case WM_CLOSE:
+        // Closed by Close() only.
+        return 0;
+    default:
+        return DefWindowProcA(hwnd, msg, wparam, lparam);
+    }
+}
+
+VirtualProjectorOutput::VirtualProjectorOutput(int width, int height, double refresh_ms, SimulatedProjector* projector)
+{
+    mWidth      = width;
+    mHeight     = height;
+    mRefresh    = MAX(1.0, refresh_ms);
+    mStart      = 0;
+    mProjector  = projector;
+    mScreen     = NULL;
+    mBack       = NULL;
+    mFlip       = false;
+    mFrameCount = 0;
+    InitializeCriticalSection(&mScreenLock);
+}
+
+VirtualProjectorOutput::~VirtualProjectorOutput()
+{
+    Close();
+    DeleteCriticalSection(&mScreenLock);
+}
+
+IplImage* VirtualProjectorOutput::GetScreen()
+{
+    EnterCriticalSection(&mScreenLock);
+    IplImage* screen = mScreen != NULL ? cvCloneImage(mScreen) : NULL;
+    LeaveCriticalSection(&mScreenLock);
+    return screen;
+}
+
+bool VirtualProjectorOutput::openDisplay()
+{
+    EnterCriticalSection(&mScreenLock);
+    mScreen = cvCreateImage(cvSize(mWidth, mHeight), IPL_DEPTH_8U, 3);
+    cvZero(mScreen);
+    LeaveCriticalSection(&mScreenLock);
+    mBack  = cvCreateImage(cvSize(mWidth, mHeight), IPL_DEPTH_8U, 3);
+    mFlip  = false;
+    mStart = Now();
+    return true;
+}
+
+void VirtualProjectorOutput::closeDisplay()
+{
+    EnterCriticalSection(&mScreenLock);
+    cvReleaseImage(&mScreen);
+    LeaveCriticalSection(&mScreenLock);
+    cvReleaseImage(&mBack);
+}
+
+void VirtualProjectorOutput::present(const IplImage* frame)
+{
+    if(frame->width != mWidth || frame->height != mHeight){
+        printf("ERROR: Projector output frame is %dx%d, the virtual screen %dx%d!\n",
+            frame->width, frame->height, mWidth, mHeight);
+        return;
+    }
+    cvCopy(frame, mBack);
+    mFlip = true;
+}
+
+bool VirtualProjectorOutput::waitForRefresh()
+{
+    // The screen refreshes every mRefresh ms since it was opened.
+    double elapsed = Now() - mStart;
+    double next    = mStart + (floor(elapsed/mRefresh) + 1)*mRefresh;
+    for(;;){
+        double left = next - Now();
+        if(left <= 0)
+            break;
+        if(left > 2)
+            Sleep((DWORD)(left - 1));
+        else
+            SwitchToThread();
+    }
+
+    // Flip the presented frame.
+    if(mFlip){
+        EnterCriticalSection(&mScreenLock);
+        cvCopy(mBack, mScreen);
+        LeaveCriticalSection(&mScreenLock);
+        if(mProjector != NULL)
+            mProjector->Show(mBack);
+        InterlockedIncrement(&mFrameCount);
+        mFlip = false;
+    }
+    return true;
+}
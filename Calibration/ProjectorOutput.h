@@ -0,0 +1,224 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\ProjectorOutput.h
+//
+// summary:	Declares the scheduled projector output classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "SimulatedScene.h"
+#include "Kinect-Parallel.h"
+
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  ProjectorOutput
+///
+/// @brief  Presents projector frames from a thread of its own, and records when each frame was
+///         on screen.
+///
+///         A sequence is preloaded with Load(), which converts every pattern into the display
+///         format up front, so presenting a pattern only copies it to the screen. Play() presents
+///         the sequence on every vertical refresh (period 0) or at a fixed period; Show() presents
+///         a single frame as soon as possible and returns once it is on screen.
+///
+///         Present times are taken after the display has refreshed (if it can wait for the
+///         refresh, otherwise right after the frame was sent), on the clock of Now(). A frame
+///         captured at time t shows the pattern FindPattern(t - latency) returns, so capture code
+///         can match frames to patterns without sleeping.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class ProjectorOutput
+{
+public:
+    /// <summary> A presented frame. </summary>
+    struct Present
+    {
+        int    pattern;                 // index of the pattern in the loaded sequence (-1 for Show())
+        int    sequence;                // present number (from 0, since the output was opened)
+        double time;                    // when the frame was on screen (in ms, see Now())
+    };
+
+    ProjectorOutput();
+    virtual ~ProjectorOutput();
+
+    // Start the presenter thread; period_ms is the period of sequences (0 = every vertical refresh).
+    // Note: Returns false if the display cannot be opened.
+    bool Open(double period_ms);
+
+    // Stop the presenter thread and close the display (derived destructors must call it).
+    void Close();
+
+    bool IsOpen()                           { return mPresenter != NULL; };
+
+    // Preload a sequence (stops a playing one); the patterns are converted and may be released.
+    void Load(IplImage** patterns, int count);
+
+    // Present the loaded sequence once, from the first pattern; returns at once.
+    void Play();
+    void Stop();
+    bool IsPlaying();
+
+    // Wait until the sequence has been presented.
+    void WaitForSequence();
+
+    // Present a frame as soon as possible and return its present time (-1 if the output is not open
+    // or is closed before the frame was presented).
+    // Note: Takes priority over a playing sequence. Call from one thread at a time (one frame of
+    //       Show() is pending at most).
+    double Show(const IplImage* frame);
+
+    // Presents of the sequence (since Play()).
+    std::vector<Present> GetPresents();
+
+    // Pattern of the sequence on screen at time (-1 before the first or after Load()).
+    int FindPattern(double time);
+
+    // Clock of the present times (in ms).
+    static double Now();
+
+protected:
+    // Called on the presenter thread: open and close the display.
+    virtual bool openDisplay() = 0;
+    virtual void closeDisplay() = 0;
+
+    // Called on the presenter thread: send a frame (in display format) to the screen.
+    virtual void present(const IplImage* frame) = 0;
+
+    // Called on the presenter thread: wait for the next vertical refresh.
+    // Note: Returns false if the display cannot wait (sequences are then paced at 60 Hz).
+    virtual bool waitForRefresh()           { return false; };
+
+    // Called on the presenter thread while it is idle (e.g., to dispatch window messages).
+    virtual void idle()                     { return; };
+
+    // Convert a pattern into the display format (8-bit BGR by default).
+    virtual IplImage* convert(const IplImage* pattern);
+
+private:
+    // The presenter thread.
+    class Presenter : public Kinect::AsyncTask
+    {
+    public:
+        Presenter(ProjectorOutput* owner)   { mOwner = owner; };
+        virtual void Run()                  { mOwner->run(); };
+    private:
+        ProjectorOutput* mOwner;
+    };
+
+    void run();
+
+    // Wait until a pattern of the sequence is due at time; returns early for Show(), Stop(),
+    // Load(), Play() or Close().
+    void waitUntil(double time);
+    void releaseSequence();
+
+    Presenter*             mPresenter;
+    CRITICAL_SECTION       mLock;
+    CRITICAL_SECTION       mPresentLock;    // held while a pattern of the sequence is picked and presented
+    HANDLE                 mWake;           // auto-reset: new work, or stop
+    HANDLE                 mOpened;         // manual-reset: the display was opened (or failed to)
+    HANDLE                 mShown;          // auto-reset: the frame of Show() is on screen
+    HANDLE                 mIdle;           // manual-reset: no sequence is playing
+    HANDLE                 mClosed;         // manual-reset: the presenter is stopped (or not started)
+    volatile LONG          mStopping;
+    bool                   mOpenResult;
+    double                 mPeriod;
+
+    std::vector<IplImage*> mSequence;
+    bool                   mPlaying;
+    int                    mNext;           // next pattern of the sequence
+    double                 mNextTime;       // when it is due (0 = at once)
+    double                 mFirstTime;      // present time of the first pattern
+
+    const IplImage*        mShowFrame;
+    double                 mShowTime;
+
+    std::vector<Present>   mPresents;
+    int                    mPresentCount;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  WindowProjectorOutput
+///
+/// @brief  Projector output to a borderless, topmost window covering the projector's screen.
+///
+///         Frames are copied with SetDIBitsToDevice. With desktop composition, DwmFlush() waits
+///         for the vertical refresh; without it, frames are paced at the fixed period (or 60 Hz).
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class WindowProjectorOutput : public ProjectorOutput
+{
+public:
+    // Window at (x, y) of the desktop, of the projector size.
+    WindowProjectorOutput(int x, int y, int width, int height);
+    virtual ~WindowProjectorOutput();
+
+protected:
+    virtual bool openDisplay();
+    virtual void closeDisplay();
+    virtual void present(const IplImage* frame);
+    virtual bool waitForRefresh();
+    virtual void idle();
+
+private:
+    static LRESULT CALLBACK windowProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
+
+    typedef HRESULT (WINAPI *DwmFlushProc)();
+
+    int          mX;
+    int          mY;
+    int          mWidth;
+    int          mHeight;
+    HWND         mWindow;
+    HDC          mDC;
+    HMODULE      mDwmApi;
+    DwmFlushProc mDwmFlush;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  VirtualProjectorOutput
+///
+/// @brief  Headless projector output for tests: the screen is an image in memory that refreshes
+///         at a fixed rate.
+///
+///         Presented frames go to a back buffer, which is flipped to the screen at the next
+///         refresh and, if a simulated projector is given, shown by it (on the presenter thread).
+///         Like on a real display, a pattern changes on screen shortly before its present time.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class VirtualProjectorOutput : public ProjectorOutput
+{
+public:
+    VirtualProjectorOutput(int width, int height, double refresh_ms = 1000.0/60.0, SimulatedProjector* projector = NULL);
+    virtual ~VirtualProjectorOutput();
+
+    // Copy of the screen (8-bit BGR, released by the caller; NULL if the output is not open).
+    IplImage* GetScreen();
+
+    // Number of frames presented.
+    int GetFrameCount()                     { return mFrameCount; };
+
+protected:
+    virtual bool openDisplay();
+    virtual void closeDisplay();
+    virtual void present(const IplImage* frame);
+    virtual bool waitForRefresh();
+
+private:
+    int                 mWidth;
+    int                 mHeight;
+    double              mRefresh;
+    double              mStart;
+    SimulatedProjector* mProjector;
+    CRITICAL_SECTION    mScreenLock;
+    IplImage*           mScreen;
+    IplImage*           mBack;          // presented frame, flipped at the next refresh
+    bool                mFlip;
+    volatile LONG       mFrameCount;
+};
@@ -0,0 +1,316 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\RayPlaneTriangulator.cpp
+//
+// summary:	Implements the ray-plane triangulation class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "RayPlaneTriangulator.h"
+#include "ProCamGeometry.h"
+#include "Kinect-Parallel.h"
+#include <emmintrin.h>
+#include <vector>
+
+// Triangulate a band of rows; the points of row y are written starting at y*width (compacted later).
+class RayPlaneTriangulateBody : public Kinect::ParallelLoopBody
+{
+public:
+    RayPlaneTriangulateBody(const IplImage* decoded_cols, const IplImage* decoded_rows, const IplImage* mask,
+                            const CvMat* rays, const CvMat* denominators, const CvMat* col_lut, const CvMat* row_lut,
+                            const float* col_num, const float* row_num, const float* dist_range, float dist_reject,
+                            CvMat* points, CvMat* indices, int* row_counts)
+    {
+        mDecodedCols  = decoded_cols;
+        mDecodedRows  = decoded_rows;
+        mMask         = mask;
+        mRays         = rays;
+        mDenominators = denominators;
+        mColLUT       = col_lut;
+        mRowLUT       = row_lut;
+        mColNum       = col_num;
+        mRowNum       = row_num;
+        mDistRange    = dist_range;
+        mDistReject   = dist_reject;
+        mPoints       = points;
+        mIndices      = indices;
+        mRowCounts    = row_counts;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int y=begin; y<end; y++)
+            mRowCounts[y] = triangulateRow(y);
+    }
+
+private:
+    const float* row(const CvMat* mat, int r, int offset)
+    {
+        return (const float*)(mat->data.ptr + r*mat->step) + offset;
+    }
+
+    float* row(CvMat* mat, int r, int offset)
+    {
+        return (float*)(mat->data.ptr + r*mat->step) + offset;
+    }
+
+    // Look up the undistorted coordinate of four decoded values (invalid lanes are clamped).
+    static inline __m128 gather(const CvMat* lut, const ushort* decoded)
+    {
+        const float* table = lut->data.fl;
+        const int    last  = lut->cols - 1;
+        return _mm_setr_ps(table[MIN(decoded[0], last)], table[MIN(decoded[1], last)],
+                           table[MIN(decoded[2], last)], table[MIN(decoded[3], last)]);
+    }
+
+    int triangulateRow(int y)
+    {
+        const int     width  = mMask->width;
+        const int     offset = y*width;
+        const uchar*  mask   = (const uchar*)mMask->imageData + y*mMask->widthStep;
+        const ushort* cols   = mDecodedCols ? (const ushort*)(mDecodedCols->imageData + y*mDecodedCols->widthStep) : NULL;
+        const ushort* rows   = mDecodedRows ? (const ushort*)(mDecodedRows->imageData + y*mDecodedRows->widthStep) : NULL;
+        const float*  rx     = row(mRays, 0, offset);
+        const float*  ry     = row(mRays, 1, offset);
+        const float*  rz     = row(mRays, 2, offset);
+        const float*  cc     = row(mDenominators, 0, offset);
+        const float*  cd     = row(mDenominators, 1, offset);
+        const float*  rc     = row(mDenominators, 2, offset);
+        const float*  rd     = row(mDenominators, 3, offset);
+        float*        px     = row(mPoints, 0, offset);
+        float*        py     = row(mPoints, 1, offset);
+        float*        pz     = row(mPoints, 2, offset);
+        int*          index  = mIndices ? (int*)(mIndices->data.ptr) + offset : NULL;
+
+        const __m128 col_a  = _mm_set1_ps(mColNum[0]);
+        const __m128 col_b  = _mm_set1_ps(mColNum[1]);
+        const __m128 row_a  = _mm_set1_ps(mRowNum[0]);
+        const __m128 row_b  = _mm_set1_ps(mRowNum[1]);
+        const __m128 t_min  = _mm_set1_ps(mDistRange[0]);
+        const __m128 t_max  = _mm_set1_ps(mDistRange[1]);
+        const __m128 reject = _mm_set1_ps(mDistReject);
+        const __m128 half   = _mm_set1_ps(0.5f);
+        const __m128 sign   = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+        int count = 0;
+        int x = 0;
+        for(; x+4 <= width; x+=4){
+            int valid = (mask[x] != 0) | ((mask[x+1] != 0) << 1) | ((mask[x+2] != 0) << 2) | ((mask[x+3] != 0) << 3);
+            if(valid == 0)
+                continue;
+
+            // Distance along the ray for the column planes and/or the row planes.
+            __m128 t, t_row;
+            if(cols != NULL){
+                __m128 u = gather(mColLUT, cols + x);
+                t = _mm_div_ps(_mm_add_ps(col_a, _mm_mul_ps(col_b, u)),
+                               _mm_add_ps(_mm_loadu_ps(cc + x), _mm_mul_ps(_mm_loadu_ps(cd + x), u)));
+            }
+            if(rows != NULL){
+                __m128 v = gather(mRowLUT, rows + x);
+                t_row = _mm_div_ps(_mm_add_ps(row_a, _mm_mul_ps(row_b, v)),
+                                   _mm_add_ps(_mm_loadu_ps(rc + x), _mm_mul_ps(_mm_loadu_ps(rd + x), v)));
+                if(cols != NULL){
+                    __m128 diff = _mm_and_ps(_mm_sub_ps(t, t_row), sign);
+                    valid &= _mm_movemask_ps(_mm_cmple_ps(diff, reject));
+                    t = _mm_mul_ps(_mm_add_ps(t, t_row), half);
+                }
+                else
+                    t = t_row;
+            }
+            valid &= _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(t, t_min), _mm_cmple_ps(t, t_max)));
+            if(valid == 0)
+                continue;
+
+            // Evaluate the points and append the accepted ones.
+            float X[4], Y[4], Z[4];
+            _mm_storeu_ps(X, _mm_mul_ps(t, _mm_loadu_ps(rx + x)));
+            _mm_storeu_ps(Y, _mm_mul_ps(t, _mm_loadu_ps(ry + x)));
+            _mm_storeu_ps(Z, _mm_mul_ps(t, _mm_loadu_ps(rz + x)));
+            for(int k=0; k<4; k++){
+                if(valid & (1 << k)){
+                    px[count] = X[k];
+                    py[count] = Y[k];
+                    pz[count] = Z[k];
+                    if(index != NULL)
+                        index[count] = offset + x + k;
+                    count++;
+                }
+            }
+        }
+
+        // Remaining pixels.
+        for(; x<width; x++){
+            if(mask[x] == 0)
+                continue;
+            float t = 0;
+            if(cols != NULL){
+                float u = mColLUT->data.fl[MIN(cols[x], mColLUT->cols-1)];
+                t = (mColNum[0] + mColNum[1]*u)/(cc[x] + cd[x]*u);
+            }
+            if(rows != NULL){
+                float v = mRowLUT->data.fl[MIN(rows[x], mRowLUT->cols-1)];
+                float t_row = (mRowNum[0] + mRowNum[1]*v)/(rc[x] + rd[x]*v);
+                if(cols != NULL){
+                    if(!(fabs(t - t_row) <= mDistReject))
+                        continue;
+                    t = 0.5f*(t + t_row);
+                }
+                else
+                    t = t_row;
+            }
+            if(!(t >= mDistRange[0] && t <= mDistRange[1]))
+                continue;
+            px[count] = t*rx[x];
+            py[count] = t*ry[x];
+            pz[count] = t*rz[x];
+            if(index != NULL)
+                index[count] = offset + x;
+            count++;
+        }
+        return count;
+    }
+
+    const IplImage* mDecodedCols;
+    const IplImage* mDecodedRows;
+    const IplImage* mMask;
+    const CvMat*    mRays;
+    const CvMat*    mDenominators;
+    const CvMat*    mColLUT;
+    const CvMat*    mRowLUT;
+    const float*    mColNum;
+    const float*    mRowNum;
+    const float*    mDistRange;
+    float           mDistReject;
+    CvMat*          mPoints;
+    CvMat*          mIndices;
+    int*            mRowCounts;
+};
+
+RayPlaneTriangulator::RayPlaneTriangulator()
+{
+    mRays         = NULL;
+    mDenominators = NULL;
+    mColLUT       = NULL;
+    mRowLUT       = NULL;
+}
+
+RayPlaneTriangulator::~RayPlaneTriangulator()
+{
+    release();
+}
+
+void RayPlaneTriangulator::release()
+{
+    if(mRays != NULL){
+        cvReleaseMat(&mRays);
+        cvReleaseMat(&mDenominators);
+        cvReleaseMat(&mColLUT);
+        cvReleaseMat(&mRowLUT);
+    }
+}
+
+bool RayPlaneTriangulator::Build(struct slParams* sl_params, struct slCalib* sl_calib)
+{
+    release();
+    if(!sl_calib->cam_intrinsic_calib || !sl_calib->proj_intrinsic_calib || !sl_calib->procam_extrinsic_calib){
+        printf("ERROR: Ray-plane triangulation requires a calibrated projector-camera system!\n");
+        return false;
+    }
+
+    mWidth        = sl_params->cam_w;
+    mHeight       = sl_params->cam_h;
+    mDistRange[0] = sl_params->dist_range[0];
+    mDistRange[1] = sl_params->dist_range[1];
+    mDistReject   = sl_params->dist_reject;
+    int n = mWidth*mHeight;
+
+    // Projector matrix rows and the constant numerators (the camera center is the origin).
+    CvMat* projection = cvCreateMat(3, 4, CV_64FC1);
+    getProjectorProjection(sl_calib, projection);
+    double P[3][4];
+    for(int i=0; i<3; i++)
+        for(int j=0; j<4; j++)
+            P[i][j] = cvmGet(projection, i, j);
+    cvReleaseMat(&projection);
+    mColNum[0] = (float)-P[0][3];
+    mColNum[1] = (float) P[2][3];
+    mRowNum[0] = (float)-P[1][3];
+    mRowNum[1] = (float) P[2][3];
+
+    // Camera rays and per-pixel denominators.
+    mRays         = cvCreateMat(3, n, CV_32FC1);
+    mDenominators = cvCreateMat(4, n, CV_32FC1);
+    if(sl_calib->procam_geometry_calib)
+        cvCopy(sl_calib->cam_rays, mRays);
+    else
+        computeCameraRays(sl_params, sl_calib, mRays);
+    const float* rx = (const float*)(mRays->data.ptr);
+    const float* ry = (const float*)(mRays->data.ptr + mRays->step);
+    const float* rz = (const float*)(mRays->data.ptr + 2*mRays->step);
+    float* den[4];
+    for(int k=0; k<4; k++)
+        den[k] = (float*)(mDenominators->data.ptr + k*mDenominators->step);
+    for(int i=0; i<n; i++){
+        double p0 = P[0][0]*rx[i] + P[0][1]*ry[i] + P[0][2]*rz[i];
+        double p1 = P[1][0]*rx[i] + P[1][1]*ry[i] + P[1][2]*rz[i];
+        double p2 = P[2][0]*rx[i] + P[2][1]*ry[i] + P[2][2]*rz[i];
+        den[0][i] = (float) p0;
+        den[1][i] = (float)-p2;
+        den[2][i] = (float) p1;
+        den[3][i] = (float)-p2;
+    }
+
+    // Undistorted column coordinates (along the principal row) and row coordinates (along the principal column).
+    double cx = cvmGet(sl_calib->proj_intrinsic, 0, 2);
+    double cy = cvmGet(sl_calib->proj_intrinsic, 1, 2);
+    mColLUT = cvCreateMat(1, sl_params->proj_w, CV_32FC1);
+    mRowLUT = cvCreateMat(1, sl_params->proj_h, CV_32FC1);
+    CvMat* pixels = cvCreateMat(sl_params->proj_w + sl_params->proj_h, 2, CV_32FC1);
+    for(int c=0; c<sl_params->proj_w; c++){
+        CV_MAT_ELEM(*pixels, float, c, 0) = (float)c;
+        CV_MAT_ELEM(*pixels, float, c, 1) = (float)cy;
+    }
+    for(int r=0; r<sl_params->proj_h; r++){
+        CV_MAT_ELEM(*pixels, float, sl_params->proj_w + r, 0) = (float)cx;
+        CV_MAT_ELEM(*pixels, float, sl_params->proj_w + r, 1) = (float)r;
+    }
+    undistortPixels(pixels, sl_calib->proj_intrinsic, sl_calib->proj_distortion);
+    for(int c=0; c<sl_params->proj_w; c++)
+        mColLUT->data.fl[c] = CV_MAT_ELEM(*pixels, float, c, 0);
+    for(int r=0; r<sl_params->proj_h; r++)
+        mRowLUT->data.fl[r] = CV_MAT_ELEM(*pixels, float, sl_params->proj_w + r, 1);
+    cvReleaseMat(&pixels);
+    return true;
+}
+
+int RayPlaneTriangulator::Triangulate(const IplImage* decoded_cols, const IplImage* decoded_rows, const IplImage* mask,
+                                      CvMat* points, CvMat* indices)
+{
+    if(!IsBuilt() || (decoded_cols == NULL && decoded_rows == NULL) ||
+       mask->width != mWidth || mask->height != mHeight || points->cols < mWidth*mHeight){
+        printf("ERROR: Decoded maps do not match the ray-plane triangulator!\n");
+        return 0;
+    }
+
+    // Triangulate every row in place, then pack the rows.
+    std::vector<int> row_counts(mHeight);
+    RayPlaneTriangulateBody body(decoded_cols, decoded_rows, mask, mRays, mDenominators, mColLUT, mRowLUT,
+                                 mColNum, mRowNum, mDistRange, mDistReject, points, indices, &row_counts[0]);
+    Kinect::ParallelFor(0, mHeight, body, 16);
+
+    int count = 0;
+    for(int y=0; y<mHeight; y++){
+        int offset = y*mWidth;
+        if(offset != count && row_counts[y] > 0){
+            for(int k=0; k<3; k++){
+                float* p = (float*)(points->data.ptr + k*points->step);
+                memmove(p + count, p + offset, row_counts[y]*sizeof(float));
+            }
+            if(indices != NULL)
+                memmove(indices->data.i + count, indices->data.i + offset, row_counts[y]*sizeof(int));
+        }
+        count += row_counts[y];
+    }
+    return count;
+}
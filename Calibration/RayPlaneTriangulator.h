@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\RayPlaneTriangulator.h
+//
+// summary:	Declares the ray-plane triangulation class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  RayPlaneTriangulator
+///
+/// @brief  Ray-plane ("mode 1") reconstruction from decoded projector column/row maps.
+///
+///         The planes of the projector columns form a pencil P0 - u*P2 (rows: P1 - v*P2), where
+///         Pi are the rows of the projector matrix in camera coordinates. The distance along the
+///         unit ray r of a camera pixel is therefore the rational function
+///
+///             t(u) = (a + b*u)/(c + d*u),   a = -P0[3], b = P2[3], c = P0.r, d = -P2.r
+///
+///         with a and b constant and (c, d) precomputed per pixel, once per calibration. Decoded
+///         columns/rows are corrected for projector distortion with a lookup table (evaluated
+///         through the projector principal point). Triangulation processes four pixels at a time
+///         (SSE) in parallel row bands, applies dist_range (and dist_reject when both columns
+///         and rows are scanned) and writes the accepted points compactly as separate X, Y, Z rows.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class RayPlaneTriangulator
+{
+public:
+    RayPlaneTriangulator();
+    ~RayPlaneTriangulator();
+
+    // Precompute the per-pixel coefficients (must be called again whenever the calibration changes).
+    // Note: Returns false if the projector-camera system has not been calibrated.
+    bool Build(struct slParams* sl_params, struct slCalib* sl_calib);
+
+    bool IsBuilt()                  { return mRays != NULL; };
+
+    // Triangulate the valid pixels of decoded column/row maps (16-bit, either may be NULL).
+    // Note: points must be 3 x (cam_w*cam_h) (CV_32FC1) and receives X, Y and Z in its rows;
+    //       indices (1 x cam_w*cam_h, CV_32SC1, optional) receives the pixel index of each point.
+    //       Returns the number of points.
+    int Triangulate(const IplImage* decoded_cols, const IplImage* decoded_rows, const IplImage* mask,
+                    CvMat* points, CvMat* indices = NULL);
+
+private:
+    void release();
+
+    int    mWidth;
+    int    mHeight;
+    float  mDistRange[2];
+    float  mDistReject;
+
+    /// <summary> Constant numerator coefficients (a, b) for columns and rows. </summary>
+    float  mColNum[2];
+    float  mRowNum[2];
+
+    /// <summary> Unit camera rays (3 rows of cam_w*cam_h). </summary>
+    CvMat* mRays;
+
+    /// <summary> Per-pixel denominator coefficients (c, d) for columns and rows (4 rows). </summary>
+    CvMat* mDenominators;
+
+    /// <summary> Undistorted column/row coordinate of every decoded column/row. </summary>
+    CvMat* mColLUT;
+    CvMat* mRowLUT;
+};
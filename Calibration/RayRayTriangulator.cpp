@@ -0,0 +1,311 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\RayRayTriangulator.cpp
+//
+// summary:	Implements the ray-ray triangulation class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "RayRayTriangulator.h"
+#include "ProCamGeometry.h"
+#include "Kinect-Parallel.h"
+#include <emmintrin.h>
+
+// Triangulate a band of rows.
+class RayRayTriangulateBody : public Kinect::ParallelLoopBody
+{
+public:
+    RayRayTriangulateBody(const IplImage* decoded_cols, const IplImage* decoded_rows, IplImage* mask,
+                          const CvMat* cam_rays, const CvMat* proj_rays, int proj_w, int proj_h,
+                          const float* proj_center, const float (*proj_ray_map)[3], const float* dist_range, float dist_reject,
+                          CvMat* points, CvMat* residuals, int* row_counts)
+    {
+        mDecodedCols = decoded_cols;
+        mDecodedRows = decoded_rows;
+        mMask        = mask;
+        mCamRays     = cam_rays;
+        mProjRays    = proj_rays;
+        mProjW       = proj_w;
+        mProjH       = proj_h;
+        mProjCenter  = proj_center;
+        mProjRayMap  = proj_ray_map;
+        mDistRange   = dist_range;
+        mDistReject  = dist_reject;
+        mPoints      = points;
+        mResiduals   = residuals;
+        mRowCounts   = row_counts;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int y=begin; y<end; y++)
+            mRowCounts[y] = triangulateRow(y);
+    }
+
+private:
+    template<typename T> static T* row(const CvMat* mat, int r, int offset)
+    {
+        return (T*)(mat->data.ptr + r*mat->step) + offset;
+    }
+
+    // Projector ray through the sub-pixel position (u, v).
+    void projectorRay(float u, float v, float* d)
+    {
+        if(mProjRays == NULL){
+            for(int k=0; k<3; k++)
+                d[k] = mProjRayMap[k][0]*u + mProjRayMap[k][1]*v + mProjRayMap[k][2];
+            return;
+        }
+
+        // Bilinear interpolation of the ray table (clamped to the projector).
+        u = MIN(MAX(u, 0.f), (float)(mProjW-1));
+        v = MIN(MAX(v, 0.f), (float)(mProjH-1));
+        int   x0 = MIN((int)u, mProjW-2);
+        int   y0 = MIN((int)v, mProjH-2);
+        float ax = u - x0, ay = v - y0;
+        int   i  = y0*mProjW + x0;
+        for(int k=0; k<3; k++){
+            const float* r = row<const float>(mProjRays, k, i);
+            d[k] = (1-ay)*((1-ax)*r[0] + ax*r[1]) + ay*((1-ax)*r[mProjW] + ax*r[mProjW+1]);
+        }
+    }
+
+    int triangulateRow(int y)
+    {
+        const int    width  = mMask->width;
+        const int    offset = y*width;
+        uchar*       mask   = (uchar*)mMask->imageData + y*mMask->widthStep;
+        const float* cols   = (const float*)(mDecodedCols->imageData + y*mDecodedCols->widthStep);
+        const float* rows   = (const float*)(mDecodedRows->imageData + y*mDecodedRows->widthStep);
+        const float* rx     = row<const float>(mCamRays, 0, offset);
+        const float* ry     = row<const float>(mCamRays, 1, offset);
+        const float* rz     = row<const float>(mCamRays, 2, offset);
+        float*       px     = row<float>(mPoints, 0, offset);
+        float*       py     = row<float>(mPoints, 1, offset);
+        float*       pz     = row<float>(mPoints, 2, offset);
+        float*       res    = mResiduals ? row<float>(mResiduals, 0, offset) : NULL;
+
+        const __m128 cx     = _mm_set1_ps(mProjCenter[0]);
+        const __m128 cy     = _mm_set1_ps(mProjCenter[1]);
+        const __m128 cz     = _mm_set1_ps(mProjCenter[2]);
+        const __m128 t_min  = _mm_set1_ps(mDistRange[0]);
+        const __m128 t_max  = _mm_set1_ps(mDistRange[1]);
+        const __m128 reject = _mm_set1_ps(mDistReject);
+        const __m128 half   = _mm_set1_ps(0.5f);
+
+        int count = 0;
+        int x = 0;
+        for(; x+4 <= width; x+=4){
+            int valid = (mask[x] != 0) | ((mask[x+1] != 0) << 1) | ((mask[x+2] != 0) << 2) | ((mask[x+3] != 0) << 3);
+            if(valid == 0)
+                continue;
+
+            // Projector rays of the four pixels.
+            __m128 dx, dy, dz;
+            if(mProjRays == NULL){
+                __m128 u = _mm_loadu_ps(cols + x);
+                __m128 v = _mm_loadu_ps(rows + x);
+                dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mProjRayMap[0][0]), u), _mm_mul_ps(_mm_set1_ps(mProjRayMap[0][1]), v)), _mm_set1_ps(mProjRayMap[0][2]));
+                dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mProjRayMap[1][0]), u), _mm_mul_ps(_mm_set1_ps(mProjRayMap[1][1]), v)), _mm_set1_ps(mProjRayMap[1][2]));
+                dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mProjRayMap[2][0]), u), _mm_mul_ps(_mm_set1_ps(mProjRayMap[2][1]), v)), _mm_set1_ps(mProjRayMap[2][2]));
+            }
+            else{
+                float d[3][4];
+                for(int k=0; k<4; k++){
+                    float dk[3] = {0, 0, 1};
+                    if(valid & (1 << k))
+                        projectorRay(cols[x+k], rows[x+k], dk);
+                    d[0][k] = dk[0];
+                    d[1][k] = dk[1];
+                    d[2][k] = dk[2];
+                }
+                dx = _mm_loadu_ps(d[0]);
+                dy = _mm_loadu_ps(d[1]);
+                dz = _mm_loadu_ps(d[2]);
+            }
+            __m128 vx = _mm_loadu_ps(rx + x);
+            __m128 vy = _mm_loadu_ps(ry + x);
+            __m128 vz = _mm_loadu_ps(rz + x);
+
+            // Closest points q1 + s*v1 (camera, q1 = 0, |v1| = 1) and q2 + t*v2 (projector).
+            __m128 b     = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+            __m128 c     = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            __m128 q_v1  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, cx), _mm_mul_ps(vy, cy)), _mm_mul_ps(vz, cz));
+            __m128 q_v2  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, cx), _mm_mul_ps(dy, cy)), _mm_mul_ps(dz, cz));
+            __m128 denom = _mm_sub_ps(c, _mm_mul_ps(b, b));
+            __m128 s     = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(c, q_v1), _mm_mul_ps(b, q_v2)), denom);
+            __m128 t     = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(b, q_v1), q_v2), denom);
+
+            __m128 p1x = _mm_mul_ps(s, vx), p1y = _mm_mul_ps(s, vy), p1z = _mm_mul_ps(s, vz);
+            __m128 p2x = _mm_add_ps(cx, _mm_mul_ps(t, dx));
+            __m128 p2y = _mm_add_ps(cy, _mm_mul_ps(t, dy));
+            __m128 p2z = _mm_add_ps(cz, _mm_mul_ps(t, dz));
+            __m128 ex  = _mm_sub_ps(p1x, p2x), ey = _mm_sub_ps(p1y, p2y), ez = _mm_sub_ps(p1z, p2z);
+            __m128 r   = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez)));
+
+            _mm_storeu_ps(px + x, _mm_mul_ps(_mm_add_ps(p1x, p2x), half));
+            _mm_storeu_ps(py + x, _mm_mul_ps(_mm_add_ps(p1y, p2y), half));
+            _mm_storeu_ps(pz + x, _mm_mul_ps(_mm_add_ps(p1z, p2z), half));
+            if(res != NULL)
+                _mm_storeu_ps(res + x, r);
+
+            // Consistency and range tests.
+            int accepted = valid & _mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(r, reject),
+                _mm_and_ps(_mm_cmpge_ps(s, t_min), _mm_cmple_ps(s, t_max))));
+            for(int k=0; k<4; k++){
+                if(accepted & (1 << k))
+                    count++;
+                else
+                    mask[x+k] = 0;
+            }
+        }
+
+        // Remaining pixels.
+        for(; x<width; x++){
+            if(mask[x] == 0)
+                continue;
+            float d[3];
+            projectorRay(cols[x], rows[x], d);
+            float v[3] = {rx[x], ry[x], rz[x]};
+            float b = 0, c = 0, q_v1 = 0, q_v2 = 0;
+            for(int k=0; k<3; k++){
+                b    += v[k]*d[k];
+                c    += d[k]*d[k];
+                q_v1 += v[k]*mProjCenter[k];
+                q_v2 += d[k]*mProjCenter[k];
+            }
+            float denom = c - b*b;
+            float s = (c*q_v1 - b*q_v2)/denom;
+            float t = (b*q_v1 - q_v2)/denom;
+            float p1[3], p2[3], r = 0;
+            for(int k=0; k<3; k++){
+                p1[k] = s*v[k];
+                p2[k] = mProjCenter[k] + t*d[k];
+                r += (p1[k] - p2[k])*(p1[k] - p2[k]);
+            }
+            r = sqrt(r);
+            px[x] = 0.5f*(p1[0] + p2[0]);
+            py[x] = 0.5f*(p1[1] + p2[1]);
+            pz[x] = 0.5f*(p1[2] + p2[2]);
+            if(res != NULL)
+                res[x] = r;
+            if(r <= mDistReject && s >= mDistRange[0] && s <= mDistRange[1])
+                count++;
+            else
+                mask[x] = 0;
+        }
+        return count;
+    }
+
+    const IplImage*    mDecodedCols;
+    const IplImage*    mDecodedRows;
+    IplImage*          mMask;
+    const CvMat*       mCamRays;
+    const CvMat*       mProjRays;
+    int                mProjW;
+    int                mProjH;
+    const float*       mProjCenter;
+    const float      (*mProjRayMap)[3];
+    const float*       mDistRange;
+    float              mDistReject;
+    CvMat*             mPoints;
+    CvMat*             mResiduals;
+    int*               mRowCounts;
+};
+
+RayRayTriangulator::RayRayTriangulator()
+{
+    mCamRays  = NULL;
+    mProjRays = NULL;
+}
+
+RayRayTriangulator::~RayRayTriangulator()
+{
+    release();
+}
+
+void RayRayTriangulator::release()
+{
+    if(mCamRays != NULL)
+        cvReleaseMat(&mCamRays);
+    if(mProjRays != NULL)
+        cvReleaseMat(&mProjRays);
+}
+
+bool RayRayTriangulator::Build(struct slParams* sl_params, struct slCalib* sl_calib)
+{
+    release();
+    if(!sl_calib->cam_intrinsic_calib || !sl_calib->proj_intrinsic_calib || !sl_calib->procam_extrinsic_calib){
+        printf("ERROR: Ray-ray triangulation requires a calibrated projector-camera system!\n");
+        return false;
+    }
+
+    mWidth        = sl_params->cam_w;
+    mHeight       = sl_params->cam_h;
+    mProjW        = sl_params->proj_w;
+    mProjH        = sl_params->proj_h;
+    mDistRange[0] = sl_params->dist_range[0];
+    mDistRange[1] = sl_params->dist_range[1];
+    mDistReject   = sl_params->dist_reject;
+
+    // Projector center -R^T*T and the linear ray map R^T*K^-1.
+    CvMat* rotation    = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* translation = cvCreateMat(3, 1, CV_64FC1);
+    CvMat* intrinsic   = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* ray_map     = cvCreateMat(3, 3, CV_64FC1);
+    double center[3];
+    getProjectorPose(sl_calib, rotation, translation);
+    getProjectorCenter(sl_calib, center);
+    for(int i=0; i<3; i++){
+        for(int j=0; j<3; j++)
+            cvmSet(intrinsic, i, j, cvmGet(sl_calib->proj_intrinsic, i, j));
+        mProjCenter[i] = (float)center[i];
+    }
+    cvInvert(intrinsic, intrinsic);
+    cvGEMM(rotation, intrinsic, 1, NULL, 0, ray_map, CV_GEMM_A_T);
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            mProjRayMap[i][j] = (float)cvmGet(ray_map, i, j);
+    cvReleaseMat(&rotation);
+    cvReleaseMat(&translation);
+    cvReleaseMat(&intrinsic);
+    cvReleaseMat(&ray_map);
+
+    // Camera rays, and the projector ray table if the projector lens is distorted.
+    // Note: The rays of the evaluated projector-camera geometry are used if available.
+    mCamRays = cvCreateMat(3, mWidth*mHeight, CV_32FC1);
+    if(sl_calib->procam_geometry_calib)
+        cvCopy(sl_calib->cam_rays, mCamRays);
+    else
+        computeCameraRays(sl_params, sl_calib, mCamRays);
+    if(cvNorm(sl_calib->proj_distortion, NULL, CV_L1) > 0){
+        mProjRays = cvCreateMat(3, mProjW*mProjH, CV_32FC1);
+        if(sl_calib->procam_geometry_calib)
+            cvCopy(sl_calib->proj_rays, mProjRays);
+        else
+            computeProjectorRays(sl_params, sl_calib, mProjRays);
+    }
+    return true;
+}
+
+int RayRayTriangulator::Triangulate(const IplImage* decoded_cols, const IplImage* decoded_rows, IplImage* mask,
+                                    CvMat* points, CvMat* residuals)
+{
+    if(!IsBuilt() || decoded_cols == NULL || decoded_rows == NULL ||
+       decoded_cols->depth != IPL_DEPTH_32F || decoded_rows->depth != IPL_DEPTH_32F ||
+       mask->width != mWidth || mask->height != mHeight || points->cols < mWidth*mHeight){
+        printf("ERROR: Decoded maps do not match the ray-ray triangulator!\n");
+        return 0;
+    }
+
+    int* row_counts = new int[mHeight];
+    RayRayTriangulateBody body(decoded_cols, decoded_rows, mask, mCamRays, mProjRays, mProjW, mProjH,
+                               mProjCenter, mProjRayMap, mDistRange, mDistReject, points, residuals, row_counts);
+    Kinect::ParallelFor(0, mHeight, body, 16);
+
+    int count = 0;
+    for(int y=0; y<mHeight; y++)
+        count += row_counts[y];
+    delete [] row_counts;
+    return count;
+}
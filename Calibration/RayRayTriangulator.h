@@ -0,0 +1,68 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\RayRayTriangulator.h
+//
+// summary:	Declares the ray-ray triangulation class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  RayRayTriangulator
+///
+/// @brief  Ray-ray ("mode 2") reconstruction from decoded sub-pixel projector coordinates.
+///
+///         Every camera pixel with a decoded projector position (u, v) is triangulated as the
+///         midpoint of the closest points of the camera ray and the projector ray; the distance
+///         between these points is the residual. Projector rays are evaluated on the fly as
+///         R^T*K^-1*(u, v, 1) when the projector has no distortion, and otherwise interpolated
+///         bilinearly from a table of undistorted rays (one per projector pixel). Camera rays
+///         are precomputed once per calibration. Pixels are solved four at a time (SSE) in
+///         parallel row bands, and rejected if the residual exceeds dist_reject or the distance
+///         along the camera ray is outside of dist_range.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class RayRayTriangulator
+{
+public:
+    RayRayTriangulator();
+    ~RayRayTriangulator();
+
+    // Precompute the camera rays and projector geometry (again whenever the calibration changes).
+    // Note: Returns false if the projector-camera system has not been calibrated.
+    bool Build(struct slParams* sl_params, struct slCalib* sl_calib);
+
+    bool IsBuilt()                  { return mCamRays != NULL; };
+
+    // Triangulate sub-pixel column/row maps (IPL_DEPTH_32F) for the pixels set in mask.
+    // Note: points (3 x cam_w*cam_h, CV_32FC1) receives the midpoint of every pixel in its X, Y and
+    //       Z rows, and residuals (1 x cam_w*cam_h, optional) the distance between the rays.
+    //       Rejected pixels are cleared in mask. Returns the number of valid pixels.
+    int Triangulate(const IplImage* decoded_cols, const IplImage* decoded_rows, IplImage* mask,
+                    CvMat* points, CvMat* residuals = NULL);
+
+private:
+    void release();
+
+    int    mWidth;
+    int    mHeight;
+    int    mProjW;
+    int    mProjH;
+    float  mDistRange[2];
+    float  mDistReject;
+
+    /// <summary> Projector center of projection (in camera coordinates). </summary>
+    float  mProjCenter[3];
+
+    /// <summary> Linear map from projector pixels to rays, R^T*K^-1 (used without a ray table). </summary>
+    float  mProjRayMap[3][3];
+
+    /// <summary> Unit camera rays (3 rows of cam_w*cam_h). </summary>
+    CvMat* mCamRays;
+
+    /// <summary> Projector rays (3 rows of proj_w*proj_h), or NULL without projector distortion. </summary>
+    CvMat* mProjRays;
+};
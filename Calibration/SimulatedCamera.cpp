@@ -0,0 +1,184 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\SimulatedCamera.cpp
+//
+// summary:	Implements the simulated camera class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "SimulatedCamera.h"
+#include "Kinect-Parallel.h"
+#include "Kinect-Trace.h"
+
+// Hash a pixel and frame index to a uniform value in [-1, 1).
+static inline float noiseHash(unsigned int x, unsigned int y, unsigned int frame)
+{
+    unsigned int h = x*73856093u ^ y*19349663u ^ frame*83492791u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return (float)(h & 0xffff)/32768.0f - 1.0f;
+}
+
+// Render a band of camera rows.
+class SimulatedRenderBody : public Kinect::ParallelLoopBody
+{
+public:
+    SimulatedRenderBody(const SimulatedScene* scene, const SimulatedProjector* projector, const IplImage* projected,
+                        float focal, const float* principal, int samples, float ambient, float noise, int frame_index,
+                        IplImage* frame)
+    {
+        mScene      = scene;
+        mProjector  = projector;
+        mProjected  = projected;
+        mFocal      = focal;
+        mPrincipal  = principal;
+        mSamples    = samples;
+        mAmbient    = ambient;
+        mNoise      = noise;
+        mFrameIndex = frame_index;
+        mFrame      = frame;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        float center[3];
+        mProjector->GetCenter(center);
+        float weight = 1.0f/(mSamples*mSamples);
+
+        // Uniform noise with the requested standard deviation.
+        float noise_scale = 1.7320508f*mNoise;
+        for(int y=begin; y<end; y++){
+            uchar* row = (uchar*)mFrame->imageData + y*mFrame->widthStep;
+            for(int x=0; x<mFrame->width; x++){
+                float color[3] = { 0, 0, 0 };
+                for(int sy=0; sy<mSamples; sy++){
+                    for(int sx=0; sx<mSamples; sx++){
+                        float dir[3] = {
+                            (x + (sx + 0.5f)/mSamples - 0.5f - mPrincipal[0])/mFocal,
+                            (y + (sy + 0.5f)/mSamples - 0.5f - mPrincipal[1])/mFocal,
+                            1.0f };
+                        float point[3], normal[3], albedo[3];
+                        if(mScene->Trace(dir, point, normal, albedo) <= 0)
+                            continue;
+
+                        // Lambertian shading of the projector light (unless the point is in shadow).
+                        float light[3] = { 0, 0, 0 };
+                        float to_proj[3] = { center[0] - point[0], center[1] - point[1], center[2] - point[2] };
+                        float cosine = (normal[0]*to_proj[0] + normal[1]*to_proj[1] + normal[2]*to_proj[2])/
+                            sqrt(to_proj[0]*to_proj[0] + to_proj[1]*to_proj[1] + to_proj[2]*to_proj[2]);
+                        if(cosine > 0 && !mScene->Occluded(point, center))
+                            mProjector->Illuminate(point, mProjected, light);
+                        else
+                            cosine = 0;
+                        for(int c=0; c<3; c++)
+                            color[c] += albedo[c]*(mAmbient + cosine*light[c]);
+                    }
+                }
+                float n = (mNoise > 0) ? noise_scale*noiseHash(x, y, mFrameIndex) : 0;
+                for(int c=0; c<3; c++)
+                    row[3*x+c] = CV_CAST_8U(cvRound(weight*color[c] + n));
+            }
+        }
+    }
+
+private:
+    const SimulatedScene*     mScene;
+    const SimulatedProjector* mProjector;
+    const IplImage*           mProjected;   // projector frame (copy, so Show() may run meanwhile)
+    float        mFocal;
+    const float* mPrincipal;
+    int          mSamples;
+    float        mAmbient;
+    float        mNoise;
+    int          mFrameIndex;
+    IplImage*    mFrame;
+};
+
+// Trace the pixel centers of a band of camera rows.
+class SimulatedDepthBody : public Kinect::ParallelLoopBody
+{
+public:
+    SimulatedDepthBody(const SimulatedScene* scene, float focal, const float* principal, CvMat* depth)
+    {
+        mScene     = scene;
+        mFocal     = focal;
+        mPrincipal = principal;
+        mDepth     = depth;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int y=begin; y<end; y++){
+            float* row = (float*)(mDepth->data.ptr + y*mDepth->step);
+            for(int x=0; x<mDepth->cols; x++){
+                float dir[3] = { (x - mPrincipal[0])/mFocal, (y - mPrincipal[1])/mFocal, 1.0f };
+                float point[3], normal[3], albedo[3];
+                row[x] = (mScene->Trace(dir, point, normal, albedo) > 0) ? point[2] : 0;
+            }
+        }
+    }
+
+private:
+    const SimulatedScene* mScene;
+    float        mFocal;
+    const float* mPrincipal;
+    CvMat*       mDepth;
+};
+
+SimulatedCamera::SimulatedCamera(struct slParams* sl_params, SimulatedScene* scene, SimulatedProjector* projector)
+{
+    mScene        = scene;
+    mProjector    = projector;
+    mWidth        = sl_params->cam_w;
+    mHeight       = sl_params->cam_h;
+    mFocal        = 1.1f*mWidth;
+    mPrincipal[0] = 0.5f*(mWidth - 1);
+    mPrincipal[1] = 0.5f*(mHeight - 1);
+    mSamples      = 2;
+    mAmbient      = 20.0f;
+    mNoise        = 1.0f;
+    mFrameCount   = 0;
+    mCurFrame     = NULL;
+    mCamParams    = NULL;
+    mEnabled      = false;
+}
+
+void SimulatedCamera::Init(CameraConfigParams* camParams)
+{
+    mCamParams = camParams;
+    mEnabled   = true;
+}
+
+IplImage* SimulatedCamera::QueryFrame()
+{
+    KINECT_TRACE_SCOPE("camera.query_frame");
+    IplImage* frame = cvCreateImage(cvSize(mWidth, mHeight), IPL_DEPTH_8U, 3);
+    IplImage* projected = mProjector->GetFrame();
+    SimulatedRenderBody body(mScene, mProjector, projected, mFocal, mPrincipal, mSamples, mAmbient, mNoise, mFrameCount, frame);
+    Kinect::ParallelFor(0, mHeight, body, 8);
+    cvReleaseImage(&projected);
+    mFrameCount++;
+    return frame;
+}
+
+void SimulatedCamera::GetIntrinsic(CvMat* intrinsic) const
+{
+    cvZero(intrinsic);
+    cvmSet(intrinsic, 0, 0, mFocal);
+    cvmSet(intrinsic, 1, 1, mFocal);
+    cvmSet(intrinsic, 0, 2, mPrincipal[0]);
+    cvmSet(intrinsic, 1, 2, mPrincipal[1]);
+    cvmSet(intrinsic, 2, 2, 1);
+}
+
+void SimulatedCamera::GetDistortion(CvMat* distortion) const
+{
+    cvZero(distortion);
+}
+
+void SimulatedCamera::RenderDepth(CvMat* depth) const
+{
+    SimulatedDepthBody body(mScene, mFocal, mPrincipal, depth);
+    Kinect::ParallelFor(0, depth->rows, body, 8);
+}
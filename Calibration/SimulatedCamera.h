@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\SimulatedCamera.h
+//
+// summary:	Declares the simulated camera class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "Camera.h"
+#include "SimulatedScene.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  SimulatedCamera
+///
+/// @brief  Virtual camera (cam_w x cam_h, BGR) viewing a simulated scene lit by a simulated
+///         projector.
+///
+///         Every frame is rendered when it is queried: each camera ray is traced into the scene
+///         and the pixel is the albedo times the ambient light plus the projector light reaching
+///         the point (Lambertian, with shadows). Pixels are supersampled (2x2 by default, to
+///         anti-alias the chessboard edges) and a small amount of deterministic noise is added.
+///         The camera is an ideal pinhole at the origin (focal length 1.1*cam_w, no distortion),
+///         so rendered frames are identical from run to run. Rows are rendered in parallel.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class SimulatedCamera : public Camera
+{
+public:
+    SimulatedCamera(struct slParams* sl_params, SimulatedScene* scene, SimulatedProjector* projector);
+    virtual ~SimulatedCamera() {};
+
+    virtual void Init(CameraConfigParams* camParams);
+
+    virtual void StartCapture()
+        { return; };
+
+    virtual void EndCapture()
+        { return; };
+
+    // Render the current scene (a new 8-bit BGR image, released by the caller).
+    virtual IplImage* QueryFrame();
+
+    // Samples per pixel along each axis (1 = one sample at the pixel center).
+    void SetSupersampling(int samples)      { mSamples = MAX(samples, 1); };
+
+    // Ambient light (0-255) and noise amplitude (standard deviation in gray levels).
+    void SetAmbient(float ambient)          { mAmbient = ambient; };
+    void SetNoise(float noise)              { mNoise = noise; };
+
+    // Ground truth: 3x3 intrinsic matrix and 5x1 distortion coefficients (all zero).
+    void GetIntrinsic(CvMat* intrinsic) const;
+    void GetDistortion(CvMat* distortion) const;
+
+    // Render the depth (z, in mm) seen at every pixel center (cam_h x cam_w, CV_32FC1).
+    void RenderDepth(CvMat* depth) const;
+
+    // Number of frames rendered so far.
+    int GetFrameCount() const               { return mFrameCount; };
+
+private:
+    SimulatedScene*     mScene;
+    SimulatedProjector* mProjector;
+
+    /// <summary> Intrinsic parameters (focal length and principal point, in pixels). </summary>
+    float mFocal;
+    float mPrincipal[2];
+
+    int   mSamples;
+    float mAmbient;
+    float mNoise;
+    int   mFrameCount;
+};
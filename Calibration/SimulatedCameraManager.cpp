@@ -0,0 +1,99 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\SimulatedCameraManager.cpp
+//
+// summary:	Implements the simulated camera manager class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "SimulatedCameraManager.h"
+
+SimulatedCameraManager::SimulatedCameraManager(struct slParams* sl_params)
+{
+    mSlParams  = sl_params;
+    mScene     = NULL;
+    mProjector = NULL;
+    mCamera    = NULL;
+    mIsLoaded  = false;
+    mCamParams = NULL;
+}
+
+SimulatedCameraManager::~SimulatedCameraManager()
+{
+    CleanUp();
+}
+
+void SimulatedCameraManager::Init(CameraConfigParams* camParams)
+{
+    CleanUp();
+    mCamParams = camParams;
+    mScene     = new SimulatedScene(mSlParams);
+    mProjector = new SimulatedProjector(mSlParams);
+    mCamera    = new SimulatedCamera(mSlParams, mScene, mProjector);
+    mCamera->Init(camParams);
+    mCameras.push_back(mCamera);
+    mIsLoaded  = true;
+}
+
+void SimulatedCameraManager::CleanUp()
+{
+    mCameras.clear();
+    delete mCamera;
+    delete mProjector;
+    delete mScene;
+    mCamera    = NULL;
+    mProjector = NULL;
+    mScene     = NULL;
+    mIsLoaded  = false;
+}
+
+void SimulatedCameraManager::GetCalibration(struct slCalib* sl_calib)
+{
+    mCamera->GetIntrinsic(sl_calib->cam_intrinsic);
+    mCamera->GetDistortion(sl_calib->cam_distortion);
+    mProjector->GetIntrinsic(sl_calib->proj_intrinsic);
+    cvZero(sl_calib->proj_distortion);
+
+    // Camera extrinsics: the board pose. Projector extrinsics: R_proj*R_board, R_proj*T_board + T_proj.
+    float board_rotation[9], board_translation[3];
+    mScene->GetBoardPose(0, board_rotation, board_translation);
+    CvMat* cam_R  = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* cam_T  = cvCreateMat(3, 1, CV_64FC1);
+    CvMat* proj_R = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* proj_T = cvCreateMat(3, 1, CV_64FC1);
+    CvMat* R      = cvCreateMat(3, 3, CV_64FC1);
+    CvMat* T      = cvCreateMat(3, 1, CV_64FC1);
+    CvMat* r      = cvCreateMat(3, 1, CV_64FC1);
+    for(int i=0; i<3; i++){
+        for(int j=0; j<3; j++)
+            cvmSet(cam_R, i, j, board_rotation[3*i+j]);
+        cvmSet(cam_T, i, 0, board_translation[i]);
+    }
+    mProjector->GetPose(proj_R, proj_T);
+
+    cvRodrigues2(cam_R, r);
+    for(int i=0; i<3; i++){
+        cvmSet(sl_calib->cam_extrinsic, 0, i, cvmGet(r, i, 0));
+        cvmSet(sl_calib->cam_extrinsic, 1, i, cvmGet(cam_T, i, 0));
+    }
+    cvMatMul(proj_R, cam_R, R);
+    cvGEMM(proj_R, cam_T, 1, proj_T, 1, T);
+    cvRodrigues2(R, r);
+    for(int i=0; i<3; i++){
+        cvmSet(sl_calib->proj_extrinsic, 0, i, cvmGet(r, i, 0));
+        cvmSet(sl_calib->proj_extrinsic, 1, i, cvmGet(T, i, 0));
+    }
+
+    cvReleaseMat(&cam_R);
+    cvReleaseMat(&cam_T);
+    cvReleaseMat(&proj_R);
+    cvReleaseMat(&proj_T);
+    cvReleaseMat(&R);
+    cvReleaseMat(&T);
+    cvReleaseMat(&r);
+
+    sl_calib->cam_intrinsic_calib    = true;
+    sl_calib->proj_intrinsic_calib   = true;
+    sl_calib->procam_extrinsic_calib = true;
+    sl_calib->procam_geometry_calib  = false;
+}
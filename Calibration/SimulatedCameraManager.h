@@ -0,0 +1,49 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\SimulatedCameraManager.h
+//
+// summary:	Declares the simulated camera manager class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+#include "CameraManager.h"
+#include "SimulatedCamera.h"
+#include "SimulatedScene.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  SimulatedCameraManager
+///
+/// @brief  Camera manager of a simulated projector-camera system (no hardware required).
+///
+///         Init() creates the scene, the projector and one SimulatedCamera, all sized from the
+///         slParams dimensions. Projector frames are passed to GetProjector()->Show() instead of a
+///         projector window. The ground-truth calibration is available through GetCalibration().
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class SimulatedCameraManager : public CameraManager
+{
+public:
+    SimulatedCameraManager(struct slParams* sl_params);
+    ~SimulatedCameraManager();
+
+    void Init(CameraConfigParams* camParams);
+    void CleanUp();
+
+    SimulatedCamera*    GetCamera()         { return mCamera; };
+    SimulatedProjector* GetProjector()      { return mProjector; };
+    SimulatedScene*     GetScene()          { return mScene; };
+
+    // Fill the intrinsics, distortion and extrinsics of sl_calib with the ground truth and mark the
+    // system as calibrated (the geometry still has to be evaluated).
+    // Note: The extrinsics are given with respect to the board at scripted pose 0.
+    void GetCalibration(struct slCalib* sl_calib);
+
+private:
+    struct slParams*    mSlParams;
+    SimulatedScene*     mScene;
+    SimulatedProjector* mProjector;
+    SimulatedCamera*    mCamera;
+};
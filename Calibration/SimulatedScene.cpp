@@ -0,0 +1,299 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\SimulatedScene.cpp
+//
+// summary:	Implements the simulated projector and scene classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "SimulatedScene.h"
+
+// Projector baseline (to the right of the camera) and depth at which the optical axes meet (mm).
+static const float SIM_PROJ_BASELINE    = 150.0f;
+static const float SIM_PROJ_CONVERGENCE = 1100.0f;
+
+// Albedo (BGR) of the paper, the printed squares, the wall and the sphere.
+static const float SIM_PAPER_ALBEDO[3]  = { 0.90f, 0.90f, 0.90f };
+static const float SIM_INK_ALBEDO[3]    = { 0.80f, 0.70f, 0.10f };
+static const float SIM_WALL_ALBEDO[3]   = { 0.60f, 0.60f, 0.60f };
+static const float SIM_SPHERE_ALBEDO[3] = { 0.75f, 0.75f, 0.75f };
+
+// White margin around the printed squares (in squares).
+static const float SIM_BOARD_MARGIN = 1.5f;
+
+static inline float dot3(const float* a, const float* b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// Multiply two row-major 3x3 matrices (c = a*b).
+static void mul33(const float* a, const float* b, float* c)
+{
+    for(int i=0; i<3; i++)
+        for(int j=0; j<3; j++)
+            c[3*i+j] = a[3*i]*b[j] + a[3*i+1]*b[3+j] + a[3*i+2]*b[6+j];
+}
+
+SimulatedProjector::SimulatedProjector(struct slParams* sl_params)
+{
+    mWidth        = sl_params->proj_w;
+    mHeight       = sl_params->proj_h;
+    mFocal[0]     = 1.2f*mWidth;
+    mFocal[1]     = 1.2f*mWidth;
+    mPrincipal[0] = 0.5f*(mWidth - 1);
+    mPrincipal[1] = 0.5f*(mHeight - 1);
+
+    // Turn the projector (about the y axis) towards the point where the optical axes meet.
+    float angle = atan2(SIM_PROJ_BASELINE, SIM_PROJ_CONVERGENCE);
+    float c = cos(angle), s = sin(angle);
+    float rotation[9] = { c, 0, s,   0, 1, 0,   -s, 0, c };
+    memcpy(mRotation, rotation, sizeof(mRotation));
+    mCenter[0] = SIM_PROJ_BASELINE;
+    mCenter[1] = 0;
+    mCenter[2] = 0;
+    for(int i=0; i<3; i++)
+        mTranslation[i] = -dot3(&mRotation[3*i], mCenter);
+
+    mFrame = cvCreateImage(cvSize(mWidth, mHeight), IPL_DEPTH_8U, 3);
+    cvZero(mFrame);
+    InitializeCriticalSection(&mLock);
+}
+
+SimulatedProjector::~SimulatedProjector()
+{
+    DeleteCriticalSection(&mLock);
+    cvReleaseImage(&mFrame);
+}
+
+void SimulatedProjector::Show(const IplImage* frame)
+{
+    if(frame->width != mWidth || frame->height != mHeight || frame->depth != IPL_DEPTH_8U){
+        printf("ERROR: Simulated projector frame does not match the projector resolution!\n");
+        return;
+    }
+    EnterCriticalSection(&mLock);
+    if(frame->nChannels == 1)
+        cvCvtColor(frame, mFrame, CV_GRAY2BGR);
+    else
+        cvCopy(frame, mFrame);
+    LeaveCriticalSection(&mLock);
+}
+
+IplImage* SimulatedProjector::GetFrame() const
+{
+    EnterCriticalSection(&mLock);
+    IplImage* frame = cvCloneImage(mFrame);
+    LeaveCriticalSection(&mLock);
+    return frame;
+}
+
+void SimulatedProjector::Illuminate(const float* point, const IplImage* frame, float* light) const
+{
+    light[0] = light[1] = light[2] = 0;
+    float p[3];
+    for(int i=0; i<3; i++)
+        p[i] = dot3(&mRotation[3*i], point) + mTranslation[i];
+    if(p[2] <= 0)
+        return;
+    int u = cvFloor(mFocal[0]*p[0]/p[2] + mPrincipal[0] + 0.5f);
+    int v = cvFloor(mFocal[1]*p[1]/p[2] + mPrincipal[1] + 0.5f);
+    if(u < 0 || v < 0 || u >= mWidth || v >= mHeight)
+        return;
+    const uchar* pixel = (const uchar*)frame->imageData + v*frame->widthStep + 3*u;
+    light[0] = pixel[0];
+    light[1] = pixel[1];
+    light[2] = pixel[2];
+}
+
+void SimulatedProjector::GetCenter(float* center) const
+{
+    memcpy(center, mCenter, sizeof(mCenter));
+}
+
+void SimulatedProjector::GetIntrinsic(CvMat* intrinsic) const
+{
+    cvZero(intrinsic);
+    cvmSet(intrinsic, 0, 0, mFocal[0]);
+    cvmSet(intrinsic, 1, 1, mFocal[1]);
+    cvmSet(intrinsic, 0, 2, mPrincipal[0]);
+    cvmSet(intrinsic, 1, 2, mPrincipal[1]);
+    cvmSet(intrinsic, 2, 2, 1);
+}
+
+void SimulatedProjector::GetPose(CvMat* rotation, CvMat* translation) const
+{
+    for(int i=0; i<3; i++){
+        for(int j=0; j<3; j++)
+            cvmSet(rotation, i, j, mRotation[3*i+j]);
+        cvmSet(translation, i, 0, mTranslation[i]);
+    }
+}
+
+SimulatedScene::SimulatedScene(struct slParams* sl_params)
+{
+    mBoardW          = sl_params->cam_board_w;
+    mBoardH          = sl_params->cam_board_h;
+    mSquareW         = sl_params->cam_board_w_mm;
+    mSquareH         = sl_params->cam_board_h_mm;
+    mSphereCenter[0] = 0;
+    mSphereCenter[1] = 0;
+    mSphereCenter[2] = 1100.0f;
+    mSphereRadius    = 150.0f;
+    GetBoardPose(0, mBoardRotation, mBoardTranslation);
+    SetWall(1000.0f);
+}
+
+void SimulatedScene::SetWall(float depth)
+{
+    mType      = SCENE_WALL;
+    mWallDepth = depth;
+}
+
+void SimulatedScene::SetBoardPose(int index)
+{
+    float rotation[9], translation[3];
+    GetBoardPose(index, rotation, translation);
+    SetBoardPose(rotation, translation);
+}
+
+void SimulatedScene::SetBoardPose(const float* rotation, const float* translation)
+{
+    mType      = SCENE_BOARD;
+    mWallDepth = 1400.0f;
+    memcpy(mBoardRotation, rotation, sizeof(mBoardRotation));
+    memcpy(mBoardTranslation, translation, sizeof(mBoardTranslation));
+}
+
+void SimulatedScene::SetObject()
+{
+    mType      = SCENE_OBJECT;
+    mWallDepth = 1300.0f;
+}
+
+// The scripted poses tilt the board by up to 20 degrees about x, 23 degrees about y and 6 degrees
+// about z, with the board center 820 to 980 mm from the camera.
+void SimulatedScene::GetBoardPose(int index, float* rotation, float* translation) const
+{
+    float k  = (float)index;
+    float rx = 0.35f*sin(0.9f*k + 0.3f);
+    float ry = 0.40f*sin(1.3f*k + 1.1f);
+    float rz = 0.10f*sin(0.7f*k);
+    float Rx[9] = { 1, 0, 0,   0, cos(rx), -sin(rx),   0, sin(rx), cos(rx) };
+    float Ry[9] = { cos(ry), 0, sin(ry),   0, 1, 0,   -sin(ry), 0, cos(ry) };
+    float Rz[9] = { cos(rz), -sin(rz), 0,   sin(rz), cos(rz), 0,   0, 0, 1 };
+    float Ryx[9];
+    mul33(Ry, Rx, Ryx);
+    mul33(Rz, Ryx, rotation);
+
+    // Place the center of the printed corners at the scripted position.
+    float center[3] = { 100.0f*sin(1.7f*k), 70.0f*cos(1.1f*k), 900.0f + 80.0f*sin(0.5f*k) };
+    float board_center[3] = { 0.5f*(mBoardW - 1)*mSquareW, 0.5f*(mBoardH - 1)*mSquareH, 0 };
+    for(int i=0; i<3; i++)
+        translation[i] = center[i] - dot3(&rotation[3*i], board_center);
+}
+
+float SimulatedScene::Trace(const float* dir, float* point, float* normal, float* albedo) const
+{
+    float t = 0;
+
+    // Wall (behind everything else).
+    if(dir[2] > 0){
+        t = mWallDepth/dir[2];
+        normal[0] = 0;
+        normal[1] = 0;
+        normal[2] = -1;
+        memcpy(albedo, SIM_WALL_ALBEDO, sizeof(SIM_WALL_ALBEDO));
+    }
+
+    // Printed chessboard: the plane n.X = n.T, with n the board z axis.
+    if(mType == SCENE_BOARD){
+        float n[3] = { mBoardRotation[2], mBoardRotation[5], mBoardRotation[8] };
+        float n_dot_dir = dot3(n, dir);
+        if(fabs(n_dot_dir) > 1e-6f){
+            float tb = dot3(n, mBoardTranslation)/n_dot_dir;
+            if(tb > 0 && (t == 0 || tb < t)){
+                // Board coordinates (R^T*(X - T)).
+                float d[3], b[2];
+                for(int i=0; i<3; i++)
+                    d[i] = tb*dir[i] - mBoardTranslation[i];
+                b[0] = mBoardRotation[0]*d[0] + mBoardRotation[3]*d[1] + mBoardRotation[6]*d[2];
+                b[1] = mBoardRotation[1]*d[0] + mBoardRotation[4]*d[1] + mBoardRotation[7]*d[2];
+                float sx = b[0]/mSquareW, sy = b[1]/mSquareH;
+                if(sx >= -1 - SIM_BOARD_MARGIN && sx <= mBoardW + SIM_BOARD_MARGIN &&
+                   sy >= -1 - SIM_BOARD_MARGIN && sy <= mBoardH + SIM_BOARD_MARGIN){
+                    t = tb;
+                    float sign = (n_dot_dir > 0) ? -1.0f : 1.0f;
+                    for(int i=0; i<3; i++)
+                        normal[i] = sign*n[i];
+                    int cx = cvFloor(sx), cy = cvFloor(sy);
+                    bool printed = (cx >= -1 && cx < mBoardW && cy >= -1 && cy < mBoardH && ((cx + cy) & 1) == 0);
+                    memcpy(albedo, printed ? SIM_INK_ALBEDO : SIM_PAPER_ALBEDO, sizeof(SIM_PAPER_ALBEDO));
+                }
+            }
+        }
+    }
+
+    // Sphere (nearest intersection of |t*dir - c| = r).
+    if(mType == SCENE_OBJECT){
+        float a = dot3(dir, dir);
+        float b = dot3(dir, mSphereCenter);
+        float c = dot3(mSphereCenter, mSphereCenter) - mSphereRadius*mSphereRadius;
+        float disc = b*b - a*c;
+        if(disc > 0){
+            float ts = (b - sqrt(disc))/a;
+            if(ts > 0 && (t == 0 || ts < t)){
+                t = ts;
+                for(int i=0; i<3; i++)
+                    normal[i] = (ts*dir[i] - mSphereCenter[i])/mSphereRadius;
+                memcpy(albedo, SIM_SPHERE_ALBEDO, sizeof(SIM_SPHERE_ALBEDO));
+            }
+        }
+    }
+
+    for(int i=0; i<3; i++)
+        point[i] = t*dir[i];
+    return t;
+}
+
+bool SimulatedScene::Occluded(const float* point, const float* target) const
+{
+    const float eps = 1e-3f;
+    float d[3];
+    for(int i=0; i<3; i++)
+        d[i] = target[i] - point[i];
+
+    if(mType == SCENE_BOARD){
+        float n[3] = { mBoardRotation[2], mBoardRotation[5], mBoardRotation[8] };
+        float n_dot_d = dot3(n, d);
+        if(fabs(n_dot_d) > 1e-6f){
+            float s = (dot3(n, mBoardTranslation) - dot3(n, point))/n_dot_d;
+            if(s > eps && s < 1){
+                float q[3], b[2];
+                for(int i=0; i<3; i++)
+                    q[i] = point[i] + s*d[i] - mBoardTranslation[i];
+                b[0] = (mBoardRotation[0]*q[0] + mBoardRotation[3]*q[1] + mBoardRotation[6]*q[2])/mSquareW;
+                b[1] = (mBoardRotation[1]*q[0] + mBoardRotation[4]*q[1] + mBoardRotation[7]*q[2])/mSquareH;
+                if(b[0] >= -1 - SIM_BOARD_MARGIN && b[0] <= mBoardW + SIM_BOARD_MARGIN &&
+                   b[1] >= -1 - SIM_BOARD_MARGIN && b[1] <= mBoardH + SIM_BOARD_MARGIN)
+                    return true;
+            }
+        }
+    }
+
+    if(mType == SCENE_OBJECT){
+        float m[3];
+        for(int i=0; i<3; i++)
+            m[i] = point[i] - mSphereCenter[i];
+        float a = dot3(d, d);
+        float b = dot3(d, m);
+        float c = dot3(m, m) - mSphereRadius*mSphereRadius;
+        float disc = b*b - a*c;
+        if(disc > 0){
+            float root = sqrt(disc);
+            float s0 = (-b - root)/a, s1 = (-b + root)/a;
+            if((s0 > eps && s0 < 1) || (s1 > eps && s1 < 1))
+                return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\SimulatedScene.h
+//
+// summary:	Declares the simulated projector and scene classes
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  SimulatedProjector
+///
+/// @brief  Virtual projector showing the frames of a projector window.
+///
+///         The projector is an ideal pinhole (no distortion) with a known pose relative to the
+///         camera. It is placed 150 mm to the right of the camera and turned towards the camera
+///         axis, so that both optical axes meet 1.1 m in front of the camera. Shown frames are
+///         copied (as 8-bit BGR) and sampled with nearest neighbour lookup. Show() may be called
+///         from another thread (e.g. a projector output's presenter) while a camera renders: the
+///         camera samples a copy of the frame taken with GetFrame().
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class SimulatedProjector
+{
+public:
+    SimulatedProjector(struct slParams* sl_params);
+    ~SimulatedProjector();
+
+    // Show a projector frame (8-bit, 1 or 3 channels, projector size); the frame is copied.
+    void Show(const IplImage* frame);
+
+    // Copy of the frame on screen (8-bit BGR, released by the caller).
+    IplImage* GetFrame() const;
+
+    // Get the light (BGR, 0-255) sent towards a point in camera coordinates while frame (from
+    // GetFrame()) is on screen (0 outside the frame).
+    void Illuminate(const float* point, const IplImage* frame, float* light) const;
+
+    // Get the projector center of projection in camera coordinates (mm).
+    void GetCenter(float* center) const;
+
+    // Ground truth: 3x3 intrinsic matrix and pose X_proj = R*X_cam + T (3x3 and 3x1 matrices).
+    void GetIntrinsic(CvMat* intrinsic) const;
+    void GetPose(CvMat* rotation, CvMat* translation) const;
+
+    int GetWidth() const            { return mWidth; };
+    int GetHeight() const           { return mHeight; };
+
+private:
+    int       mWidth;
+    int       mHeight;
+
+    /// <summary> Intrinsic parameters (focal lengths and principal point, in pixels). </summary>
+    float     mFocal[2];
+    float     mPrincipal[2];
+
+    /// <summary> Pose (X_proj = R*X_cam + T) and center of projection (-R^T*T). </summary>
+    float     mRotation[9];
+    float     mTranslation[3];
+    float     mCenter[3];
+
+    /// <summary> Current frame (8-bit BGR), guarded by mLock. </summary>
+    IplImage* mFrame;
+    mutable CRITICAL_SECTION mLock;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  SimulatedScene
+///
+/// @brief  Analytic scene seen by the simulated camera (all units in mm, camera coordinates).
+///
+///         - Wall: a white wall facing the camera (projector-camera homography).
+///         - Board: a printed chessboard (cam_board_w x cam_board_h interior corners) with a white
+///           margin of 1.5 squares, at one of a list of scripted poses in front of a wall. The
+///           squares are printed in cyan, so that they are dark in the red channel but stay
+///           bright under white projector light.
+///         - Object: a sphere (radius 150 mm) in front of a wall, for structured light scanning.
+///
+///         Trace() intersects camera rays with the scene; Occluded() tests shadow rays towards the
+///         projector.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class SimulatedScene
+{
+public:
+    enum SceneType { SCENE_WALL, SCENE_BOARD, SCENE_OBJECT };
+
+    SimulatedScene(struct slParams* sl_params);
+
+    // Show only a wall at depth (mm).
+    void SetWall(float depth);
+
+    // Show the printed chessboard at scripted pose index (any index >= 0 is valid).
+    void SetBoardPose(int index);
+
+    // Show the printed chessboard at an explicit pose (X_cam = R*X_board + T, R is row-major 3x3).
+    void SetBoardPose(const float* rotation, const float* translation);
+
+    // Show the sphere in front of the wall.
+    void SetObject();
+
+    SceneType GetType() const       { return mType; };
+
+    // Get the scripted board pose index (X_cam = R*X_board + T).
+    // Note: The board origin is the first interior corner, x runs along the cam_board_w corners
+    //       and y along the cam_board_h corners (both in mm), and the board is the plane z = 0.
+    void GetBoardPose(int index, float* rotation, float* translation) const;
+
+    // Intersect the camera ray t*dir (from the camera center) with the scene.
+    // Returns the ray parameter t (0 if nothing is hit) and the point, normal and albedo (BGR).
+    float Trace(const float* dir, float* point, float* normal, float* albedo) const;
+
+    // Returns true if the segment between point and target (e.g., the projector center) is blocked.
+    bool Occluded(const float* point, const float* target) const;
+
+private:
+    SceneType mType;
+
+    /// <summary> Wall depth (z, in mm). </summary>
+    float mWallDepth;
+
+    /// <summary> Printed chessboard: interior corners, square size and board pose. </summary>
+    int   mBoardW;
+    int   mBoardH;
+    float mSquareW;
+    float mSquareH;
+    float mBoardRotation[9];
+    float mBoardTranslation[3];
+
+    /// <summary> Sphere center and radius (mm). </summary>
+    float mSphereCenter[3];
+    float mSphereRadius;
+};
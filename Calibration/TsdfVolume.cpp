@@ -0,0 +1,641 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\TsdfVolume.cpp
+//
+// summary:	Implements the sparse truncated signed distance volume class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "TsdfVolume.h"
+#include "Kinect-Parallel.h"
+
+#include <emmintrin.h>
+#include <limits.h>
+
+// Number of depth map rows per allocation task, and number of blocks per extraction task.
+static const int TSDF_ALLOCATION_ROWS = 16;
+static const int TSDF_EXTRACTION_BLOCKS = 64;
+
+// Maximum number of ray samples per pixel during block allocation.
+static const int TSDF_MAX_SAMPLES = 16;
+
+// Hash the integer coordinates of a block.
+static unsigned int hashBlock(const int* c)
+{
+    return ((unsigned int)c[0]*73856093u) ^ ((unsigned int)c[1]*19349663u) ^ ((unsigned int)c[2]*83492791u);
+}
+
+// Integer division rounding towards negative infinity.
+static int floorDiv(int a, int b)
+{
+    return (a >= 0) ? a/b : -((-a + b - 1)/b);
+}
+
+// Read a 3x3 matrix and a 3x1 vector (any floating point type) into double arrays.
+static void readPose(const CvMat* rotation, const CvMat* translation, double* R, double* T)
+{
+    for(int i=0; i<3; i++){
+        for(int j=0; j<3; j++)
+            R[3*i+j] = cvmGet(rotation, i, j);
+        T[i] = (translation->rows == 3) ? cvmGet(translation, i, 0) : cvmGet(translation, 0, i);
+    }
+}
+
+// Collect the coordinates of the blocks within the truncation band of a range of depth map row bands.
+class TsdfAllocationBody : public Kinect::ParallelLoopBody
+{
+public:
+    TsdfAllocationBody(const float* depth, int width, int height, int step, float depth_scale,
+                       const double* K, const double* R, const double* T, float block_side, float truncation,
+                       std::vector<std::vector<int> >& keys)
+        : mKeys(keys)
+    {
+        mDepth      = depth;
+        mWidth      = width;
+        mHeight     = height;
+        mStep       = step;
+        mDepthScale = depth_scale;
+        mK          = K;
+        mR          = R;
+        mT          = T;
+        mBlockSide  = block_side;
+        mTruncation = truncation;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        // Sample the truncation band at half the block size.
+        int   n_samples = MIN(TSDF_MAX_SAMPLES, (int)ceil(4*mTruncation/mBlockSide) + 1);
+        float spacing   = (n_samples > 1) ? 2*mTruncation/(n_samples - 1) : 0;
+        for(int band=begin; band<end; band++){
+            std::vector<int>& keys = mKeys[band];
+            keys.clear();
+            int last[TSDF_MAX_SAMPLES][3];
+            for(int s=0; s<n_samples; s++)
+                last[s][0] = last[s][1] = last[s][2] = INT_MIN;
+            int r1 = MIN((band + 1)*TSDF_ALLOCATION_ROWS, mHeight);
+            for(int r=band*TSDF_ALLOCATION_ROWS; r<r1; r++){
+                const float* row = mDepth + r*mStep;
+                double y = (r - mK[5])/mK[4];
+                for(int c=0; c<mWidth; c++){
+                    float d = row[c]*mDepthScale;
+                    if(!(d > 0))
+                        continue;
+                    double x = (c - mK[2])/mK[0];
+                    for(int s=0; s<n_samples; s++){
+                        // Camera point at depth z, transformed into the world: R^T*(X - T).
+                        double z    = d - mTruncation + s*spacing;
+                        double p[3] = { x*z - mT[0], y*z - mT[1], z - mT[2] };
+                        int    key[3];
+                        for(int k=0; k<3; k++){
+                            double w = mR[k]*p[0] + mR[3+k]*p[1] + mR[6+k]*p[2];
+                            key[k] = (int)floor(w/mBlockSide);
+                        }
+                        // Skip the block if the previous pixel's sample already produced it.
+                        if(key[0] == last[s][0] && key[1] == last[s][1] && key[2] == last[s][2])
+                            continue;
+                        last[s][0] = key[0];
+                        last[s][1] = key[1];
+                        last[s][2] = key[2];
+                        keys.push_back(key[0]);
+                        keys.push_back(key[1]);
+                        keys.push_back(key[2]);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    const float*  mDepth;
+    int           mWidth;
+    int           mHeight;
+    int           mStep;
+    float         mDepthScale;
+    const double* mK;
+    const double* mR;
+    const double* mT;
+    float         mBlockSide;
+    float         mTruncation;
+    std::vector<std::vector<int> >& mKeys;
+};
+
+// Evaluate the factor that converts depth differences into distances to the surface for a range of rows.
+// Note: The factor is |ray|*cos(incidence) (with the ray scaled to unit depth and the incidence angle
+//       from the depth map normal), so views at different angles agree on the signed distance.
+//       The cosine is also the weight of the measurement, as grazing views are the least accurate.
+class TsdfScaleBody : public Kinect::ParallelLoopBody
+{
+public:
+    TsdfScaleBody(const float* depth, int width, int height, int step, float depth_scale, const double* K,
+                  float* scale, float* weight)
+    {
+        mDepth      = depth;
+        mWidth      = width;
+        mHeight     = height;
+        mStep       = step;
+        mDepthScale = depth_scale;
+        mK          = K;
+        mScale      = scale;
+        mWeight     = weight;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int r=begin; r<end; r++){
+            for(int c=0; c<mWidth; c++){
+                double ray[3] = { (c - mK[2])/mK[0], (r - mK[5])/mK[4], 1 };
+                double len    = sqrt(ray[0]*ray[0] + ray[1]*ray[1] + 1);
+                double cosine = 1;
+                double p[3], dc[3], dr[3];
+                if(point(r, c, p) && (point(r, c + 1, dc) || point(r, c - 1, dc)) &&
+                   (point(r + 1, c, dr) || point(r - 1, c, dr))){
+                    for(int k=0; k<3; k++){
+                        dc[k] -= p[k];
+                        dr[k] -= p[k];
+                    }
+                    double n[3] = { dc[1]*dr[2] - dc[2]*dr[1], dc[2]*dr[0] - dc[0]*dr[2], dc[0]*dr[1] - dc[1]*dr[0] };
+                    double n_len = sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+                    if(n_len > 0)
+                        cosine = MAX(fabs(n[0]*ray[0] + n[1]*ray[1] + n[2])/(n_len*len), 0.1);
+                }
+                mScale[r*mWidth+c]  = (float)(len*cosine);
+                mWeight[r*mWidth+c] = (float)cosine;
+            }
+        }
+    }
+
+private:
+    bool point(int r, int c, double* p) const
+    {
+        if(r < 0 || r >= mHeight || c < 0 || c >= mWidth)
+            return false;
+        double d = mDepth[r*mStep+c]*mDepthScale;
+        if(!(d > 0))
+            return false;
+        p[0] = (c - mK[2])/mK[0]*d;
+        p[1] = (r - mK[5])/mK[4]*d;
+        p[2] = d;
+        return true;
+    }
+
+    const float*  mDepth;
+    int           mWidth;
+    int           mHeight;
+    int           mStep;
+    float         mDepthScale;
+    const double* mK;
+    float*        mScale;
+    float*        mWeight;
+};
+
+// Update the voxels of a range of the visible blocks.
+class TsdfIntegrationBody : public Kinect::ParallelLoopBody
+{
+public:
+    TsdfIntegrationBody(const float* depth, const float* scale, const float* confidence, int width, int height, int step, float depth_scale,
+                        const double* K, const double* R, const double* T, float voxel_size, float truncation,
+                        float max_weight, const int* visible, const int* coords, float** tsdf, float** weight)
+    {
+        mDepth      = depth;
+        mScale      = scale;
+        mConfidence = confidence;
+        mWidth      = width;
+        mHeight     = height;
+        mStep       = step;
+        mDepthScale = depth_scale;
+        mK          = K;
+        mR          = R;
+        mT          = T;
+        mVoxelSize  = voxel_size;
+        mTruncation = truncation;
+        mMaxWeight  = max_weight;
+        mVisible    = visible;
+        mCoords     = coords;
+        mTsdf       = tsdf;
+        mWeight     = weight;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        const int S = TsdfVolume::BLOCK_SIZE;
+        const __m128 fx        = _mm_set1_ps((float)mK[0]);
+        const __m128 fy        = _mm_set1_ps((float)mK[4]);
+        const __m128 cx        = _mm_set1_ps((float)mK[2]);
+        const __m128 cy        = _mm_set1_ps((float)mK[5]);
+        const __m128 zero      = _mm_setzero_ps();
+        const __m128 one       = _mm_set1_ps(1.0f);
+        const __m128 max_w     = _mm_set1_ps(mMaxWeight);
+        const __m128 neg_trunc = _mm_set1_ps(-mTruncation);
+        const __m128 inv_trunc = _mm_set1_ps(1.0f/mTruncation);
+        const __m128 lane      = _mm_set_ps(3, 2, 1, 0);
+        int   u[4], v[4];
+        float zc[4], measured[4], factor[4], confidence[4];
+
+        // Camera-space steps between neighbouring voxels.
+        double dx[3], dy[3], dz[3];
+        for(int k=0; k<3; k++){
+            dx[k] = mR[3*k+0]*mVoxelSize;
+            dy[k] = mR[3*k+1]*mVoxelSize;
+            dz[k] = mR[3*k+2]*mVoxelSize;
+        }
+        for(int b=begin; b<end; b++){
+            int    block = mVisible[b];
+            float* tsdf   = mTsdf[block];
+            float* weight = mWeight[block];
+
+            // Camera coordinates of the center of the first voxel.
+            double origin[3], cam0[3];
+            for(int k=0; k<3; k++)
+                origin[k] = (mCoords[3*block+k]*S + 0.5)*mVoxelSize;
+            for(int k=0; k<3; k++)
+                cam0[k] = mR[3*k]*origin[0] + mR[3*k+1]*origin[1] + mR[3*k+2]*origin[2] + mT[k];
+
+            for(int z=0; z<S; z++){
+                for(int y=0; y<S; y++){
+                    double base[3];
+                    for(int k=0; k<3; k++)
+                        base[k] = cam0[k] + y*dy[k] + z*dz[k];
+                    for(int x=0; x<S; x+=4){
+                        __m128 i  = _mm_add_ps(lane, _mm_set1_ps((float)x));
+                        __m128 px = _mm_add_ps(_mm_set1_ps((float)base[0]), _mm_mul_ps(i, _mm_set1_ps((float)dx[0])));
+                        __m128 py = _mm_add_ps(_mm_set1_ps((float)base[1]), _mm_mul_ps(i, _mm_set1_ps((float)dx[1])));
+                        __m128 pz = _mm_add_ps(_mm_set1_ps((float)base[2]), _mm_mul_ps(i, _mm_set1_ps((float)dx[2])));
+
+                        // Project the voxels (behind the camera they are rejected below).
+                        __m128 front = _mm_cmpgt_ps(pz, zero);
+                        __m128 inv_z = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(front, pz), _mm_andnot_ps(front, one)));
+                        __m128 pu    = _mm_add_ps(_mm_mul_ps(fx, _mm_mul_ps(px, inv_z)), cx);
+                        __m128 pv    = _mm_add_ps(_mm_mul_ps(fy, _mm_mul_ps(py, inv_z)), cy);
+                        __m128 lim   = _mm_set1_ps(1e6f);
+                        pu = _mm_max_ps(_mm_min_ps(pu, lim), _mm_sub_ps(zero, lim));
+                        pv = _mm_max_ps(_mm_min_ps(pv, lim), _mm_sub_ps(zero, lim));
+                        _mm_storeu_si128((__m128i*)u, _mm_cvtps_epi32(pu));
+                        _mm_storeu_si128((__m128i*)v, _mm_cvtps_epi32(pv));
+                        _mm_storeu_ps(zc, pz);
+
+                        // Look up the measured depths.
+                        for(int k=0; k<4; k++){
+                            measured[k]   = 0;
+                            factor[k]     = 1;
+                            confidence[k] = 0;
+                            if(zc[k] > 0 && u[k] >= 0 && u[k] < mWidth && v[k] >= 0 && v[k] < mHeight){
+                                float d = mDepth[v[k]*mStep + u[k]]*mDepthScale;
+                                if(d > 0){
+                                    measured[k]   = d;
+                                    factor[k]     = mScale[v[k]*mWidth + u[k]];
+                                    confidence[k] = mConfidence[v[k]*mWidth + u[k]];
+                                }
+                            }
+                        }
+
+                        // Running average of the truncated signed distance.
+                        __m128 d     = _mm_loadu_ps(measured);
+                        __m128 sdf   = _mm_mul_ps(_mm_sub_ps(d, pz), _mm_loadu_ps(factor));
+                        __m128 valid = _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_cmpge_ps(sdf, neg_trunc));
+                        int    idx   = (z*S + y)*S + x;
+                        __m128 t     = _mm_loadu_ps(tsdf + idx);
+                        __m128 w     = _mm_loadu_ps(weight + idx);
+                        __m128 c     = _mm_loadu_ps(confidence);
+                        __m128 w1    = _mm_add_ps(w, c);
+                        __m128 t_new = _mm_min_ps(_mm_mul_ps(sdf, inv_trunc), one);
+                        __m128 t_avg = _mm_div_ps(_mm_add_ps(_mm_mul_ps(t, w), _mm_mul_ps(t_new, c)), w1);
+                        __m128 w_new = _mm_min_ps(w1, max_w);
+                        _mm_storeu_ps(tsdf + idx,   _mm_or_ps(_mm_and_ps(valid, t_avg), _mm_andnot_ps(valid, t)));
+                        _mm_storeu_ps(weight + idx, _mm_or_ps(_mm_and_ps(valid, w_new), _mm_andnot_ps(valid, w)));
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    const float*  mDepth;
+    const float*  mScale;
+    const float*  mConfidence;
+    int           mWidth;
+    int           mHeight;
+    int           mStep;
+    float         mDepthScale;
+    const double* mK;
+    const double* mR;
+    const double* mT;
+    float         mVoxelSize;
+    float         mTruncation;
+    float         mMaxWeight;
+    const int*    mVisible;
+    const int*    mCoords;
+    float**       mTsdf;
+    float**       mWeight;
+};
+
+// Find the zero crossings of a range of blocks (in chunks of TSDF_EXTRACTION_BLOCKS).
+class TsdfExtractionBody : public Kinect::ParallelLoopBody
+{
+public:
+    TsdfExtractionBody(const TsdfVolume* volume, int n_blocks, const int* coords, float** tsdf, float** weight,
+                       float voxel_size, std::vector<std::vector<float> >& results)
+        : mResults(results)
+    {
+        mVolume     = volume;
+        mBlockCount = n_blocks;
+        mCoords     = coords;
+        mTsdf       = tsdf;
+        mWeight     = weight;
+        mVoxelSize  = voxel_size;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        const int S = TsdfVolume::BLOCK_SIZE;
+        for(int chunk=begin; chunk<end; chunk++){
+            std::vector<float>& out = mResults[chunk];
+            out.clear();
+            int last = MIN((chunk + 1)*TSDF_EXTRACTION_BLOCKS, mBlockCount);
+            for(int block=chunk*TSDF_EXTRACTION_BLOCKS; block<last; block++){
+                const float* tsdf   = mTsdf[block];
+                const float* weight = mWeight[block];
+                for(int z=0; z<S; z++)
+                for(int y=0; y<S; y++)
+                for(int x=0; x<S; x++){
+                    int idx = (z*S + y)*S + x;
+                    float t0 = tsdf[idx];
+                    if(weight[idx] <= 0 || !(fabs(t0) < 1))
+                        continue;
+                    for(int axis=0; axis<3; axis++){
+                        int   n[3] = { x, y, z };
+                        float t1;
+                        n[axis]++;
+                        if(!mVolume->getVoxel(block, n[0], n[1], n[2], t1) || !(fabs(t1) < 1) || (t0 > 0) == (t1 > 0))
+                            continue;
+
+                        // Interpolate the crossing and evaluate the gradient at the voxel.
+                        float g[3];
+                        if(!gradient(block, x, y, z, t0, g))
+                            continue;
+                        float a = t0/(t0 - t1);
+                        float p[3] = { (float)x, (float)y, (float)z };
+                        p[axis] += a;
+                        for(int k=0; k<3; k++)
+                            out.push_back((mCoords[3*block+k]*S + p[k] + 0.5f)*mVoxelSize);
+                        for(int k=0; k<3; k++)
+                            out.push_back(g[k]);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    // Normalized TSDF gradient (central differences where possible).
+    bool gradient(int block, int x, int y, int z, float t0, float* g) const
+    {
+        float len = 0;
+        for(int axis=0; axis<3; axis++){
+            int   p[3] = { x, y, z }, m[3] = { x, y, z };
+            float tp, tm;
+            p[axis]++;
+            m[axis]--;
+            bool has_p = mVolume->getVoxel(block, p[0], p[1], p[2], tp);
+            bool has_m = mVolume->getVoxel(block, m[0], m[1], m[2], tm);
+            if(has_p && has_m)
+                g[axis] = 0.5f*(tp - tm);
+            else if(has_p)
+                g[axis] = tp - t0;
+            else if(has_m)
+                g[axis] = t0 - tm;
+            else
+                return false;
+            len += g[axis]*g[axis];
+        }
+        if(!(len > 0))
+            return false;
+        len = 1.0f/sqrt(len);
+        for(int k=0; k<3; k++)
+            g[k] *= len;
+        return true;
+    }
+
+    const TsdfVolume* mVolume;
+    int          mBlockCount;
+    const int*   mCoords;
+    float**      mTsdf;
+    float**      mWeight;
+    float        mVoxelSize;
+    std::vector<std::vector<float> >& mResults;
+};
+
+TsdfVolume::TsdfVolume(float voxel_size, float truncation, float max_weight)
+{
+    mVoxelSize  = voxel_size;
+    mTruncation = MAX(truncation, voxel_size);
+    mMaxWeight  = MAX(max_weight, 1.0f);
+    mView       = 0;
+    mTable.assign(4096, -1);
+}
+
+TsdfVolume::~TsdfVolume()
+{
+    Reset();
+}
+
+void TsdfVolume::Reset()
+{
+    for(size_t i=0; i<mBlocks.size(); i++)
+        delete mBlocks[i];
+    mBlocks.clear();
+    mStamp.clear();
+    mVisible.clear();
+    mTable.assign(4096, -1);
+}
+
+int TsdfVolume::findBlock(const int* c) const
+{
+    int mask = (int)mTable.size() - 1;
+    for(int s=(int)(hashBlock(c) & mask); mTable[s] >= 0; s=(s + 1) & mask){
+        const int* b = mBlocks[mTable[s]]->coord;
+        if(b[0] == c[0] && b[1] == c[1] && b[2] == c[2])
+            return mTable[s];
+    }
+    return -1;
+}
+
+int TsdfVolume::allocateBlock(const int* c)
+{
+    int mask = (int)mTable.size() - 1;
+    int s    = (int)(hashBlock(c) & mask);
+    for(; mTable[s] >= 0; s=(s + 1) & mask){
+        const int* b = mBlocks[mTable[s]]->coord;
+        if(b[0] == c[0] && b[1] == c[1] && b[2] == c[2])
+            return mTable[s];
+    }
+
+    Block* block = new Block;
+    for(int k=0; k<3; k++)
+        block->coord[k] = c[k];
+    for(int i=0; i<BLOCK_VOXELS; i++){
+        block->tsdf[i]   = 1;
+        block->weight[i] = 0;
+    }
+    int index = (int)mBlocks.size();
+    mBlocks.push_back(block);
+    mStamp.push_back(-1);
+    mTable[s] = index;
+
+    // Keep the load factor of the table below one half.
+    if(2*mBlocks.size() > mTable.size())
+        rehash(2*(int)mTable.size());
+    return index;
+}
+
+void TsdfVolume::rehash(int table_size)
+{
+    mTable.assign(table_size, -1);
+    int mask = table_size - 1;
+    for(int i=0; i<(int)mBlocks.size(); i++){
+        int s = (int)(hashBlock(mBlocks[i]->coord) & mask);
+        while(mTable[s] >= 0)
+            s = (s + 1) & mask;
+        mTable[s] = i;
+    }
+}
+
+bool TsdfVolume::getVoxel(int block, int x, int y, int z, float& tsdf) const
+{
+    const Block* b = mBlocks[block];
+    if(x < 0 || x >= BLOCK_SIZE || y < 0 || y >= BLOCK_SIZE || z < 0 || z >= BLOCK_SIZE){
+        int c[3] = { b->coord[0] + floorDiv(x, BLOCK_SIZE),
+                     b->coord[1] + floorDiv(y, BLOCK_SIZE),
+                     b->coord[2] + floorDiv(z, BLOCK_SIZE) };
+        int neighbour = findBlock(c);
+        if(neighbour < 0)
+            return false;
+        b = mBlocks[neighbour];
+        x -= floorDiv(x, BLOCK_SIZE)*BLOCK_SIZE;
+        y -= floorDiv(y, BLOCK_SIZE)*BLOCK_SIZE;
+        z -= floorDiv(z, BLOCK_SIZE)*BLOCK_SIZE;
+    }
+    int idx = (z*BLOCK_SIZE + y)*BLOCK_SIZE + x;
+    tsdf = b->tsdf[idx];
+    return b->weight[idx] > 0;
+}
+
+int TsdfVolume::Integrate(const float* depth, int width, int height, int step, const CvMat* intrinsic,
+                          const CvMat* rotation, const CvMat* translation, float depth_scale)
+{
+    if(depth == NULL || intrinsic == NULL || rotation == NULL || translation == NULL){
+        printf("ERROR: Invalid depth map for TSDF integration!\n");
+        return 0;
+    }
+    double K[9], R[9], T[3];
+    for(int i=0; i<9; i++)
+        K[i] = cvmGet(intrinsic, i/3, i%3);
+    readPose(rotation, translation, R, T);
+    mView++;
+
+    // Collect the blocks in the truncation band (in parallel), then allocate them.
+    int n_bands = (height + TSDF_ALLOCATION_ROWS - 1)/TSDF_ALLOCATION_ROWS;
+    std::vector<std::vector<int> > keys(n_bands);
+    TsdfAllocationBody allocation(depth, width, height, step, depth_scale, K, R, T,
+                                  BLOCK_SIZE*mVoxelSize, mTruncation, keys);
+    Kinect::ParallelFor(0, n_bands, allocation);
+    mVisible.clear();
+    for(int band=0; band<n_bands; band++){
+        for(size_t i=0; i<keys[band].size(); i+=3){
+            int block = allocateBlock(&keys[band][i]);
+            if(mStamp[block] != mView){
+                mStamp[block] = mView;
+                mVisible.push_back(block);
+            }
+        }
+    }
+    if(mVisible.empty())
+        return 0;
+
+    // Evaluate the distance factors, and update the visible blocks in parallel.
+    std::vector<float> scale(width*height), confidence(width*height);
+    TsdfScaleBody scaling(depth, width, height, step, depth_scale, K, &scale[0], &confidence[0]);
+    Kinect::ParallelFor(0, height, scaling, 16);
+    std::vector<int>    coords(3*mBlocks.size());
+    std::vector<float*> tsdf(mBlocks.size()), weight(mBlocks.size());
+    for(size_t i=0; i<mBlocks.size(); i++){
+        for(int k=0; k<3; k++)
+            coords[3*i+k] = mBlocks[i]->coord[k];
+        tsdf[i]   = mBlocks[i]->tsdf;
+        weight[i] = mBlocks[i]->weight;
+    }
+    TsdfIntegrationBody integration(depth, &scale[0], &confidence[0], width, height, step, depth_scale, K, R, T, mVoxelSize, mTruncation,
+                                    mMaxWeight, &mVisible[0], &coords[0], &tsdf[0], &weight[0]);
+    Kinect::ParallelFor(0, (int)mVisible.size(), integration, 8);
+    return (int)mVisible.size();
+}
+
+int TsdfVolume::IntegratePoints(const CvMat* points, const CvMat* mask, int width, int height,
+                                const CvMat* intrinsic, const CvMat* rotation, const CvMat* translation)
+{
+    int n = width*height;
+    if(points == NULL || points->cols != n || points->rows < 3){
+        printf("ERROR: Invalid point cloud for TSDF integration!\n");
+        return 0;
+    }
+
+    // Project the points into a depth map (keeping the nearest point per pixel).
+    double fx = cvmGet(intrinsic, 0, 0), fy = cvmGet(intrinsic, 1, 1);
+    double cx = cvmGet(intrinsic, 0, 2), cy = cvmGet(intrinsic, 1, 2);
+    const float* X = points->data.fl;
+    const float* Y = X + points->step/sizeof(float);
+    const float* Z = Y + points->step/sizeof(float);
+    std::vector<float> depth(n, 0.0f);
+    for(int i=0; i<n; i++){
+        if((mask != NULL && mask->data.fl[i] == 0) || !(Z[i] > 0))
+            continue;
+        int c = cvRound(fx*X[i]/Z[i] + cx);
+        int r = cvRound(fy*Y[i]/Z[i] + cy);
+        if(c < 0 || c >= width || r < 0 || r >= height)
+            continue;
+        float& d = depth[r*width+c];
+        if(d == 0 || Z[i] < d)
+            d = Z[i];
+    }
+    return Integrate(&depth[0], width, height, width, intrinsic, rotation, translation);
+}
+
+int TsdfVolume::ExtractSurface(CvMat** points, CvMat** normals)
+{
+    int n_blocks = (int)mBlocks.size();
+    int n_chunks = (n_blocks + TSDF_EXTRACTION_BLOCKS - 1)/TSDF_EXTRACTION_BLOCKS;
+    std::vector<int>    coords(3*n_blocks);
+    std::vector<float*> tsdf(n_blocks), weight(n_blocks);
+    for(int i=0; i<n_blocks; i++){
+        for(int k=0; k<3; k++)
+            coords[3*i+k] = mBlocks[i]->coord[k];
+        tsdf[i]   = mBlocks[i]->tsdf;
+        weight[i] = mBlocks[i]->weight;
+    }
+    std::vector<std::vector<float> > results(n_chunks);
+    if(n_chunks > 0){
+        TsdfExtractionBody extraction(this, n_blocks, &coords[0], &tsdf[0], &weight[0], mVoxelSize, results);
+        Kinect::ParallelFor(0, n_chunks, extraction);
+    }
+
+    int count = 0;
+    for(int i=0; i<n_chunks; i++)
+        count += (int)results[i].size()/6;
+    *points  = cvCreateMat(3, MAX(count, 1), CV_32FC1);
+    *normals = cvCreateMat(3, MAX(count, 1), CV_32FC1);
+    float* P[3], *N[3];
+    for(int k=0; k<3; k++){
+        P[k] = (float*)((*points)->data.ptr  + k*(*points)->step);
+        N[k] = (float*)((*normals)->data.ptr + k*(*normals)->step);
+    }
+    int j = 0;
+    for(int i=0; i<n_chunks; i++){
+        const std::vector<float>& r = results[i];
+        for(size_t p=0; p<r.size(); p+=6, j++){
+            for(int k=0; k<3; k++){
+                P[k][j] = r[p+k];
+                N[k][j] = r[p+3+k];
+            }
+        }
+    }
+    return count;
+}
@@ -0,0 +1,100 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\TsdfVolume.h
+//
+// summary:	Declares the sparse truncated signed distance volume class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  TsdfVolume
+///
+/// @brief  Sparse, voxel-hashed truncated signed distance function (TSDF) for depth map fusion.
+///
+///         The volume consists of blocks of 8x8x8 voxels that are allocated on demand: for every
+///         valid depth pixel, the blocks along its ray within the truncation band are looked up in
+///         an open-addressing hash table (keyed by the integer block coordinates) and created if
+///         needed. Only these blocks are updated by a view. Each of their voxels is projected into
+///         the depth map, and its signed distance to the surface (measured minus voxel depth,
+///         converted to a distance along the surface normal of the depth map, divided by the
+///         truncation distance and clamped to 1) is added to a weighted running average. Voxel rows are updated four voxels at a time (SSE) and the blocks of a view are
+///         updated in parallel.
+///
+///         ExtractSurface() returns the zero crossings of the TSDF between neighbouring voxels as
+///         an oriented point cloud (normals from the TSDF gradient), in the format of the point
+///         cloud exporters. Views may be integrated at any time after an extraction.
+///
+///         Depths are along the optical axis; poses map world coordinates into the camera
+///         (X_cam = R*X_world + T). Lengths are in the units of the voxel size (mm by convention).
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class TsdfVolume
+{
+public:
+    /// <summary> Number of voxels along each side of a block. </summary>
+    enum { BLOCK_SIZE = 8, BLOCK_VOXELS = BLOCK_SIZE*BLOCK_SIZE*BLOCK_SIZE };
+
+    // Create an empty volume with voxel size and truncation distance (in mm). The weight of each
+    // voxel saturates at max_weight, so older views are gradually forgotten.
+    TsdfVolume(float voxel_size, float truncation, float max_weight = 64);
+    ~TsdfVolume();
+
+    // Remove all blocks.
+    void Reset();
+
+    int   GetBlockCount()           { return (int)mBlocks.size(); };
+    float GetVoxelSize()            { return mVoxelSize; };
+
+    // Integrate a depth map (width x height floats, step floats per row); depth values are scaled by
+    // depth_scale (e.g., 10 for Kinect depth in cm), and values <= 0 are invalid.
+    // Note: intrinsic is the 3x3 matrix of the (undistorted) depth map; rotation (3x3) and
+    //       translation (3x1) are the world-to-camera pose. Returns the number of updated blocks.
+    int   Integrate(const float* depth, int width, int height, int step, const CvMat* intrinsic,
+                    const CvMat* rotation, const CvMat* translation, float depth_scale = 1);
+
+    // Integrate an organized point cloud in camera coordinates (3 x width*height, CV_32FC1) for the
+    // points where mask (1 x width*height, CV_32FC1, optional) is non-zero.
+    // Note: The points are projected with intrinsic into a depth map (so it has no lens distortion).
+    int   IntegratePoints(const CvMat* points, const CvMat* mask, int width, int height,
+                          const CvMat* intrinsic, const CvMat* rotation, const CvMat* translation);
+
+    // Extract the surface as points and normals (both 3xN, CV_32FC1, released by the caller) in
+    // world coordinates. Returns the number of points.
+    int   ExtractSurface(CvMat** points, CvMat** normals);
+
+private:
+    friend class TsdfExtractionBody;
+
+    struct Block
+    {
+        int   coord[3];
+        float tsdf[BLOCK_VOXELS];
+        float weight[BLOCK_VOXELS];
+    };
+
+    // Find the block with integer coordinates c (returns -1 if absent), or allocate it.
+    int   findBlock(const int* c) const;
+    int   allocateBlock(const int* c);
+
+    // Get a voxel value, with coordinates up to BLOCK_SIZE into the neighbouring blocks.
+    bool  getVoxel(int block, int x, int y, int z, float& tsdf) const;
+
+    void  rehash(int table_size);
+
+    float mVoxelSize;
+    float mTruncation;
+    float mMaxWeight;
+
+    /// <summary> Voxel blocks, and the hash table of block indices (-1 for empty slots). </summary>
+    std::vector<Block*> mBlocks;
+    std::vector<int>    mTable;
+
+    /// <summary> Blocks touched by the current view (and the view stamp of every block). </summary>
+    std::vector<int>    mVisible;
+    std::vector<int>    mStamp;
+    int                 mView;
+};
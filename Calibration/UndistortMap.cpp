@@ -0,0 +1,325 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\UndistortMap.cpp
+//
+// summary:	Implements the fixed-point undistortion map class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "Common.h"
+#include "Calibration.h"
+#include "UndistortMap.h"
+#include "Kinect-Parallel.h"
+#include <emmintrin.h>
+
+// Bilinear weights for every fractional index, packed as two 16-bit pairs:
+// [0] = (w00, w01) for the top neighbours, [1] = (w10, w11) for the bottom neighbours.
+static int  gWeightTable[UndistortMap::INTER_TAB_SIZE*UndistortMap::INTER_TAB_SIZE][2];
+static bool gWeightTableReady = false;
+
+static void initWeightTable()
+{
+    if(gWeightTableReady)
+        return;
+    const int one = 1 << UndistortMap::WEIGHT_BITS;
+    for(int fy=0; fy<UndistortMap::INTER_TAB_SIZE; fy++){
+        for(int fx=0; fx<UndistortMap::INTER_TAB_SIZE; fx++){
+            float ax = fx/(float)UndistortMap::INTER_TAB_SIZE;
+            float ay = fy/(float)UndistortMap::INTER_TAB_SIZE;
+            int w[4];
+            w[0] = cvRound((1-ax)*(1-ay)*one);
+            w[1] = cvRound(ax*(1-ay)*one);
+            w[2] = cvRound((1-ax)*ay*one);
+            w[3] = cvRound(ax*ay*one);
+
+            // Make the weights sum to exactly one (adjust the largest).
+            int largest = 0;
+            for(int k=1; k<4; k++)
+                if(w[k] > w[largest])
+                    largest = k;
+            w[largest] += one - (w[0] + w[1] + w[2] + w[3]);
+
+            int* entry = gWeightTable[fy*UndistortMap::INTER_TAB_SIZE + fx];
+            entry[0] = (w[0] & 0xFFFF) | (w[1] << 16);
+            entry[1] = (w[2] & 0xFFFF) | (w[3] << 16);
+        }
+    }
+    gWeightTableReady = true;
+}
+
+// Bilinear sample with a constant (zero) border, used near the image boundary.
+static inline uchar sampleBorder(const IplImage* src, int x, int y, int c, const int* weights)
+{
+    int w[4] = { (short)(weights[0] & 0xFFFF), weights[0] >> 16, (short)(weights[1] & 0xFFFF), weights[1] >> 16 };
+    int sum = 0;
+    for(int k=0; k<4; k++){
+        int sx = x + (k & 1);
+        int sy = y + (k >> 1);
+        if(sx >= 0 && sy >= 0 && sx < src->width && sy < src->height)
+            sum += w[k]*((const uchar*)src->imageData)[sy*src->widthStep + sx*src->nChannels + c];
+    }
+    return (uchar)((sum + (1 << (UndistortMap::WEIGHT_BITS-1))) >> UndistortMap::WEIGHT_BITS);
+}
+
+// Remap a band of rows of the region of interest.
+class UndistortRemapBody : public Kinect::ParallelLoopBody
+{
+public:
+    UndistortRemapBody(const IplImage* src, IplImage* dst, const CvMat* coordinates, const CvMat* fractions, int x0, int x1)
+    {
+        mSrc         = src;
+        mDst         = dst;
+        mCoordinates = coordinates;
+        mFractions   = fractions;
+        mX0          = x0;
+        mX1          = x1;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int y=begin; y<end; y++){
+            if(mSrc->nChannels == 1)
+                remapRowGray(y);
+            else
+                remapRowColor(y);
+        }
+    }
+
+private:
+    // Single channel: four destination pixels per iteration.
+    void remapRowGray(int y)
+    {
+        const short*  xy    = (const short*)(mCoordinates->data.ptr + y*mCoordinates->step);
+        const ushort* frac  = (const ushort*)(mFractions->data.ptr + y*mFractions->step);
+        const uchar*  src   = (const uchar*)mSrc->imageData;
+        uchar*        dst   = (uchar*)mDst->imageData + y*mDst->widthStep;
+        const int     step  = mSrc->widthStep;
+        const int     max_x = mSrc->width - 2;
+        const int     max_y = mSrc->height - 2;
+        const __m128i round = _mm_set1_epi32(1 << (UndistortMap::WEIGHT_BITS-1));
+
+        int x = mX0;
+        for(; x+4 <= mX1; x+=4){
+            bool inside = true;
+            for(int k=0; k<4; k++){
+                int sx = xy[2*(x+k)], sy = xy[2*(x+k)+1];
+                inside &= (sx >= 0) & (sy >= 0) & (sx <= max_x) & (sy <= max_y);
+            }
+            if(!inside){
+                for(int k=0; k<4; k++)
+                    dst[x+k] = sampleBorder(mSrc, xy[2*(x+k)], xy[2*(x+k)+1], 0, gWeightTable[frac[x+k]]);
+                continue;
+            }
+
+            // Gather (p00, p01) and (p10, p11) as 16-bit pairs.
+            int top[4], bottom[4], wtop[4], wbottom[4];
+            for(int k=0; k<4; k++){
+                const uchar* p = src + xy[2*(x+k)+1]*step + xy[2*(x+k)];
+                top[k]     = p[0]    | (p[1] << 16);
+                bottom[k]  = p[step] | (p[step+1] << 16);
+                wtop[k]    = gWeightTable[frac[x+k]][0];
+                wbottom[k] = gWeightTable[frac[x+k]][1];
+            }
+            __m128i sum = _mm_add_epi32(
+                _mm_madd_epi16(_mm_setr_epi32(top[0], top[1], top[2], top[3]),
+                               _mm_setr_epi32(wtop[0], wtop[1], wtop[2], wtop[3])),
+                _mm_madd_epi16(_mm_setr_epi32(bottom[0], bottom[1], bottom[2], bottom[3]),
+                               _mm_setr_epi32(wbottom[0], wbottom[1], wbottom[2], wbottom[3])));
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, round), UndistortMap::WEIGHT_BITS);
+            sum = _mm_packs_epi32(sum, sum);
+            sum = _mm_packus_epi16(sum, sum);
+            *(int*)(dst + x) = _mm_cvtsi128_si32(sum);
+        }
+        for(; x<mX1; x++)
+            dst[x] = sampleBorder(mSrc, xy[2*x], xy[2*x+1], 0, gWeightTable[frac[x]]);
+    }
+
+    // Three channels: one destination pixel (all channels) per iteration.
+    void remapRowColor(int y)
+    {
+        const short*  xy    = (const short*)(mCoordinates->data.ptr + y*mCoordinates->step);
+        const ushort* frac  = (const ushort*)(mFractions->data.ptr + y*mFractions->step);
+        const uchar*  src   = (const uchar*)mSrc->imageData;
+        uchar*        dst   = (uchar*)mDst->imageData + y*mDst->widthStep;
+        const int     step  = mSrc->widthStep;
+        const int     max_x = mSrc->width - 2;
+        const int     max_y = mSrc->height - 2;
+        const __m128i round = _mm_set1_epi32(1 << (UndistortMap::WEIGHT_BITS-1));
+
+        for(int x=mX0; x<mX1; x++){
+            int sx = xy[2*x], sy = xy[2*x+1];
+            const int* weights = gWeightTable[frac[x]];
+            uchar* d = dst + 3*x;
+            if(sx < 0 || sy < 0 || sx > max_x || sy > max_y){
+                for(int c=0; c<3; c++)
+                    d[c] = sampleBorder(mSrc, sx, sy, c, weights);
+                continue;
+            }
+
+            const uchar* p = src + sy*step + 3*sx;
+            __m128i top    = _mm_setr_epi16(p[0], p[3], p[1], p[4], p[2], p[5], 0, 0);
+            __m128i bottom = _mm_setr_epi16(p[step], p[step+3], p[step+1], p[step+4], p[step+2], p[step+5], 0, 0);
+            __m128i sum = _mm_add_epi32(_mm_madd_epi16(top,    _mm_set1_epi32(weights[0])),
+                                        _mm_madd_epi16(bottom, _mm_set1_epi32(weights[1])));
+            sum = _mm_srai_epi32(_mm_add_epi32(sum, round), UndistortMap::WEIGHT_BITS);
+            sum = _mm_packs_epi32(sum, sum);
+            sum = _mm_packus_epi16(sum, sum);
+            int packed = _mm_cvtsi128_si32(sum);
+            d[0] = (uchar)(packed);
+            d[1] = (uchar)(packed >> 8);
+            d[2] = (uchar)(packed >> 16);
+        }
+    }
+
+    const IplImage* mSrc;
+    IplImage*       mDst;
+    const CvMat*    mCoordinates;
+    const CvMat*    mFractions;
+    int             mX0;
+    int             mX1;
+};
+
+UndistortMap::UndistortMap()
+{
+    mSize        = cvSize(0, 0);
+    mCoordinates = NULL;
+    mFractions   = NULL;
+    initWeightTable();
+}
+
+UndistortMap::~UndistortMap()
+{
+    cvReleaseMat(&mCoordinates);
+    cvReleaseMat(&mFractions);
+}
+
+void UndistortMap::allocate(CvSize size)
+{
+    if(mCoordinates != NULL && mSize.width == size.width && mSize.height == size.height)
+        return;
+    cvReleaseMat(&mCoordinates);
+    cvReleaseMat(&mFractions);
+    mSize        = size;
+    mCoordinates = cvCreateMat(size.height, size.width, CV_16SC2);
+    mFractions   = cvCreateMat(size.height, size.width, CV_16UC1);
+}
+
+void UndistortMap::pack(const CvMat* map_x, const CvMat* map_y)
+{
+    for(int y=0; y<mSize.height; y++){
+        const float* mx   = (const float*)(map_x->data.ptr + y*map_x->step);
+        const float* my   = (const float*)(map_y->data.ptr + y*map_y->step);
+        short*       xy   = (short*)(mCoordinates->data.ptr + y*mCoordinates->step);
+        ushort*      frac = (ushort*)(mFractions->data.ptr + y*mFractions->step);
+        for(int x=0; x<mSize.width; x++){
+            // Clamp far-away coordinates (they are outside the image either way).
+            float fx = MIN(MAX(mx[x], -16384.f), 16383.f);
+            float fy = MIN(MAX(my[x], -16384.f), 16383.f);
+            int ix = cvRound(fx*INTER_TAB_SIZE);
+            int iy = cvRound(fy*INTER_TAB_SIZE);
+            xy[2*x]   = (short)(ix >> INTER_BITS);
+            xy[2*x+1] = (short)(iy >> INTER_BITS);
+            frac[x]   = (ushort)((iy & (INTER_TAB_SIZE-1))*INTER_TAB_SIZE + (ix & (INTER_TAB_SIZE-1)));
+        }
+    }
+}
+
+void UndistortMap::Build(const CvMat* intrinsic, const CvMat* distortion, CvSize size, bool predistort)
+{
+    allocate(size);
+    CvMat* map_x = cvCreateMat(size.height, size.width, CV_32FC1);
+    CvMat* map_y = cvCreateMat(size.height, size.width, CV_32FC1);
+
+    if(!predistort){
+        // For every undistorted pixel, find the distorted source pixel.
+        cvInitUndistortMap(intrinsic, distortion, map_x, map_y);
+    }
+    else{
+        // For every (distorted) device pixel, find the ideal pattern pixel it has to show.
+        CvMat* pixels      = cvCreateMat(1, size.width*size.height, CV_32FC2);
+        CvMat* undistorted = cvCreateMat(1, size.width*size.height, CV_32FC2);
+        float* p = pixels->data.fl;
+        for(int y=0; y<size.height; y++){
+            for(int x=0; x<size.width; x++){
+                *p++ = (float)x;
+                *p++ = (float)y;
+            }
+        }
+        cvUndistortPoints(pixels, undistorted, intrinsic, distortion, NULL, intrinsic);
+        const float* q = undistorted->data.fl;
+        for(int y=0; y<size.height; y++){
+            float* mx = (float*)(map_x->data.ptr + y*map_x->step);
+            float* my = (float*)(map_y->data.ptr + y*map_y->step);
+            for(int x=0; x<size.width; x++){
+                mx[x] = *q++;
+                my[x] = *q++;
+            }
+        }
+        cvReleaseMat(&pixels);
+        cvReleaseMat(&undistorted);
+    }
+
+    pack(map_x, map_y);
+    cvReleaseMat(&map_x);
+    cvReleaseMat(&map_y);
+}
+
+bool UndistortMap::Load(const CvMat* coordinates, const CvMat* fractions)
+{
+    if(CV_MAT_TYPE(coordinates->type) != CV_16SC2 || CV_MAT_TYPE(fractions->type) != CV_16UC1 ||
+       coordinates->rows != fractions->rows || coordinates->cols != fractions->cols)
+        return false;
+    allocate(cvSize(coordinates->cols, coordinates->rows));
+    cvCopy(coordinates, mCoordinates);
+    cvCopy(fractions,   mFractions);
+    return true;
+}
+
+void UndistortMap::Remap(const IplImage* src, IplImage* dst, const CvRect* roi)
+{
+    if(mCoordinates == NULL || src->depth != IPL_DEPTH_8U || src->nChannels != dst->nChannels ||
+       (src->nChannels != 1 && src->nChannels != 3) || dst->width != mSize.width || dst->height != mSize.height){
+        printf("ERROR: Undistortion map does not match the image format!\n");
+        return;
+    }
+
+    // Clip the region of interest to the image.
+    int x0 = 0, y0 = 0, x1 = mSize.width, y1 = mSize.height;
+    if(roi != NULL){
+        x0 = MAX(roi->x, 0);
+        y0 = MAX(roi->y, 0);
+        x1 = MIN(roi->x + roi->width,  mSize.width);
+        y1 = MIN(roi->y + roi->height, mSize.height);
+        if(x0 >= x1 || y0 >= y1)
+            return;
+    }
+
+    UndistortRemapBody body(src, dst, mCoordinates, mFractions, x0, x1);
+    Kinect::ParallelFor(y0, y1, body, 16);
+}
+
+UndistortMap* getCameraUndistortMap(struct slParams* sl_params, struct slCalib* sl_calib)
+{
+    if(sl_calib->cam_undistort_map == NULL){
+        sl_calib->cam_undistort_map = new UndistortMap();
+        sl_calib->cam_undistort_map->Build(sl_calib->cam_intrinsic, sl_calib->cam_distortion,
+            cvSize(sl_params->cam_w, sl_params->cam_h));
+    }
+    return sl_calib->cam_undistort_map;
+}
+
+UndistortMap* getProjectorUndistortMap(struct slParams* sl_params, struct slCalib* sl_calib)
+{
+    if(sl_calib->proj_undistort_map == NULL){
+        sl_calib->proj_undistort_map = new UndistortMap();
+        sl_calib->proj_undistort_map->Build(sl_calib->proj_intrinsic, sl_calib->proj_distortion,
+            cvSize(sl_params->proj_w, sl_params->proj_h), true);
+    }
+    return sl_calib->proj_undistort_map;
+}
+
+void releaseUndistortMaps(struct slCalib* sl_calib)
+{
+    delete sl_calib->cam_undistort_map;
+    delete sl_calib->proj_undistort_map;
+    sl_calib->cam_undistort_map  = NULL;
+    sl_calib->proj_undistort_map = NULL;
+}
@@ -0,0 +1,75 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// file:	Calibration\UndistortMap.h
+//
+// summary:	Declares the fixed-point undistortion map class
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Common.h"
+#include "Calibration.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @class  UndistortMap
+///
+/// @brief  Precomputed dense undistortion (remap) table with a bilinear SSE2 remap kernel.
+///
+///         Each destination pixel stores the integer source coordinates (CV_16SC2) and a
+///         5-bit/5-bit fractional index (CV_16UC1) into a shared table of 14-bit bilinear
+///         weights. The table is built once from the intrinsics and distortion coefficients;
+///         applying it only costs the neighbour gather and a fixed-point weighted sum. Rows
+///         are remapped in parallel bands, optionally limited to a region of interest.
+///
+/// @ingroup Calibration
+////////////////////////////////////////////////////////////////////////////////////////////////////
+class UndistortMap
+{
+public:
+    /// <summary> Fractional bits per coordinate and fixed-point bits of the weights. </summary>
+    enum { INTER_BITS = 5, INTER_TAB_SIZE = 1 << INTER_BITS, WEIGHT_BITS = 14 };
+
+    UndistortMap();
+    ~UndistortMap();
+
+    // Build the table for a camera (maps undistorted pixels to distorted source pixels).
+    // Note: With predistort set, the inverse mapping is built instead (for projector patterns,
+    //       so that the projected pattern appears undistorted after the projector lens).
+    void Build(const CvMat* intrinsic, const CvMat* distortion, CvSize size, bool predistort = false);
+
+    // Initialize the table from packed coordinates (CV_16SC2) and fractions (CV_16UC1).
+    // Note: Returns false if the matrices have the wrong type or size.
+    bool Load(const CvMat* coordinates, const CvMat* fractions);
+
+    // Remap an 8-bit, 1- or 3-channel image (src and dst must both have the table size).
+    // Note: Pixels mapped outside the source are set to zero. With roi, only that part of dst is written.
+    //       The remap cannot be done in place (src and dst must be different images).
+    void Remap(const IplImage* src, IplImage* dst, const CvRect* roi = NULL);
+
+    bool   IsBuilt()                { return mCoordinates != NULL; };
+    CvSize GetSize()                { return mSize; };
+    CvMat* GetCoordinates()         { return mCoordinates; };
+    CvMat* GetFractions()           { return mFractions; };
+
+private:
+    void allocate(CvSize size);
+
+    // Convert floating-point source coordinates into the packed fixed-point table.
+    void pack(const CvMat* map_x, const CvMat* map_y);
+
+    CvSize mSize;
+
+    /// <summary> Integer source coordinates (x, y) of every destination pixel. </summary>
+    CvMat* mCoordinates;
+
+    /// <summary> Fractional part of every source coordinate (y*INTER_TAB_SIZE + x). </summary>
+    CvMat* mFractions;
+};
+
+// Get the camera undistortion map (built on first use from cam_intrinsic/cam_distortion).
+UndistortMap* getCameraUndistortMap(struct slParams* sl_params, struct slCalib* sl_calib);
+
+// Get the projector predistortion map (built on first use from proj_intrinsic/proj_distortion).
+UndistortMap* getProjectorUndistortMap(struct slParams* sl_params, struct slCalib* sl_calib);
+
+// Release the cached maps (must be called whenever the intrinsics change).
+void releaseUndistortMaps(struct slCalib* sl_calib);
@@ -8,9 +8,13 @@
 #include "Calibration.h"
 #include "UtilProCam.h"
 #include "Camera.h"
+#include "PointCloudExport.h"
+#include "PointSubsampler.h"
+#include "GridMesher.h"
+#include "Kinect-Parallel.h"
+#include "Kinect-Trace.h"
 
 #include <stdlib.h>
-#include <time.h>
 
 // Calculate the base 2 logarithm.
 double log2(double x)
@@ -123,6 +127,109 @@ void intersectLineWithLine3D(const float* q1,
 		p[i] = ( (q1[i]+s*v1[i]) + (q2[i]+t*v2[i]) )/2;
 }
 
+// Map the projected chessboard corners (seen by the camera) onto the printed chessboard plane.
+// Note: The point lists must be continuous (e.g., row ranges of a larger point list), since they
+//       are reinterpreted as 2-channel vectors instead of being copied element by element.
+void mapProjectorCornersToBoard(const CvMat* cam_image_points, 
+								const CvMat* cam_object_points, 
+								const CvMat* proj_cam_points,
+								const CvMat* cam_intrinsic, 
+								const CvMat* cam_distortion, 
+								CvMat* proj_object_points){
+
+	int cam_board_n  = cam_image_points->rows;
+	int proj_board_n = proj_cam_points->rows;
+
+	// Evaluate undistorted image pixels for both the camera and the projector chessboard corners.
+	CvMat cam_dist_image_points, proj_dist_image_points;
+	CvMat* cam_undist_image_points  = cvCreateMat(cam_board_n,  1, CV_32FC2);
+	CvMat* proj_undist_image_points = cvCreateMat(proj_board_n, 1, CV_32FC2);
+	cvUndistortPoints(cvReshape(cam_image_points, &cam_dist_image_points, 2), cam_undist_image_points, 
+		cam_intrinsic, cam_distortion, NULL, NULL);
+	cvUndistortPoints(cvReshape(proj_cam_points, &proj_dist_image_points, 2), proj_undist_image_points, 
+		cam_intrinsic, cam_distortion, NULL, NULL);
+
+	// Estimate homography that maps undistorted image pixels to positions on the chessboard.
+	CvMat object_xy, cam_dst_xy;
+	CvMat* homography = cvCreateMat(3, 3, CV_32FC1);
+	CvMat* cam_dst    = cvCreateMat(cam_board_n, 1, CV_32FC2);
+	cvCopy(cvGetCols(cam_object_points, &object_xy, 0, 2), cvReshape(cam_dst, &cam_dst_xy, 1));
+	{
+		KINECT_TRACE_SCOPE("calibration.homography");
+		cvFindHomography(cam_undist_image_points, cam_dst, homography);
+	}
+	cvReleaseMat(&cam_undist_image_points);
+	cvReleaseMat(&cam_dst);
+
+	// Map undistorted projector image corners to positions on the chessboard plane (z = 0).
+	CvMat proj_object_xy, proj_dst_xy;
+	CvMat* proj_dst = cvCreateMat(proj_board_n, 1, CV_32FC2);
+	cvPerspectiveTransform(proj_undist_image_points, proj_dst, homography);
+	cvZero(proj_object_points);
+	cvCopy(cvReshape(proj_dst, &proj_dst_xy, 1), cvGetCols(proj_object_points, &proj_object_xy, 0, 2));
+	cvReleaseMat(&proj_undist_image_points);
+	cvReleaseMat(&proj_dst);
+	cvReleaseMat(&homography);
+}
+
+// Map the projector chessboard corners of a range of views onto the camera chessboard plane.
+class ProjectorCornerMapper : public Kinect::ParallelLoopBody
+{
+public:
+    ProjectorCornerMapper(const CvMat* cam_image_points, const CvMat* cam_object_points, const CvMat* proj_cam_points,
+                          const CvMat* cam_intrinsic, const CvMat* cam_distortion, CvMat* proj_object_points,
+                          int cam_board_n, int proj_board_n)
+    {
+        mCamImagePoints   = cam_image_points;
+        mCamObjectPoints  = cam_object_points;
+        mProjCamPoints    = proj_cam_points;
+        mCamIntrinsic     = cam_intrinsic;
+        mCamDistortion    = cam_distortion;
+        mProjObjectPoints = proj_object_points;
+        mCamBoardN        = cam_board_n;
+        mProjBoardN       = proj_board_n;
+    }
+
+    virtual void Run(int begin, int end)
+    {
+        for(int i=begin; i<end; i++){
+            CvMat cam_image_view, cam_object_view, proj_cam_view, proj_object_view;
+            mapProjectorCornersToBoard(
+                cvGetRows(mCamImagePoints,   &cam_image_view,   mCamBoardN*i,  mCamBoardN*(i+1)),
+                cvGetRows(mCamObjectPoints,  &cam_object_view,  mCamBoardN*i,  mCamBoardN*(i+1)),
+                cvGetRows(mProjCamPoints,    &proj_cam_view,    mProjBoardN*i, mProjBoardN*(i+1)),
+                mCamIntrinsic, mCamDistortion,
+                cvGetRows(mProjObjectPoints, &proj_object_view, mProjBoardN*i, mProjBoardN*(i+1)));
+        }
+    }
+
+private:
+    const CvMat* mCamImagePoints;
+    const CvMat* mCamObjectPoints;
+    const CvMat* mProjCamPoints;
+    const CvMat* mCamIntrinsic;
+    const CvMat* mCamDistortion;
+    CvMat* mProjObjectPoints;
+    int    mCamBoardN;
+    int    mProjBoardN;
+};
+
+// Map the projected chessboard corners of several views onto the printed chessboard plane.
+void mapProjectorCornersToBoards(const CvMat* cam_image_points, 
+								 const CvMat* cam_object_points, 
+								 const CvMat* proj_cam_points,
+								 const CvMat* cam_intrinsic, 
+								 const CvMat* cam_distortion, 
+								 CvMat* proj_object_points,
+								 int cam_board_n,
+								 int proj_board_n,
+								 int views){
+	KINECT_TRACE_SCOPE("calibration.map_corners");
+	ProjectorCornerMapper mapper(cam_image_points, cam_object_points, proj_cam_points, cam_intrinsic, cam_distortion, 
+		proj_object_points, cam_board_n, proj_board_n);
+	Kinect::ParallelFor(0, views, mapper);
+}
+
 // Capture live image stream (e.g., for adjusting object placement).
 int camPreview(Camera* camera, struct slParams* sl_params, struct slCalib* sl_calib){
 
@@ -224,90 +331,90 @@ int savePointsVRML(char* filename,
 				   CvMat* normals,
 				   CvMat* colors,
 				   CvMat* mask){
+	PointCloudExport cloud(points, normals, colors, mask);
+	return cloud.SaveVRML(filename);
+}
 
-	// Open output file and create header.
-	FILE* pFile = fopen(filename, "w");
-	if(pFile == NULL){
-		fprintf(stderr,"ERROR: Cannot open VRML file!\n");
-		return -1;
-	}
-	fprintf(pFile, "#VRML V2.0 utf8\n");
-	fprintf(pFile, "Shape {\n");
-	fprintf(pFile, " geometry IndexedFaceSet {\n");
-
-	// Output points (i.e., indexed face set vertices).
-	// Note: Flip y-component for compatibility with Java-based viewer.
-	if(points != NULL){
-		fprintf(pFile, "  coord Coordinate {\n");
-		fprintf(pFile, "   point [\n");
-		for(int c=0; c<points->cols; c++){
-			if(mask == NULL || mask->data.fl[c] != 0){
-				for(int r=0; r<points->rows; r++){
-					if(r != 1)
-						fprintf(pFile, "    %f ",  points->data.fl[c + points->cols*r]);
-					else
-						fprintf(pFile, "    %f ", -points->data.fl[c + points->cols*r]);
-				}
-				fprintf(pFile, "\n");
-			}
-		}
-		fprintf(pFile, "   ]\n");
-		fprintf(pFile, "  }\n");
-	}
+// Save a binary PLY-formatted point cloud.
+int savePointsPLY(char* filename, 
+				  CvMat* points,
+				  CvMat* normals,
+				  CvMat* colors,
+				  CvMat* mask){
+	PointCloudExport cloud(points, normals, colors, mask);
+	return cloud.SavePLY(filename);
+}
 
-	// Output normals (if provided).
-	// Note: Flips normals, for compatibility with Java-based viewer.
-	if(normals != NULL){
-		fprintf(pFile, "  normalPerVertex TRUE\n");
-		fprintf(pFile, "  normal Normal {\n");
-		fprintf(pFile, "   vector [\n");
-		for(int c=0; c<normals->cols; c++){
-			if(mask == NULL || mask->data.fl[c] != 0){
-				for(int r=0; r<normals->rows; r++)
-					fprintf(pFile, "    %f ", -normals->data.fl[c + normals->cols*r]);
-				fprintf(pFile, "\n");
-			}
-		}
-		fprintf(pFile, "   ]\n");
-		fprintf(pFile, "  }\n");
+// Format the correspondences of a range of the selected points into a text buffer.
+class PointsTxtBody : public Kinect::ParallelLoopBody
+{
+public:
+	PointsTxtBody(const CvMat* points, const IplImage* gray_decoded_cols, const IplImage* gray_decoded_rows,
+				  const std::vector<int>& indices, int cam_w, int chunk_size, std::vector<std::vector<char> >& buffers)
+		: mIndices(indices), mBuffers(buffers)
+	{
+		mPoints    = points;
+		mCols      = gray_decoded_cols;
+		mRows      = gray_decoded_rows;
+		mCamW      = cam_w;
+		mChunkSize = chunk_size;
 	}
 
-	// Output colors (if provided).
-	// Note: Assumes input is an 8-bit RGB color array.
-	if(colors != NULL){
-		fprintf(pFile, "  colorPerVertex TRUE\n");
-		fprintf(pFile, "  color Color {\n");
-		fprintf(pFile, "   color [\n");
-		for(int c=0; c<colors->cols; c++){
-			if(mask == NULL || mask->data.fl[c] != 0){
-				for(int r=0; r<colors->rows; r++)
-					fprintf(pFile, "    %f ", colors->data.fl[c + colors->cols*r]);
-				fprintf(pFile, "\n");
+	virtual void Run(int begin, int end)
+	{
+		int cam_nelems = mPoints->cols;
+		for(int chunk=begin; chunk<end; chunk++){
+			int first = chunk*mChunkSize;
+			int last  = MIN(first + mChunkSize, (int)mIndices.size());
+			std::vector<char>& buffer = mBuffers[chunk];
+			// Seven values, their separators and the two constant fields per line.
+			buffer.resize((last - first)*(7*(PointCloudExport::MAX_FLOAT_LENGTH + 3) + 8));
+			char* p = &buffer[0];
+			for(int i=first; i<last; i++){
+				int rc_cam = mIndices[i];
+				int r      = rc_cam/mCamW;
+				int c      = rc_cam - r*mCamW;
+				float corresponding_column = ((float*)(mCols->imageData + r*mCols->widthStep))[c];
+				float corresponding_row    = ((float*)(mRows->imageData + r*mRows->widthStep))[c];
+
+				// Same layout as "\n%f %f %f %d 0 %f %f 1 %f %f".
+				*p++ = '\n';
+				for(int k=0; k<3; k++){
+					p = PointCloudExport::FormatFloat(p, mPoints->data.fl[rc_cam+cam_nelems*k]);
+					*p++ = ' ';
+				}
+				memcpy(p, "2 0 ", 4);
+				p = PointCloudExport::FormatFloat(p + 4, (float)c);
+				*p++ = ' ';
+				p = PointCloudExport::FormatFloat(p, (float)r);
+				memcpy(p, " 1 ", 3);
+				p = PointCloudExport::FormatFloat(p + 3, corresponding_column);
+				*p++ = ' ';
+				p = PointCloudExport::FormatFloat(p, corresponding_row);
 			}
+			buffer.resize(p - &buffer[0]);
 		}
-		fprintf(pFile, "   ]\n");
-		fprintf(pFile, "  }\n");
 	}
 
-	// Create footer and close file.
-	fprintf(pFile, " }\n");
-	fprintf(pFile, "}\n");
-	if(fclose(pFile) != 0){
-		printf("ERROR: Cannot close VRML file!\n");
-		return -1;
-	}
-
-	// Return without errors.
-	return 0;
-}
+private:
+	const CvMat*    mPoints;
+	const IplImage* mCols;
+	const IplImage* mRows;
+	int             mCamW;
+	int             mChunkSize;
+	const std::vector<int>&          mIndices;
+	std::vector<std::vector<char> >& mBuffers;
+};
 
 // Save a text file of 3D world points and camera and projector image points
+// Note: The points are subsampled to the export point budget (see PointSubsampler).
 int savePointsTxt(char* filename, 
 					CvMat* points,
 					IplImage*& gray_decoded_cols, 
 					IplImage*& gray_decoded_rows, 
 					CvMat* mask, struct slParams* sl_params)
 {
+	KINECT_TRACE_SCOPE("export.text");
 	FILE* pFile = fopen(filename, "w");
 	
 	if(pFile == NULL)
@@ -316,71 +423,40 @@ int savePointsTxt(char* filename,
 		return -1;
 	}
 
-	float*	gray_decoded_cols_data = (float*)gray_decoded_cols->imageData;
-	int     gray_decoded_cols_step = gray_decoded_cols->widthStep/sizeof(float);
-	float*	gray_decoded_rows_data = (float*)gray_decoded_rows->imageData;
-	int     gray_decoded_rows_step = gray_decoded_rows->widthStep/sizeof(float);
-	int		cam_nelems				= sl_params->cam_w*sl_params->cam_h;
-	int		num_frames				= 2;
-	float	point[3];
-	float   percentSubSample = 0.01;
-
 	// Output point format: X Y Z  nframes  frame0 x0 y0  frame1 x1 y1
 	// This format is for a 1 camera, 1 projector set up
 
-	// to do:
-	// change to use rand with ms
-	srand(time(NULL));
-	
-	for(int r=0; r<sl_params->cam_h; r++)
-	{
-		for(int c=0; c<sl_params->cam_w; c++)
-		{	
-			if(mask->data.fl[sl_params->cam_w*r+c] == 1)
-			{
-				// randomly subsample
-				float randVal = rand() % 1000 / 1000.0;
-				if(randVal < percentSubSample)
-				{
-                    fprintf(pFile, "\n");
-
-					float corresponding_column = gray_decoded_cols_data[r*gray_decoded_cols_step+c];
-					float corresponding_row    = gray_decoded_rows_data[r*gray_decoded_rows_step+c];
-
-					int rc_cam  = (sl_params->cam_w)*r+c;
-					
-					for(int i = 0; i < 3; i++)
-						point[i] = points->data.fl[rc_cam+cam_nelems*i];
-
-					for(int i = 0; i < 3; i++)
-					{
-						fprintf(pFile, "%f ", point[i]);
-					}
-
-					float fRow = r;
-					float fCol = c;
-
-					fprintf(pFile, "%d ", num_frames);
-					
-					fprintf(pFile, "0 ");
-					fprintf(pFile, "%f %f ", fCol, fRow);
-					fprintf(pFile, "1 ");
-					fprintf(pFile, "%f %f", corresponding_column, corresponding_row);
-				}
-			}
-		}
-	}
+	// Select a deterministic, evenly distributed subset of the reconstructed points.
+	std::vector<int> indices;
+	PointSubsampler subsampler(sl_params);
+	subsampler.Select(points, mask, sl_params->cam_w, sl_params->cam_h, indices);
+
+	// Format the points in parallel chunks and write them in order.
+	const int chunk_size = 4096;
+	int n_chunks = ((int)indices.size() + chunk_size - 1)/chunk_size;
+	std::vector<std::vector<char> > buffers(n_chunks);
+	PointsTxtBody body(points, gray_decoded_cols, gray_decoded_rows, indices, sl_params->cam_w, chunk_size, buffers);
+	Kinect::ParallelFor(0, n_chunks, body);
+
+	bool ok = true;
+	for(int i=0; i<n_chunks && ok; i++)
+		if(!buffers[i].empty())
+			ok = (fwrite(&buffers[i][0], 1, buffers[i].size(), pFile) == buffers[i].size());
 
 	// Create footer and close file.
 	if(fclose(pFile) != 0){
 		printf("ERROR: Cannot close Txt file!\n");
 		return -1;
 	}
+	if(!ok){
+		printf("ERROR: Cannot write Txt file!\n");
+		return -1;
+	}
 
     return 0;
 }
 
-// Save a VRML-formatted point cloud.
+// Save a OBJ-formatted point cloud.
 int savePointsOBJ(char* filename, 
 				   CvMat* points,
                    CvMat* faces,
@@ -388,89 +464,26 @@ int savePointsOBJ(char* filename,
                    CvMat* uvCoords,
 				   CvMat* colors,
 				   CvMat* mask){
+	PointCloudExport cloud(points, normals, colors, mask, uvCoords);
+	return cloud.SaveOBJ(filename, faces);
+}
 
-	// Open output file and create header.
-	FILE* pFile = fopen(filename, "w");
-	if(pFile == NULL){
-		fprintf(stderr,"ERROR: Cannot open VRML file!\n");
-		return -1;
-	}
-	fprintf(pFile, "#OBJ File\n");
-	fprintf(pFile, "\n");
-
-	fprintf(pFile, "#Begin Vertices\n");
-
-	// Output points (i.e., indexed face set vertices).
-	// Note: Flip y-component for compatibility with Java-based viewer.
-	if(points != NULL){
-		for(int c=0; c<points->cols; c++){
-			if(mask == NULL || mask->data.fl[c] != 0){
-		        fprintf(pFile, "v ");
-				for(int r=0; r<points->rows; r++){
-					if(r != 1)
-                        fprintf(pFile, "%f ",  points->data.fl[c + points->step/sizeof(float)*r]);
-					else
-                        fprintf(pFile, "%f ", -points->data.fl[c + points->step/sizeof(float)*r]);
-				}
-				fprintf(pFile, "\n");
-			}
-		}
-		fprintf(pFile, "\n");
-	}
-
-	// Output faces
-	if(faces != NULL){
-		for(int c=0; c<faces->cols; c++){
-			if(mask == NULL || mask->data.fl[c] != 0){
-                if( faces->data.i[c] > 0 ){
-		            fprintf(pFile, "f ");
-				    for(int r=0; r<faces->rows; r++){
-                        fprintf(pFile, "%i ",  faces->data.i[c + faces->step/sizeof(int)*r]);
-				    }
-				    fprintf(pFile, "\n");
-                }
-			}
-		}
-		fprintf(pFile, "\n");
-	}
-
-	// Output normals (if provided).
-	// Note: Flips normals, for compatibility with Java-based viewer.
-	if(normals != NULL){
-		for(int c=0; c<normals->cols; c++){
-			if(mask == NULL || mask->data.fl[c] != 0){
-                fprintf(pFile, "vn ");
-				for(int r=0; r<normals->rows; r++)
-                    fprintf(pFile, "%f ", -normals->data.fl[c + normals->step/sizeof(float)*r]);
-				fprintf(pFile, "\n");
-			}
-		}
-		fprintf(pFile, "   ]\n");
-	}
-
-	// Output uv coords
-	if(uvCoords != NULL){
-		for(int c=0; c<uvCoords->cols; c++){
-			if(mask == NULL || mask->data.fl[c] != 0){
-		        fprintf(pFile, "vt ");
-				for(int r=0; r<uvCoords->rows; r++){
-                    fprintf(pFile, "%f ", uvCoords->data.fl[c + uvCoords->step/sizeof(float)*r]);
-				}
-				fprintf(pFile, "\n");
-			}
-		}
-		fprintf(pFile, "\n");
-	}
-
-	// Create footer and close file.
-	fprintf(pFile, "\n");
-	if(fclose(pFile) != 0){
-		printf("ERROR: Cannot close OBJ file!\n");
+// Save a grid-meshed point cloud (binary PLY or OBJ, by file extension).
+int saveMesh(char* filename,
+			 CvMat* points,
+			 CvMat* normals,
+			 CvMat* colors,
+			 CvMat* mask,
+			 struct slParams* sl_params){
+	GridMesher mesher(sl_params);
+	mesher.Build(points, mask);
+	PointCloudExport cloud(points, normals, colors, mask);
+	if(!cloud.SetMesh(&mesher))
 		return -1;
-	}
-
-	// Return without errors.
-	return 0;
+	const char* ext = strrchr(filename, '.');
+	if(ext != NULL && (strcmp(ext, ".obj") == 0 || strcmp(ext, ".OBJ") == 0))
+		return cloud.SaveOBJ(filename);
+	return cloud.SavePLY(filename);
 }
 
 // In-place conversion of a 10-bit raw image to an 8-bit BGR image.
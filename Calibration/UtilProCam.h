@@ -26,6 +26,20 @@ void intersectLineWithLine3D(const float* q1, const float* v1, const float* q2,
 // Define camera capture (support Logitech QuickCam 9000 raw-mode).
 IplImage* QueryFrame2(CvCapture* capture, struct slParams* sl_params, bool return_raw = false);
 
+// Map the projected chessboard corners (seen by the camera) onto the printed chessboard plane.
+// Note: The corners are undistorted with the camera intrinsics and transferred with the homography
+//       between the undistorted camera chessboard corners and their object points (z = 0).
+//       The point lists must be continuous (e.g., row ranges of the per-session point lists).
+void mapProjectorCornersToBoard(const CvMat* cam_image_points, const CvMat* cam_object_points, const CvMat* proj_cam_points,
+                                const CvMat* cam_intrinsic, const CvMat* cam_distortion, CvMat* proj_object_points);
+
+// Map the projected chessboard corners of views boards onto the printed chessboard plane.
+// Note: View i uses rows [i*cam_board_n, (i+1)*cam_board_n) of the camera lists and rows
+//       [i*proj_board_n, (i+1)*proj_board_n) of the projector lists; views are mapped in parallel.
+void mapProjectorCornersToBoards(const CvMat* cam_image_points, const CvMat* cam_object_points, const CvMat* proj_cam_points,
+                                 const CvMat* cam_intrinsic, const CvMat* cam_distortion, CvMat* proj_object_points,
+                                 int cam_board_n, int proj_board_n, int views);
+
 // Capture live image stream (e.g., for adjusting object placement).
 int camPreview(Camera* camera, struct slParams* sl_params, struct slCalib* sl_calib);
 
@@ -38,9 +52,16 @@ void ShowImageResampled(char* name, IplImage* image, int width, int height);
 // Save a VRML-formatted point cloud.
 int savePointsVRML(char* filename, CvMat* points, CvMat* normals, CvMat* colors, CvMat* mask);
 
+// Save a binary PLY-formatted point cloud.
+int savePointsPLY(char* filename, CvMat* points, CvMat* normals, CvMat* colors, CvMat* mask);
+
 // Save a OBJ-formatted point cloud.
 int savePointsOBJ(char* filename, CvMat* points, CvMat* faces, CvMat* normals, CvMat* uvCoords, CvMat* colors, CvMat* mask);
 
+// Save a grid-meshed point cloud (binary PLY or OBJ, by file extension).
+// Note: Triangles are not created across depth jumps larger than sl_params->dist_reject.
+int saveMesh(char* filename, CvMat* points, CvMat* normals, CvMat* colors, CvMat* mask, struct slParams* sl_params);
+
 // Save in a format used by sba - sfm
 int savePointsTxt(char* filename, CvMat* points, IplImage*& gray_decoded_cols, IplImage*& gray_decoded_rows, CvMat* mask, struct slParams* sl_params);
 
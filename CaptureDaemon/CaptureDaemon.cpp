@@ -0,0 +1,289 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @file   CaptureDaemon\CaptureDaemon.cpp
+///
+/// @brief  Implements the capture daemon executable.
+///
+/// @defgroup CaptureDaemon CaptureDaemon
+///       Owns the Kinect and publishes its frames on a shared-memory frame bus, so any number of
+///       processes (calibration, viewers, recorders) can use one Kinect at the same time. Frames
+///       can also be replayed from image files, and the bus can be read to check its throughput.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <windows.h>
+#include <conio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "cv.h"
+#include "highgui.h"
+
+#include "Kinect-win32.h"
+#include "Kinect-Utility.h"
+#include "Kinect-FrameBus.h"
+#include "Kinect-Log.h"
+
+// The largest frame published: a decoded color frame.
+static const int DAEMON_MAX_FRAME_BYTES = Kinect::KINECT_COLOR_WIDTH*Kinect::KINECT_COLOR_HEIGHT*3;
+
+// Keeps the reader's checksum from being optimized away.
+static volatile unsigned int gChecksum = 0;
+
+static void printUsage()
+{
+    printf("Usage: CaptureDaemon [options]\n");
+    printf("  --bus <name>          frame bus name (default kinect)\n");
+    printf("  --slots <n>           frames kept in the ring (default 16)\n");
+    printf("  --replay <pattern>    publish image files instead of the Kinect (printf pattern of\n");
+    printf("                        the file names, numbered from 0, e.g. frames\\%%04d.png)\n");
+    printf("  --fps <rate>          replay frame rate (default 30)\n");
+    printf("  --read                read the bus and print statistics instead of publishing\n");
+    printf("  --stream <n>          stream read by --read (0 = color, 1 = depth, 2 = raw color,\n");
+    printf("                        3 = raw depth; default 0)\n");
+    printf("  --delay <ms>          time spent on each frame read (simulates a slow reader)\n");
+    printf("Press q or ESC to quit.\n");
+}
+
+static bool quitRequested()
+{
+    if(!_kbhit())
+        return false;
+    int key = _getch();
+    return key == 'q' || key == 'Q' || key == 27;
+}
+
+// Publishes every frame the Kinect delivers (called on the driver's USB threads).
+class FrameBusPublisher : public Kinect::KinectListener
+{
+public:
+    FrameBusPublisher(Kinect::FrameBusWriter* writer)   { mWriter = writer; };
+
+    virtual void ColorReceived(Kinect::Kinect* K)
+    {
+        // The raw frame is copied into the ring once and decoded from there into the next slot.
+        LONG raw_ticket, color_ticket;
+        unsigned char* bayer = (unsigned char*)mWriter->BeginFrame(Kinect::FRAMEBUS_COLOR_RAW, Kinect::FRAMEBUS_BAYER8,
+            Kinect::KINECT_COLOR_WIDTH, Kinect::KINECT_COLOR_HEIGHT, Kinect::KINECT_COLOR_RAW_SIZE, &raw_ticket);
+        K->CopyRawColor(bayer);
+        mWriter->CommitFrame(raw_ticket);
+
+        unsigned char* rgb = (unsigned char*)mWriter->BeginFrame(Kinect::FRAMEBUS_COLOR, Kinect::FRAMEBUS_RGB8,
+            Kinect::KINECT_COLOR_WIDTH, Kinect::KINECT_COLOR_HEIGHT, DAEMON_MAX_FRAME_BYTES, &color_ticket);
+        Kinect::Kinect_DemosaicColor(bayer, rgb);
+        mWriter->CommitFrame(color_ticket);
+    };
+
+    virtual void DepthReceived(Kinect::Kinect* K)
+    {
+        const int count = Kinect::KINECT_DEPTH_WIDTH*Kinect::KINECT_DEPTH_HEIGHT;
+        LONG raw_ticket, depth_ticket;
+        unsigned char* packed = (unsigned char*)mWriter->BeginFrame(Kinect::FRAMEBUS_DEPTH_RAW, Kinect::FRAMEBUS_DEPTH11,
+            Kinect::KINECT_DEPTH_WIDTH, Kinect::KINECT_DEPTH_HEIGHT, Kinect::KINECT_DEPTH_RAW_SIZE, &raw_ticket);
+        K->CopyRawDepth(packed);
+        mWriter->CommitFrame(raw_ticket);
+
+        // Note: Kinect_UnpackDepth() reads past the packed data; the slots are padded for it.
+        unsigned short* depth = (unsigned short*)mWriter->BeginFrame(Kinect::FRAMEBUS_DEPTH, Kinect::FRAMEBUS_DEPTH16,
+            Kinect::KINECT_DEPTH_WIDTH, Kinect::KINECT_DEPTH_HEIGHT, count*sizeof(unsigned short), &depth_ticket);
+        Kinect::Kinect_UnpackDepth(packed, depth, count);
+        mWriter->CommitFrame(depth_ticket);
+    };
+
+private:
+    Kinect::FrameBusWriter* mWriter;
+};
+
+// Publish the frames of the first Kinect until a key is pressed.
+static int runKinect(const char* bus, int slots)
+{
+    Kinect::KinectFinder finder;
+    if(finder.GetKinectCount() < 1){
+        printf("ERROR: No Kinect found!\n");
+        return -1;
+    }
+    Kinect::Kinect* kinect = finder.GetKinect(0);
+    if(kinect == NULL){
+        printf("ERROR: Cannot open the Kinect!\n");
+        return -1;
+    }
+
+    Kinect::FrameBusWriter writer;
+    if(!writer.Create(bus, slots, DAEMON_MAX_FRAME_BYTES)){
+        printf("ERROR: Cannot create the frame bus \"%s\" (is another daemon running, or do readers hold a bus of another size?)!\n", bus);
+        return -1;
+    }
+    FrameBusPublisher publisher(&writer);
+    kinect->SetLedMode(Kinect::Led_Green);
+    kinect->AddListener(&publisher);
+    printf("Publishing the Kinect on the frame bus \"%s\".\n", bus);
+
+    while(!quitRequested())
+        Sleep(50);
+
+    // No callback runs once the listener is removed.
+    kinect->RemoveListener(&publisher);
+    kinect->SetLedMode(Kinect::Led_Off);
+    writer.Close();
+    return 0;
+}
+
+// Publish image files (numbered from 0) in a loop at the given rate until a key is pressed.
+static int runReplay(const char* bus, int slots, const char* pattern, double fps)
+{
+    // Load all frames up front, so disk reads do not disturb the frame rate.
+    std::vector<IplImage*> frames;
+    int max_bytes = 0;
+    for(;;){
+        char filename[1024];
+        sprintf(filename, pattern, (int)frames.size());
+        IplImage* frame = cvLoadImage(filename, CV_LOAD_IMAGE_UNCHANGED);
+        if(frame == NULL)
+            break;
+        if(frame->depth != IPL_DEPTH_8U || (frame->nChannels != 1 && frame->nChannels != 3)){
+            printf("ERROR: \"%s\" is not an 8-bit color or gray image!\n", filename);
+            cvReleaseImage(&frame);
+            break;
+        }
+        frames.push_back(frame);
+        max_bytes = MAX(max_bytes, frame->width*frame->height*frame->nChannels);
+    }
+    if(frames.empty()){
+        printf("ERROR: No image matches \"%s\"!\n", pattern);
+        return -1;
+    }
+
+    Kinect::FrameBusWriter writer;
+    if(!writer.Create(bus, slots, max_bytes)){
+        printf("ERROR: Cannot create the frame bus \"%s\" (is another daemon running, or do readers hold a bus of another size?)!\n", bus);
+        for(unsigned int i=0; i<frames.size(); i++)
+            cvReleaseImage(&frames[i]);
+        return -1;
+    }
+    printf("Replaying %d frames at %.1f fps on the frame bus \"%s\".\n", (int)frames.size(), fps, bus);
+
+    LARGE_INTEGER frequency, start, now;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    for(int n=0; !quitRequested(); n++){
+        IplImage* frame = frames[n % frames.size()];
+        int format    = (frame->nChannels == 3) ? Kinect::FRAMEBUS_RGB8 : Kinect::FRAMEBUS_GRAY8;
+        int row_bytes = frame->width*frame->nChannels;
+
+        // Frames are published with packed rows.
+        LONG ticket;
+        char* data = (char*)writer.BeginFrame(Kinect::FRAMEBUS_COLOR, format, frame->width, frame->height,
+                                              row_bytes*frame->height, &ticket);
+        for(int y=0; y<frame->height; y++)
+            memcpy(data + y*row_bytes, frame->imageData + y*frame->widthStep, row_bytes);
+        writer.CommitFrame(ticket);
+
+        // Pace the frames from the start time, so the rate does not drift.
+        QueryPerformanceCounter(&now);
+        double due_ms = 1000.0*(n + 1)/fps - 1000.0*(now.QuadPart - start.QuadPart)/frequency.QuadPart;
+        if(due_ms > 0)
+            Sleep((DWORD)due_ms);
+    }
+
+    writer.Close();
+    for(unsigned int i=0; i<frames.size(); i++)
+        cvReleaseImage(&frames[i]);
+    return 0;
+}
+
+// Read a stream of the bus and print the frame rate, the frames missed and the frames overwritten
+// while they were read (in place) once a second until a key is pressed.
+static int runReader(const char* bus, int stream, int delay_ms)
+{
+    Kinect::FrameBusReader reader;
+    if(!reader.Open(bus)){
+        printf("ERROR: No capture daemon publishes the frame bus \"%s\"!\n", bus);
+        return -1;
+    }
+    printf("Reading stream %d of the frame bus \"%s\".\n", stream, bus);
+
+    LARGE_INTEGER frequency, now;
+    QueryPerformanceFrequency(&frequency);
+    DWORD window_start = GetTickCount();
+    int frames = 0, torn = 0;
+    double latency_ms = 0;
+    while(!quitRequested()){
+        Kinect::FrameBusFrame frame;
+        if(reader.Acquire(stream, &frame, 1000)){
+            QueryPerformanceCounter(&now);
+            latency_ms += 1000.0*(now.QuadPart - frame.mTimestamp)/frequency.QuadPart;
+
+            // Touch every byte in place, as a consumer would.
+            const unsigned char* data = (const unsigned char*)frame.mData;
+            unsigned int sum = 0;
+            for(int i=0; i<frame.mBytes; i++)
+                sum += data[i];
+            gChecksum = sum;
+            if(delay_ms > 0)
+                Sleep(delay_ms);
+            if(!reader.IsValid(frame))
+                torn++;
+            frames++;
+        }
+        else if(!reader.Open(bus)){
+            printf("ERROR: The frame bus \"%s\" was closed!\n", bus);
+            return -1;
+        }
+
+        DWORD elapsed = GetTickCount() - window_start;
+        if(elapsed >= 1000){
+            printf("%5.1f fps, latency %5.2f ms, %ld missed, %d overwritten while read\n",
+                   1000.0*frames/elapsed, frames ? latency_ms/frames : 0.0, reader.GetMissedCount(), torn);
+            window_start += elapsed;
+            frames = 0;
+            latency_ms = 0;
+        }
+    }
+    return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/// @fn int main(int argc, char* argv[])
+///
+/// @brief  Main entry-point for the capture daemon.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    printf("[CaptureDaemon]\n");
+    const char* bus    = "kinect";
+    const char* replay = NULL;
+    bool   read     = false;
+    int    slots    = 16;
+    int    stream   = Kinect::FRAMEBUS_COLOR;
+    int    delay_ms = 0;
+    double fps      = 30;
+
+    for(int i=1; i<argc; i++){
+        bool has_value = (i + 1 < argc);
+        if(strcmp(argv[i], "--bus") == 0 && has_value)              bus      = argv[++i];
+        else if(strcmp(argv[i], "--slots") == 0 && has_value)       slots    = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--replay") == 0 && has_value)      replay   = argv[++i];
+        else if(strcmp(argv[i], "--fps") == 0 && has_value)         fps      = atof(argv[++i]);
+        else if(strcmp(argv[i], "--read") == 0)                     read     = true;
+        else if(strcmp(argv[i], "--stream") == 0 && has_value)      stream   = atoi(argv[++i]);
+        else if(strcmp(argv[i], "--delay") == 0 && has_value)       delay_ms = atoi(argv[++i]);
+        else{
+            printUsage();
+            return -1;
+        }
+    }
+    if(slots < 2 || fps <= 0 || stream < 0 || stream >= Kinect::FRAMEBUS_STREAMS){
+        printUsage();
+        return -1;
+    }
+
+    int result;
+    if(read)
+        result = runReader(bus, stream, delay_ms);
+    else if(replay != NULL)
+        result = runReplay(bus, slots, replay, fps);
+    else
+        result = runKinect(bus, slots);
+    Kinect::LogFlush();
+    return result;
+}
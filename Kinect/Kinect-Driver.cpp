@@ -29,6 +29,8 @@
 
 #include "Kinect-win32.h"
 #include "Kinect-win32-internal.h"
+#include "Kinect-Trace.h"
+#include "Kinect-Log.h"
 
 #define DORGB 1
 #define DODEPTH 1
@@ -48,6 +50,7 @@ namespace Kinect
 			return 0;
 		};
 
+		TraceSetThreadName("Kinect depth USB");
 		KID->LockDepthThread();
 		KID->mDepthInput = new KinectFrameInput(KID, KID->mDeviceHandle, 0x82, 1760, DEPTH_PKTS_PER_XFER, DEPTH_NUM_XFERS, 422400);
 		if (KID->mDepthInput)
@@ -66,6 +69,8 @@ namespace Kinect
 		};
 
 		KID->UnlockDepthThread();
+		TraceThreadExit();
+		LogThreadExit();
 		
 		return 0;
 	};
@@ -81,6 +86,7 @@ namespace Kinect
 		{
 			return 0;
 		};
+		TraceSetThreadName("Kinect color USB");
 		KID->LockRGBThread();
 		KID->mRGBInput = new KinectFrameInput(KID, KID->mDeviceHandle, 0x81, 1920, RGB_PKTS_PER_XFER, RGB_NUM_XFERS, 307200 );
 		if (KID->mRGBInput )
@@ -99,6 +105,8 @@ namespace Kinect
 		};
 
 		KID->UnlockRGBThread();
+		TraceThreadExit();
+		LogThreadExit();
 		return 0;
 	};
 
@@ -110,6 +118,23 @@ namespace Kinect
 		uint16_t tag;
 	};
 
+	// Write data as hex bytes to out (as far as they fit, marking a cut with "...").
+	static void FormatHex(char *out, int outsize, const uint8_t *data, int len)
+	{
+		int pos = 0;
+		out[0] = 0;
+		for (int j=0; j<len; j++)
+		{
+			if (pos + 3 > outsize - 4)
+			{
+				strcpy(out + pos, "...");
+				return;
+			}
+			sprintf(out + pos, "%02x ", data[j]);
+			pos += 3;
+		}
+	};
+
 	void KinectInternalData::send_init()
 	{
 
@@ -185,11 +210,10 @@ namespace Kinect
 			ret = usb_control_msg(mDeviceHandle, 0x40, 0, 0, 0, (char*)obuf, ip->cmdlen + sizeof(cam_hdr), 1600);
 			if (ret <0)
 			{
-				printf("error: %s\n", usb_strerror());
+				KINECT_LOG(LOG_ERROR, "error: %s\n", usb_strerror());
 				//return;
 			}
-            if(mDebugInfo)
-			    printf("sending init %d from %d... ", i+1, num_inits);
+			KINECT_LOG(LOG_DEBUG, "sending init %d from %d...\n", i+1, num_inits);
 			
 			do 
 			{
@@ -201,49 +225,43 @@ namespace Kinect
 				ret = usb_control_msg(mDeviceHandle, 0xc0, 0, 0, 0, (char*)ibuf, 0x200, 1600);
 				if (ret<0)
 				{
-					printf("error: %s\n", usb_strerror());				
+					KINECT_LOG(LOG_ERROR, "error: %s\n", usb_strerror());
 				}
 
 			} while (ret == 0);
 
 			if (rhdr->magic[0] != 0x52 || rhdr->magic[1] != 0x42) 
 			{
-				printf("Bad magic %02x %02x\n", rhdr->magic[0], rhdr->magic[1]);
+				KINECT_LOG(LOG_WARNING, "Bad magic %02x %02x\n", rhdr->magic[0], rhdr->magic[1]);
 				continue;
 			}
-            if(mDebugInfo)
-			    printf("succes!\n");
+			KINECT_LOG(LOG_DEBUG, "succes!\n");
 
 
 			if (rhdr->cmd != chdr->cmd) 
 			{
-				printf("Bad cmd %02x != %02x\n", rhdr->cmd, chdr->cmd);
+				KINECT_LOG(LOG_WARNING, "Bad cmd %02x != %02x\n", rhdr->cmd, chdr->cmd);
 				continue;
 			}
 
 			if (rhdr->tag != chdr->tag) 
 			{
-				printf("Bad tag %04x != %04x\n", rhdr->tag, chdr->tag);
+				KINECT_LOG(LOG_WARNING, "Bad tag %04x != %04x\n", rhdr->tag, chdr->tag);
 				continue;
 			}
 
 			if (rhdr->len != (ret-sizeof(*rhdr))/2) 
 			{
-				printf("Bad len %04x != %04x\n", rhdr->len, (int)(ret-sizeof(*rhdr))/2);
+				KINECT_LOG(LOG_WARNING, "Bad len %04x != %04x\n", rhdr->len, (int)(ret-sizeof(*rhdr))/2);
 				continue;
 			}
 			
 			if (rhdr->len != (ip->replylen/2) || memcmp(ibuf+sizeof(*rhdr), ip->replydata, ip->replylen)) 
 			{
-				printf("Expected: ");
-				for (j=0; j<ip->replylen; j++) {
-					printf("%02x ", ip->replydata[j]);
-				}
-				printf("\nGot:      ");
-				for (j=0; j<(rhdr->len*2); j++) {
-					printf("%02x ", ibuf[j+sizeof(*rhdr)]);
-				}
-				printf("\n");
+				char expected[200], got[200];
+				FormatHex(expected, sizeof(expected), ip->replydata, ip->replylen);
+				FormatHex(got, sizeof(got), ibuf+sizeof(*rhdr), rhdr->len*2);
+				KINECT_LOG(LOG_WARNING, "Expected: %s\nGot:      %s\n", expected, got);
 			}
 		}
 	}
@@ -317,7 +335,7 @@ namespace Kinect
 		ret = usb_set_configuration(mDeviceHandle, 1);
 		if (ret<0)
 		{
-			printf("usb_set_configuration error: %s\n", usb_strerror());
+			KINECT_LOG(LOG_ERROR, "usb_set_configuration error: %s\n", usb_strerror());
 			//return;
 		}
 
@@ -326,7 +344,7 @@ namespace Kinect
 
 		if (ret<0)
 		{
-			printf("usb_claim_interface error: %s\n", usb_strerror());
+			KINECT_LOG(LOG_ERROR, "usb_claim_interface error: %s\n", usb_strerror());
 			return;
 		}
 
@@ -398,8 +416,6 @@ namespace Kinect
 		depth_sourcebuf2 = new uint8_t[1000*1000*3];
 		rgb_buf2= new uint8_t[640*480*3];
 
-        mDebugInfo = false;
-
 		InitializeCriticalSection(&depth_lock);
 		InitializeCriticalSection(&rgb_lock);
 		InitializeCriticalSection(&depththread_lock);
@@ -408,6 +424,7 @@ namespace Kinect
 
 	void KinectInternalData::BufferComplete(KinectFrameInput *source)
 	{
+		KINECT_TRACE_SCOPE("kinect.buffer_complete");
 		if (source == mDepthInput)
 		{
 			LockDepth();
@@ -0,0 +1,16 @@
+#ifndef KINECTEXPORT
+#define KINECTEXPORT
+
+// The Kinect library is a DLL, so its global state (the thread pool, the trace and the log) exists
+// once per process and is shared by the modules that use it (KinectCamera, Calibration, ...).
+#ifdef _WIN32
+	#ifdef KINECT_DECL_EXPORT
+		#define KINECT_DECL __declspec(dllexport)
+	#else
+		#define KINECT_DECL __declspec(dllimport)
+	#endif
+#else
+	#define KINECT_DECL
+#endif
+
+#endif
@@ -0,0 +1,321 @@
+#include "Kinect-FrameBus.h"
+#include "Kinect-Trace.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace Kinect
+{
+	enum
+	{
+		FRAMEBUS_MAGIC = 0x4b464253,	// "KFBS"
+		FRAMEBUS_VERSION = 2,
+		FRAMEBUS_HEADER_SIZE = 4096,	// the header and each slot start on a page
+		FRAMEBUS_SLOT_HEADER_SIZE = 64,
+		FRAMEBUS_SLOT_PADDING = 64		// readable bytes past a frame (e.g. for Kinect_UnpackDepth)
+	};
+
+	// Layout of the shared memory: the header, followed by the slots.
+	struct FrameBusHeader
+	{
+		DWORD mMagic;
+		DWORD mVersion;
+		LONG mSlotCount;
+		LONG mSlotSize;
+		LONG mMaxFrameBytes;
+		volatile LONG mClosed;
+		volatile LONG mWriterProcess;					// id of the process that publishes
+		volatile LONG mSequence;						// last claimed sequence number
+		volatile LONG mCommits;							// committed frames (selects the wake event)
+		volatile LONG mLatest[FRAMEBUS_STREAMS];		// newest committed sequence per stream (0 = none)
+		volatile LONG mFrameCount[FRAMEBUS_STREAMS];
+	};
+
+	struct FrameBusSlot
+	{
+		volatile LONG mSequence;	// 0 while the slot is being written
+		LONG mFrameNumber;
+		LONG mStream;
+		LONG mFormat;
+		LONG mWidth;
+		LONG mHeight;
+		LONG mBytes;
+		LONGLONG mTimestamp;
+	};
+
+	static inline FrameBusSlot *GetSlot(const FrameBusHeader *header, LONG sequence)
+	{
+		char *base = (char *)header + FRAMEBUS_HEADER_SIZE;
+		return (FrameBusSlot *)(base + (size_t)((sequence - 1) % header->mSlotCount) * header->mSlotSize);
+	};
+
+	static inline void *GetSlotData(FrameBusSlot *slot)
+	{
+		return (char *)slot + FRAMEBUS_SLOT_HEADER_SIZE;
+	};
+
+	static void GetFrameBusNames(const char *name, char *mapping, char *event0, char *event1)
+	{
+		sprintf(mapping, "Local\\KinectFrameBus.%s", name);
+		sprintf(event0, "Local\\KinectFrameBus.%s.0", name);
+		sprintf(event1, "Local\\KinectFrameBus.%s.1", name);
+	};
+
+	static bool IsProcessRunning(DWORD id)
+	{
+		HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, id);
+		if (process == NULL) return GetLastError() == ERROR_ACCESS_DENIED;
+		bool running = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+		CloseHandle(process);
+		return running;
+	};
+
+	// Take over an existing bus whose writer closed it or exited (readers keep the mapping, and so
+	// its name, alive). The sequence numbers continue, so readers keep their cursors.
+	static bool TakeOverFrameBus(FrameBusHeader *header, int slots, LONG slot_size)
+	{
+		if (header->mMagic != FRAMEBUS_MAGIC || header->mVersion != FRAMEBUS_VERSION ||
+			header->mSlotCount != slots || header->mSlotSize != slot_size) return false;
+		LONG writer = header->mWriterProcess;
+		if (!header->mClosed && IsProcessRunning((DWORD)writer)) return false;
+		if (InterlockedCompareExchange(&header->mWriterProcess, (LONG)GetCurrentProcessId(), writer) != writer) return false;
+		InterlockedExchange(&header->mClosed, 0);
+		return true;
+	};
+
+	FrameBusWriter::FrameBusWriter()
+	{
+		mHeader = NULL;
+		mMapping = NULL;
+		mEvents[0] = mEvents[1] = NULL;
+	};
+
+	FrameBusWriter::~FrameBusWriter()
+	{
+		Close();
+	};
+
+	bool FrameBusWriter::Create(const char *name, int slots, int max_frame_bytes)
+	{
+		Close();
+		if (slots < 2 || max_frame_bytes <= 0 || strlen(name) > 200) return false;
+
+		LONG slot_size = (FRAMEBUS_SLOT_HEADER_SIZE + max_frame_bytes + FRAMEBUS_SLOT_PADDING + 4095) & ~4095;
+		LONGLONG size = FRAMEBUS_HEADER_SIZE + (LONGLONG)slots * slot_size;
+		char mapping[256], event0[256], event1[256];
+		GetFrameBusNames(name, mapping, event0, event1);
+
+		mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(size >> 32), (DWORD)size, mapping);
+		if (mMapping == NULL) return false;
+		bool existed = (GetLastError() == ERROR_ALREADY_EXISTS);
+		mHeader = (FrameBusHeader *)MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (mHeader != NULL && existed && !TakeOverFrameBus(mHeader, slots, slot_size))
+		{
+			// Another daemon publishes the bus (or it has another layout); leave it alone.
+			UnmapViewOfFile(mHeader);
+			mHeader = NULL;
+		}
+		mEvents[0] = CreateEventA(NULL, TRUE, FALSE, event0);
+		mEvents[1] = CreateEventA(NULL, TRUE, FALSE, event1);
+		if (mHeader == NULL || mEvents[0] == NULL || mEvents[1] == NULL)
+		{
+			Close();
+			return false;
+		}
+		if (existed) return true;
+
+		// The mapping is zero-filled; the magic is written last, so readers see a complete header.
+		mHeader->mVersion = FRAMEBUS_VERSION;
+		mHeader->mSlotCount = slots;
+		mHeader->mSlotSize = slot_size;
+		mHeader->mMaxFrameBytes = max_frame_bytes;
+		mHeader->mWriterProcess = (LONG)GetCurrentProcessId();
+		InterlockedExchange((volatile LONG *)&mHeader->mMagic, FRAMEBUS_MAGIC);
+		return true;
+	};
+
+	void FrameBusWriter::Close()
+	{
+		if (mHeader != NULL)
+		{
+			// Wake the readers, so they notice that the bus is closed.
+			InterlockedExchange(&mHeader->mClosed, 1);
+			if (mEvents[0]) SetEvent(mEvents[0]);
+			if (mEvents[1]) SetEvent(mEvents[1]);
+			UnmapViewOfFile(mHeader);
+			mHeader = NULL;
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			if (mEvents[i]) CloseHandle(mEvents[i]);
+			mEvents[i] = NULL;
+		}
+		if (mMapping) CloseHandle(mMapping);
+		mMapping = NULL;
+	};
+
+	void *FrameBusWriter::BeginFrame(int stream, int format, int width, int height, int bytes, LONG *ticket)
+	{
+		if (mHeader == NULL || stream < 0 || stream >= FRAMEBUS_STREAMS || bytes > mHeader->mMaxFrameBytes) return NULL;
+
+		// Invalidate the slot before its data changes (readers check the sequence after reading).
+		LONG sequence = InterlockedIncrement(&mHeader->mSequence);
+		FrameBusSlot *slot = GetSlot(mHeader, sequence);
+		InterlockedExchange(&slot->mSequence, 0);
+
+		slot->mFrameNumber = InterlockedIncrement(&mHeader->mFrameCount[stream]);
+		slot->mStream = stream;
+		slot->mFormat = format;
+		slot->mWidth = width;
+		slot->mHeight = height;
+		slot->mBytes = bytes;
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		slot->mTimestamp = now.QuadPart;
+
+		*ticket = sequence;
+		return GetSlotData(slot);
+	};
+
+	void FrameBusWriter::CommitFrame(LONG ticket)
+	{
+		if (mHeader == NULL) return;
+		FrameBusSlot *slot = GetSlot(mHeader, ticket);
+		InterlockedExchange(&slot->mSequence, ticket);
+		InterlockedExchange(&mHeader->mLatest[slot->mStream], ticket);
+
+		// Readers wait on the event of the next commit; re-arm the one after it.
+		LONG commits = InterlockedIncrement(&mHeader->mCommits);
+		ResetEvent(mEvents[(commits + 1) & 1]);
+		SetEvent(mEvents[commits & 1]);
+	};
+
+	LONG FrameBusWriter::Publish(int stream, int format, int width, int height, const void *data, int bytes)
+	{
+		KINECT_TRACE_SCOPE("framebus.publish");
+		LONG ticket;
+		void *slot_data = BeginFrame(stream, format, width, height, bytes, &ticket);
+		if (slot_data == NULL) return 0;
+		memcpy(slot_data, data, bytes);
+		CommitFrame(ticket);
+		return ticket;
+	};
+
+	FrameBusReader::FrameBusReader()
+	{
+		mHeader = NULL;
+		mMapping = NULL;
+		mEvents[0] = mEvents[1] = NULL;
+		mMissed = 0;
+		for (int i = 0; i < FRAMEBUS_STREAMS; i++) mCursor[i] = mLastFrameNumber[i] = 0;
+	};
+
+	FrameBusReader::~FrameBusReader()
+	{
+		Close();
+	};
+
+	bool FrameBusReader::Open(const char *name)
+	{
+		Close();
+		if (strlen(name) > 200) return false;
+		char mapping[256], event0[256], event1[256];
+		GetFrameBusNames(name, mapping, event0, event1);
+
+		mMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, mapping);
+		if (mMapping == NULL) return false;
+		mHeader = (const FrameBusHeader *)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+		mEvents[0] = OpenEventA(SYNCHRONIZE, FALSE, event0);
+		mEvents[1] = OpenEventA(SYNCHRONIZE, FALSE, event1);
+		if (mHeader == NULL || mEvents[0] == NULL || mEvents[1] == NULL ||
+			mHeader->mMagic != FRAMEBUS_MAGIC || mHeader->mVersion != FRAMEBUS_VERSION || mHeader->mClosed)
+		{
+			Close();
+			return false;
+		}
+
+		// Start at the newest frames.
+		for (int i = 0; i < FRAMEBUS_STREAMS; i++)
+		{
+			mCursor[i] = mHeader->mLatest[i];
+			mLastFrameNumber[i] = 0;
+		}
+		mMissed = 0;
+		return true;
+	};
+
+	void FrameBusReader::Close()
+	{
+		if (mHeader != NULL) UnmapViewOfFile((LPCVOID)mHeader);
+		mHeader = NULL;
+		for (int i = 0; i < 2; i++)
+		{
+			if (mEvents[i]) CloseHandle(mEvents[i]);
+			mEvents[i] = NULL;
+		}
+		if (mMapping) CloseHandle(mMapping);
+		mMapping = NULL;
+	};
+
+	bool FrameBusReader::ReadSlot(LONG sequence, FrameBusFrame *frame)
+	{
+		FrameBusSlot *slot = GetSlot(mHeader, sequence);
+		if (slot->mSequence != sequence) return false;
+		frame->mSequence = sequence;
+		frame->mFrameNumber = slot->mFrameNumber;
+		frame->mStream = slot->mStream;
+		frame->mFormat = slot->mFormat;
+		frame->mWidth = slot->mWidth;
+		frame->mHeight = slot->mHeight;
+		frame->mBytes = slot->mBytes;
+		frame->mTimestamp = slot->mTimestamp;
+		frame->mData = GetSlotData(slot);
+
+		// The fields are consistent if the slot was not claimed again while they were read.
+		MemoryBarrier();
+		return slot->mSequence == sequence;
+	};
+
+	bool FrameBusReader::Acquire(int stream, FrameBusFrame *frame, DWORD timeout_ms)
+	{
+		if (mHeader == NULL || stream < 0 || stream >= FRAMEBUS_STREAMS) return false;
+
+		DWORD start = GetTickCount();
+		for (;;)
+		{
+			if (mHeader->mClosed) return false;
+
+			// Take the newest frame.
+			LONG commits = mHeader->mCommits;
+			LONG sequence = mHeader->mLatest[stream];
+			if (sequence != 0 && sequence != mCursor[stream])
+			{
+				if (ReadSlot(sequence, frame))
+				{
+					if (mLastFrameNumber[stream] > 0 && frame->mFrameNumber > mLastFrameNumber[stream] + 1)
+						mMissed += frame->mFrameNumber - mLastFrameNumber[stream] - 1;
+					mLastFrameNumber[stream] = frame->mFrameNumber;
+					mCursor[stream] = sequence;
+					return true;
+				}
+
+				// The slot was overwritten before it could be read, so a newer frame is committed (or
+				// about to be): skip this one as missed (counted by the frame number gap of the next
+				// frame read) and wait for the commit below.
+				mCursor[stream] = sequence;
+			}
+
+			// Wait for the next commit (re-checking now and then, as the events are only a hint).
+			DWORD elapsed = GetTickCount() - start;
+			if (elapsed >= timeout_ms) return false;
+			DWORD wait = timeout_ms - elapsed;
+			WaitForSingleObject(mEvents[(commits + 1) & 1], wait < 10 ? wait : 10);
+		}
+	};
+
+	bool FrameBusReader::IsValid(const FrameBusFrame &frame)
+	{
+		if (mHeader == NULL) return false;
+		MemoryBarrier();
+		return GetSlot(mHeader, frame.mSequence)->mSequence == frame.mSequence;
+	};
+};
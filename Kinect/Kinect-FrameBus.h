@@ -0,0 +1,116 @@
+#ifndef KINECTFRAMEBUS
+#define KINECTFRAMEBUS
+
+#include <windows.h>
+#include "Kinect-Export.h"
+
+namespace Kinect
+{
+	// Shared-memory frame bus: one process (the capture daemon) publishes frames that any number
+	// of processes read without copying them.
+	//
+	// The bus is a named file mapping holding a ring of slots. Every published frame gets the next
+	// sequence number and the slot (sequence - 1) % slots, so the writer never waits: it simply
+	// overwrites the oldest slot. Readers map the ring read-only and keep their own cursor (the
+	// last sequence they read per stream); a reader that falls behind skips to the newest frame
+	// and counts the frames it missed. A slot's sequence number is cleared while the slot is being
+	// written, so a reader can check that a frame it uses in place was not overwritten meanwhile.
+
+	enum FrameBusStream
+	{
+		FRAMEBUS_COLOR = 0,			// decoded color (RGB8, as in Kinect::mColorBuffer)
+		FRAMEBUS_DEPTH,				// unpacked depth (DEPTH16, as in Kinect::mDepthBuffer)
+		FRAMEBUS_COLOR_RAW,			// raw Bayer color (BAYER8, as sent by the device)
+		FRAMEBUS_DEPTH_RAW,			// packed 11-bit depth (DEPTH11, as sent by the device)
+		FRAMEBUS_STREAMS
+	};
+
+	enum FrameBusFormat
+	{
+		FRAMEBUS_RGB8 = 0,
+		FRAMEBUS_GRAY8,
+		FRAMEBUS_DEPTH16,
+		FRAMEBUS_BAYER8,
+		FRAMEBUS_DEPTH11
+	};
+
+	struct FrameBusHeader;
+
+	// A frame in the ring (mData points into the shared memory; see FrameBusReader::IsValid).
+	struct FrameBusFrame
+	{
+		LONG mSequence;				// bus sequence number
+		LONG mFrameNumber;			// number of the frame within its stream (from 1)
+		int mStream;
+		int mFormat;
+		int mWidth;
+		int mHeight;
+		int mBytes;
+		LONGLONG mTimestamp;		// QueryPerformanceCounter() when the frame was published
+		const void *mData;
+	};
+
+	class KINECT_DECL FrameBusWriter
+	{
+	public:
+		FrameBusWriter();
+		~FrameBusWriter();
+
+		// Create the bus with slots frames of at most max_frame_bytes each. Returns false if another
+		// daemon publishes the bus or it cannot be created. A bus left by a daemon that closed it or
+		// exited (readers keep it mapped) is taken over if it has the same layout.
+		bool Create(const char *name, int slots, int max_frame_bytes);
+		void Close();
+
+		// Claim the next slot and return its data (max_frame_bytes, writable until CommitFrame),
+		// or NULL if bytes is too large. Each stream must be published from one thread at a time.
+		void *BeginFrame(int stream, int format, int width, int height, int bytes, LONG *ticket);
+		void CommitFrame(LONG ticket);
+
+		// Copy a frame into the next slot; returns its sequence number (0 on failure).
+		LONG Publish(int stream, int format, int width, int height, const void *data, int bytes);
+
+		bool IsOpen() { return mHeader != NULL; };
+
+	private:
+		FrameBusHeader *mHeader;
+		HANDLE mMapping;
+		HANDLE mEvents[2];
+	};
+
+	class KINECT_DECL FrameBusReader
+	{
+	public:
+		FrameBusReader();
+		~FrameBusReader();
+
+		// Map the bus of name read-only; returns false if no daemon publishes it (or it is closed).
+		bool Open(const char *name);
+		void Close();
+
+		// Get the newest frame of stream that is newer than the last one acquired, waiting up to
+		// timeout_ms for it. Returns false on timeout or when the writer has closed the bus.
+		bool Acquire(int stream, FrameBusFrame *frame, DWORD timeout_ms);
+
+		// True if frame has not been overwritten since it was acquired; check after using
+		// mData in place (a frame stays valid for about slots - 1 newer frames).
+		bool IsValid(const FrameBusFrame &frame);
+
+		// Frames of the acquired streams that were overwritten before this reader got to them.
+		long GetMissedCount() { return mMissed; };
+
+		bool IsOpen() { return mHeader != NULL; };
+
+	private:
+		bool ReadSlot(LONG sequence, FrameBusFrame *frame);
+
+		const FrameBusHeader *mHeader;
+		HANDLE mMapping;
+		HANDLE mEvents[2];
+		LONG mCursor[FRAMEBUS_STREAMS];
+		LONG mLastFrameNumber[FRAMEBUS_STREAMS];
+		long mMissed;
+	};
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "Kinect-win32-internal.h"
+#include "Kinect-Trace.h"
+#include "Kinect-Log.h"
 
 namespace Kinect
 {
@@ -20,14 +22,12 @@ namespace Kinect
 		mCurrentTransfer = 0;
 		mWriteHeadPosition = 0;
 
-        mDebugInfo = false;
-
 		for (int i = 0;i<mMaxTransfers;i++)
 		{
 			int	ret = usb_isochronous_setup_async(mDeviceHandle, &mTransfers[i], mEndPoint, mMaxActualPacketLength);
 			if (ret<0)
 			{
-				printf("error setting up isochronous request!");	
+				KINECT_LOG(LOG_ERROR, "error setting up isochronous request!\n");
 			};
 
 			mPacketBuffers[i] = new unsigned char[mTransferSize];
@@ -39,7 +39,7 @@ namespace Kinect
 			int ret = usb_submit_async(mTransfers[i], (char*)&mPacketBuffers[i][0], mTransferSize);
 			if (ret<0)
 			{
-				printf("error submitting isochronous request!");	
+				KINECT_LOG(LOG_ERROR, "error submitting isochronous request!\n");
 			};
 		};
 	};
@@ -111,8 +111,8 @@ namespace Kinect
 				}
 				else
 				{
-                    if(mDebugInfo)
-					    printf("frame dropped.. missing %d bytes!\n", mOutputBufferSize-mWriteHeadPosition);
+					KINECT_TRACE_COUNTER("usb.missing_bytes", mOutputBufferSize-mWriteHeadPosition);
+					KINECT_LOG(LOG_DEBUG, "frame dropped.. missing %d bytes!\n", mOutputBufferSize-mWriteHeadPosition);
 				};
 				return;
 			};
@@ -126,6 +126,7 @@ namespace Kinect
 		int RetVal = 0;
 		if (UsbStatus>0)
 		{
+			KINECT_TRACE_SCOPE("usb.reap");
 			RetVal = 1;
 			unsigned char *CurrentBuffer = &mPacketBuffers[mCurrentTransfer][0];
 			int PacketOffset = 0;
@@ -152,6 +153,8 @@ namespace Kinect
 				LeftOverBytes-= PacketOffset;				
 			};
 			
+			KINECT_TRACE_SCOPE("usb.process_packets");
+			int PacketCount = 0;
 			while (LeftOverBytes >0)
 			{
 				int CurrentPacketLength = __min(LeftOverBytes,mMaxActualPacketLength);
@@ -162,16 +165,17 @@ namespace Kinect
 					{
 						if (CurrentPacketLength == 960)
 						{
-							printf ("valid halve packet found!\n");
+							KINECT_LOG(LOG_WARNING, "valid halve packet found!\n");
 						}
 						else
 						{
-							printf ("incomplete packet of length %d found..\n", CurrentPacketLength);
+							KINECT_LOG(LOG_WARNING, "incomplete packet of length %d found..\n", CurrentPacketLength);
 						};
 					}
 					else
 					{
 						ProcessPacket(Header, &CurrentBuffer[PacketOffset+sizeof(KinectUSBFrameHeader)], __min(mMaxPacketLength,CurrentPacketLength)-sizeof(KinectUSBFrameHeader));
+						PacketCount++;
 					}
 				}
 				else
@@ -180,7 +184,8 @@ namespace Kinect
 				}
 				PacketOffset += CurrentPacketLength;
 				LeftOverBytes-= CurrentPacketLength;
-			};			
+			};
+			KINECT_TRACE_COUNTER("usb.packets", PacketCount);
 		}
 		else
 		{
@@ -199,7 +204,7 @@ namespace Kinect
 		int ret = usb_submit_async(mTransfers[mCurrentTransfer], (char*)&mPacketBuffers[mCurrentTransfer][0],  mTransferSize);
 		if( ret < 0 )
 		{
-			printf("error submitting async usb request: %s\n", usb_strerror());
+			KINECT_LOG(LOG_ERROR, "error submitting async usb request: %s\n", usb_strerror());
 			usb_cancel_async(mTransfers[mCurrentTransfer]);
 		}
 		mCurrentTransfer = (mCurrentTransfer + 1) % mMaxTransfers;
@@ -210,9 +215,9 @@ namespace Kinect
 	void KinectFrameInput::CheckSequence(KinectUSBFrameHeader *header)
 	{
 		unsigned char NewSequence = mCurrentSequence + 1;
-		if (header->mSequence != NewSequence && mDebugInfo)
+		if (header->mSequence != NewSequence)
 		{
-			printf("sequence lost: expected %02x, got %02x.\n", NewSequence, header->mSequence);
+			KINECT_LOG(LOG_DEBUG, "sequence lost: expected %02x, got %02x.\n", NewSequence, header->mSequence);
 		}
 		mCurrentSequence = header->mSequence;
 	};
@@ -0,0 +1,266 @@
+#include "Kinect-Log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+namespace Kinect
+{
+	volatile LONG gLogLevel = LOG_INFO;
+
+	enum
+	{
+		LOG_RECORDS = 64,			// pending messages per thread (further messages are dropped)
+		LOG_RECORD_SIZE = 512		// characters per message (longer messages are truncated)
+	};
+
+	struct LogRecord
+	{
+		LONG mSequence;
+		LONG mSuppressed;
+		char mText[LOG_RECORD_SIZE];
+	};
+
+	// Ring buffer of one thread; only the owning thread writes and only the writer thread reads.
+	struct LogBuffer
+	{
+		LogRecord mRecords[LOG_RECORDS];
+		volatile LONG mHead;		// messages written
+		volatile LONG mTail;		// messages printed
+		bool mInUse;
+	};
+
+	struct LogState
+	{
+		LogState()
+		{
+			InitializeCriticalSection(&mLock);
+			mTls = TLS_OUT_OF_INDEXES;
+			mThread = NULL;
+			mWake = NULL;
+			mStarted = 0;
+			mRateLimit = 10;
+			mRateWindow = 1000;
+			mSequence = 0;
+			mSuppressed = 0;
+			mDropped = 0;
+			mPasses = 0;
+		};
+
+		CRITICAL_SECTION mLock;
+		DWORD mTls;
+		HANDLE mThread;
+		HANDLE mWake;
+		volatile LONG mStarted;
+		volatile LONG mRateLimit;
+		volatile LONG mRateWindow;
+		volatile LONG mSequence;
+		volatile LONG mSuppressed;
+		volatile LONG mDropped;
+		volatile LONG mPasses;
+		std::vector<LogBuffer *> mBuffers;		// only ever grows (guarded by mLock)
+	};
+
+	static LogState gLog;
+
+	static bool LogRecordBefore(const LogRecord *a, const LogRecord *b)
+	{
+		return a->mSequence < b->mSequence;
+	};
+
+	// Print the pending messages of all threads in the order they were logged.
+	static void WriteLogRecords()
+	{
+		EnterCriticalSection(&gLog.mLock);
+		std::vector<LogBuffer *> buffers = gLog.mBuffers;
+		LeaveCriticalSection(&gLog.mLock);
+
+		std::vector<LONG> heads(buffers.size());
+		std::vector<const LogRecord *> records;
+		for (unsigned int i = 0; i < buffers.size(); i++)
+		{
+			heads[i] = buffers[i]->mHead;
+			for (LONG j = buffers[i]->mTail; j < heads[i]; j++) records.push_back(&buffers[i]->mRecords[j % LOG_RECORDS]);
+		}
+		if (records.empty()) return;
+
+		std::sort(records.begin(), records.end(), LogRecordBefore);
+		for (unsigned int i = 0; i < records.size(); i++)
+		{
+			if (records[i]->mSuppressed > 0) printf("(%d similar messages suppressed)\n", (int)records[i]->mSuppressed);
+			fputs(records[i]->mText, stdout);
+		}
+		fflush(stdout);
+
+		// Hand the printed records back to their threads.
+		for (unsigned int i = 0; i < buffers.size(); i++) buffers[i]->mTail = heads[i];
+	};
+
+	static DWORD WINAPI LogWriterThread(LPVOID lpParam)
+	{
+		for (;;)
+		{
+			WaitForSingleObject(gLog.mWake, 10);
+			WriteLogRecords();
+			InterlockedIncrement(&gLog.mPasses);
+		}
+		return 0;
+	};
+
+	static void StartLogWriter()
+	{
+		EnterCriticalSection(&gLog.mLock);
+		if (!gLog.mStarted)
+		{
+			gLog.mTls = TlsAlloc();
+			gLog.mWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+			DWORD tid;
+			if (gLog.mTls != TLS_OUT_OF_INDEXES && gLog.mWake != NULL)
+				gLog.mThread = CreateThread(NULL, 0, LogWriterThread, NULL, 0, &tid);
+			if (gLog.mThread != NULL)
+			{
+				SetThreadPriority(gLog.mThread, THREAD_PRIORITY_BELOW_NORMAL);
+				atexit(LogFlush);
+			}
+			InterlockedExchange(&gLog.mStarted, 1);
+		}
+		LeaveCriticalSection(&gLog.mLock);
+	};
+
+	static LogBuffer *AcquireLogBuffer()
+	{
+		LogBuffer *buffer = NULL;
+		EnterCriticalSection(&gLog.mLock);
+		for (unsigned int i = 0; i < gLog.mBuffers.size() && buffer == NULL; i++)
+		{
+			LogBuffer *b = gLog.mBuffers[i];
+			if (!b->mInUse && b->mTail == b->mHead) buffer = b;
+		}
+		if (buffer == NULL)
+		{
+			buffer = new LogBuffer;
+			buffer->mHead = 0;
+			buffer->mTail = 0;
+			gLog.mBuffers.push_back(buffer);
+		}
+		buffer->mInUse = true;
+		TlsSetValue(gLog.mTls, buffer);
+		LeaveCriticalSection(&gLog.mLock);
+		return buffer;
+	};
+
+	void SetLogLevel(LogLevel level)
+	{
+		InterlockedExchange(&gLogLevel, (LONG)level);
+	};
+
+	LogLevel GetLogLevel()
+	{
+		return (LogLevel)gLogLevel;
+	};
+
+	void SetLogRateLimit(int messages, int window_ms)
+	{
+		InterlockedExchange(&gLog.mRateLimit, (LONG)messages);
+		InterlockedExchange(&gLog.mRateWindow, (LONG)window_ms);
+	};
+
+	long GetLogSuppressedCount()
+	{
+		return gLog.mSuppressed;
+	};
+
+	long GetLogDroppedCount()
+	{
+		return gLog.mDropped;
+	};
+
+	void LogMessage(LogSite *site, LogLevel level, const char *format, ...)
+	{
+		if (level < gLogLevel) return;
+
+		// Start a new window once the current one has passed; beyond the limit, only count.
+		LONG suppressed = 0;
+		if (gLog.mRateLimit > 0)
+		{
+			LONG now = (LONG)GetTickCount();
+			LONG start = site->mWindowStart;
+			if ((DWORD)(now - start) >= (DWORD)gLog.mRateWindow && InterlockedCompareExchange(&site->mWindowStart, now, start) == start)
+				InterlockedExchange(&site->mCount, 0);
+			if (InterlockedIncrement(&site->mCount) > gLog.mRateLimit)
+			{
+				InterlockedIncrement(&site->mSuppressed);
+				InterlockedIncrement(&gLog.mSuppressed);
+				return;
+			}
+			suppressed = InterlockedExchange(&site->mSuppressed, 0);
+		}
+
+		if (!gLog.mStarted) StartLogWriter();
+
+		va_list args;
+		va_start(args, format);
+		if (gLog.mThread == NULL)
+		{
+			// No writer thread; print directly.
+			if (suppressed > 0) printf("(%d similar messages suppressed)\n", (int)suppressed);
+			vprintf(format, args);
+			va_end(args);
+			return;
+		}
+
+		LogBuffer *buffer = (LogBuffer *)TlsGetValue(gLog.mTls);
+		if (buffer == NULL) buffer = AcquireLogBuffer();
+		LONG head = buffer->mHead;
+		if (head - buffer->mTail >= LOG_RECORDS)
+		{
+			InterlockedIncrement(&gLog.mDropped);
+			InterlockedExchangeAdd(&site->mSuppressed, suppressed);
+			va_end(args);
+			return;
+		}
+
+		// Note: _vsnprintf does not terminate truncated messages.
+		LogRecord *record = &buffer->mRecords[head % LOG_RECORDS];
+		int length = _vsnprintf(record->mText, LOG_RECORD_SIZE - 1, format, args);
+		va_end(args);
+		if (length < 0 || length >= LOG_RECORD_SIZE - 1) strcpy(record->mText + LOG_RECORD_SIZE - 5, "...\n");
+		record->mSuppressed = suppressed;
+		record->mSequence = InterlockedIncrement(&gLog.mSequence);
+
+		// Publish the message (a volatile store has release semantics in Visual C++).
+		buffer->mHead = head + 1;
+	};
+
+	void LogFlush()
+	{
+		if (!gLog.mStarted || gLog.mThread == NULL) return;
+
+		// Wait for two passes of the writer, so that one pass started after this call.
+		LONG passes = gLog.mPasses;
+		while (gLog.mPasses - passes < 2)
+		{
+			// At process exit the DLL runs LogFlush after the writer thread has been terminated.
+			if (WaitForSingleObject(gLog.mThread, 0) != WAIT_TIMEOUT)
+			{
+				WriteLogRecords();
+				return;
+			}
+			SetEvent(gLog.mWake);
+			Sleep(1);
+		}
+	};
+
+	void LogThreadExit()
+	{
+		if (!gLog.mStarted || gLog.mTls == TLS_OUT_OF_INDEXES) return;
+		LogBuffer *buffer = (LogBuffer *)TlsGetValue(gLog.mTls);
+		if (buffer == NULL) return;
+		EnterCriticalSection(&gLog.mLock);
+		buffer->mInUse = false;
+		TlsSetValue(gLog.mTls, NULL);
+		LeaveCriticalSection(&gLog.mLock);
+	};
+};
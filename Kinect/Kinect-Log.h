@@ -0,0 +1,68 @@
+#ifndef KINECTLOG
+#define KINECTLOG
+
+#include <windows.h>
+#include "Kinect-Export.h"
+
+namespace Kinect
+{
+	// Asynchronous, rate-limited logging for the driver threads.
+	//
+	// A message is formatted into a ring buffer of the calling thread (no locks once the thread has
+	// a buffer) and written to the console by a background thread, so logging never blocks on a
+	// console write. Each call site prints at most a limited number of messages per time window
+	// (the number suppressed in between is reported with its next message), and messages below the
+	// log level are skipped before they are formatted. The log state lives in the Kinect DLL, so the
+	// level and rate limit set by the application apply to the driver in KinectCamera as well.
+
+	enum LogLevel
+	{
+		LOG_DEBUG,
+		LOG_INFO,
+		LOG_WARNING,
+		LOG_ERROR,
+		LOG_NONE
+	};
+
+	// Rate limiting state of one call site (see KINECT_LOG).
+	struct LogSite
+	{
+		volatile LONG mWindowStart;		// GetTickCount() at the start of the current window
+		volatile LONG mCount;			// messages in the current window
+		volatile LONG mSuppressed;		// messages suppressed since the last printed one
+	};
+
+	extern KINECT_DECL volatile LONG gLogLevel;
+
+	// Minimum level of the messages written (default LOG_INFO).
+	KINECT_DECL void SetLogLevel(LogLevel level);
+	KINECT_DECL LogLevel GetLogLevel();
+
+	// Number of messages each call site may print per window (default 10 per 1000 ms, 0 = unlimited).
+	KINECT_DECL void SetLogRateLimit(int messages, int window_ms);
+
+	// Number of messages suppressed by the rate limit, and dropped because a thread's buffer was full.
+	KINECT_DECL long GetLogSuppressedCount();
+	KINECT_DECL long GetLogDroppedCount();
+
+	// Log a message (use KINECT_LOG, which keeps the rate limiting state of the call site).
+	KINECT_DECL void LogMessage(LogSite *site, LogLevel level, const char *format, ...);
+
+	// Wait until every message logged so far is written.
+	KINECT_DECL void LogFlush();
+
+	// Release the calling thread's buffer for reuse by later threads (call before a thread that may
+	// have logged exits).
+	KINECT_DECL void LogThreadExit();
+};
+
+#define KINECT_LOG(level, ...) \
+	do { \
+		if ((level) >= ::Kinect::gLogLevel) \
+		{ \
+			static ::Kinect::LogSite kinectLogSite = { 0, 0, 0 }; \
+			::Kinect::LogMessage(&kinectLogSite, (level), __VA_ARGS__); \
+		} \
+	} while (0)
+
+#endif
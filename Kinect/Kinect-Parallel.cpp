@@ -0,0 +1,489 @@
+#include "Kinect-Parallel.h"
+#include "Kinect-Trace.h"
+#include "Kinect-Log.h"
+#include <deque>
+#include <vector>
+
+namespace Kinect
+{
+	// A queued task; mPending is the counter of the group waiting for it.
+	struct PoolItem
+	{
+		Task *mTask;
+		volatile LONG *mPending;
+	};
+
+	struct WorkQueue
+	{
+		WorkQueue() { InitializeCriticalSection(&mLock); };
+		~WorkQueue() { DeleteCriticalSection(&mLock); };
+
+		CRITICAL_SECTION mLock;
+		std::deque<PoolItem> mItems;
+	};
+
+	enum
+	{
+		POOL_MAX_WORKERS = MAXIMUM_WAIT_OBJECTS		// StopPool waits for all workers at once
+	};
+
+	struct ThreadPool
+	{
+		ThreadPool()
+		{
+			InitializeCriticalSection(&mLock);
+			mTls = TLS_OUT_OF_INDEXES;
+			mThreadCount = 0;
+			mAffinity = 0;
+			mWake = NULL;
+			mDone = NULL;
+			mQueueCount = 0;
+			mStarted = 0;
+			mWorkers = 0;
+			mStopping = 0;
+			mQueued = 0;
+			mSleeping = 0;
+			mWaiting = 0;
+		};
+
+		CRITICAL_SECTION mLock;			// guards the settings, starting and stopping
+		DWORD mTls;						// queue index of the current thread (0 = not a worker)
+		volatile LONG mThreadCount;
+		DWORD_PTR mAffinity;
+		HANDLE mWake;					// semaphore: tasks queued while workers sleep
+		HANDLE mDone;					// semaphore: a group finished or a task was queued while threads wait
+
+		// 0: tasks of threads outside the pool, 1..: one per worker. A queue is never deleted, so
+		// threads outside the pool may keep using the queues while the pool is stopped, and they run
+		// the tasks left in them themselves.
+		WorkQueue *mQueues[POOL_MAX_WORKERS + 1];
+		volatile LONG mQueueCount;
+
+		std::vector<HANDLE> mThreads;	// guarded by mLock
+		volatile LONG mStarted;
+		volatile LONG mWorkers;			// workers of the started pool
+		volatile LONG mStopping;
+		volatile LONG mQueued;			// tasks in all queues
+		volatile LONG mSleeping;		// workers waiting for mWake
+		volatile LONG mWaiting;			// threads waiting for mDone
+	};
+
+	static ThreadPool gPool;
+
+	int GetParallelThreadCount()
+	{
+		if (gPool.mThreadCount <= 0)
+		{
+			EnterCriticalSection(&gPool.mLock);
+			if (gPool.mThreadCount <= 0)
+			{
+				SYSTEM_INFO info;
+				GetSystemInfo(&info);
+				InterlockedExchange(&gPool.mThreadCount, (info.dwNumberOfProcessors > 0) ? (LONG)info.dwNumberOfProcessors : 1);
+			}
+			LeaveCriticalSection(&gPool.mLock);
+		}
+		return (int)gPool.mThreadCount;
+	};
+
+	static void StopPool();
+
+	void SetParallelThreadCount(int count)
+	{
+		EnterCriticalSection(&gPool.mLock);
+		StopPool();
+		InterlockedExchange(&gPool.mThreadCount, count);
+		LeaveCriticalSection(&gPool.mLock);
+	};
+
+	void SetParallelAffinity(DWORD_PTR mask)
+	{
+		EnterCriticalSection(&gPool.mLock);
+		StopPool();
+		gPool.mAffinity = mask;
+		LeaveCriticalSection(&gPool.mLock);
+	};
+
+	DWORD_PTR GetNumaNodeProcessors(int node)
+	{
+		ULONGLONG mask = 0;
+		if (node < 0 || node > 255 || !GetNumaNodeProcessorMask((UCHAR)node, &mask)) return 0;
+		return (DWORD_PTR)mask;
+	};
+
+	// Wake the threads waiting for tasks, so they check their groups again.
+	static void WakeWaitingThreads()
+	{
+		LONG waiting = gPool.mWaiting;
+		if (waiting > 0) ReleaseSemaphore(gPool.mDone, waiting, NULL);
+	};
+
+	// Count a task of a group as done. Only the pool is touched after the decrement: the waiting
+	// thread may return and free the counter as soon as it is 0.
+	static void FinishTask(volatile LONG *pending)
+	{
+		if (InterlockedDecrement(pending) == 0) WakeWaitingThreads();
+	};
+
+	// Take a task from queue: the newest one (from_back) or the oldest one. With a group, only its
+	// tasks are taken.
+	static bool TakeItem(WorkQueue *queue, volatile LONG *group, bool from_back, PoolItem *item)
+	{
+		bool found = false;
+		EnterCriticalSection(&queue->mLock);
+		int n = (int)queue->mItems.size();
+		for (int i = 0; i < n && !found; i++)
+		{
+			int j = from_back ? n - 1 - i : i;
+			if (group == NULL || queue->mItems[j].mPending == group)
+			{
+				*item = queue->mItems[j];
+				queue->mItems.erase(queue->mItems.begin() + j);
+				found = true;
+			}
+		}
+		LeaveCriticalSection(&queue->mLock);
+		if (found) InterlockedDecrement(&gPool.mQueued);
+		return found;
+	};
+
+	// Run a queued task (of group, if given): the newest of the own queue, or else the oldest of
+	// another queue. Returns false if there was none.
+	static bool RunQueuedTask(int self, volatile LONG *group)
+	{
+		if (gPool.mQueued == 0) return false;
+		PoolItem item;
+		int queues = (int)gPool.mQueueCount;
+		bool found = TakeItem(gPool.mQueues[self], group, true, &item);
+		for (int i = 1; i < queues && !found; i++) found = TakeItem(gPool.mQueues[(self + i) % queues], group, false, &item);
+		if (!found) return false;
+
+		item.mTask->Run();
+		FinishTask(item.mPending);
+		return true;
+	};
+
+	static DWORD WINAPI PoolWorkerThread(LPVOID lpParam)
+	{
+		int self = (int)(INT_PTR)lpParam;
+		TlsSetValue(gPool.mTls, lpParam);
+		while (!gPool.mStopping)
+		{
+			if (RunQueuedTask(self, NULL)) continue;
+
+			// Announce the sleep before checking the queues again, so a new task cannot be missed.
+			InterlockedIncrement(&gPool.mSleeping);
+			if (gPool.mQueued == 0 && !gPool.mStopping) WaitForSingleObject(gPool.mWake, INFINITE);
+			InterlockedDecrement(&gPool.mSleeping);
+		}
+		TraceThreadExit();
+		LogThreadExit();
+		return 0;
+	};
+
+	// Start the workers (once). Returns false if the pool has no workers.
+	static bool StartPool()
+	{
+		if (gPool.mStarted) return gPool.mWorkers > 0;
+
+		EnterCriticalSection(&gPool.mLock);
+		if (!gPool.mStarted)
+		{
+			int workers = GetParallelThreadCount() - 1;
+			if (workers > POOL_MAX_WORKERS) workers = POOL_MAX_WORKERS;
+			if (gPool.mTls == TLS_OUT_OF_INDEXES) gPool.mTls = TlsAlloc();
+			if (gPool.mWake == NULL) gPool.mWake = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+			if (gPool.mDone == NULL) gPool.mDone = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+			gPool.mStopping = 0;
+			if (gPool.mTls != TLS_OUT_OF_INDEXES && gPool.mWake != NULL && gPool.mDone != NULL)
+			{
+				// Create the missing queues first; a worker may steal from any of them as soon as it runs.
+				while (gPool.mQueueCount <= workers)
+				{
+					gPool.mQueues[gPool.mQueueCount] = new WorkQueue();
+					InterlockedIncrement(&gPool.mQueueCount);
+				}
+				int processor = 0;
+				for (int i = 1; i <= workers; i++)
+				{
+					DWORD tid;
+					HANDLE h = CreateThread(NULL, 0, PoolWorkerThread, (LPVOID)(INT_PTR)i, CREATE_SUSPENDED, &tid);
+					if (h == NULL) break;
+					if (gPool.mAffinity != 0)
+					{
+						// Spread the workers over the processors of the mask.
+						while (!((gPool.mAffinity >> processor) & 1)) processor = (processor + 1) % (8 * sizeof(DWORD_PTR));
+						SetThreadAffinityMask(h, gPool.mAffinity);
+						SetThreadIdealProcessor(h, processor);
+						processor = (processor + 1) % (8 * sizeof(DWORD_PTR));
+					}
+					gPool.mThreads.push_back(h);
+					ResumeThread(h);
+				}
+			}
+			InterlockedExchange(&gPool.mWorkers, (LONG)gPool.mThreads.size());
+			KINECT_LOG(LOG_DEBUG, "Started %d parallel worker threads.\n", (int)gPool.mThreads.size());
+			InterlockedExchange(&gPool.mStarted, 1);
+		}
+		LeaveCriticalSection(&gPool.mLock);
+		return gPool.mWorkers > 0;
+	};
+
+	// Stop the workers. The queues and semaphores are kept for the threads still using them.
+	static void StopPool()
+	{
+		EnterCriticalSection(&gPool.mLock);
+		if (gPool.mStarted)
+		{
+			InterlockedExchange(&gPool.mStopping, 1);
+			if (!gPool.mThreads.empty())
+			{
+				ReleaseSemaphore(gPool.mWake, (LONG)gPool.mThreads.size(), NULL);
+				WaitForMultipleObjects((DWORD)gPool.mThreads.size(), &gPool.mThreads[0], TRUE, INFINITE);
+				for (unsigned int i = 0; i < gPool.mThreads.size(); i++) CloseHandle(gPool.mThreads[i]);
+			}
+			gPool.mThreads.clear();
+			InterlockedExchange(&gPool.mWorkers, 0);
+			InterlockedExchange(&gPool.mStarted, 0);
+		}
+		LeaveCriticalSection(&gPool.mLock);
+	};
+
+	static int GetQueueIndex()
+	{
+		return (int)(INT_PTR)TlsGetValue(gPool.mTls);
+	};
+
+	// Queue a task for the pool, or run it right away if the pool has no workers.
+	static void SubmitTask(Task *task, volatile LONG *pending)
+	{
+		InterlockedIncrement(pending);
+		if (!StartPool())
+		{
+			task->Run();
+			FinishTask(pending);
+			return;
+		}
+
+		PoolItem item;
+		item.mTask = task;
+		item.mPending = pending;
+		WorkQueue *queue = gPool.mQueues[GetQueueIndex()];
+		EnterCriticalSection(&queue->mLock);
+		queue->mItems.push_back(item);
+		LeaveCriticalSection(&queue->mLock);
+
+		InterlockedIncrement(&gPool.mQueued);
+		if (gPool.mSleeping > 0) ReleaseSemaphore(gPool.mWake, 1, NULL);
+		WakeWaitingThreads();
+	};
+
+	// Wait until pending is 0, running the group's queued tasks meanwhile.
+	static void WaitForTasks(volatile LONG *pending)
+	{
+		while (*pending > 0)
+		{
+			if (RunQueuedTask(GetQueueIndex(), pending)) continue;
+
+			// The remaining tasks run on other threads. Announce the wait before checking the queues
+			// again, so a finished group or a new task cannot be missed.
+			InterlockedIncrement(&gPool.mWaiting);
+			if (!RunQueuedTask(GetQueueIndex(), pending) && *pending > 0) WaitForSingleObject(gPool.mDone, INFINITE);
+			InterlockedDecrement(&gPool.mWaiting);
+		}
+	};
+
+	TaskGroup::TaskGroup()
+	{
+		mPending = 0;
+	};
+
+	TaskGroup::~TaskGroup()
+	{
+		Wait();
+	};
+
+	void TaskGroup::Run(Task *task)
+	{
+		SubmitTask(task, &mPending);
+	};
+
+	void TaskGroup::Wait()
+	{
+		WaitForTasks(&mPending);
+	};
+
+	bool TaskGroup::IsDone()
+	{
+		return mPending == 0;
+	};
+
+	// A task of a graph; starts the tasks depending on it once it is done.
+	class TaskGraph::Node : public Task
+	{
+	public:
+		Node(Task *task)
+		{
+			mTask = task;
+			mGroup = NULL;
+			mDependencies = 0;
+			mWaiting = 0;
+		};
+
+		virtual void Run()
+		{
+			mTask->Run();
+			for (unsigned int i = 0; i < mSuccessors.size(); i++)
+			{
+				Node *next = mSuccessors[i];
+				if (InterlockedDecrement(&next->mWaiting) == 0) mGroup->Run(next);
+			}
+		};
+
+		Task *mTask;
+		TaskGroup *mGroup;
+		std::vector<Node *> mSuccessors;
+		LONG mDependencies;
+		volatile LONG mWaiting;		// dependencies not done yet in the current run
+	};
+
+	TaskGraph::TaskGraph()
+	{
+	};
+
+	TaskGraph::~TaskGraph()
+	{
+		for (unsigned int i = 0; i < mNodes.size(); i++) delete mNodes[i];
+	};
+
+	int TaskGraph::Add(Task *task)
+	{
+		mNodes.push_back(new Node(task));
+		return (int)mNodes.size() - 1;
+	};
+
+	void TaskGraph::AddDependency(int before, int after)
+	{
+		mNodes[before]->mSuccessors.push_back(mNodes[after]);
+		mNodes[after]->mDependencies++;
+	};
+
+	void TaskGraph::Run()
+	{
+		TaskGroup group;
+		for (unsigned int i = 0; i < mNodes.size(); i++)
+		{
+			mNodes[i]->mGroup = &group;
+			mNodes[i]->mWaiting = mNodes[i]->mDependencies;
+		}
+		for (unsigned int i = 0; i < mNodes.size(); i++)
+		{
+			if (mNodes[i]->mDependencies == 0) group.Run(mNodes[i]);
+		}
+		group.Wait();
+	};
+
+	// Shared state of one ParallelFor call; chunks are claimed with an atomic counter.
+	struct ParallelForJob
+	{
+		ParallelLoopBody *mBody;
+		int mBegin;
+		int mEnd;
+		int mChunk;
+		volatile LONG mNextChunk;
+	};
+
+	static void RunParallelForChunks(ParallelForJob *job)
+	{
+		KINECT_TRACE_SCOPE("parallel.for");
+		for (;;)
+		{
+			LONG chunk = InterlockedIncrement(&job->mNextChunk) - 1;
+			int begin = job->mBegin + (int)chunk * job->mChunk;
+			if (begin >= job->mEnd) return;
+			int end = begin + job->mChunk;
+			if (end > job->mEnd) end = job->mEnd;
+			job->mBody->Run(begin, end);
+		}
+	};
+
+	// Helper of a ParallelFor call on a pool thread (returns at once if all chunks are claimed).
+	class ParallelForTask : public Task
+	{
+	public:
+		ParallelForTask(ParallelForJob *job) { mJob = job; };
+		virtual void Run() { RunParallelForChunks(mJob); };
+
+	private:
+		ParallelForJob *mJob;
+	};
+
+	void ParallelFor(int begin, int end, ParallelLoopBody &body, int grain)
+	{
+		int count = end - begin;
+		if (count <= 0) return;
+		if (grain < 1) grain = 1;
+
+		// Use a few chunks per thread so uneven iterations still balance.
+		int threads = GetParallelThreadCount();
+		int chunk = count / (threads * 4);
+		if (chunk < grain) chunk = grain;
+		int chunks = (count + chunk - 1) / chunk;
+		if (threads > chunks) threads = chunks;
+		if (threads <= 1 || !StartPool())
+		{
+			body.Run(begin, end);
+			return;
+		}
+
+		ParallelForJob job;
+		job.mBody = &body;
+		job.mBegin = begin;
+		job.mEnd = end;
+		job.mChunk = chunk;
+		job.mNextChunk = 0;
+
+		// Helpers not started by the time the caller is done are run (and return) in WaitForTasks.
+		ParallelForTask helper(&job);
+		volatile LONG pending = 0;
+		for (int i = 1; i < threads; i++) SubmitTask(&helper, &pending);
+		RunParallelForChunks(&job);
+		WaitForTasks(&pending);
+	};
+
+	AsyncTask::AsyncTask()
+	{
+		mThread = NULL;
+	};
+
+	AsyncTask::~AsyncTask()
+	{
+		Wait();
+	};
+
+	DWORD WINAPI AsyncTask::ThreadProc(LPVOID lpParam)
+	{
+		((AsyncTask *)lpParam)->Run();
+		TraceThreadExit();
+		LogThreadExit();
+		return 0;
+	};
+
+	void AsyncTask::Start()
+	{
+		if (mThread != NULL) return;
+		DWORD tid;
+		mThread = CreateThread(NULL, 0, ThreadProc, this, 0, &tid);
+
+		// Fall back to running inline if no thread could be created.
+		if (mThread == NULL) Run();
+	};
+
+	void AsyncTask::Wait()
+	{
+		if (mThread == NULL) return;
+		WaitForSingleObject(mThread, INFINITE);
+		CloseHandle(mThread);
+		mThread = NULL;
+	};
+};
@@ -0,0 +1,112 @@
+#ifndef KINECTPARALLEL
+#define KINECTPARALLEL
+
+#include <windows.h>
+#include <vector>
+#include "Kinect-Export.h"
+
+namespace Kinect
+{
+	// Parallel work runs on one shared work-stealing thread pool.
+	//
+	// The pool has GetParallelThreadCount() - 1 worker threads (the thread waiting for the work
+	// takes part), so the thread count caps the cores used by all the parallel work of the process,
+	// e.g. of several cameras. Each worker keeps its own queue of tasks (newest first); an idle
+	// worker steals the oldest task of another queue. A thread waiting for its tasks runs those of
+	// them still queued itself, so tasks may wait for nested work without deadlocks.
+
+	// Body of a parallel loop. Run() is called concurrently with disjoint [begin, end) ranges.
+	class KINECT_DECL ParallelLoopBody
+	{
+	public:
+		virtual ~ParallelLoopBody(){};
+		virtual void Run(int begin, int end) = 0;
+	};
+
+	// Number of threads used for parallel work (defaults to the number of processors).
+	// Note: Set the count while no parallel work runs; the pool is restarted with the new count.
+	KINECT_DECL int GetParallelThreadCount();
+	KINECT_DECL void SetParallelThreadCount(int count);
+
+	// Restrict the pool's worker threads to the processors of mask (0 = any processor); the
+	// workers are spread over the processors of the mask.
+	KINECT_DECL void SetParallelAffinity(DWORD_PTR mask);
+
+	// Processors of a NUMA node (0 if the node does not exist), e.g. for SetParallelAffinity().
+	KINECT_DECL DWORD_PTR GetNumaNodeProcessors(int node);
+
+	// Run body over [begin, end) split into chunks of at least grain iterations.
+	// The calling thread takes part in the loop; returns once every chunk is done.
+	KINECT_DECL void ParallelFor(int begin, int end, ParallelLoopBody &body, int grain = 1);
+
+	// A unit of work run on the thread pool (see TaskGroup and TaskGraph).
+	class KINECT_DECL Task
+	{
+	public:
+		virtual ~Task(){};
+		virtual void Run() = 0;
+	};
+
+	// Tasks run concurrently on the pool. Wait() returns once every task added so far is done.
+	// Note: A task must stay alive until Wait() returns; the destructor waits.
+	class KINECT_DECL TaskGroup
+	{
+	public:
+		TaskGroup();
+		~TaskGroup();
+
+		void Run(Task *task);
+		void Wait();
+
+		// True once every task added so far is done (without waiting).
+		// Note: Without worker threads (a thread count of 1), queued tasks only run in Wait().
+		bool IsDone();
+
+	private:
+		volatile LONG mPending;
+	};
+
+	// Tasks with dependencies: a task starts once all the tasks it depends on are done, tasks
+	// without a dependency between them run concurrently.
+	class KINECT_DECL TaskGraph
+	{
+	public:
+		TaskGraph();
+		~TaskGraph();
+
+		// Add a task (alive until Run() returns); returns its index.
+		int Add(Task *task);
+
+		// Let the task after start only once the task before is done.
+		void AddDependency(int before, int after);
+
+		// Run all tasks; returns once every task is done. The graph may be run again.
+		void Run();
+
+	private:
+		class Node;
+		std::vector<Node *> mNodes;
+	};
+
+	// A unit of work executed on its own thread, for long-running or blocking work that should
+	// not occupy a pool thread (e.g. a writer thread waiting for work).
+	// Note: Call Wait() before a derived task is destroyed.
+	class KINECT_DECL AsyncTask
+	{
+	public:
+		AsyncTask();
+		virtual ~AsyncTask();
+
+		void Start();
+		void Wait();
+
+		virtual void Run() = 0;
+
+	private:
+		static DWORD WINAPI ThreadProc(LPVOID lpParam);
+
+		HANDLE mThread;
+	};
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "Kinect-Trace.h"
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+namespace Kinect
+{
+	volatile LONG gTraceEnabled = 0;
+
+	enum TraceEventType
+	{
+		TRACE_ZONE,
+		TRACE_COUNTER
+	};
+
+	struct TraceEvent
+	{
+		const char *mName;
+		LONGLONG mStart;
+		union
+		{
+			LONGLONG mEnd;		// zones
+			double mValue;		// counters
+		};
+		DWORD mThreadId;
+		int mType;
+	};
+
+	// Ring buffer of one thread; only the owning thread writes, the exporter reads.
+	struct TraceBuffer
+	{
+		TraceEvent *mEvents;
+		ULONG mCapacity;			// a power of two, so the slot index stays continuous when mHead wraps
+		volatile ULONG mHead;		// number of events written, modulo 2^32 (the newest mCapacity are kept)
+		volatile LONG mFull;		// set once every slot has been written
+		DWORD mThreadId;
+		bool mInUse;
+	};
+
+	// Buffers and thread names (guarded by mLock; the record path only takes it to get a buffer).
+	struct TraceRegistry
+	{
+		TraceRegistry()
+		{
+			InitializeCriticalSection(&mLock);
+			mTls = TLS_OUT_OF_INDEXES;
+			mCapacity = 65536;
+			mStart = 0;
+			mFrequency = 1;
+		};
+
+		CRITICAL_SECTION mLock;
+		DWORD mTls;
+		ULONG mCapacity;
+		LONGLONG mStart;
+		LONGLONG mFrequency;
+		std::vector<TraceBuffer *> mBuffers;
+		std::vector<std::pair<DWORD, const char *> > mThreadNames;
+	};
+
+	static TraceRegistry gTrace;
+
+	static TraceBuffer *AcquireTraceBuffer()
+	{
+		TraceBuffer *buffer = NULL;
+		EnterCriticalSection(&gTrace.mLock);
+		for (unsigned int i = 0; i < gTrace.mBuffers.size() && buffer == NULL; i++)
+		{
+			if (!gTrace.mBuffers[i]->mInUse) buffer = gTrace.mBuffers[i];
+		}
+		if (buffer == NULL)
+		{
+			buffer = new TraceBuffer;
+			buffer->mCapacity = gTrace.mCapacity;
+			buffer->mEvents = new TraceEvent[buffer->mCapacity];
+			buffer->mHead = 0;
+			buffer->mFull = 0;
+			gTrace.mBuffers.push_back(buffer);
+		}
+		buffer->mThreadId = GetCurrentThreadId();
+		buffer->mInUse = true;
+		TlsSetValue(gTrace.mTls, buffer);
+		LeaveCriticalSection(&gTrace.mLock);
+		return buffer;
+	};
+
+	static TraceEvent *BeginTraceEvent(TraceBuffer *&buffer)
+	{
+		buffer = (TraceBuffer *)TlsGetValue(gTrace.mTls);
+		if (buffer == NULL) buffer = AcquireTraceBuffer();
+		TraceEvent *e = &buffer->mEvents[buffer->mHead & (buffer->mCapacity - 1)];
+		e->mThreadId = buffer->mThreadId;
+		return e;
+	};
+
+	static void EndTraceEvent(TraceBuffer *buffer)
+	{
+		// Publish the event (a volatile store has release semantics in Visual C++).
+		ULONG head = buffer->mHead + 1;
+		if ((head & (buffer->mCapacity - 1)) == 0) buffer->mFull = 1;
+		buffer->mHead = head;
+	};
+
+	void TraceStart(int events_per_thread)
+	{
+		EnterCriticalSection(&gTrace.mLock);
+		if (gTrace.mTls == TLS_OUT_OF_INDEXES) gTrace.mTls = TlsAlloc();
+		if (events_per_thread > 0)
+		{
+			// Round up to a power of two (at most 2^30 events).
+			ULONG capacity = 1;
+			while (capacity < (ULONG)events_per_thread && capacity < (1UL << 30)) capacity <<= 1;
+			gTrace.mCapacity = capacity;
+		}
+		LARGE_INTEGER frequency, now;
+		QueryPerformanceFrequency(&frequency);
+		QueryPerformanceCounter(&now);
+		gTrace.mFrequency = frequency.QuadPart;
+		gTrace.mStart = now.QuadPart;
+		LeaveCriticalSection(&gTrace.mLock);
+
+		if (gTrace.mTls == TLS_OUT_OF_INDEXES)
+		{
+			printf("ERROR: Cannot allocate thread local storage for tracing!\n");
+			return;
+		}
+		InterlockedExchange(&gTraceEnabled, 1);
+	};
+
+	void TraceStop()
+	{
+		InterlockedExchange(&gTraceEnabled, 0);
+	};
+
+	void TraceSetThreadName(const char *name)
+	{
+		DWORD id = GetCurrentThreadId();
+		EnterCriticalSection(&gTrace.mLock);
+		unsigned int i = 0;
+		while (i < gTrace.mThreadNames.size() && gTrace.mThreadNames[i].first != id) i++;
+		if (i < gTrace.mThreadNames.size())
+			gTrace.mThreadNames[i].second = name;
+		else
+			gTrace.mThreadNames.push_back(std::make_pair(id, name));
+		LeaveCriticalSection(&gTrace.mLock);
+	};
+
+	void TraceThreadExit()
+	{
+		if (gTrace.mTls == TLS_OUT_OF_INDEXES) return;
+		TraceBuffer *buffer = (TraceBuffer *)TlsGetValue(gTrace.mTls);
+		if (buffer == NULL) return;
+		EnterCriticalSection(&gTrace.mLock);
+		buffer->mInUse = false;
+		TlsSetValue(gTrace.mTls, NULL);
+		LeaveCriticalSection(&gTrace.mLock);
+	};
+
+	void TraceZone(const char *name, LONGLONG start)
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		TraceBuffer *buffer;
+		TraceEvent *e = BeginTraceEvent(buffer);
+		e->mName = name;
+		e->mStart = start;
+		e->mEnd = now.QuadPart;
+		e->mType = TRACE_ZONE;
+		EndTraceEvent(buffer);
+	};
+
+	void TraceCounter(const char *name, double value)
+	{
+		LARGE_INTEGER now;
+		QueryPerformanceCounter(&now);
+		TraceBuffer *buffer;
+		TraceEvent *e = BeginTraceEvent(buffer);
+		e->mName = name;
+		e->mStart = now.QuadPart;
+		e->mValue = value;
+		e->mType = TRACE_COUNTER;
+		EndTraceEvent(buffer);
+	};
+
+	static bool TraceEventBefore(const TraceEvent &a, const TraceEvent &b)
+	{
+		return a.mStart < b.mStart;
+	};
+
+	// Write a name as a JSON string; with category set, only the part before the first '.'.
+	static void WriteTraceName(FILE *f, const char *name, bool category)
+	{
+		fputc('"', f);
+		for (const char *c = name; *c; c++)
+		{
+			if (category && *c == '.') break;
+			if (*c == '"' || *c == '\\') fputc('\\', f);
+			if ((unsigned char)*c >= 0x20) fputc(*c, f);
+		}
+		fputc('"', f);
+	};
+
+	bool TraceExport(const char *filename)
+	{
+		// Copy the events recorded since TraceStart. Events written while a buffer is copied may
+		// overwrite the oldest copied ones (the slot being written is the oldest), so those are dropped.
+		std::vector<TraceEvent> events;
+		std::vector<std::pair<DWORD, const char *> > names;
+		EnterCriticalSection(&gTrace.mLock);
+		LONGLONG start = gTrace.mStart;
+		double scale = 1.0e6 / (double)gTrace.mFrequency;
+		for (unsigned int i = 0; i < gTrace.mBuffers.size(); i++)
+		{
+			TraceBuffer *buffer = gTrace.mBuffers[i];
+			// The counters wrap at 2^32, so only their (unsigned) differences are used.
+			ULONG mask = buffer->mCapacity - 1;
+			ULONG head = buffer->mHead;
+			ULONG count = buffer->mFull ? buffer->mCapacity : head;
+			ULONG first = head - count;
+			size_t offset = events.size();
+			for (ULONG j = 0; j < count; j++) events.push_back(buffer->mEvents[(first + j) & mask]);
+
+			// Events written meanwhile (plus the one being written) replaced the oldest slots,
+			// once the empty ones were used up.
+			LONGLONG written = (LONGLONG)(ULONG)(buffer->mHead - head) + 1;
+			LONGLONG overwritten = written - (LONGLONG)(buffer->mCapacity - count);
+			if (overwritten > 0)
+			{
+				size_t dropped = (size_t)std::min(overwritten, (LONGLONG)count);
+				events.erase(events.begin() + offset, events.begin() + offset + dropped);
+			}
+		}
+		names = gTrace.mThreadNames;
+		LeaveCriticalSection(&gTrace.mLock);
+		std::sort(events.begin(), events.end(), TraceEventBefore);
+
+		FILE *f = fopen(filename, "w");
+		if (f == NULL) return false;
+
+		DWORD pid = GetCurrentProcessId();
+		fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"Kinect calibration\"}}", pid);
+		for (unsigned int i = 0; i < names.size(); i++)
+		{
+			fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":", pid, names[i].first);
+			WriteTraceName(f, names[i].second, false);
+			fprintf(f, "}}");
+		}
+		for (unsigned int i = 0; i < events.size(); i++)
+		{
+			const TraceEvent &e = events[i];
+			if (e.mStart < start) continue;
+			fprintf(f, ",\n{\"name\":");
+			WriteTraceName(f, e.mName, false);
+			fprintf(f, ",\"cat\":");
+			WriteTraceName(f, e.mName, true);
+			if (e.mType == TRACE_ZONE)
+			{
+				fprintf(f, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}",
+					(double)(e.mStart - start) * scale, (double)(e.mEnd - e.mStart) * scale, pid, e.mThreadId);
+			}
+			else
+			{
+				fprintf(f, ",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"value\":%g}}",
+					(double)(e.mStart - start) * scale, pid, e.mThreadId, e.mValue);
+			}
+		}
+		fprintf(f, "\n]}\n");
+		bool ok = (ferror(f) == 0);
+		fclose(f);
+		return ok;
+	};
+};
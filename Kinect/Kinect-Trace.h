@@ -0,0 +1,85 @@
+#ifndef KINECTTRACE
+#define KINECTTRACE
+
+#include <windows.h>
+#include "Kinect-Export.h"
+
+namespace Kinect
+{
+	// Hot-path tracing with scoped zones and counters.
+	//
+	// Every thread records into its own ring buffer (no locks once the thread has a buffer), keeping
+	// its newest events. The events are exported as Chrome trace JSON, which chrome://tracing and
+	// ui.perfetto.dev show as a flame chart per thread. While tracing is stopped, a zone costs a load
+	// and a branch; define KINECT_NO_TRACE to compile the zones and counters out altogether. The
+	// trace lives in the Kinect DLL, so one trace holds the events of all modules of the process
+	// (the driver threads of KinectCamera included).
+	//
+	// Note: Names must be string literals (only the pointer is recorded). The part of a name before
+	//       the first '.' is its category (e.g. "usb" for "usb.reap").
+
+	extern KINECT_DECL volatile LONG gTraceEnabled;
+
+	inline bool IsTraceEnabled()
+	{
+		return gTraceEnabled != 0;
+	};
+
+	// Start recording; events recorded before are dropped. Threads that get a buffer afterwards keep
+	// their newest events_per_thread events (rounded up to a power of two).
+	KINECT_DECL void TraceStart(int events_per_thread = 65536);
+	KINECT_DECL void TraceStop();
+
+	// Write the events recorded since TraceStart to a Chrome trace JSON file (may be called while
+	// recording). Returns false if the file cannot be written.
+	KINECT_DECL bool TraceExport(const char *filename);
+
+	// Name the calling thread in exported traces (name must be a string literal).
+	KINECT_DECL void TraceSetThreadName(const char *name);
+
+	// Release the calling thread's buffer for reuse by later threads. Call before a thread that may
+	// have recorded events exits (the events stay in the buffer until they are overwritten).
+	KINECT_DECL void TraceThreadExit();
+
+	// Record a zone that started at start (a QueryPerformanceCounter value) and ends now.
+	KINECT_DECL void TraceZone(const char *name, LONGLONG start);
+
+	// Record the value of a counter (shown as a graph).
+	KINECT_DECL void TraceCounter(const char *name, double value);
+
+	// Records a zone from construction to destruction (if tracing was enabled at construction).
+	class TraceScope
+	{
+	public:
+		TraceScope(const char *name)
+		{
+			mName = NULL;
+			if (gTraceEnabled)
+			{
+				mName = name;
+				QueryPerformanceCounter(&mStart);
+			};
+		};
+
+		~TraceScope()
+		{
+			if (mName) TraceZone(mName, mStart.QuadPart);
+		};
+
+	private:
+		const char *mName;
+		LARGE_INTEGER mStart;
+	};
+};
+
+#ifndef KINECT_NO_TRACE
+	#define KINECT_TRACE_CONCAT2(a, b) a##b
+	#define KINECT_TRACE_CONCAT(a, b) KINECT_TRACE_CONCAT2(a, b)
+	#define KINECT_TRACE_SCOPE(name) ::Kinect::TraceScope KINECT_TRACE_CONCAT(traceScope, __LINE__)(name)
+	#define KINECT_TRACE_COUNTER(name, value) do { if (::Kinect::gTraceEnabled) ::Kinect::TraceCounter(name, (double)(value)); } while (0)
+#else
+	#define KINECT_TRACE_SCOPE(name)
+	#define KINECT_TRACE_COUNTER(name, value) do { } while (0)
+#endif
+
+#endif
@@ -1,4 +1,6 @@
 #include "Kinect-Utility.h"
+#include "Kinect-Parallel.h"
+#include <string.h>
 
 namespace Kinect
 {
@@ -17,6 +19,133 @@ namespace Kinect
 		return 100.0f/(-0.00307f * (float)Depth + 3.33f);
 	};
 
+	// Unpack a band of depth values; begin is a multiple of 8 (a whole number of bytes in).
+	static void UnpackDepthBand(const unsigned char *packed, unsigned short *depth, int begin, int end)
+	{
+		int bitshift = 0;
+		for (int i=begin; i<end; i++) 
+		{
+			int idx = (i*11)/8;
+			unsigned int word = (packed[idx]<<16) | (packed[idx+1]<<8) | packed[idx+2];
+			depth[i] = (unsigned short)((word >> (13-bitshift)) & 0x7ff);
+			bitshift = (bitshift + 11) % 8;
+		}
+	};
+
+	// Unpacks bands of 8-value groups.
+	class UnpackDepthBody : public ParallelLoopBody
+	{
+	public:
+		UnpackDepthBody(const unsigned char *packed, unsigned short *depth, int count)
+		{
+			mPacked = packed;
+			mDepth = depth;
+			mCount = count;
+		};
+
+		virtual void Run(int begin, int end)
+		{
+			UnpackDepthBand(mPacked, mDepth, begin*8, (end*8 < mCount) ? end*8 : mCount);
+		};
+
+	private:
+		const unsigned char *mPacked;
+		unsigned short *mDepth;
+		int mCount;
+	};
+
+	void Kinect_UnpackDepth(const unsigned char *packed, unsigned short *depth, int count)
+	{
+		// Every group of 8 values starts on a byte, so groups unpack independently (a row of 640
+		// values is 80 groups).
+		UnpackDepthBody body(packed, depth, count);
+		ParallelFor(0, (count + 7)/8, body, 80*32);
+	};
+
+	// Interpolate the rows [begin, end) of a Bayer frame.
+	static void DemosaicColorRows(const unsigned char *bayer, unsigned char *rgb, int begin, int end)
+	{
+		for (int y=begin; y<end; y++) 
+		{
+			for (int x=0; x<640; x++) 
+			{
+				int i = y*640+x;
+				if (x&1) 
+				{
+					if (y&1) 
+					{
+						rgb[3*i+1] = bayer[i];
+						rgb[3*i+4] = bayer[i];
+					} 
+					else 
+					{
+						rgb[3*i] = bayer[i];
+						rgb[3*i+3] = bayer[i];
+						rgb[3*(i-640)] = bayer[i];
+						rgb[3*(i-640)+3] = bayer[i];
+					}
+				} 
+				else 
+				{
+					if (y&1) 
+					{
+						rgb[3*i+2] = bayer[i];
+						rgb[3*i-1] = bayer[i];
+						rgb[3*(i+640)+2] = bayer[i];
+						rgb[3*(i+640)-1] = bayer[i];
+					}
+					else 
+					{
+						rgb[3*i+1] = bayer[i];
+						rgb[3*i-2] = bayer[i];
+					}
+				}
+			}
+		}
+	};
+
+	// Interpolates bands of row pairs (an odd row and the even row below it).
+	class DemosaicColorBody : public ParallelLoopBody
+	{
+	public:
+		DemosaicColorBody(const unsigned char *bayer, unsigned char *rgb)
+		{
+			mBayer = bayer;
+			mRgb = rgb;
+		};
+
+		virtual void Run(int begin, int end)
+		{
+			DemosaicColorRows(mBayer, mRgb, 1 + 2*begin, 1 + 2*end);
+		};
+
+	private:
+		const unsigned char *mBayer;
+		unsigned char *mRgb;
+	};
+
+	void Kinect_DemosaicColor(const unsigned char *bayer, unsigned char *rgb)
+	{
+		// A row also writes into its neighbors (an odd row the blue values of the row below and of
+		// the last pixel above, an even row the red values of the row above and the green value of
+		// the last pixel above), but only into bytes no row outside its pair writes, so the pairs
+		// are interpolated concurrently.
+		DemosaicColorBody body(bayer, rgb);
+		ParallelFor(0, 239, body, 16);
+
+		// Rows 0 and 479 are not interpolated, and the edge pixels of a row get values of the
+		// opposite edge or none; repeat their neighbors, so every byte is written (the frame bus
+		// decodes into reused slots).
+		for (int y=1; y<479; y++)
+		{
+			unsigned char *row = rgb + y*640*3;
+			memcpy(row, row + 3, 3);
+			memcpy(row + 639*3, row + 638*3, 3);
+		}
+		memcpy(rgb, rgb + 640*3, 640*3);
+		memcpy(rgb + 479*640*3, rgb + 478*640*3, 640*3);
+	};
+
 	void KinectDepthToWorld(V3<float> &v)
 	{
 		KinectDepthToWorld(v.x,v.y,v.z);
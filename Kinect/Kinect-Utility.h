@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Kinect-win32.h"
+#include "Kinect-Export.h"
 
 namespace Kinect
 {
@@ -8,12 +9,12 @@ namespace Kinect
 	
 	float const Kinect_MinDistance = -10;
 	float const Kinect_DepthScaleFactor = .0021f;
-	extern float Kinect_ColorScaleFactor;
-	extern double Kinect_rgbxoffset;
-	extern double Kinect_rgbyoffset;
+	extern KINECT_DECL float Kinect_ColorScaleFactor;
+	extern KINECT_DECL double Kinect_rgbxoffset;
+	extern KINECT_DECL double Kinect_rgbyoffset;
 	
 
-	class KinectFrameHelper
+	class KINECT_DECL KinectFrameHelper
 	{
 	public:
 		KinectFrameHelper(Kinect *inKinect);
@@ -113,10 +114,18 @@ namespace Kinect
 	typedef Rect<unsigned char> Rectub;
 	typedef Box<unsigned char> Boxub;
 	
-	void KinectDepthToWorld(float &x, float &y, float &z);
-	void KinectWorldToRGBSpace(float &x, float &y, float z);
-	void KinectDepthToWorld(V3<float> &v);
+	KINECT_DECL void KinectDepthToWorld(float &x, float &y, float &z);
+	KINECT_DECL void KinectWorldToRGBSpace(float &x, float &y, float z);
+	KINECT_DECL void KinectDepthToWorld(V3<float> &v);
 	
-	float Kinect_DepthValueToZ(unsigned short Depth);
-	bool Kinect_IsDepthValid(unsigned short Depth);
+	KINECT_DECL float Kinect_DepthValueToZ(unsigned short Depth);
+	KINECT_DECL bool Kinect_IsDepthValid(unsigned short Depth);
+
+	// Unpack count 11-bit depth values (packed most significant bit first, as sent by the device).
+	// Note: Reads up to 2 bytes past the packed data.
+	KINECT_DECL void Kinect_UnpackDepth(const unsigned char *packed, unsigned short *depth, int count);
+
+	// Interpolate a raw 640x480 Bayer frame (as sent by the device) into an RGB frame (every pixel
+	// is written; the border repeats its inner neighbors).
+	KINECT_DECL void Kinect_DemosaicColor(const unsigned char *bayer, unsigned char *rgb);
 };
\ No newline at end of file
@@ -85,8 +85,6 @@ namespace Kinect
 		int mOutputBufferSize;
 		void **mTransfers;
 		unsigned char **mPacketBuffers;
-
-        bool mDebugInfo;
 	};
 
 	class KinectInternalData: public KinectFrameInputCallbacks
@@ -126,8 +124,6 @@ namespace Kinect
 		KinectFrameInput *mDepthInput;
 		KinectFrameInput *mRGBInput;
 
-        bool mDebugInfo;
-
 		void OpenDevice(usb_device_t *dev,usb_device_t *motordev);
 
 		void cams_init();
@@ -1,5 +1,7 @@
 #include "Kinect-win32.h"
 #include "Kinect-win32-internal.h"
+#include "Kinect-Utility.h"
+#include "Kinect-Trace.h"
 
 #include<algorithm>
 
@@ -116,6 +118,7 @@ namespace Kinect
 
 	void Kinect::DepthReceived()
 	{		
+		KINECT_TRACE_SCOPE("kinect.dispatch_depth");
 		EnterCriticalSection(&mListenersLock);
 		for (unsigned int i=0;i<mListeners.size();i++) mListeners[i]->DepthReceived(this);
 		LeaveCriticalSection(&mListenersLock);
@@ -123,6 +126,7 @@ namespace Kinect
 
 	void Kinect::ColorReceived()
 	{	
+		KINECT_TRACE_SCOPE("kinect.dispatch_color");
 		EnterCriticalSection(&mListenersLock);
 		for (unsigned int i=0;i<mListeners.size();i++) mListeners[i]->ColorReceived(this);
 		LeaveCriticalSection(&mListenersLock);
@@ -152,51 +156,17 @@ namespace Kinect
 
 	void Kinect::ParseColorBuffer()
 	{
+		KINECT_TRACE_SCOPE("kinect.demosaic");
 		KinectInternalData *KID = (KinectInternalData *) mInternalData;
 
 		KID->LockRGB();
-		for (int y=1; y<479; y++) 
-		{
-			for (int x=0; x<640; x++) 
-			{
-				int i = y*640+x;
-				if (x&1) 
-				{
-					if (y&1) 
-					{
-						mColorBuffer[3*i+1] = KID->rgb_buf2[i];
-						mColorBuffer[3*i+4] = KID->rgb_buf2[i];
-					} 
-					else 
-					{
-						mColorBuffer[3*i] = KID->rgb_buf2[i];
-						mColorBuffer[3*i+3] = KID->rgb_buf2[i];
-						mColorBuffer[3*(i-640)] = KID->rgb_buf2[i];
-						mColorBuffer[3*(i-640)+3] = KID->rgb_buf2[i];
-					}
-				} 
-				else 
-				{
-					if (y&1) 
-					{
-						mColorBuffer[3*i+2] = KID->rgb_buf2[i];
-						mColorBuffer[3*i-1] = KID->rgb_buf2[i];
-						mColorBuffer[3*(i+640)+2] = KID->rgb_buf2[i];
-						mColorBuffer[3*(i+640)-1] = KID->rgb_buf2[i];
-					}
-					else 
-					{
-						mColorBuffer[3*i+1] = KID->rgb_buf2[i];
-						mColorBuffer[3*i-2] = KID->rgb_buf2[i];
-					}
-				}
-			}
-		}
+		Kinect_DemosaicColor(KID->rgb_buf2, mColorBuffer);
 		KID->UnlockRGB();
 	}
 	
 	void Kinect::ParseDepthBuffer()
 	{
+		KINECT_TRACE_SCOPE("kinect.unpack_depth");
 		if (0)
 		{
 			KinectInternalData *KID = (KinectInternalData *) mInternalData;
@@ -219,19 +189,28 @@ namespace Kinect
 		else
 		{
 			KinectInternalData *KID = (KinectInternalData *) mInternalData;
-			int bitshift = 0;
 			KID->LockDepth();
-			for (int i=0; i<640*480; i++) 
-			{
-				int idx = (i*11)/8;
-				uint32_t word = (KID->depth_sourcebuf2[idx]<<16) | (KID->depth_sourcebuf2[idx+1]<<8) | KID->depth_sourcebuf2[idx+2];
-				mDepthBuffer[i] = ((word >> (13-bitshift)) & 0x7ff);
-				bitshift = (bitshift + 11) % 8;
-			}
+			Kinect_UnpackDepth(KID->depth_sourcebuf2, mDepthBuffer, 640*480);
 			KID->UnlockDepth();
 		};
 	};
 
+	void Kinect::CopyRawColor(unsigned char *bayer)
+	{
+		KinectInternalData *KID = (KinectInternalData *) mInternalData;
+		KID->LockRGB();
+		memcpy(bayer, KID->rgb_buf2, KINECT_COLOR_RAW_SIZE);
+		KID->UnlockRGB();
+	};
+
+	void Kinect::CopyRawDepth(unsigned char *packed)
+	{
+		KinectInternalData *KID = (KinectInternalData *) mInternalData;
+		KID->LockDepth();
+		memcpy(packed, KID->depth_sourcebuf2, KINECT_DEPTH_RAW_SIZE);
+		KID->UnlockDepth();
+	};
+
 	void Kinect::SetMotorPosition(double newpos)
 	{
 		KinectInternalData *KID = (KinectInternalData *) mInternalData;
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <windows.h>
+#include "Kinect-Export.h"
 
 namespace Kinect
 {
@@ -13,7 +14,9 @@ namespace Kinect
 		KINECT_COLOR_WIDTH = 640,
 		KINECT_COLOR_HEIGHT = 480,
 		KINECT_MICROPHONE_COUNT = 4,
-		KINECT_AUDIO_BUFFER_LENGTH = 256	
+		KINECT_AUDIO_BUFFER_LENGTH = 256,
+		KINECT_COLOR_RAW_SIZE = KINECT_COLOR_WIDTH * KINECT_COLOR_HEIGHT,
+		KINECT_DEPTH_RAW_SIZE = KINECT_DEPTH_WIDTH * KINECT_DEPTH_HEIGHT * 11 / 8
 	};
 
 	class Kinect;
@@ -40,7 +43,7 @@ namespace Kinect
 		virtual void AudioReceived(Kinect *K) {};
 	};
 
-	class Kinect
+	class KINECT_DECL Kinect
 	{
 	public:
 		Kinect(void *internalhandle, void *internalmotorhandle);  // takes usb handle.. never explicitly construct! use kinectfinder!
@@ -71,9 +74,14 @@ namespace Kinect
 
 		void ParseColorBuffer();
 		void ParseDepthBuffer();
+
+		// Copy the last received raw frames: the Bayer color frame (KINECT_COLOR_RAW_SIZE bytes) and
+		// the packed 11-bit depth frame (KINECT_DEPTH_RAW_SIZE bytes).
+		void CopyRawColor(unsigned char *bayer);
+		void CopyRawDepth(unsigned char *packed);
 	};
 
-	class KinectFinder
+	class KINECT_DECL KinectFinder
 	{
 	public:
 
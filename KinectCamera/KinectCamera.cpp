@@ -6,6 +6,7 @@
 
 #include "KinectCamera.h"
 #include "KinectInterface.h"
+#include "Kinect-Trace.h"
 
 #include "cv.h"
 #include "highgui.h"
@@ -47,6 +48,7 @@ void KinectCamera::InitHardware(Kinect::Kinect* kinect)
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 IplImage* KinectCamera::QueryFrame(void)
 {
+	KINECT_TRACE_SCOPE("camera.query_frame");
 	mKinectInterface->update();
 
 	IplImage* cvImage = cvCreateImage(cvSize(640,  480), IPL_DEPTH_8U, 3);
@@ -44,7 +44,8 @@ KinectInterface::KinectInterface(Kinect::Kinect *K)
 
 KinectInterface::~KinectInterface()
 {
-	mKinect->RemoveListener(this);
+	if(mKinect != NULL)
+		mKinect->RemoveListener(this);
 }
 
 
@@ -85,6 +86,11 @@ void KinectInterface::parseColor()
 }
 
 void KinectInterface::parseDepth()
+{
+	parseDepth(mKinect->mDepthBuffer);
+}
+
+void KinectInterface::parseDepth(const unsigned short* depth)
 {
 	int i=0;
 	for (int y=0; y<480; y++)
@@ -94,7 +100,7 @@ void KinectInterface::parseDepth()
 		float *maxDepth = mMaxDepthBuffer + ((y)*640);
 		for (int x=0; x<640; x++)
 		{
-			unsigned short Depth = mKinect->mDepthBuffer[i];
+			unsigned short Depth = depth[i];
 			if(::Kinect::Kinect_IsDepthValid(Depth))
 			{
 				float depthValue = ::Kinect::Kinect_DepthValueToZ(Depth);
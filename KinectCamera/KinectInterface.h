@@ -29,6 +29,9 @@ public:
 	void parseDepth();
 	void parseColor();
 
+	// Convert a depth frame (640x480 raw depth values) into metric and colored depth buffers.
+	void parseDepth(const unsigned short* depth);
+
 	virtual void DepthReceived(::Kinect::Kinect *K);
 	virtual void ColorReceived(::Kinect::Kinect *K);
 